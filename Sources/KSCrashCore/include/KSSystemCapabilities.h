@@ -34,6 +34,12 @@
 #define KSCRASH_HOST_ANDROID 1
 #endif
 
+#ifdef __linux__
+#define KSCRASH_HOST_LINUX 1
+#else
+#define KSCRASH_HOST_LINUX 0
+#endif
+
 #if defined(TARGET_OS_VISION) && TARGET_OS_VISION
 #define KSCRASH_HOST_VISION 1
 #else
@@ -151,4 +157,14 @@
 #define KSCRASH_HAS_REACHABILITY 0
 #endif
 
+// Android's seccomp policy does not let apps use io_uring.
+#if KSCRASH_HOST_LINUX && !defined(__ANDROID__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define KSCRASH_HAS_IO_URING 1
+#endif
+#endif
+#ifndef KSCRASH_HAS_IO_URING
+#define KSCRASH_HAS_IO_URING 0
+#endif
+
 #endif  // HDR_KSSystemCapabilities_h
@@ -37,6 +37,20 @@
 // #define KSLogger_LocalLevel TRACE
 #import "KSLogger.h"
 
+char *ksdm_demangleSymbol(const char *mangledSymbol)
+{
+    if (mangledSymbol == NULL) {
+        return NULL;
+    }
+    char *demangled = ksdm_demangleCPP(mangledSymbol);
+#if KSCRASH_HAS_SWIFT
+    if (demangled == NULL) {
+        demangled = ksdm_demangleSwift(mangledSymbol);
+    }
+#endif
+    return demangled;
+}
+
 @interface KSCrashReportFilterDemangle ()
 
 @end
@@ -57,4 +57,16 @@ NS_SWIFT_NAME(CrashReportFilterDemangle)
 
 @end
 
+/** Demangles a C++ or Swift symbol.
+ *
+ * Matches `KSReportDemangleFunction`, so it can be set as
+ * `KSCrashReportStoreConfiguration.demangleFunction` to demangle reports as they are read.
+ *
+ * @param mangledSymbol The mangled symbol.
+ *
+ * @return A demangled symbol, or NULL if demangling failed.
+ *         MEMORY MANAGEMENT WARNING: User is responsible for calling free() on the returned value.
+ */
+FOUNDATION_EXTERN char *_Nullable ksdm_demangleSymbol(const char *mangledSymbol) NS_SWIFT_NAME(demangleSymbol(_:));
+
 NS_ASSUME_NONNULL_END
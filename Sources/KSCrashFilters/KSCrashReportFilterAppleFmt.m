@@ -764,8 +764,23 @@ static NSDictionary *g_registerOrders;
     NSDictionary *crash = [self crashReport:report];
     NSArray *threads = [crash objectForKey:KSCrashField_Threads];
 
+    // Threads whose backtrace was collapsed refer to an earlier thread with the same one.
+    NSMutableDictionary *backtraces = [NSMutableDictionary dictionary];
     for (NSDictionary *thread in threads) {
-        [str appendString:[self threadStringForThread:thread mainExecutableName:mainExecutableName]];
+        NSDictionary *threadToWrite = thread;
+        NSDictionary *backtrace = [thread objectForKey:KSCrashField_Backtrace];
+        NSNumber *sameBacktraceAs = [thread objectForKey:KSCrashField_SameBacktraceAs];
+        if (backtrace != nil) {
+            NSNumber *index = [thread objectForKey:KSCrashField_Index];
+            if (index != nil) {
+                backtraces[index] = backtrace;
+            }
+        } else if (sameBacktraceAs != nil && backtraces[sameBacktraceAs] != nil) {
+            NSMutableDictionary *expandedThread = [thread mutableCopy];
+            expandedThread[KSCrashField_Backtrace] = backtraces[sameBacktraceAs];
+            threadToWrite = expandedThread;
+        }
+        [str appendString:[self threadStringForThread:threadToWrite mainExecutableName:mainExecutableName]];
     }
 
     return str;
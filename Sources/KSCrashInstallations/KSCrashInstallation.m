@@ -130,6 +130,8 @@ static CrashHandlerData *g_crashHandlerData;
 @property(nonatomic, readwrite, strong) NSMutableData *crashHandlerDataBacking;
 @property(nonatomic, readwrite, strong) NSMutableDictionary *fields;
 @property(nonatomic, readwrite, strong) KSCrashReportFilterPipeline *prependedFilters;
+/** YES if the report store demangles symbols as it reads reports, making the demangle filter redundant. */
+@property(nonatomic, readwrite, assign) BOOL isStoreDemangling;
 
 @end
 
@@ -238,6 +240,12 @@ static CrashHandlerData *g_crashHandlerData;
     @synchronized(handler) {
         g_crashHandlerData = self.crashHandlerData;
 
+        // Demangle in the store's fixup pass rather than in a filter on the decoded report.
+        if (self.isDemangleEnabled && configuration.reportStoreConfiguration.demangleFunction == NULL) {
+            configuration.reportStoreConfiguration.demangleFunction = ksdm_demangleSymbol;
+        }
+        self.isStoreDemangling = configuration.reportStoreConfiguration.demangleFunction != NULL;
+
         configuration.crashNotifyCallback = ^(const struct KSCrashReportWriter *_Nonnull writer) {
             CrashHandlerData *crashHandlerData = g_crashHandlerData;
             if (crashHandlerData == NULL) {
@@ -303,7 +311,7 @@ static CrashHandlerData *g_crashHandlerData;
 
     // 如果启用了Demangle过滤器，添加它
     // 解决代码混淆问题
-    if (self.isDemangleEnabled) {
+    if (self.isDemangleEnabled && self.isStoreDemangling == NO) {
         [installationFilters addObject:[KSCrashReportFilterDemangle new]];
     }
 
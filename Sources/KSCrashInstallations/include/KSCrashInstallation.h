@@ -51,7 +51,9 @@ NS_SWIFT_NAME(CrashInstallation)
 @property(atomic, readwrite, assign, nullable) KSReportWriteCallback onCrash;
 
 /** Flag for disabling built-in demangling pre-filter.
- * If enabled an additional `KSCrashReportFilterDemangle` filter will be applied first.
+ * If enabled, symbols are demangled by the report store as reports are read
+ * (see `KSCrashReportStoreConfiguration.demangleFunction`). If the store is not set up to
+ * demangle, an additional `KSCrashReportFilterDemangle` filter will be applied first instead.
  * @note Enabled by-default.
  */
 @property(nonatomic, assign) BOOL isDemangleEnabled;
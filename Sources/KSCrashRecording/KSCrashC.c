@@ -26,6 +26,7 @@
 
 #include "KSCrashC.h"
 
+#include "KSArena.h"
 #include "KSCompilerDefines.h"
 #include "KSCrashCachedData.h"
 #include "KSCrashMonitorContext.h"
@@ -36,28 +37,35 @@
 #include "KSCrashMonitor_MachException.h"
 #include "KSCrashMonitor_Memory.h"
 #include "KSCrashMonitor_NSException.h"
+#include "KSCrashMonitor_Profiler.h"
 #include "KSCrashMonitor_Signal.h"
 #include "KSCrashMonitor_System.h"
 #include "KSCrashMonitor_User.h"
 #include "KSCrashMonitor_Zombie.h"
 #include "KSCrashReportC.h"
 #include "KSCrashReportFixer.h"
+#include "KSCrashReportMinidump.h"
 #include "KSCrashReportStoreC+Private.h"
 #include "KSFileUtils.h"
 #include "KSObjC.h"
 #include "KSString.h"
 #include "KSSystemCapabilities.h"
+#include "KSUnwindTable.h"
 
 // #define KSLogger_LocalLevel TRACE
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "KSLogger.h"
 
 #define KSC_MAX_APP_NAME_LENGTH 100
 
+/** Memory reserved for crash handling: the signal stack plus report writing scratch space. */
+#define KSC_ARENA_SIZE (1024 * 1024)
+
 typedef enum {
     KSApplicationStateNone,
     KSApplicationStateDidBecomeActive,
@@ -79,7 +87,8 @@ static const struct KSCrashMonitorMapping {
                           { KSCrashMonitorTypeSystem, kscm_system_getAPI },
                           { KSCrashMonitorTypeApplicationState, kscm_appstate_getAPI },
                           { KSCrashMonitorTypeZombie, kscm_zombie_getAPI },
-                          { KSCrashMonitorTypeMemoryTermination, kscm_memory_getAPI } };
+                          { KSCrashMonitorTypeMemoryTermination, kscm_memory_getAPI },
+                          { KSCrashMonitorTypeProfiler, kscm_profiler_getAPI } };
 
 static const size_t g_monitorMappingCount = sizeof(g_monitorMappings) / sizeof(g_monitorMappings[0]);
 
@@ -92,12 +101,15 @@ static volatile bool g_installed = 0;
 
 static bool g_shouldAddConsoleLogToReport = false;
 static bool g_shouldPrintPreviousLog = false;
+static bool g_shouldWriteMinidump = false;
+static int g_consoleLogBufferSize = 0;
 static char g_consoleLogPath[KSFU_MAX_PATH_LENGTH];
 static KSCrashMonitorType g_monitoring = KSCrashMonitorTypeProductionSafeMinimal;
 static char g_lastCrashReportFilePath[KSFU_MAX_PATH_LENGTH];
 static KSCrashReportStoreCConfiguration g_reportStoreConfig;
 static KSReportWrittenCallback g_reportWrittenCallback;
 static KSApplicationState g_lastApplicationState = KSApplicationStateNone;
+static KSCrashInstallTimings g_installTimings;
 
 // ============================================================================
 #pragma mark - Utility -
@@ -105,9 +117,9 @@ static KSApplicationState g_lastApplicationState = KSApplicationStateNone;
 
 static void printPreviousLog(const char *filePath)
 {
-    char *data;
     int length;
-    if (ksfu_readEntireFile(filePath, &data, &length, 0)) {
+    char *data = kslog_readLogBufferFile(filePath, &length);
+    if (data != NULL || ksfu_readEntireFile(filePath, &data, &length, 0)) {
         printf("\nvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv Previous Log vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv\n\n");
         printf("%s\n", data);
         free(data);
@@ -116,6 +128,23 @@ static void printPreviousLog(const char *filePath)
     }
 }
 
+/** Write a minidump next to a report, named after it with a .dmp extension. */
+static void writeMinidumpForReport(const struct KSCrash_MonitorContext *monitorContext, const char *reportPath)
+{
+    char path[KSFU_MAX_PATH_LENGTH];
+    size_t length = strlen(reportPath);
+    const char *extension = ".json";
+    size_t extensionLength = strlen(extension);
+    if (length >= extensionLength && strcmp(reportPath + length - extensionLength, extension) == 0) {
+        length -= extensionLength;
+    }
+    if (snprintf(path, sizeof(path), "%.*s.dmp", (int)length, reportPath) >= (int)sizeof(path)) {
+        KSLOG_ERROR("Minidump path for %s is too long", reportPath);
+        return;
+    }
+    kscrashreport_writeMinidump(monitorContext, path);
+}
+
 static void notifyOfBeforeInstallationState(void)
 {
     KSLOG_DEBUG("Notifying of pre-installation state");
@@ -156,12 +185,18 @@ static void onCrash(struct KSCrash_MonitorContext *monitorContext)
     } else if (monitorContext->reportPath) {
         //reportPath写reportPath路径中
         kscrashreport_writeStandardReport(monitorContext, monitorContext->reportPath);
+        if (g_shouldWriteMinidump) {
+            writeMinidumpForReport(monitorContext, monitorContext->reportPath);
+        }
     } else {
         char crashReportFilePath[KSFU_MAX_PATH_LENGTH];
         int64_t reportID = kscrs_getNextCrashReport(crashReportFilePath, &g_reportStoreConfig);
         strncpy(g_lastCrashReportFilePath, crashReportFilePath, sizeof(g_lastCrashReportFilePath));
         //把崩溃的上下文下到文件中
         kscrashreport_writeStandardReport(monitorContext, crashReportFilePath);
+        if (g_shouldWriteMinidump) {
+            writeMinidumpForReport(monitorContext, crashReportFilePath);
+        }
 
         if (g_reportWrittenCallback) {
             g_reportWrittenCallback(reportID);
@@ -197,7 +232,10 @@ void handleConfiguration(KSCrashCConfiguration *configuration)
 #endif
     ksccd_setSearchQueueNames(configuration->enableQueueNameSearch);
     kscrashreport_setIntrospectMemory(configuration->enableMemoryIntrospection);
+    kscrashreport_setCollapseIdenticalBacktraces(configuration->collapseIdenticalBacktraces);
     kscm_signal_sigterm_setMonitoringEnabled(configuration->enableSigTermMonitoring);
+    kscm_setProfilerSampleInterval(configuration->profilerSampleInterval);
+    kscm_setProfilerWindowDuration(configuration->profilerWindowDuration);
 
     if (configuration->doNotIntrospectClasses.strings != NULL) {
         kscrashreport_setDoNotIntrospectClasses(configuration->doNotIntrospectClasses.strings,
@@ -207,12 +245,35 @@ void handleConfiguration(KSCrashCConfiguration *configuration)
     kscrashreport_setUserSectionWriteCallback(configuration->crashNotifyCallback);
     g_reportWrittenCallback = configuration->reportWrittenCallback;
     g_shouldAddConsoleLogToReport = configuration->addConsoleLogToReport;
+    kscrashreport_setConsoleLogLimits(configuration->maxConsoleLogLines, configuration->maxConsoleLogBytes);
     g_shouldPrintPreviousLog = configuration->printPreviousLogOnStartup;
+    g_shouldWriteMinidump = configuration->writeMinidump;
+    g_consoleLogBufferSize = configuration->consoleLogBufferSize;
 
     if (configuration->enableSwapCxaThrow) {
         kscm_enableSwapCxaThrow();
     }
+
+    if (configuration->enableUnwindTables) {
+        ksunwind_initialize();
+    }
 }
+static int64_t getMonotonicMicroseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + (int64_t)ts.tv_nsec / 1000;
+}
+
+/** Get the time elapsed since *phaseStartTime, and start the next phase now. */
+static int64_t endInstallPhase(int64_t *phaseStartTime)
+{
+    int64_t now = getMonotonicMicroseconds();
+    int64_t elapsed = now - *phaseStartTime;
+    *phaseStartTime = now;
+    return elapsed;
+}
+
 // ============================================================================
 #pragma mark - API -
 // ============================================================================
@@ -232,7 +293,12 @@ KSCrashInstallErrorCode kscrash_install(const char *appName, const char *const i
         return KSCrashInstallErrorInvalidParameter;
     }
 
+    memset(&g_installTimings, 0, sizeof(g_installTimings));
+    int64_t installStartTime = getMonotonicMicroseconds();
+    int64_t phaseStartTime = installStartTime;
+
     handleConfiguration(configuration);
+    g_installTimings.configuration = endInstallPhase(&phaseStartTime);
 
     if (g_reportStoreConfig.appName == NULL) {
         g_reportStoreConfig.appName = strdup(appName);
@@ -248,6 +314,7 @@ KSCrashInstallErrorCode kscrash_install(const char *appName, const char *const i
     }
 
     kscrs_initialize(&g_reportStoreConfig);
+    g_installTimings.reportStore = endInstallPhase(&phaseStartTime);
 
     if (snprintf(path, sizeof(path), "%s/Data", installPath) >= (int)sizeof(path)) {
         KSLOG_ERROR("Data path is too long.");
@@ -258,14 +325,17 @@ KSCrashInstallErrorCode kscrash_install(const char *appName, const char *const i
         return KSCrashInstallErrorCouldNotCreatePath;
     }
     ksmemory_initialize(path);
+    g_installTimings.memory = endInstallPhase(&phaseStartTime);
 
     if (snprintf(path, sizeof(path), "%s/Data/CrashState.json", installPath) >= (int)sizeof(path)) {
         KSLOG_ERROR("Crash state path is too long.");
         return KSCrashInstallErrorPathTooLong;
     }
     kscrashstate_initialize(path);
+    g_installTimings.crashState = endInstallPhase(&phaseStartTime);
 
-    if (snprintf(g_consoleLogPath, sizeof(g_consoleLogPath), "%s/Data/ConsoleLog.txt", installPath) >=
+    const char *consoleLogName = g_consoleLogBufferSize > 0 ? "ConsoleLog.buf" : "ConsoleLog.txt";
+    if (snprintf(g_consoleLogPath, sizeof(g_consoleLogPath), "%s/Data/%s", installPath, consoleLogName) >=
         (int)sizeof(g_consoleLogPath)) {
         KSLOG_ERROR("Console log path is too long.");
         return KSCrashInstallErrorPathTooLong;
@@ -273,9 +343,18 @@ KSCrashInstallErrorCode kscrash_install(const char *appName, const char *const i
     if (g_shouldPrintPreviousLog) {
         printPreviousLog(g_consoleLogPath);
     }
-    kslog_setLogFilename(g_consoleLogPath, true);
+    if (g_consoleLogBufferSize <= 0 || !kslog_setLogBuffer(g_consoleLogPath, g_consoleLogBufferSize, true)) {
+        kslog_setLogFilename(g_consoleLogPath, true);
+    }
+    g_installTimings.consoleLog = endInstallPhase(&phaseStartTime);
 
     ksccd_init(60);
+    g_installTimings.cachedData = endInstallPhase(&phaseStartTime);
+
+    // The signal stack comes from the arena, so it has to exist before the monitors are activated.
+    if (!ksarena_install(KSC_ARENA_SIZE)) {
+        KSLOG_ERROR("Could not reserve the crash arena. Crash handling will use the stack and heap instead.");
+    }
 
     //保存 onCrash 到 g_onExceptionEvent
     //崩溃后要写日志
@@ -286,13 +365,18 @@ KSCrashInstallErrorCode kscrash_install(const char *appName, const char *const i
         return KSCrashInstallErrorNoActiveMonitors;
     }
 
+    g_installTimings.monitors = endInstallPhase(&phaseStartTime);
+    g_installTimings.total = getMonotonicMicroseconds() - installStartTime;
+
     g_installed = true;
-    KSLOG_DEBUG("Installation complete.");
+    KSLOG_DEBUG("Installation complete in %" PRId64 " us.", g_installTimings.total);
 
     notifyOfBeforeInstallationState();
     return KSCrashInstallErrorNone;
 }
 
+KSCrashInstallTimings kscrash_getInstallTimings(void) { return g_installTimings; }
+
 void kscrash_setUserInfoJSON(const char *const userInfoJSON) { kscrashreport_setUserInfoJSON(userInfoJSON); }
 
 const char *kscrash_getUserInfoJSON(void) { return kscrashreport_getUserInfoJSON(); }
@@ -26,143 +26,417 @@
 
 // #define KSLogger_LocalLevel TRACE
 #include <errno.h>
-#include <mach/mach.h>
 #include <memory.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "KSSystemCapabilities.h"
+
+#if KSCRASH_HOST_APPLE
+#include <mach/mach.h>
+#elif KSCRASH_HOST_LINUX
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#endif
+
 #include "KSLogger.h"
 
-#define SWAP_POINTERS(A, B) \
-    {                       \
-        void *temp = A;     \
-        A = B;              \
-        B = temp;           \
-    }
+/** Names are stored in chunks of at least this many bytes. */
+#define kNameChunkSize 4096
+
+/** A name pool is only compacted once it holds at least this many bytes. */
+#define kMinCompactableNamePoolSize (16 * 1024)
+
+typedef struct NameChunk {
+    struct NameChunk *next;
+    size_t used;
+    size_t size;
+    char bytes[];
+} NameChunk;
+
+/** Thread and queue names, each stored once. A name stays where it is until
+ * the whole pool is freed, so snapshots can share names without copying them.
+ */
+typedef struct {
+    NameChunk *chunks;
+
+    /** Open addressing hash table of the names. Its size is a power of 2. */
+    const char **table;
+    size_t tableSize;
+    size_t nameCount;
+    size_t byteCount;
+} NamePool;
+
+typedef struct {
+    KSThread *threads;
+    const char **threadNames;
+    const char **queueNames;
+    int count;
+    int capacity;
+} ThreadSnapshot;
 
 static int g_pollingIntervalInSeconds;
 static pthread_t g_cacheThread;
-static KSThread *g_allMachThreads;
-static KSThread *g_allPThreads;
-static const char **g_allThreadNames;
-static const char **g_allQueueNames;
-static int g_allThreadsCount;
+
+/** Readers see one snapshot while the next update is built into the other.
+ * An update that finds nothing changed leaves the current snapshot in place.
+ */
+static ThreadSnapshot g_snapshots[2];
+static _Atomic(ThreadSnapshot *) g_snapshot;
+static NamePool g_namePool;
+static pthread_mutex_t g_updateMutex = PTHREAD_MUTEX_INITIALIZER;
+
 static _Atomic(int) g_semaphoreCount;
 static bool g_searchQueueNames = false;
 static bool g_hasThreadStarted = false;
-/*
- 已经崩溃了，减少开销
- 为了减少内核态与用户态上下文切换，设计了在写报告时查询的缓存
- updateThreadList 是一个函数，用于更新当前进程中的线程列表信息。
- 它通过调用 Mach 和 POSIX API 来获取活动线程的 Mach 线程句柄、POSIX 线程句柄（pthread_t），
- 以及线程的名称和队列名称等信息，并将这些信息存储在全局变量中以供后续使用。
+
+// ============================================================================
+#pragma mark - Name Pool -
+// ============================================================================
+
+static size_t hashName(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *ptr = (const unsigned char *)name; *ptr != 0; ptr++) {
+        hash = (hash ^ *ptr) * 16777619u;
+    }
+    return hash;
+}
+
+static const char *allocateName(NamePool *pool, const char *name)
+{
+    size_t size = strlen(name) + 1;
+    NameChunk *chunk = pool->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunkSize = size > kNameChunkSize ? size : kNameChunkSize;
+        chunk = malloc(sizeof(*chunk) + chunkSize);
+        if (chunk == NULL) {
+            KSLOG_ERROR("Could not allocate %zu bytes for thread names", chunkSize);
+            return NULL;
+        }
+        chunk->next = pool->chunks;
+        chunk->used = 0;
+        chunk->size = chunkSize;
+        pool->chunks = chunk;
+    }
+    char *copy = chunk->bytes + chunk->used;
+    memcpy(copy, name, size);
+    chunk->used += size;
+    pool->byteCount += size;
+    return copy;
+}
+
+static bool growNameTable(NamePool *pool)
+{
+    size_t tableSize = pool->tableSize == 0 ? 64 : pool->tableSize * 2;
+    const char **table = calloc(tableSize, sizeof(*table));
+    if (table == NULL) {
+        KSLOG_ERROR("Could not allocate a thread name table with %zu entries", tableSize);
+        return false;
+    }
+    for (size_t i = 0; i < pool->tableSize; i++) {
+        const char *name = pool->table[i];
+        if (name != NULL) {
+            size_t index = hashName(name) & (tableSize - 1);
+            while (table[index] != NULL) {
+                index = (index + 1) & (tableSize - 1);
+            }
+            table[index] = name;
+        }
+    }
+    free(pool->table);
+    pool->table = table;
+    pool->tableSize = tableSize;
+    return true;
+}
+
+/** Get the pooled copy of a name, adding the name to the pool if needed.
+ *
+ * @return The pooled name, or NULL if the name is empty or couldn't be added.
  */
-static void updateThreadList(void)
+static const char *internName(NamePool *pool, const char *name)
 {
-    // 获取当前任务的 Mach task 句柄
-    const task_t thisTask = mach_task_self();
+    if (name == NULL || name[0] == 0) {
+        return NULL;
+    }
+    if ((pool->nameCount + 1) * 2 > pool->tableSize && !growNameTable(pool)) {
+        return NULL;
+    }
+    size_t mask = pool->tableSize - 1;
+    for (size_t index = hashName(name) & mask;; index = (index + 1) & mask) {
+        const char *entry = pool->table[index];
+        if (entry == NULL) {
+            entry = allocateName(pool, name);
+            if (entry != NULL) {
+                pool->table[index] = entry;
+                pool->nameCount++;
+            }
+            return entry;
+        }
+        if (strcmp(entry, name) == 0) {
+            return entry;
+        }
+    }
+}
 
-    // 保存之前的线程数量，便于后续释放资源
-    int oldThreadsCount = g_allThreadsCount;
+static void freeNamePool(NamePool *pool)
+{
+    for (NameChunk *chunk = pool->chunks; chunk != NULL;) {
+        NameChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(pool->table);
+    memset(pool, 0, sizeof(*pool));
+}
 
-    // 临时存储线程相关数据
-    KSThread *allMachThreads = NULL;  // Mach 线程数组
-    KSThread *allPThreads = NULL;     // POSIX 线程数组
-    static const char **allThreadNames;  // 线程名称数组
-    static const char **allQueueNames;   // 线程队列名称数组
+// ============================================================================
+#pragma mark - Snapshots -
+// ============================================================================
 
-    // 定义线程计数变量和线程列表存储
-    mach_msg_type_number_t allThreadsCount;
+static bool reserveSnapshot(ThreadSnapshot *snapshot, int capacity)
+{
+    if (capacity <= snapshot->capacity) {
+        return true;
+    }
+    capacity = capacity < 64 ? 64 : capacity * 2;
+    KSThread *threads = realloc(snapshot->threads, (size_t)capacity * sizeof(*threads));
+    if (threads != NULL) {
+        snapshot->threads = threads;
+    }
+    const char **threadNames = realloc(snapshot->threadNames, (size_t)capacity * sizeof(*threadNames));
+    if (threadNames != NULL) {
+        snapshot->threadNames = threadNames;
+    }
+    const char **queueNames = realloc(snapshot->queueNames, (size_t)capacity * sizeof(*queueNames));
+    if (queueNames != NULL) {
+        snapshot->queueNames = queueNames;
+    }
+    if (threads == NULL || threadNames == NULL || queueNames == NULL) {
+        KSLOG_ERROR("Could not allocate a thread list for %d threads", capacity);
+        return false;
+    }
+    snapshot->capacity = capacity;
+    return true;
+}
+
+/** Find a thread in a snapshot, starting where it most likely is.
+ *
+ * @return The thread's index, or -1 if it isn't in the snapshot.
+ */
+static int findThread(const ThreadSnapshot *snapshot, KSThread thread, int hint)
+{
+    if (snapshot == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < snapshot->count; i++) {
+        int index = (hint + i) % snapshot->count;
+        if (snapshot->threads[index] == thread) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/** Keep the previous name of a thread if it didn't change, so that nothing needs to be added to the pool. */
+static const char *updatedName(const char *previousName, const char *name)
+{
+    if (previousName != NULL && strcmp(previousName, name) == 0) {
+        return previousName;
+    }
+    return internName(&g_namePool, name);
+}
+
+// ============================================================================
+#pragma mark - Platform -
+// ============================================================================
+
+#if KSCRASH_HOST_APPLE
+
+static bool listThreads(ThreadSnapshot *snapshot)
+{
+    const task_t thisTask = mach_task_self();
     thread_act_array_t threads;
+    mach_msg_type_number_t threadCount;
     kern_return_t kr;
 
-    // 获取当前任务的所有线程
-    if ((kr = task_threads(thisTask, &threads, &allThreadsCount)) != KERN_SUCCESS) {
+    if ((kr = task_threads(thisTask, &threads, &threadCount)) != KERN_SUCCESS) {
         KSLOG_ERROR("task_threads: %s", mach_error_string(kr));
-        return; // 如果失败，记录日志并退出
+        return false;
     }
 
-    // 为线程数据分配内存
-    allMachThreads = calloc(allThreadsCount, sizeof(*allMachThreads));
-    allPThreads = calloc(allThreadsCount, sizeof(*allPThreads));
-    allThreadNames = calloc(allThreadsCount, sizeof(*allThreadNames));
-    allQueueNames = calloc(allThreadsCount, sizeof(*allQueueNames));
+    bool isListed = reserveSnapshot(snapshot, (int)threadCount);
+    if (isListed) {
+        for (mach_msg_type_number_t i = 0; i < threadCount; i++) {
+            snapshot->threads[i] = (KSThread)threads[i];
+        }
+        snapshot->count = (int)threadCount;
+    }
 
-    // 遍历所有线程，提取相关信息
-    for (mach_msg_type_number_t i = 0; i < allThreadsCount; i++) {
-        char buffer[1000]; // 临时存储线程名称或队列名称
-        thread_t thread = threads[i];
-        pthread_t pthread = pthread_from_mach_thread_np(thread); // 获取 POSIX 线程
+    for (mach_msg_type_number_t i = 0; i < threadCount; i++) {
+        mach_port_deallocate(thisTask, threads[i]);
+    }
+    vm_deallocate(thisTask, (vm_address_t)threads, sizeof(thread_t) * threadCount);
+    return isListed;
+}
 
-        // 保存 Mach 线程和 POSIX 线程句柄
-        allMachThreads[i] = (KSThread)thread;
-        allPThreads[i] = (KSThread)pthread;
+static bool getThreadName(KSThread thread, char *buffer, int length)
+{
+    pthread_t pthread = pthread_from_mach_thread_np((thread_t)thread);
+    return pthread != 0 && pthread_getname_np(pthread, buffer, (size_t)length) == 0 && buffer[0] != 0;
+}
 
-        // 如果 POSIX 线程句柄有效，尝试获取线程名称
-        if (pthread != 0 && pthread_getname_np(pthread, buffer, sizeof(buffer)) == 0 && buffer[0] != 0) {
-            allThreadNames[i] = strdup(buffer); // 拷贝线程名称
-        }
+static bool getQueueName(KSThread thread, char *buffer, int length)
+{
+    return ksthread_getQueueName(thread, buffer, length) && buffer[0] != 0;
+}
+
+#elif KSCRASH_HOST_LINUX
 
-        // 如果启用了队列名称搜索，获取线程队列名称
-        if (g_searchQueueNames && ksthread_getQueueName((KSThread)thread, buffer, sizeof(buffer)) && buffer[0] != 0) {
-            allQueueNames[i] = strdup(buffer); // 拷贝队列名称
+/** Threads are identified by their kernel thread IDs. */
+static bool listThreads(ThreadSnapshot *snapshot)
+{
+    DIR *taskDir = opendir("/proc/self/task");
+    if (taskDir == NULL) {
+        KSLOG_ERROR("Could not open /proc/self/task: %s", strerror(errno));
+        return false;
+    }
+    bool isListed = true;
+    snapshot->count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(taskDir)) != NULL) {
+        KSThread thread = (KSThread)strtoul(entry->d_name, NULL, 10);
+        if (thread == 0) {
+            // "." and ".."
+            continue;
         }
+        if (!reserveSnapshot(snapshot, snapshot->count + 1)) {
+            isListed = false;
+            break;
+        }
+        snapshot->threads[snapshot->count++] = thread;
+    }
+    closedir(taskDir);
+    return isListed;
+}
+
+static bool getThreadName(KSThread thread, char *buffer, int length)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%lu/comm", (unsigned long)thread);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t bytesRead = read(fd, buffer, (size_t)length - 1);
+    close(fd);
+    if (bytesRead > 0 && buffer[bytesRead - 1] == '\n') {
+        bytesRead--;
+    }
+    if (bytesRead <= 0) {
+        return false;
     }
+    buffer[bytesRead] = 0;
+    return true;
+}
+
+static bool getQueueName(__unused KSThread thread, __unused char *buffer, __unused int length) { return false; }
+
+#else
 
-    // 更新全局线程数据，释放旧数据
-    g_allThreadsCount = g_allThreadsCount < (int)allThreadsCount ? g_allThreadsCount : (int)allThreadsCount;
-    SWAP_POINTERS(g_allMachThreads, allMachThreads);
-    SWAP_POINTERS(g_allPThreads, allPThreads);
-    SWAP_POINTERS(g_allThreadNames, allThreadNames);
-    SWAP_POINTERS(g_allQueueNames, allQueueNames);
-    g_allThreadsCount = (int)allThreadsCount;
+static bool listThreads(ThreadSnapshot *snapshot)
+{
+    snapshot->count = 0;
+    return true;
+}
+
+static bool getThreadName(__unused KSThread thread, __unused char *buffer, __unused int length) { return false; }
+
+static bool getQueueName(__unused KSThread thread, __unused char *buffer, __unused int length) { return false; }
 
-    // 释放分配的临时内存
-    if (allMachThreads != NULL) {
-        free(allMachThreads);
+#endif
+
+// ============================================================================
+#pragma mark - Update -
+// ============================================================================
+
+/** Refresh the cached thread list. To keep the cost of a poll down, the new
+ * list is compared against the previous one: names are only added to the pool
+ * for threads that appeared or were renamed, and readers only get a new
+ * snapshot when something changed.
+ */
+static void updateThreadList(void)
+{
+    pthread_mutex_lock(&g_updateMutex);
+    if (g_semaphoreCount > 0) {
+        goto done;
     }
-    if (allPThreads != NULL) {
-        free(allPThreads);
+
+    ThreadSnapshot *current = atomic_load(&g_snapshot);
+    ThreadSnapshot *next = current == &g_snapshots[0] ? &g_snapshots[1] : &g_snapshots[0];
+    if (!listThreads(next)) {
+        goto done;
     }
-    if (allThreadNames != NULL) {
-        for (int i = 0; i < oldThreadsCount; i++) {
-            const char *name = allThreadNames[i];
-            if (name != NULL) {
-                free((void *)name);
-            }
+
+    bool hasChanged = current == NULL || next->count != current->count;
+    size_t nameBytes = 0;
+    int hint = 0;
+    char buffer[1000];
+    for (int i = 0; i < next->count; i++) {
+        KSThread thread = next->threads[i];
+        int previousIndex = findThread(current, thread, hint);
+        const char *previousName = NULL;
+        const char *previousQueueName = NULL;
+        if (previousIndex >= 0) {
+            previousName = current->threadNames[previousIndex];
+            previousQueueName = current->queueNames[previousIndex];
+            hint = previousIndex + 1;
         }
-        free(allThreadNames);
+
+        next->threadNames[i] = getThreadName(thread, buffer, sizeof(buffer)) ? updatedName(previousName, buffer) : NULL;
+        next->queueNames[i] = g_searchQueueNames && getQueueName(thread, buffer, sizeof(buffer))
+                                  ? updatedName(previousQueueName, buffer)
+                                  : NULL;
+
+        hasChanged = hasChanged || previousIndex != i || next->threadNames[i] != previousName ||
+                     next->queueNames[i] != previousQueueName;
+        nameBytes += (next->threadNames[i] != NULL ? strlen(next->threadNames[i]) + 1 : 0) +
+                     (next->queueNames[i] != NULL ? strlen(next->queueNames[i]) + 1 : 0);
     }
-    if (allQueueNames != NULL) {
-        for (int i = 0; i < oldThreadsCount; i++) {
-            const char *name = allQueueNames[i];
-            if (name != NULL) {
-                free((void *)name);
-            }
-        }
-        free(allQueueNames);
+    if (!hasChanged) {
+        goto done;
     }
 
-    // 释放 Mach 线程句柄数组
-    for (mach_msg_type_number_t i = 0; i < allThreadsCount; i++) {
-        mach_port_deallocate(thisTask, threads[i]);
+    // Once most of the pool is names that no thread has anymore, move the names in use to a new pool.
+    NamePool retiredPool = { 0 };
+    if (g_namePool.byteCount > kMinCompactableNamePoolSize && g_namePool.byteCount > nameBytes * 2) {
+        KSLOG_DEBUG("Compacting thread names from %zu bytes", g_namePool.byteCount);
+        retiredPool = g_namePool;
+        memset(&g_namePool, 0, sizeof(g_namePool));
+        for (int i = 0; i < next->count; i++) {
+            next->threadNames[i] = internName(&g_namePool, next->threadNames[i]);
+            next->queueNames[i] = internName(&g_namePool, next->queueNames[i]);
+        }
     }
+    atomic_store(&g_snapshot, next);
+    freeNamePool(&retiredPool);
 
-    // 释放线程数组内存
-    vm_deallocate(thisTask, (vm_address_t)threads, sizeof(thread_t) * allThreadsCount);
+done:
+    pthread_mutex_unlock(&g_updateMutex);
 }
 
-
 static void *monitorCachedData(__unused void *const userData)
 {
     static int quickPollCount = 4;
     usleep(1);
     for (;;) {
-        if (g_semaphoreCount <= 0) {
-            updateThreadList();
-        }
+        updateThreadList();
         //默认1秒醒一次，60秒问询一次
         unsigned pollintInterval = (unsigned)g_pollingIntervalInSeconds;
         if (quickPollCount > 0) {
@@ -234,34 +508,27 @@ void ksccd_setSearchQueueNames(bool searchQueueNames) {
     g_searchQueueNames = searchQueueNames;
 }
 
+void ksccd_refresh(void) { updateThreadList(); }
+
 KSThread *ksccd_getAllThreads(int *threadCount)
 {
+    const ThreadSnapshot *snapshot = atomic_load(&g_snapshot);
     if (threadCount != NULL) {
-        *threadCount = g_allThreadsCount;
+        *threadCount = snapshot != NULL ? snapshot->count : 0;
     }
-    return g_allMachThreads;
+    return snapshot != NULL ? snapshot->threads : NULL;
 }
 
 const char *ksccd_getThreadName(KSThread thread)
 {
-    if (g_allThreadNames != NULL) {
-        for (int i = 0; i < g_allThreadsCount; i++) {
-            if (g_allMachThreads[i] == thread) {
-                return g_allThreadNames[i];
-            }
-        }
-    }
-    return NULL;
+    const ThreadSnapshot *snapshot = atomic_load(&g_snapshot);
+    int index = findThread(snapshot, thread, 0);
+    return index >= 0 ? snapshot->threadNames[index] : NULL;
 }
 
 const char *ksccd_getQueueName(KSThread thread)
 {
-    if (g_allQueueNames != NULL) {
-        for (int i = 0; i < g_allThreadsCount; i++) {
-            if (g_allMachThreads[i] == thread) {
-                return g_allQueueNames[i];
-            }
-        }
-    }
-    return NULL;
+    const ThreadSnapshot *snapshot = atomic_load(&g_snapshot);
+    int index = findThread(snapshot, thread, 0);
+    return index >= 0 ? snapshot->queueNames[index] : NULL;
 }
@@ -23,6 +23,9 @@
 //
 
 /* Maintains a cache of difficult-to-retrieve data.
+ *
+ * On Linux, threads are identified by their kernel thread IDs, and are
+ * listed from /proc/self/task.
  */
 
 #include "KSThread.h"
@@ -34,6 +37,11 @@ void ksccd_unfreeze(void);
 
 void ksccd_setSearchQueueNames(bool searchQueueNames);
 
+/** Refresh the cached data now instead of waiting for the next poll.
+ * Does nothing while the cache is frozen.
+ */
+void ksccd_refresh(void);
+
 KSThread *ksccd_getAllThreads(int *threadCount);
 
 const char *ksccd_getThreadName(KSThread thread);
@@ -58,13 +58,30 @@
         _crashNotifyCallback = nil;
         _reportWrittenCallback = nil;
         _addConsoleLogToReport = cConfig.addConsoleLogToReport ? YES : NO;
+        _maxConsoleLogLines = (NSInteger)cConfig.maxConsoleLogLines;
+        _maxConsoleLogBytes = (NSInteger)cConfig.maxConsoleLogBytes;
+        _consoleLogBufferSize = (NSInteger)cConfig.consoleLogBufferSize;
         _printPreviousLogOnStartup = cConfig.printPreviousLogOnStartup ? YES : NO;
         _enableSwapCxaThrow = cConfig.enableSwapCxaThrow ? YES : NO;
         _enableSigTermMonitoring = cConfig.enableSigTermMonitoring ? YES : NO;
+        _enableUnwindTables = cConfig.enableUnwindTables ? YES : NO;
+        _profilerSampleInterval = cConfig.profilerSampleInterval;
+        _profilerWindowDuration = cConfig.profilerWindowDuration;
+        _collapseIdenticalBacktraces = cConfig.collapseIdenticalBacktraces ? YES : NO;
+        _writeMinidump = cConfig.writeMinidump ? YES : NO;
 
         _reportStoreConfiguration = [KSCrashReportStoreConfiguration new];
         _reportStoreConfiguration.appName = nil;
         _reportStoreConfiguration.maxReportCount = cConfig.reportStoreConfiguration.maxReportCount;
+        _reportStoreConfiguration.maxReportsPerFingerprint =
+            cConfig.reportStoreConfiguration.maxReportsPerFingerprint;
+        _reportStoreConfiguration.maxReportsTotalSize = cConfig.reportStoreConfiguration.maxReportsTotalSize;
+        _reportStoreConfiguration.maxReportAge = cConfig.reportStoreConfiguration.maxReportAge;
+        _reportStoreConfiguration.demangleFunction = cConfig.reportStoreConfiguration.demangleFunction;
+        _reportStoreConfiguration.durability = cConfig.reportStoreConfiguration.durability;
+        _reportStoreConfiguration.groupCommitInterval = cConfig.reportStoreConfiguration.groupCommitInterval;
+        _reportStoreConfiguration.groupCommitMaxReports =
+            (NSInteger)cConfig.reportStoreConfiguration.groupCommitMaxReports;
 
         KSCrashCConfiguration_Release(&cConfig);
     }
@@ -101,9 +118,17 @@
         config.reportWrittenCallback = (KSReportWrittenCallback)imp_implementationWithBlock(self.reportWrittenCallback);
     }
     config.addConsoleLogToReport = self.addConsoleLogToReport;
+    config.maxConsoleLogLines = (int)self.maxConsoleLogLines;
+    config.maxConsoleLogBytes = (int)self.maxConsoleLogBytes;
+    config.consoleLogBufferSize = (int)self.consoleLogBufferSize;
     config.printPreviousLogOnStartup = self.printPreviousLogOnStartup;
     config.enableSwapCxaThrow = self.enableSwapCxaThrow;
     config.enableSigTermMonitoring = self.enableSigTermMonitoring;
+    config.enableUnwindTables = self.enableUnwindTables;
+    config.profilerSampleInterval = self.profilerSampleInterval;
+    config.profilerWindowDuration = self.profilerWindowDuration;
+    config.collapseIdenticalBacktraces = self.collapseIdenticalBacktraces;
+    config.writeMinidump = self.writeMinidump;
 
     return config;
 }
@@ -154,9 +179,17 @@
     copy.crashNotifyCallback = [self.crashNotifyCallback copy];
     copy.reportWrittenCallback = [self.reportWrittenCallback copy];
     copy.addConsoleLogToReport = self.addConsoleLogToReport;
+    copy.maxConsoleLogLines = self.maxConsoleLogLines;
+    copy.maxConsoleLogBytes = self.maxConsoleLogBytes;
+    copy.consoleLogBufferSize = self.consoleLogBufferSize;
     copy.printPreviousLogOnStartup = self.printPreviousLogOnStartup;
     copy.enableSwapCxaThrow = self.enableSwapCxaThrow;
     copy.enableSigTermMonitoring = self.enableSigTermMonitoring;
+    copy.enableUnwindTables = self.enableUnwindTables;
+    copy.profilerSampleInterval = self.profilerSampleInterval;
+    copy.profilerWindowDuration = self.profilerWindowDuration;
+    copy.collapseIdenticalBacktraces = self.collapseIdenticalBacktraces;
+    copy.writeMinidump = self.writeMinidump;
     return copy;
 }
 
@@ -174,6 +207,13 @@
 
         KSCrashReportStoreCConfiguration cConfig = KSCrashReportStoreCConfiguration_Default();
         _maxReportCount = (NSInteger)cConfig.maxReportCount;
+        _maxReportsPerFingerprint = (NSInteger)cConfig.maxReportsPerFingerprint;
+        _maxReportsTotalSize = (long long)cConfig.maxReportsTotalSize;
+        _maxReportAge = cConfig.maxReportAge;
+        _demangleFunction = cConfig.demangleFunction;
+        _durability = cConfig.durability;
+        _groupCommitInterval = cConfig.groupCommitInterval;
+        _groupCommitMaxReports = (NSInteger)cConfig.groupCommitMaxReports;
     }
     return self;
 }
@@ -193,6 +233,13 @@
     config.appName = resolvedAppName != nil ? strdup(resolvedAppName.UTF8String) : NULL;
     config.reportsPath = resolvedReportsPath != nil ? strdup(resolvedReportsPath.UTF8String) : NULL;
     config.maxReportCount = (int)self.maxReportCount;
+    config.maxReportsPerFingerprint = (int)self.maxReportsPerFingerprint;
+    config.maxReportsTotalSize = (int64_t)self.maxReportsTotalSize;
+    config.maxReportAge = self.maxReportAge;
+    config.demangleFunction = self.demangleFunction;
+    config.durability = self.durability;
+    config.groupCommitInterval = self.groupCommitInterval;
+    config.groupCommitMaxReports = (int)self.groupCommitMaxReports;
 
     return config;
 }
@@ -205,6 +252,13 @@
     copy.reportsPath = [self.reportsPath copyWithZone:zone];
     copy.appName = [self.appName copyWithZone:zone];
     copy.maxReportCount = self.maxReportCount;
+    copy.maxReportsPerFingerprint = self.maxReportsPerFingerprint;
+    copy.maxReportsTotalSize = self.maxReportsTotalSize;
+    copy.maxReportAge = self.maxReportAge;
+    copy.demangleFunction = self.demangleFunction;
+    copy.durability = self.durability;
+    copy.groupCommitInterval = self.groupCommitInterval;
+    copy.groupCommitMaxReports = self.groupCommitMaxReports;
     copy.reportCleanupPolicy = self.reportCleanupPolicy;
     return copy;
 }
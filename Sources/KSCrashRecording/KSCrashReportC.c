@@ -26,6 +26,7 @@
 
 #include "KSCrashReportC.h"
 
+#include "KSArena.h"
 #include "KSCPU.h"
 #include "KSCrashCachedData.h"
 #include "KSCrashMonitorHelper.h"
@@ -35,6 +36,7 @@
 #include "KSCrashMonitor_MachException.h"
 #include "KSCrashMonitor_Memory.h"
 #include "KSCrashMonitor_NSException.h"
+#include "KSCrashMonitor_Profiler.h"
 #include "KSCrashMonitor_Signal.h"
 #include "KSCrashMonitor_System.h"
 #include "KSCrashMonitor_User.h"
@@ -51,7 +53,7 @@
 #include "KSObjC.h"
 #include "KSSignalInfo.h"
 #include "KSStackCursor_Backtrace.h"
-#include "KSStackCursor_MachineContext.h"
+#include "KSStackCursor_Unwind.h"
 #include "KSString.h"
 #include "KSSystemCapabilities.h"
 #include "KSThread.h"
@@ -63,7 +65,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "KSLogger.h"
@@ -82,11 +87,17 @@
 /** How much of the stack to dump (in pointer sized jumps). */
 #define kStackContentsPushedDistance 20
 #define kStackContentsPoppedDistance 10
-#define kStackContentsTotalDistance (kStackContentsPushedDistance + kStackContentsPoppedDistance)
+
+/** Size of the report file's write buffer, which comes from the crash arena. */
+#define kReportWriteBufferSize (32 * 1024)
 
 /** The minimum length for a valid string. */
 #define kMinStringLength 4
 
+/** FNV-1a parameters used for the report fingerprint. */
+#define kFingerprintOffsetBasis 0xcbf29ce484222325ULL
+#define kFingerprintPrime 0x100000001b3ULL
+
 // ============================================================================
 #pragma mark - JSON Encoding -
 // ============================================================================
@@ -121,6 +132,13 @@ static pthread_mutex_t g_userInfoMutex = PTHREAD_MUTEX_INITIALIZER;
 static KSCrash_IntrospectionRules g_introspectionRules;
 static KSReportWriteCallback g_userSectionWriteCallback;
 
+/** If true, threads whose backtraces match an earlier thread's refer to it instead of repeating it. */
+static bool g_shouldCollapseIdenticalBacktraces;
+
+/** Limits on how much of the console log goes into a report. 0 = no limit. */
+static int g_consoleLogMaxLines;
+static int g_consoleLogMaxBytes;
+
 #pragma mark Callbacks
 
 static void addBooleanElement(const KSCrashReportWriter *const writer, const char *const key, const bool value)
@@ -291,6 +309,53 @@ static void addTextLinesFromFile(const KSCrashReportWriter *const writer, const
     ksfu_closeBufferedReader(&reader);
 }
 
+/** Add the last lines of some text to the current array. */
+static void addTextLinesTail(const KSCrashReportWriter *const writer, const char *const text, int length, int maxLines,
+                             int maxBytes)
+{
+    for (int pos = ksfu_tailOffset(text, length, maxLines, maxBytes); pos < length;) {
+        const char *line = text + pos;
+        const char *newline = memchr(line, '\n', (size_t)(length - pos));
+        int lineLength = newline != NULL ? (int)(newline - line) : length - pos;
+        ksjson_addStringElement(getJsonContext(writer), NULL, line, lineLength);
+        pos += lineLength + 1;
+    }
+}
+
+/** Add only the last lines of a text file, as an array of strings.
+ * The file is mapped and scanned backwards, so the part before the tail is never read.
+ */
+static void addTextLinesFromFileTail(const KSCrashReportWriter *const writer, const char *const key,
+                                     const char *const filePath, int maxLines, int maxBytes)
+{
+    struct stat st;
+    if (stat(filePath, &st) != 0) {
+        KSLOG_ERROR("Could not stat %s: %s", filePath, strerror(errno));
+        return;
+    }
+    beginArray(writer, key);
+    if (st.st_size > 0) {
+        int length = 0;
+        const char *text = ksfu_mmapReadOnly(filePath, &length);
+        if (text != NULL) {
+            addTextLinesTail(writer, text, length, maxLines, maxBytes);
+            munmap((void *)text, (size_t)length);
+        }
+    }
+    endContainer(writer);
+}
+
+/** Add the lines held in the logger's memory mapped buffer, as an array of strings.
+ * The buffer is already in memory, so this copies straight from it.
+ */
+static void addTextLinesFromLogBuffer(const KSCrashReportWriter *const writer, const char *const key,
+                                      const char *const text, int length, int maxLines, int maxBytes)
+{
+    beginArray(writer, key);
+    addTextLinesTail(writer, text, length, maxLines, maxBytes);
+    endContainer(writer);
+}
+
 static int addJSONData(const char *restrict const data, const int length, void *restrict userData)
 {
     KSBufferedWriter *writer = (KSBufferedWriter *)userData;
@@ -325,6 +390,19 @@ static bool isValidString(const void *const address)
     return ksstring_isNullTerminatedUTF8String(buffer, kMinStringLength, sizeof(buffer));
 }
 
+/** Answer memory readability checks from a snapshot of the address space while the report is written.
+ *
+ * Only done for fatal crashes, where the other threads have been suspended and can't change the mappings.
+ *
+ * @param monitorContext The crash handler context.
+ *
+ * @return true if the snapshot was taken and needs clearing afterwards.
+ */
+static bool takeReadableRegionSnapshot(const KSCrash_MonitorContext *const monitorContext)
+{
+    return monitorContext->handlingCrash && ksmem_snapshotReadableRegions();
+}
+
 /** Get the backtrace for the specified machine context.
  *
  * This function will choose how to fetch the backtrace based on the crash and
@@ -348,7 +426,7 @@ static bool getStackCursor(const KSCrash_MonitorContext *const crash,
         return true;
     }
 
-    kssc_initWithMachineContext(cursor, KSSC_STACK_OVERFLOW_THRESHOLD, machineContext);
+    kssc_initWithUnwindTables(cursor, KSSC_STACK_OVERFLOW_THRESHOLD, machineContext);
     return true;
 }
 
@@ -778,6 +856,72 @@ static void writeAddressReferencedByString(const KSCrashReportWriter *const writ
     writeMemoryContents(writer, key, (uintptr_t)address, &limit);
 }
 
+#pragma mark Fingerprint
+
+static uint64_t fingerprintAddBytes(uint64_t hash, const void *const data, const size_t length)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= kFingerprintPrime;
+    }
+    return hash;
+}
+
+static uint64_t fingerprintAddString(uint64_t hash, const char *const string)
+{
+    if (string != NULL) {
+        hash = fingerprintAddBytes(hash, string, strlen(string));
+    }
+    // Include the terminator so that adjacent strings can't run into each other.
+    return fingerprintAddBytes(hash, "", 1);
+}
+
+static uint64_t fingerprintAddUInteger(uint64_t hash, const uint64_t value)
+{
+    return fingerprintAddBytes(hash, &value, sizeof(value));
+}
+
+/** Add a stack frame to a fingerprint. The frame is hashed as its image's UUID
+ * and its offset into the image, so that ASLR doesn't affect it.
+ *
+ * @param hash The fingerprint so far.
+ *
+ * @param stackCursor A stack cursor on the frame.
+ *
+ * @param isSymbolicated True if the cursor was symbolicated, filling in the image.
+ *
+ * @return The new fingerprint.
+ */
+static uint64_t fingerprintAddFrame(uint64_t hash, const KSStackCursor *const stackCursor, const bool isSymbolicated)
+{
+    uintptr_t imageAddress = stackCursor->stackEntry.imageAddress;
+    if (!isSymbolicated || imageAddress == 0) {
+        return fingerprintAddString(hash, NULL);
+    }
+    const uint8_t *uuid = ksdl_imageUUIDForHeader((const void *)imageAddress);
+    if (uuid != NULL) {
+        hash = fingerprintAddBytes(hash, uuid, 16);
+    } else {
+        hash = fingerprintAddString(hash, ksfu_lastPathEntry(stackCursor->stackEntry.imageName));
+    }
+    return fingerprintAddUInteger(hash, stackCursor->stackEntry.address - imageAddress);
+}
+
+/** Format a fingerprint as a 16 character hex string.
+ *
+ * @param fingerprint The fingerprint.
+ *
+ * @param buffer A buffer of at least 17 bytes.
+ */
+static void formatFingerprint(const uint64_t fingerprint, char *const buffer)
+{
+    for (int i = 0; i < 16; i++) {
+        buffer[i] = g_hexNybbles[(fingerprint >> ((15 - i) * 4)) & 0xf];
+    }
+    buffer[16] = '\0';
+}
+
 #pragma mark Backtrace 线程回溯
 
 /** Write a backtrace to the report.
@@ -787,9 +931,15 @@ static void writeAddressReferencedByString(const KSCrashReportWriter *const writ
  * @param key The object key, if needed.
  *
  * @param stackCursor The stack cursor to read from.
+ *
+ * @return A fingerprint of the whole stack, from the image UUID and image offset
+ *         of each frame. It's the same for the same stack in any process, so
+ *         reports can be grouped by it without reading the frames.
  */
-static void writeBacktrace(const KSCrashReportWriter *const writer, const char *const key, KSStackCursor *stackCursor)
+static uint64_t writeBacktrace(const KSCrashReportWriter *const writer, const char *const key,
+                               KSStackCursor *stackCursor)
 {
+    uint64_t fingerprint = kFingerprintOffsetBasis;
     writer->beginObject(writer, key);
     {
         writer->beginArray(writer, KSCrashField_Contents);
@@ -799,7 +949,9 @@ static void writeBacktrace(const KSCrashReportWriter *const writer, const char *
                 writer->beginObject(writer, NULL);
                 {
                     //写的时候调用kssymbolicator_symbolicate 来设置
-                    if (stackCursor->symbolicate(stackCursor)) {
+                    bool isSymbolicated = stackCursor->symbolicate(stackCursor);
+                    fingerprint = fingerprintAddFrame(fingerprint, stackCursor, isSymbolicated);
+                    if (isSymbolicated) {
                         if (stackCursor->stackEntry.imageName != NULL) {
                             writer->addStringElement(writer, KSCrashField_ObjectName,
                                                      ksfu_lastPathEntry(stackCursor->stackEntry.imageName));
@@ -822,6 +974,7 @@ static void writeBacktrace(const KSCrashReportWriter *const writer, const char *
         writer->addIntegerElement(writer, KSCrashField_Skipped, 0);
     }
     writer->endContainer(writer);
+    return fingerprint;
 }
 
 #pragma mark Stack
@@ -860,13 +1013,20 @@ static void writeStackContents(const KSCrashReportWriter *const writer, const ch
         writer->addUIntegerElement(writer, KSCrashField_DumpEnd, highAddress);
         writer->addUIntegerElement(writer, KSCrashField_StackPtr, sp);
         writer->addBooleanElement(writer, KSCrashField_Overflow, isStackOverflow);
-        uint8_t stackBuffer[kStackContentsTotalDistance * sizeof(sp)];
+        // Without the arena, the window (which is small) is copied to this stack instead.
+        uint8_t fallbackBuffer[(kStackContentsPushedDistance + kStackContentsPoppedDistance) * sizeof(uintptr_t)];
         int copyLength = (int)(highAddress - lowAddress);
-        if (ksmem_copySafely((void *)lowAddress, stackBuffer, copyLength)) {
+        uint32_t arenaMark = ksarena_getMark();
+        uint8_t *stackBuffer = ksarena_alloc((size_t)copyLength);
+        if (stackBuffer == NULL && copyLength <= (int)sizeof(fallbackBuffer)) {
+            stackBuffer = fallbackBuffer;
+        }
+        if (stackBuffer != NULL && ksmem_copySafely((void *)lowAddress, stackBuffer, copyLength)) {
             writer->addDataElement(writer, KSCrashField_Contents, (void *)stackBuffer, copyLength);
         } else {
             writer->addStringElement(writer, KSCrashField_Error, "Stack contents not accessible");
         }
+        ksarena_releaseToMark(arenaMark);
     }
     writer->endContainer(writer);
 }
@@ -897,14 +1057,37 @@ static void writeNotableStackContents(const KSCrashReportWriter *const writer,
         lowAddress = highAddress;
         highAddress = tmp;
     }
-    uintptr_t contentsAsPointer;
+    // Read the whole window in one go. Words that can't be read are skipped.
+    // Without the arena, the window (which is small) is read onto this stack instead.
+    KSMemoryRegion fallbackRegions[kStackNotableSearchBackDistance + kStackNotableSearchForwardDistance];
+    uintptr_t fallbackContents[kStackNotableSearchBackDistance + kStackNotableSearchForwardDistance];
+    const int maxCount = kStackNotableSearchBackDistance + kStackNotableSearchForwardDistance;
+    uint32_t arenaMark = ksarena_getMark();
+    KSMemoryRegion *regions = ksarena_alloc(sizeof(*regions) * maxCount);
+    uintptr_t *contents = ksarena_alloc(sizeof(*contents) * maxCount);
+    if (regions == NULL || contents == NULL) {
+        regions = fallbackRegions;
+        contents = fallbackContents;
+    }
+    int count = 0;
+    for (uintptr_t address = lowAddress; address < highAddress && count < maxCount; address += sizeof(address)) {
+        regions[count] = (KSMemoryRegion) {
+            .src = (const void *)address,
+            .dst = &contents[count],
+            .byteCount = sizeof(address),
+        };
+        count++;
+    }
+    ksmem_copyManySafely(regions, count);
+
     char nameBuffer[40];
-    for (uintptr_t address = lowAddress; address < highAddress; address += sizeof(address)) {
-        if (ksmem_copySafely((void *)address, &contentsAsPointer, sizeof(contentsAsPointer))) {
-            sprintf(nameBuffer, "stack@%p", (void *)address);
-            writeMemoryContentsIfNotable(writer, nameBuffer, contentsAsPointer);
+    for (int i = 0; i < count; i++) {
+        if (regions[i].isCopied) {
+            sprintf(nameBuffer, "stack@%p", regions[i].src);
+            writeMemoryContentsIfNotable(writer, nameBuffer, contents[i]);
         }
     }
+    ksarena_releaseToMark(arenaMark);
 }
 
 #pragma mark Registers
@@ -1010,6 +1193,88 @@ static void writeNotableRegisters(const KSCrashReportWriter *const writer,
 
 #pragma mark Thread-specific
 
+/** A thread whose backtrace was written in full, that later threads with the same backtrace can refer to. */
+typedef struct {
+    uint64_t addressHash;
+    const uintptr_t *addresses;
+    int addressCount;
+    uint64_t fingerprint;
+    int threadIndex;
+} BacktraceGroup;
+
+typedef struct {
+    BacktraceGroup *groups;
+    int count;
+    int capacity;
+
+    /** The raw addresses of the thread being written. */
+    uintptr_t *addresses;
+    int addressCount;
+} BacktraceGroups;
+
+/** Read the raw addresses of a stack, without symbolicating them, and hash them.
+ *
+ * @param stackCursor The stack cursor to read from.
+ *
+ * @param backtraceGroups Where to put the addresses.
+ *
+ * @param addressHash Filled out with the hash.
+ *
+ * @return false if the stack is too deep to hold.
+ */
+static bool readStackAddresses(KSStackCursor *stackCursor, BacktraceGroups *const backtraceGroups,
+                               uint64_t *addressHash)
+{
+    uint64_t hash = kFingerprintOffsetBasis;
+    int count = 0;
+    while (stackCursor->advanceCursor(stackCursor)) {
+        if (count == KSSC_MAX_STACK_DEPTH) {
+            return false;
+        }
+        backtraceGroups->addresses[count++] = stackCursor->stackEntry.address;
+        hash = fingerprintAddUInteger(hash, stackCursor->stackEntry.address);
+    }
+    backtraceGroups->addressCount = count;
+    *addressHash = fingerprintAddUInteger(hash, (uint64_t)count);
+    return true;
+}
+
+/** Find a group whose addresses are the same as the ones just read. */
+static const BacktraceGroup *findBacktraceGroup(const BacktraceGroups *const backtraceGroups,
+                                                const uint64_t addressHash)
+{
+    for (int i = 0; i < backtraceGroups->count; i++) {
+        const BacktraceGroup *group = &backtraceGroups->groups[i];
+        if (group->addressHash == addressHash && group->addressCount == backtraceGroups->addressCount &&
+            memcmp(group->addresses, backtraceGroups->addresses,
+                   (size_t)group->addressCount * sizeof(*group->addresses)) == 0) {
+            return group;
+        }
+    }
+    return NULL;
+}
+
+static void addBacktraceGroup(BacktraceGroups *const backtraceGroups, const uint64_t addressHash,
+                              const uint64_t fingerprint, const int threadIndex)
+{
+    if (backtraceGroups->count == backtraceGroups->capacity) {
+        return;
+    }
+    size_t addressesSize = (size_t)backtraceGroups->addressCount * sizeof(*backtraceGroups->addresses);
+    uintptr_t *addresses = ksarena_alloc(addressesSize > 0 ? addressesSize : 1);
+    if (addresses == NULL) {
+        return;
+    }
+    memcpy(addresses, backtraceGroups->addresses, addressesSize);
+    backtraceGroups->groups[backtraceGroups->count++] = (BacktraceGroup) {
+        .addressHash = addressHash,
+        .addresses = addresses,
+        .addressCount = backtraceGroups->addressCount,
+        .fingerprint = fingerprint,
+        .threadIndex = threadIndex,
+    };
+}
+
 /** Write any notable addresses in the stack or registers to the report.
  *
  * @param writer The writer.
@@ -1041,10 +1306,18 @@ static void writeNotableAddresses(const KSCrashReportWriter *const writer, const
  * @param machineContext The context whose thread to write about.
  *
  * @param shouldWriteNotableAddresses If true, write any notable addresses found.
+ *
+ * @param backtraceGroups Backtraces already written, to refer to instead of
+ *                        writing the same one again (NULL = always write).
+ *
+ * @param stackFingerprint Filled out with the thread's stack fingerprint (NULL = not needed).
+ *
+ * @return true if the thread has a backtrace, and so a stack fingerprint.
  */
-static void writeThread(const KSCrashReportWriter *const writer, const char *const key,
+static bool writeThread(const KSCrashReportWriter *const writer, const char *const key,
                         const KSCrash_MonitorContext *const crash, const struct KSMachineContext *const machineContext,
-                        const int threadIndex, const bool shouldWriteNotableAddresses)
+                        const int threadIndex, const bool shouldWriteNotableAddresses,
+                        BacktraceGroups *const backtraceGroups, uint64_t *const stackFingerprint)
 {
     bool isCrashedThread = ksmc_isCrashedContext(machineContext);
     KSThread thread = ksmc_getThreadFromContext(machineContext);
@@ -1056,8 +1329,33 @@ static void writeThread(const KSCrashReportWriter *const writer, const char *con
     writer->beginObject(writer, key);
     {
         if (hasBacktrace) {
-            //这里边回溯堆栈
-            writeBacktrace(writer, KSCrashField_Backtrace, &stackCursor);
+            // The crashed thread is always written in full, since its stack contents go with it.
+            bool canCollapse = backtraceGroups != NULL && !isCrashedThread;
+            uint64_t addressHash = 0;
+            const BacktraceGroup *group = NULL;
+            if (canCollapse) {
+                KSStackCursor addressCursor = stackCursor;
+                canCollapse = readStackAddresses(&addressCursor, backtraceGroups, &addressHash);
+                group = canCollapse ? findBacktraceGroup(backtraceGroups, addressHash) : NULL;
+            }
+
+            uint64_t backtraceFingerprint;
+            if (group != NULL) {
+                writer->addIntegerElement(writer, KSCrashField_SameBacktraceAs, group->threadIndex);
+                backtraceFingerprint = group->fingerprint;
+            } else {
+                //这里边回溯堆栈
+                backtraceFingerprint = writeBacktrace(writer, KSCrashField_Backtrace, &stackCursor);
+                if (canCollapse) {
+                    addBacktraceGroup(backtraceGroups, addressHash, backtraceFingerprint, threadIndex);
+                }
+            }
+            char fingerprint[17];
+            formatFingerprint(backtraceFingerprint, fingerprint);
+            writer->addStringElement(writer, KSCrashField_Fingerprint, fingerprint);
+            if (stackFingerprint != NULL) {
+                *stackFingerprint = backtraceFingerprint;
+            }
         }
         if (ksmc_canHaveCPUState(machineContext)) {
             writeRegisters(writer, KSCrashField_Registers, machineContext);
@@ -1082,6 +1380,7 @@ static void writeThread(const KSCrashReportWriter *const writer, const char *con
         }
     }
     writer->endContainer(writer);
+    return hasBacktrace;
 }
 #pragma mark - 写报告的时候存储所有线程堆栈
 /** Write information about all threads to the report.
@@ -1091,15 +1390,31 @@ static void writeThread(const KSCrashReportWriter *const writer, const char *con
  * @param key The object key, if needed.
  *
  * @param crash The crash handler context.
+ *
+ * @param crashedThreadFingerprint Filled out with the stack fingerprint of the crashed thread.
+ *
+ * @return true if the crashed thread has a stack fingerprint.
  */
-static void writeAllThreads(const KSCrashReportWriter *const writer, const char *const key,
-                            const KSCrash_MonitorContext *const crash, bool writeNotableAddresses)
+static bool writeAllThreads(const KSCrashReportWriter *const writer, const char *const key,
+                            const KSCrash_MonitorContext *const crash, bool writeNotableAddresses,
+                            uint64_t *const crashedThreadFingerprint)
 {
     const struct KSMachineContext *const context = crash->offendingMachineContext;
     KSThread offendingThread = ksmc_getThreadFromContext(context);
     int threadCount = ksmc_getThreadCount(context);
     KSMC_NEW_CONTEXT(machineContext);
 
+    BacktraceGroups backtraceGroups = { 0 };
+    if (g_shouldCollapseIdenticalBacktraces && threadCount > 0) {
+        backtraceGroups.groups = ksarena_alloc((size_t)threadCount * sizeof(*backtraceGroups.groups));
+        backtraceGroups.addresses = ksarena_alloc(KSSC_MAX_STACK_DEPTH * sizeof(*backtraceGroups.addresses));
+        backtraceGroups.capacity = backtraceGroups.groups != NULL ? threadCount : 0;
+    }
+    BacktraceGroups *groups =
+        backtraceGroups.groups != NULL && backtraceGroups.addresses != NULL ? &backtraceGroups : NULL;
+
+    bool hasCrashedThreadFingerprint = false;
+
     // Fetch info for all threads.
     writer->beginArray(writer, key);
     {
@@ -1107,14 +1422,16 @@ static void writeAllThreads(const KSCrashReportWriter *const writer, const char
         for (int i = 0; i < threadCount; i++) {
             KSThread thread = ksmc_getThreadAtIndex(context, i);
             if (thread == offendingThread) {
-                writeThread(writer, NULL, crash, context, i, writeNotableAddresses);
+                hasCrashedThreadFingerprint = writeThread(writer, NULL, crash, context, i, writeNotableAddresses,
+                                                          groups, crashedThreadFingerprint);
             } else {
                 ksmc_getContextForThread(thread, machineContext, false);
-                writeThread(writer, NULL, crash, machineContext, i, writeNotableAddresses);
+                writeThread(writer, NULL, crash, machineContext, i, writeNotableAddresses, groups, NULL);
             }
         }
     }
     writer->endContainer(writer);
+    return hasCrashedThreadFingerprint;
 }
 
 #pragma mark Global Report Data
@@ -1372,6 +1689,80 @@ static void writeProcessState(const KSCrashReportWriter *const writer, const cha
     writer->endContainer(writer);
 }
 
+/** Write the most recent window of profiler samples.
+ *
+ * The call tree is written in preorder as [parent, address, sample count] triples,
+ * where parent is the position of the parent triple in the list, or -1 for the
+ * outermost frames.
+ *
+ * @param writer The writer.
+ *
+ * @param key The object key, if needed.
+ *
+ * @param window The profile window.
+ */
+static void writeProfile(const KSCrashReportWriter *const writer, const char *const key,
+                         const KSProfileWindow *const window)
+{
+    // The sampler may still be adding to the window, so the walk only follows
+    // published links, and is bounded in case the window is cleared under it.
+    uint32_t siblings[KSPROFILER_MaxDepth];
+    int64_t parents[KSPROFILER_MaxDepth];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t nowMicroseconds = (int64_t)now.tv_sec * 1000000 + (int64_t)now.tv_nsec / 1000;
+
+    writer->beginObject(writer, key);
+    {
+        writer->addFloatingPointElement(writer, KSCrashField_Duration,
+                                        (double)(window->endTime - window->startTime) / 1000000.0);
+        writer->addFloatingPointElement(writer, KSCrashField_Age,
+                                        (double)(nowMicroseconds - window->endTime) / 1000000.0);
+        writer->addUIntegerElement(writer, KSCrashField_SampleCount, window->sampleCount);
+        writer->addUIntegerElement(writer, KSCrashField_DroppedSamples, window->droppedSampleCount);
+        writer->addFloatingPointElement(writer, KSCrashField_SamplingTime, (double)window->samplingTime / 1000000.0);
+
+        writer->beginArray(writer, KSCrashField_Nodes);
+        {
+            int64_t written = 0;
+            int visited = 0;
+            int depth = 0;
+            siblings[0] = __atomic_load_n(&window->nodes[0].firstChild, __ATOMIC_ACQUIRE);
+            parents[0] = -1;
+            while (depth >= 0 && visited < KSPROFILER_MaxNodes) {
+                uint32_t index = siblings[depth];
+                if (index == 0 || index >= KSPROFILER_MaxNodes) {
+                    depth--;
+                    continue;
+                }
+                visited++;
+                const KSProfileNode *node = &window->nodes[index];
+                siblings[depth] = node->nextSibling;
+                uint32_t sampleCount = node->sampleCount;
+                if (sampleCount == 0) {
+                    // Part of a sample that was dropped, or is still being added.
+                    continue;
+                }
+                writer->beginArray(writer, NULL);
+                {
+                    writer->addIntegerElement(writer, NULL, parents[depth]);
+                    writer->addUIntegerElement(writer, NULL, node->address);
+                    writer->addUIntegerElement(writer, NULL, sampleCount);
+                }
+                writer->endContainer(writer);
+                if (depth + 1 < KSPROFILER_MaxDepth) {
+                    depth++;
+                    siblings[depth] = __atomic_load_n(&node->firstChild, __ATOMIC_ACQUIRE);
+                    parents[depth] = written;
+                }
+                written++;
+            }
+        }
+        writer->endContainer(writer);
+    }
+    writer->endContainer(writer);
+}
+
 /** Write basic report information.
  *
  * @param writer The writer.
@@ -1381,9 +1772,15 @@ static void writeProcessState(const KSCrashReportWriter *const writer, const cha
  * @param type The report type.
  *
  * @param reportID The report ID.
+ *
+ * @param fingerprint The report fingerprint (NULL = none).
+ *
+ * @param fingerprintOffset Filled out with where the fingerprint is in the report file,
+ *                          so that it can be replaced later (NULL = not needed).
  */
 static void writeReportInfo(const KSCrashReportWriter *const writer, const char *const key, const char *const type,
-                            const char *const reportID, const char *const processName)
+                            const char *const reportID, const char *const processName, const char *const fingerprint,
+                            off_t *const fingerprintOffset)
 {
     writer->beginObject(writer, key);
     {
@@ -1392,6 +1789,17 @@ static void writeReportInfo(const KSCrashReportWriter *const writer, const char
         writer->addStringElement(writer, KSCrashField_ProcessName, processName);
         writer->addIntegerElement(writer, KSCrashField_Timestamp, ksdate_microseconds());
         writer->addStringElement(writer, KSCrashField_Type, type);
+        if (fingerprint != NULL) {
+            writer->addStringElement(writer, KSCrashField_Fingerprint, fingerprint);
+            if (fingerprintOffset != NULL) {
+                // The value is followed by its closing quote.
+                const KSBufferedWriter *bufferedWriter = getJsonContext(writer)->userData;
+                off_t fileOffset = lseek(bufferedWriter->fd, 0, SEEK_CUR);
+                *fingerprintOffset = fileOffset < 0 ? -1
+                                                    : fileOffset + bufferedWriter->position -
+                                                          (off_t)strlen(fingerprint) - 1;
+            }
+        }
     }
     writer->endContainer(writer);
 }
@@ -1401,6 +1809,61 @@ static void writeRecrash(const KSCrashReportWriter *const writer, const char *co
     writer->addJSONFileElement(writer, key, crashReportPath, true);
 }
 
+/** Compute a fingerprint that is stable across occurrences of the same crash.
+ * It covers the crash type, the crashed thread's stack fingerprint (see
+ * writeBacktrace()) and the app version.
+ *
+ * @param crash The crash handler context.
+ *
+ * @param crashedThreadFingerprint The crashed thread's stack fingerprint (NULL = no backtrace).
+ *
+ * @return The fingerprint.
+ */
+static uint64_t computeFingerprint(const KSCrash_MonitorContext *const crash,
+                                   const uint64_t *const crashedThreadFingerprint)
+{
+    uint64_t hash = kFingerprintOffsetBasis;
+    hash = fingerprintAddString(hash, crash->monitorId);
+    hash = fingerprintAddUInteger(hash, (uint64_t)crash->mach.type);
+    hash = fingerprintAddUInteger(hash, (uint64_t)crash->signal.signum);
+    if (isCrashOfMonitorType(crash, kscm_nsexception_getAPI())) {
+        hash = fingerprintAddString(hash, crash->NSException.name);
+    } else if (isCrashOfMonitorType(crash, kscm_cppexception_getAPI())) {
+        hash = fingerprintAddString(hash, crash->CPPException.name);
+    } else if (isCrashOfMonitorType(crash, kscm_user_getAPI())) {
+        hash = fingerprintAddString(hash, crash->userException.name);
+    }
+    if (crashedThreadFingerprint != NULL) {
+        hash = fingerprintAddUInteger(hash, *crashedThreadFingerprint);
+    } else {
+        hash = fingerprintAddString(hash, NULL);
+    }
+
+    hash = fingerprintAddString(hash, crash->System.bundleShortVersion);
+    hash = fingerprintAddString(hash, crash->System.bundleVersion);
+    return hash;
+}
+
+/** Overwrite the fingerprint that writeReportInfo() wrote, in place. Async-safe.
+ *
+ * @param bufferedWriter The report file's writer. The fingerprint must have been flushed.
+ *
+ * @param offset Where the fingerprint is in the file (-1 = unknown).
+ *
+ * @param fingerprint The new fingerprint, the same length as the old one.
+ */
+static void replaceFingerprint(const KSBufferedWriter *const bufferedWriter, const off_t offset,
+                               const char *const fingerprint)
+{
+    if (offset < 0) {
+        return;
+    }
+    size_t length = strlen(fingerprint);
+    if (pwrite(bufferedWriter->fd, fingerprint, length, offset) != (ssize_t)length) {
+        KSLOG_ERROR("Could not write the report fingerprint: %s", strerror(errno));
+    }
+}
+
 #pragma mark Setup
 
 /** Prepare a report writer for use.
@@ -1431,13 +1894,32 @@ static void prepareReportWriter(KSCrashReportWriter *const writer, KSJSONEncodeC
     writer->context = context;
 }
 
+/** Open a report file for writing. The write buffer comes from the crash arena,
+ * so if the arena isn't available, writes go straight to the file.
+ *
+ * @param bufferedWriter The writer to open.
+ *
+ * @param path The path to the report file.
+ *
+ * @return true if the file was opened.
+ */
+static bool openReportWriter(KSBufferedWriter *bufferedWriter, const char *const path)
+{
+    char *writeBuffer = ksarena_alloc(kReportWriteBufferSize);
+    if (writeBuffer == NULL) {
+        KSLOG_ERROR("No arena memory for the report write buffer. Writing unbuffered.");
+    }
+    return ksfu_openBufferedWriter(bufferedWriter, path, writeBuffer, writeBuffer != NULL ? kReportWriteBufferSize : 0);
+}
+
 // ============================================================================
 #pragma mark - Main API -
 // ============================================================================
 
 void kscrashreport_writeRecrashReport(const KSCrash_MonitorContext *const monitorContext, const char *const path)
 {
-    char writeBuffer[1024];
+    KSArenaScope arenaScope;
+    ksarena_beginScope(&arenaScope, monitorContext->handlingCrash);
     KSBufferedWriter bufferedWriter;
     static char tempPath[KSFU_MAX_PATH_LENGTH];
     strncpy(tempPath, path, sizeof(tempPath) - 10);
@@ -1447,11 +1929,13 @@ void kscrashreport_writeRecrashReport(const KSCrash_MonitorContext *const monito
     if (rename(path, tempPath) < 0) {
         KSLOG_ERROR("Could not rename %s to %s: %s", path, tempPath, strerror(errno));
     }
-    if (!ksfu_openBufferedWriter(&bufferedWriter, path, writeBuffer, sizeof(writeBuffer))) {
+    if (!openReportWriter(&bufferedWriter, path)) {
+        ksarena_endScope(&arenaScope);
         return;
     }
 
     ksccd_freeze();
+    bool isRegionSnapshotTaken = takeReadableRegionSnapshot(monitorContext);
 
     KSJSONEncodeContext jsonContext;
     jsonContext.userData = &bufferedWriter;
@@ -1469,7 +1953,7 @@ void kscrashreport_writeRecrashReport(const KSCrash_MonitorContext *const monito
             KSLOG_ERROR("Could not remove %s: %s", tempPath, strerror(errno));
         }
         writeReportInfo(writer, KSCrashField_Report, KSCrashReportType_Minimal, monitorContext->eventID,
-                        monitorContext->System.processName);
+                        monitorContext->System.processName, NULL, NULL);
         ksfu_flushBufferedWriter(&bufferedWriter);
 
         writer->beginObject(writer, KSCrashField_Crash);
@@ -1479,7 +1963,7 @@ void kscrashreport_writeRecrashReport(const KSCrash_MonitorContext *const monito
             int threadIndex = ksmc_indexOfThread(monitorContext->offendingMachineContext,
                                                  ksmc_getThreadFromContext(monitorContext->offendingMachineContext));
             writeThread(writer, KSCrashField_CrashedThread, monitorContext, monitorContext->offendingMachineContext,
-                        threadIndex, false);
+                        threadIndex, false, NULL, NULL);
             ksfu_flushBufferedWriter(&bufferedWriter);
         }
         writer->endContainer(writer);
@@ -1488,7 +1972,11 @@ void kscrashreport_writeRecrashReport(const KSCrash_MonitorContext *const monito
 
     ksjson_endEncode(getJsonContext(writer));
     ksfu_closeBufferedWriter(&bufferedWriter);
+    if (isRegionSnapshotTaken) {
+        ksmem_clearReadableRegionSnapshot();
+    }
     ksccd_unfreeze();
+    ksarena_endScope(&arenaScope);
 }
 
 static void writeAppMemoryInfo(const KSCrashReportWriter *const writer, const char *const key,
@@ -1552,8 +2040,18 @@ static void writeDebugInfo(const KSCrashReportWriter *const writer, const char *
 {
     writer->beginObject(writer, key);
     {
-        if (monitorContext->consoleLogPath != NULL) {
-            addTextLinesFromFile(writer, KSCrashField_ConsoleLog, monitorContext->consoleLogPath);
+        int logBufferLength = 0;
+        const char *logBuffer = kslog_getLogBuffer(&logBufferLength);
+        if (monitorContext->consoleLogPath != NULL && logBuffer != NULL) {
+            addTextLinesFromLogBuffer(writer, KSCrashField_ConsoleLog, logBuffer, logBufferLength,
+                                      g_consoleLogMaxLines, g_consoleLogMaxBytes);
+        } else if (monitorContext->consoleLogPath != NULL) {
+            if (g_consoleLogMaxLines > 0 || g_consoleLogMaxBytes > 0) {
+                addTextLinesFromFileTail(writer, KSCrashField_ConsoleLog, monitorContext->consoleLogPath,
+                                         g_consoleLogMaxLines, g_consoleLogMaxBytes);
+            } else {
+                addTextLinesFromFile(writer, KSCrashField_ConsoleLog, monitorContext->consoleLogPath);
+            }
         }
     }
     writer->endContainer(writer);
@@ -1562,14 +2060,17 @@ static void writeDebugInfo(const KSCrashReportWriter *const writer, const char *
 void kscrashreport_writeStandardReport(const KSCrash_MonitorContext *const monitorContext, const char *const path)
 {
     KSLOG_INFO("Writing crash report to %s", path);
-    char writeBuffer[1024];
+    KSArenaScope arenaScope;
+    ksarena_beginScope(&arenaScope, monitorContext->handlingCrash);
     KSBufferedWriter bufferedWriter;
 
-    if (!ksfu_openBufferedWriter(&bufferedWriter, path, writeBuffer, sizeof(writeBuffer))) {
+    if (!openReportWriter(&bufferedWriter, path)) {
+        ksarena_endScope(&arenaScope);
         return;
     }
 
     ksccd_freeze();
+    bool isRegionSnapshotTaken = takeReadableRegionSnapshot(monitorContext);
 
     KSJSONEncodeContext jsonContext;
     jsonContext.userData = &bufferedWriter;
@@ -1579,11 +2080,17 @@ void kscrashreport_writeStandardReport(const KSCrash_MonitorContext *const monit
 
     ksjson_beginEncode(getJsonContext(writer), true, addJSONData, &bufferedWriter);
 
+    // The fingerprint needs the crashed thread's backtrace, which is written much later. Until it's
+    // filled in, the report has one that's unique to it, so it isn't mistaken for any other report.
+    char fingerprint[17];
+    formatFingerprint(fingerprintAddString(kFingerprintOffsetBasis, monitorContext->eventID), fingerprint);
+    off_t fingerprintOffset = -1;
+
     writer->beginObject(writer, KSCrashField_Report);
     {
         //process
         writeReportInfo(writer, KSCrashField_Report, KSCrashReportType_Standard, monitorContext->eventID,
-                        monitorContext->System.processName);
+                        monitorContext->System.processName, fingerprint, &fingerprintOffset);
         ksfu_flushBufferedWriter(&bufferedWriter);
 
         //binary_images
@@ -1605,11 +2112,29 @@ void kscrashreport_writeStandardReport(const KSCrash_MonitorContext *const monit
         {
             writeError(writer, KSCrashField_Error, monitorContext);
             ksfu_flushBufferedWriter(&bufferedWriter);
-            writeAllThreads(writer, KSCrashField_Threads, monitorContext, g_introspectionRules.enabled);
+            // The crashed thread's fingerprint comes from its backtrace, so it's written after the threads.
+            uint64_t crashedThreadFingerprint;
+            bool hasCrashedThreadFingerprint = writeAllThreads(writer, KSCrashField_Threads, monitorContext,
+                                                               g_introspectionRules.enabled, &crashedThreadFingerprint);
+            if (hasCrashedThreadFingerprint) {
+                char crashedThreadFingerprintString[17];
+                formatFingerprint(crashedThreadFingerprint, crashedThreadFingerprintString);
+                writer->addStringElement(writer, KSCrashField_CrashedThreadFingerprint,
+                                         crashedThreadFingerprintString);
+            }
             ksfu_flushBufferedWriter(&bufferedWriter);
+            formatFingerprint(
+                computeFingerprint(monitorContext, hasCrashedThreadFingerprint ? &crashedThreadFingerprint : NULL),
+                fingerprint);
+            replaceFingerprint(&bufferedWriter, fingerprintOffset, fingerprint);
         }
         writer->endContainer(writer);
 
+        if (monitorContext->Profile.window != NULL) {
+            writeProfile(writer, KSCrashField_Profile, monitorContext->Profile.window);
+            ksfu_flushBufferedWriter(&bufferedWriter);
+        }
+
         //user
         if (g_userInfoJSON != NULL) {
             addJSONElement(writer, KSCrashField_User, g_userInfoJSON, false);
@@ -1631,7 +2156,11 @@ void kscrashreport_writeStandardReport(const KSCrash_MonitorContext *const monit
 
     ksjson_endEncode(getJsonContext(writer));
     ksfu_closeBufferedWriter(&bufferedWriter);
+    if (isRegionSnapshotTaken) {
+        ksmem_clearReadableRegionSnapshot();
+    }
     ksccd_unfreeze();
+    ksarena_endScope(&arenaScope);
 }
 
 void kscrashreport_setUserInfoJSON(const char *const userInfoJSON)
@@ -1668,6 +2197,17 @@ void kscrashreport_setIntrospectMemory(bool shouldIntrospectMemory)
     g_introspectionRules.enabled = shouldIntrospectMemory;
 }
 
+void kscrashreport_setCollapseIdenticalBacktraces(bool shouldCollapse)
+{
+    g_shouldCollapseIdenticalBacktraces = shouldCollapse;
+}
+
+void kscrashreport_setConsoleLogLimits(int maxLines, int maxBytes)
+{
+    g_consoleLogMaxLines = maxLines > 0 ? maxLines : 0;
+    g_consoleLogMaxBytes = maxBytes > 0 ? maxBytes : 0;
+}
+
 void kscrashreport_setDoNotIntrospectClasses(const char **doNotIntrospectClasses, int length)
 {
     const char **oldClasses = g_introspectionRules.restrictedClasses;
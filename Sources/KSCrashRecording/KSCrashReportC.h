@@ -64,6 +64,21 @@ const char *kscrashreport_getUserInfoJSON(void);
  */
 void kscrashreport_setIntrospectMemory(bool shouldIntrospectMemory);
 
+/** Configure whether threads with the same backtrace as an earlier thread
+ * refer to that thread instead of repeating the backtrace.
+ *
+ * @param shouldCollapse If true, collapse identical backtraces.
+ */
+void kscrashreport_setCollapseIdenticalBacktraces(bool shouldCollapse);
+
+/** Limit how much of the console log is added to the report.
+ * Only the end of the log is kept.
+ *
+ * @param maxLines The maximum number of lines to add, or 0 for no limit.
+ * @param maxBytes The maximum number of bytes to add, or 0 for no limit.
+ */
+void kscrashreport_setConsoleLogLimits(int maxLines, int maxBytes);
+
 /** Specify which objective-c classes should not be introspected.
  *
  * @param doNotIntrospectClasses Array of class names.
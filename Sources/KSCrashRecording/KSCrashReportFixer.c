@@ -24,9 +24,13 @@
 // THE SOFTWARE.
 //
 
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "KSCrashReportFixer.h"
+
 #include "KSCrashReportFields.h"
 #include "KSDate.h"
 #include "KSJSONCodec.h"
@@ -34,256 +38,653 @@
 #include "KSSystemCapabilities.h"
 
 #define MAX_DEPTH 100
-#define MAX_NAME_LENGTH 100
+#define MAX_VERSION_LENGTH 32
 #define REPORT_VERSION_COMPONENTS_COUNT 3
+#define STREAMING_CHUNK_SIZE 16384
+#define DEMANGLE_MEMO_INITIAL_CAPACITY 64
+
+/** FNV-1a parameters used to hash symbols in the demangle memo. */
+#define DEMANGLE_MEMO_OFFSET_BASIS 0x811c9dc5U
+#define DEMANGLE_MEMO_PRIME 0x01000193U
+
+typedef enum {
+    FixupActionNone,
+    FixupActionConvertDate,
+    FixupActionSaveVersion,
+    FixupActionDemangle,
+} FixupAction;
+
+/** A node in the trie of object paths that have fixups.
+ * The scanner keeps the node of every open container, so matching an element
+ * is one lookup among the children of its container's node, and containers
+ * outside the trie are not looked at all.
+ */
+typedef struct FixupPathNode {
+    const char *name;
+    FixupAction action;
+    const struct FixupPathNode *children;
+    int childrenCount;
+} FixupPathNode;
+
+#define FIXUP_PATH_CHILDREN(CHILDREN) CHILDREN, sizeof(CHILDREN) / sizeof(*CHILDREN)
+
+static const FixupPathNode g_reportInfoPaths[] = {
+    { KSCrashField_Timestamp, FixupActionConvertDate, NULL, 0 },
+    { KSCrashField_Version, FixupActionSaveVersion, NULL, 0 },
+};
+
+// Array elements are matched by an empty name.
+static const FixupPathNode g_stackFramePaths[] = {
+    { KSCrashField_SymbolName, FixupActionDemangle, NULL, 0 },
+};
+
+static const FixupPathNode g_stackFramesPaths[] = {
+    { "", FixupActionNone, FIXUP_PATH_CHILDREN(g_stackFramePaths) },
+};
 
-static const char *datePaths[][MAX_DEPTH] = {
-    { "", KSCrashField_Report, KSCrashField_Timestamp },
-    { "", KSCrashField_RecrashReport, KSCrashField_Report, KSCrashField_Timestamp },
+static const FixupPathNode g_backtracePaths[] = {
+    { KSCrashField_Contents, FixupActionNone, FIXUP_PATH_CHILDREN(g_stackFramesPaths) },
 };
-static int datePathsCount = sizeof(datePaths) / sizeof(*datePaths);
 
-static const char *versionPaths[][MAX_DEPTH] = {
-    { "", KSCrashField_Report, KSCrashField_Version },
-    { "", KSCrashField_RecrashReport, KSCrashField_Report, KSCrashField_Version },
+static const FixupPathNode g_threadPaths[] = {
+    { KSCrashField_Backtrace, FixupActionNone, FIXUP_PATH_CHILDREN(g_backtracePaths) },
 };
-static int versionPathsCount = sizeof(versionPaths) / sizeof(*versionPaths);
 
+static const FixupPathNode g_threadsPaths[] = {
+    { "", FixupActionNone, FIXUP_PATH_CHILDREN(g_threadPaths) },
+};
+
+static const FixupPathNode g_cppExceptionPaths[] = {
+    { KSCrashField_Name, FixupActionDemangle, NULL, 0 },
+};
+
+static const FixupPathNode g_errorPaths[] = {
+    { KSCrashField_CPPException, FixupActionNone, FIXUP_PATH_CHILDREN(g_cppExceptionPaths) },
+};
+
+static const FixupPathNode g_crashPaths[] = {
+    { KSCrashField_Threads, FixupActionNone, FIXUP_PATH_CHILDREN(g_threadsPaths) },
+    { KSCrashField_Error, FixupActionNone, FIXUP_PATH_CHILDREN(g_errorPaths) },
+};
+
+static const FixupPathNode g_recrashReportPaths[] = {
+    { KSCrashField_Report, FixupActionNone, FIXUP_PATH_CHILDREN(g_reportInfoPaths) },
+    { KSCrashField_Crash, FixupActionNone, FIXUP_PATH_CHILDREN(g_crashPaths) },
+};
+
+static const FixupPathNode g_rootPaths[] = {
+    { KSCrashField_Report, FixupActionNone, FIXUP_PATH_CHILDREN(g_reportInfoPaths) },
+    { KSCrashField_Crash, FixupActionNone, FIXUP_PATH_CHILDREN(g_crashPaths) },
+    { KSCrashField_RecrashReport, FixupActionNone, FIXUP_PATH_CHILDREN(g_recrashReportPaths) },
+};
+
+static const FixupPathNode g_rootPath = { "", FixupActionNone, FIXUP_PATH_CHILDREN(g_rootPaths) };
+
+/** A demangled symbol, kept so that each distinct symbol in a report is only demangled once. */
+typedef struct {
+    char *symbol;
+    int symbolLength;
+    /** The demangled symbol, JSON escaped. NULL if the symbol could not be demangled. */
+    char *replacement;
+    int replacementLength;
+    uint32_t hash;
+} DemangleMemoEntry;
+
+/** Open addressing hash table of demangled symbols. */
+typedef struct {
+    DemangleMemoEntry *entries;
+    int capacity;
+    int count;
+} DemangleMemo;
+
+/** The fixer scans the raw report without decoding it. Everything it does not
+ * need to change is passed to the output as spans of the original bytes, and
+ * replacements are spliced in between those spans.
+ */
 typedef struct {
-    KSJSONEncodeContext *encodeContext;
+    const char *data;
+    int length;
+    int position;
+    /** Start of the input that has not been passed to the output yet. */
+    int spanStart;
+    KSJSONAddDataFunc addJSONData;
+    void *addJSONDataUserData;
     int reportVersionComponents[REPORT_VERSION_COMPONENTS_COUNT];
-    char objectPath[MAX_DEPTH][MAX_NAME_LENGTH];
     int currentDepth;
-    char *outputPtr;
-    int outputBytesLeft;
+    KSReportDemangleFunction demangle;
+    DemangleMemo demangleMemo;
 } FixupContext;
 
-static bool increaseDepth(FixupContext *context, const char *name)
+typedef struct {
+    char *data;
+    int length;
+    int capacity;
+} BufferOutputContext;
+
+typedef struct {
+    KSCrashReportFixupOutputFunc output;
+    void *userData;
+    char buffer[STREAMING_CHUNK_SIZE];
+    int position;
+    bool isCancelled;
+} StreamingOutputContext;
+
+/** Find the trie node for an element of the container at `parent`.
+ * The name is the raw (still escaped) key, which is fine since no path contains escapes.
+ */
+static const FixupPathNode *findChildPath(const FixupPathNode *parent, const char *name, int nameLength)
 {
-    if (context->currentDepth >= MAX_DEPTH) {
-        return false;
+    if (parent == NULL || name == NULL) {
+        return NULL;
     }
-    if (name == NULL) {
-        *context->objectPath[context->currentDepth] = '\0';
-    } else {
-        strncpy(context->objectPath[context->currentDepth], name, sizeof(context->objectPath[context->currentDepth]));
+    for (int i = 0; i < parent->childrenCount; i++) {
+        const FixupPathNode *child = &parent->children[i];
+        if (strncmp(child->name, name, (size_t)nameLength) == 0 && child->name[nameLength] == '\0') {
+            return child;
+        }
     }
-    context->currentDepth++;
-    return true;
+    return NULL;
 }
 
-static bool decreaseDepth(FixupContext *context)
+static bool matchesMinVersion(FixupContext *context, int major, int minor, int patch)
 {
-    if (context->currentDepth <= 0) {
-        return false;
+    // Works only for report version 3.1.0 and above. See KSCrashReportVersion.h
+    bool result = false;
+    int *parts = context->reportVersionComponents;
+    result = result || (parts[0] > major);
+    result = result || (parts[0] == major && parts[1] > minor);
+    result = result || (parts[0] == major && parts[1] == minor && parts[2] >= patch);
+    return result;
+}
+
+/** Pass the untouched input up to `end` to the output. */
+static int flushSpan(FixupContext *context, int end)
+{
+    int length = end - context->spanStart;
+    if (length <= 0) {
+        return KSJSON_OK;
     }
-    context->currentDepth--;
-    return true;
+    int result = context->addJSONData(context->data + context->spanStart, length, context->addJSONDataUserData);
+    context->spanStart = end;
+    return result;
 }
 
-static bool matchesPath(FixupContext *context, const char **path, const char *finalName)
+/** Replace the input between `start` and `end` with `replacement`. */
+static int splice(FixupContext *context, int start, int end, const char *replacement, int replacementLength)
 {
-    if (finalName == NULL) {
-        finalName = "";
+    int result = flushSpan(context, start);
+    if (result != KSJSON_OK) {
+        return result;
     }
+    context->spanStart = end;
+    return context->addJSONData(replacement, replacementLength, context->addJSONDataUserData);
+}
 
-    for (int i = 0; i < context->currentDepth; i++) {
-        if (strncmp(context->objectPath[i], path[i], MAX_NAME_LENGTH) != 0) {
-            return false;
+static int fixDate(FixupContext *context, int start, int end)
+{
+    // Only integers get converted, the same as when the report was decoded.
+    char number[24];
+    int length = end - start;
+    if (length >= (int)sizeof(number)) {
+        return KSJSON_OK;
+    }
+    memcpy(number, context->data + start, (size_t)length);
+    number[length] = '\0';
+    for (int i = number[0] == '-' ? 1 : 0; i < length; i++) {
+        if (number[i] < '0' || number[i] > '9') {
+            return KSJSON_OK;
         }
     }
-    if (strncmp(finalName, path[context->currentDepth], MAX_NAME_LENGTH) != 0) {
-        return false;
+    errno = 0;
+    int64_t value = strtoll(number, NULL, 10);
+    if (errno == ERANGE) {
+        return KSJSON_OK;
     }
-    return true;
+
+    char buffer[28];
+    if (matchesMinVersion(context, 3, 3, 0)) {
+        ksdate_utcStringFromMicroseconds(value, buffer);
+    } else {
+        ksdate_utcStringFromTimestamp((time_t)value, buffer);
+    }
+    char quoted[sizeof(buffer) + 2];
+    int quotedLength = snprintf(quoted, sizeof(quoted), "\"%s\"", buffer);
+    return splice(context, start, end, quoted, quotedLength);
 }
 
-static bool matchesAPath(FixupContext *context, const char *name, const char *paths[][MAX_DEPTH], int pathsCount)
+static void saveVersion(FixupContext *context, const char *value, int valueLength)
 {
-    for (int i = 0; i < pathsCount; i++) {
-        if (matchesPath(context, paths[i], name)) {
-            return true;
-        }
+    memset(context->reportVersionComponents, 0, sizeof(context->reportVersionComponents));
+    char version[MAX_VERSION_LENGTH];
+    if (valueLength > (int)sizeof(version) - 1) {
+        valueLength = (int)sizeof(version) - 1;
+    }
+    memcpy(version, value, (size_t)valueLength);
+    version[valueLength] = '\0';
+    int versionPartsIndex = 0;
+    char *savePtr = NULL;
+    char *versionPart = strtok_r(version, ".", &savePtr);
+    while (versionPart != NULL && versionPartsIndex < REPORT_VERSION_COMPONENTS_COUNT) {
+        context->reportVersionComponents[versionPartsIndex++] = atoi(versionPart);
+        versionPart = strtok_r(NULL, ".", &savePtr);
     }
-    return false;
 }
 
-static bool matchesMinVersion(FixupContext *context, int major, int minor, int patch)
+static uint32_t hashSymbol(const char *symbol, int length)
 {
-    // Works only for report version 3.1.0 and above. See KSCrashReportVersion.h
-    bool result = false;
-    int *parts = context->reportVersionComponents;
-    result = result || (parts[0] > major);
-    result = result || (parts[0] == major && parts[1] > minor);
-    result = result || (parts[0] == major && parts[1] == minor && parts[2] >= patch);
-    return result;
+    uint32_t hash = DEMANGLE_MEMO_OFFSET_BASIS;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)symbol[i];
+        hash *= DEMANGLE_MEMO_PRIME;
+    }
+    return hash;
 }
 
-static bool shouldFixDate(FixupContext *context, const char *name)
+static void freeDemangleMemo(DemangleMemo *memo)
 {
-    return matchesAPath(context, name, datePaths, datePathsCount);
+    for (int i = 0; i < memo->capacity; i++) {
+        free(memo->entries[i].symbol);
+        free(memo->entries[i].replacement);
+    }
+    free(memo->entries);
+    memo->entries = NULL;
+    memo->capacity = 0;
+    memo->count = 0;
 }
 
-static bool shouldSaveVersion(FixupContext *context, const char *name)
+static DemangleMemoEntry *findDemangleMemoSlot(DemangleMemoEntry *entries, int capacity, const char *symbol,
+                                               int symbolLength, uint32_t hash)
 {
-    return matchesAPath(context, name, versionPaths, versionPathsCount);
+    int mask = capacity - 1;
+    for (int i = (int)(hash & (uint32_t)mask);; i = (i + 1) & mask) {
+        DemangleMemoEntry *entry = &entries[i];
+        if (entry->symbol == NULL) {
+            return entry;
+        }
+        if (entry->hash == hash && entry->symbolLength == symbolLength &&
+            memcmp(entry->symbol, symbol, (size_t)symbolLength) == 0) {
+            return entry;
+        }
+    }
 }
 
-static int onBooleanElement(const char *const name, const bool value, void *const userData)
+/** Make room for one more entry, keeping the table at most half full. */
+static bool reserveDemangleMemoEntry(DemangleMemo *memo)
 {
-    FixupContext *context = (FixupContext *)userData;
-    return ksjson_addBooleanElement(context->encodeContext, name, value);
+    if ((memo->count + 1) * 2 <= memo->capacity) {
+        return true;
+    }
+    int newCapacity = memo->capacity > 0 ? memo->capacity * 2 : DEMANGLE_MEMO_INITIAL_CAPACITY;
+    DemangleMemoEntry *newEntries = calloc((size_t)newCapacity, sizeof(*newEntries));
+    if (newEntries == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return false;
+    }
+    for (int i = 0; i < memo->capacity; i++) {
+        DemangleMemoEntry *entry = &memo->entries[i];
+        if (entry->symbol != NULL) {
+            *findDemangleMemoSlot(newEntries, newCapacity, entry->symbol, entry->symbolLength, entry->hash) = *entry;
+        }
+    }
+    free(memo->entries);
+    memo->entries = newEntries;
+    memo->capacity = newCapacity;
+    return true;
 }
 
-static int onFloatingPointElement(const char *const name, const double value, void *const userData)
+/** Returns a malloc'd copy of `string` with JSON escapes applied. */
+static char *escapeJSONString(const char *string, int *escapedLength)
 {
-    FixupContext *context = (FixupContext *)userData;
-    return ksjson_addFloatingPointElement(context->encodeContext, name, value);
+    static const char hexDigits[] = "0123456789abcdef";
+    size_t length = strlen(string);
+    char *escaped = malloc(length * 6 + 1);
+    if (escaped == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return NULL;
+    }
+    char *dst = escaped;
+    for (const unsigned char *src = (const unsigned char *)string; *src != '\0'; src++) {
+        unsigned char ch = *src;
+        if (ch == '"' || ch == '\\') {
+            *dst++ = '\\';
+            *dst++ = (char)ch;
+        } else if (ch < 0x20) {
+            *dst++ = '\\';
+            *dst++ = 'u';
+            *dst++ = '0';
+            *dst++ = '0';
+            *dst++ = hexDigits[ch >> 4];
+            *dst++ = hexDigits[ch & 0xf];
+        } else {
+            *dst++ = (char)ch;
+        }
+    }
+    *dst = '\0';
+    *escapedLength = (int)(dst - escaped);
+    return escaped;
 }
 
-static int onIntegerElement(const char *const name, const int64_t value, void *const userData)
+/** Replace the contents of the string between `start` and `end` with its demangled form.
+ * Symbols containing escapes are left alone; mangled names never have any.
+ */
+static int demangleSymbol(FixupContext *context, int start, int end)
 {
-    FixupContext *context = (FixupContext *)userData;
-    int result = KSJSON_OK;
-    if (shouldFixDate(context, name)) {
-        char buffer[28];
+    int length = end - start;
+    const char *symbol = context->data + start;
+    if (context->demangle == NULL || length == 0 || memchr(symbol, '\\', (size_t)length) != NULL) {
+        return KSJSON_OK;
+    }
 
-        if (matchesMinVersion(context, 3, 3, 0)) {
-            ksdate_utcStringFromMicroseconds(value, buffer);
-        } else {
-            ksdate_utcStringFromTimestamp((time_t)value, buffer);
+    DemangleMemo *memo = &context->demangleMemo;
+    if (!reserveDemangleMemoEntry(memo)) {
+        return KSJSON_OK;
+    }
+    uint32_t hash = hashSymbol(symbol, length);
+    DemangleMemoEntry *entry = findDemangleMemoSlot(memo->entries, memo->capacity, symbol, length, hash);
+    if (entry->symbol == NULL) {
+        char *symbolCopy = strndup(symbol, (size_t)length);
+        if (symbolCopy == NULL) {
+            KSLOG_ERROR("Out of memory");
+            return KSJSON_OK;
+        }
+        char *demangled = context->demangle(symbolCopy);
+        if (demangled != NULL) {
+            entry->replacement = escapeJSONString(demangled, &entry->replacementLength);
+            free(demangled);
         }
+        entry->symbol = symbolCopy;
+        entry->symbolLength = length;
+        entry->hash = hash;
+        memo->count++;
+    }
 
-        result = ksjson_addStringElement(context->encodeContext, name, buffer, (int)strlen(buffer));
-    } else {
-        result = ksjson_addIntegerElement(context->encodeContext, name, value);
+    if (entry->replacement == NULL) {
+        return KSJSON_OK;
     }
-    return result;
+    return splice(context, start, end, entry->replacement, entry->replacementLength);
 }
 
-static int onUnsignedIntegerElement(const char *const name, const uint64_t value, void *const userData)
-{
-    FixupContext *context = (FixupContext *)userData;
-    return ksjson_addUIntegerElement(context->encodeContext, name, value);
-}
+static inline bool isWhitespace(char ch) { return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r'; }
+
+static inline bool isDelimiter(char ch) { return isWhitespace(ch) || ch == ',' || ch == '}' || ch == ']'; }
 
-static int onNullElement(const char *const name, void *const userData)
+static void skipWhitespace(FixupContext *context)
 {
-    FixupContext *context = (FixupContext *)userData;
-    return ksjson_addNullElement(context->encodeContext, name);
+    while (context->position < context->length && isWhitespace(context->data[context->position])) {
+        context->position++;
+    }
 }
 
-static int onStringElement(const char *const name, const char *const value, void *const userData)
+/** Scan past the string at the current position, returning the bounds of its (still escaped) contents. */
+static int scanString(FixupContext *context, int *contentStart, int *contentEnd)
 {
-    FixupContext *context = (FixupContext *)userData;
-    const char *stringValue = value;
-    int result = ksjson_addStringElement(context->encodeContext, name, stringValue, (int)strlen(stringValue));
-    if (shouldSaveVersion(context, name)) {
-        memset(context->reportVersionComponents, 0, sizeof(context->reportVersionComponents));
-        int versionPartsIndex = 0;
-        char *mutableValue = strdup(value);
-        char *versionPart = strtok(mutableValue, ".");
-        while (versionPart != NULL && versionPartsIndex < REPORT_VERSION_COMPONENTS_COUNT) {
-            context->reportVersionComponents[versionPartsIndex++] = atoi(versionPart);
-            versionPart = strtok(NULL, ".");
+    if (context->position >= context->length) {
+        return KSJSON_ERROR_INCOMPLETE;
+    }
+    if (context->data[context->position] != '"') {
+        return KSJSON_ERROR_INVALID_CHARACTER;
+    }
+    int start = context->position + 1;
+    int position = start;
+    for (;;) {
+        const char *quote = memchr(context->data + position, '"', (size_t)(context->length - position));
+        if (quote == NULL) {
+            return KSJSON_ERROR_INCOMPLETE;
+        }
+        int quotePosition = (int)(quote - context->data);
+        int backslashCount = 0;
+        while (quotePosition - backslashCount > start && context->data[quotePosition - backslashCount - 1] == '\\') {
+            backslashCount++;
+        }
+        if (backslashCount % 2 == 0) {
+            *contentStart = start;
+            *contentEnd = quotePosition;
+            context->position = quotePosition + 1;
+            return KSJSON_OK;
         }
-        free(mutableValue);
+        position = quotePosition + 1;
     }
-    return result;
 }
 
-static int onBeginObject(const char *const name, void *const userData)
+static int scanValue(FixupContext *context, const FixupPathNode *path);
+
+static int scanContainer(FixupContext *context, const FixupPathNode *path, bool isObject)
 {
-    FixupContext *context = (FixupContext *)userData;
-    int result = ksjson_beginObject(context->encodeContext, name);
-    if (!increaseDepth(context, name)) {
+    if (context->currentDepth >= MAX_DEPTH) {
         return KSJSON_ERROR_DATA_TOO_LONG;
     }
-    return result;
+    context->currentDepth++;
+    const char closingChar = isObject ? '}' : ']';
+    context->position++;
+    skipWhitespace(context);
+    if (context->position < context->length && context->data[context->position] == closingChar) {
+        context->position++;
+        context->currentDepth--;
+        return KSJSON_OK;
+    }
+
+    // All elements of an array share one path.
+    const FixupPathNode *arrayElementPath = isObject ? NULL : findChildPath(path, "", 0);
+    for (;;) {
+        int result;
+        const FixupPathNode *elementPath = arrayElementPath;
+        if (isObject) {
+            int nameStart = 0;
+            int nameEnd = 0;
+            if ((result = scanString(context, &nameStart, &nameEnd)) != KSJSON_OK) {
+                return result;
+            }
+            elementPath = findChildPath(path, context->data + nameStart, nameEnd - nameStart);
+            skipWhitespace(context);
+            if (context->position >= context->length) {
+                return KSJSON_ERROR_INCOMPLETE;
+            }
+            if (context->data[context->position] != ':') {
+                return KSJSON_ERROR_INVALID_CHARACTER;
+            }
+            context->position++;
+            skipWhitespace(context);
+        }
+        if ((result = scanValue(context, elementPath)) != KSJSON_OK) {
+            return result;
+        }
+
+        skipWhitespace(context);
+        if (context->position >= context->length) {
+            return KSJSON_ERROR_INCOMPLETE;
+        }
+        char ch = context->data[context->position++];
+        if (ch == closingChar) {
+            context->currentDepth--;
+            return KSJSON_OK;
+        }
+        if (ch != ',') {
+            return KSJSON_ERROR_INVALID_CHARACTER;
+        }
+        skipWhitespace(context);
+    }
 }
 
-static int onBeginArray(const char *const name, void *const userData)
+static int scanValue(FixupContext *context, const FixupPathNode *path)
 {
-    FixupContext *context = (FixupContext *)userData;
-    int result = ksjson_beginArray(context->encodeContext, name);
-    if (!increaseDepth(context, name)) {
-        return KSJSON_ERROR_DATA_TOO_LONG;
+    FixupAction action = path != NULL ? path->action : FixupActionNone;
+    if (context->position >= context->length) {
+        return KSJSON_ERROR_INCOMPLETE;
+    }
+    switch (context->data[context->position]) {
+        case '{':
+            return scanContainer(context, path, true);
+        case '[':
+            return scanContainer(context, path, false);
+        case '"': {
+            int start = 0;
+            int end = 0;
+            int result = scanString(context, &start, &end);
+            if (result != KSJSON_OK) {
+                return result;
+            }
+            if (action == FixupActionSaveVersion) {
+                saveVersion(context, context->data + start, end - start);
+            } else if (action == FixupActionDemangle) {
+                return demangleSymbol(context, start, end);
+            }
+            return KSJSON_OK;
+        }
+        default: {
+            int start = context->position;
+            while (context->position < context->length && !isDelimiter(context->data[context->position])) {
+                context->position++;
+            }
+            if (context->position == start) {
+                return KSJSON_ERROR_INVALID_CHARACTER;
+            }
+            if (action == FixupActionConvertDate) {
+                return fixDate(context, start, context->position);
+            }
+            return KSJSON_OK;
+        }
     }
-    return result;
 }
 
-static int onEndContainer(void *const userData)
+static int addJSONDataToBuffer(const char *data, int length, void *userData)
 {
-    FixupContext *context = (FixupContext *)userData;
-    int result = ksjson_endContainer(context->encodeContext);
-    if (!decreaseDepth(context)) {
-        // Do something;
+    BufferOutputContext *context = (BufferOutputContext *)userData;
+    if (context->length + length + 1 > context->capacity) {
+        int newCapacity = context->capacity;
+        while (context->length + length + 1 > newCapacity) {
+            newCapacity *= 2;
+        }
+        char *newData = realloc(context->data, (unsigned)newCapacity);
+        if (newData == NULL) {
+            KSLOG_ERROR("Out of memory");
+            return KSJSON_ERROR_CANNOT_ADD_DATA;
+        }
+        context->data = newData;
+        context->capacity = newCapacity;
     }
-    return result;
+    memcpy(context->data + context->length, data, (unsigned)length);
+    context->length += length;
+    return KSJSON_OK;
 }
 
-static int onEndData(__unused void *const userData)
+static bool flushStreamingOutput(StreamingOutputContext *context)
 {
-    FixupContext *context = (FixupContext *)userData;
-    return ksjson_endEncode(context->encodeContext);
+    if (context->position > 0 && !context->isCancelled) {
+        if (!context->output(context->buffer, context->position, context->userData)) {
+            context->isCancelled = true;
+        }
+    }
+    context->position = 0;
+    return !context->isCancelled;
 }
 
-static int addJSONData(const char *data, int length, void *userData)
+static int addJSONDataToStream(const char *data, int length, void *userData)
 {
-    FixupContext *context = (FixupContext *)userData;
-    if (length > context->outputBytesLeft) {
-        return KSJSON_ERROR_DATA_TOO_LONG;
+    StreamingOutputContext *context = (StreamingOutputContext *)userData;
+    if (length > (int)sizeof(context->buffer) - context->position) {
+        if (!flushStreamingOutput(context)) {
+            return KSJSON_ERROR_CANNOT_ADD_DATA;
+        }
     }
-    memcpy(context->outputPtr, data, length);
-    context->outputPtr += length;
-    context->outputBytesLeft -= length;
-
+    if (length > (int)sizeof(context->buffer)) {
+        // Too big to be worth buffering; hand it over as-is.
+        if (!context->output(data, length, context->userData)) {
+            context->isCancelled = true;
+            return KSJSON_ERROR_CANNOT_ADD_DATA;
+        }
+        return KSJSON_OK;
+    }
+    memcpy(context->buffer + context->position, data, length);
+    context->position += length;
     return KSJSON_OK;
 }
 
+static int fixupCrashReport(const char *crashReport, int crashReportLength, KSReportDemangleFunction demangle,
+                            KSJSONAddDataFunc addJSONData, void *addJSONDataUserData)
+{
+    FixupContext fixupContext = {
+        .data = crashReport,
+        .length = crashReportLength,
+        .position = 0,
+        .spanStart = 0,
+        .addJSONData = addJSONData,
+        .addJSONDataUserData = addJSONDataUserData,
+        .reportVersionComponents = { 0 },
+        .currentDepth = 0,
+        .demangle = demangle,
+        .demangleMemo = { 0 },
+    };
+
+    skipWhitespace(&fixupContext);
+    int result = scanValue(&fixupContext, &g_rootPath);
+    if (result == KSJSON_OK) {
+        skipWhitespace(&fixupContext);
+        if (fixupContext.position < fixupContext.length) {
+            result = KSJSON_ERROR_INVALID_DATA;
+        } else {
+            result = flushSpan(&fixupContext, fixupContext.length);
+        }
+    }
+    freeDemangleMemo(&fixupContext.demangleMemo);
+    return result;
+}
+
 char *kscrf_fixupCrashReport(const char *crashReport)
 {
     if (crashReport == NULL) {
         return NULL;
     }
 
-    KSJSONDecodeCallbacks callbacks = {
-        .onBeginArray = onBeginArray,
-        .onBeginObject = onBeginObject,
-        .onBooleanElement = onBooleanElement,
-        .onEndContainer = onEndContainer,
-        .onEndData = onEndData,
-        .onFloatingPointElement = onFloatingPointElement,
-        .onIntegerElement = onIntegerElement,
-        .onUnsignedIntegerElement = onUnsignedIntegerElement,
-        .onNullElement = onNullElement,
-        .onStringElement = onStringElement,
-    };
-    int stringBufferLength = 10000;
-    char *stringBuffer = malloc((unsigned)stringBufferLength);
     int crashReportLength = (int)strlen(crashReport);
-    int fixedReportLength = (int)(crashReportLength * 1.5);
-    char *fixedReport = malloc((unsigned)fixedReportLength);
-    KSJSONEncodeContext encodeContext;
-    FixupContext fixupContext = {
-        .encodeContext = &encodeContext,
-        .reportVersionComponents = { 0 },
-        .currentDepth = 0,
-        .outputPtr = fixedReport,
-        .outputBytesLeft = fixedReportLength,
-    };
-
-    ksjson_beginEncode(&encodeContext, true, addJSONData, &fixupContext);
+    // Fixed up dates are a little longer than the raw ones.
+    BufferOutputContext outputContext = { .data = NULL, .length = 0, .capacity = crashReportLength + 256 };
+    outputContext.data = malloc((unsigned)outputContext.capacity);
+    if (outputContext.data == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return NULL;
+    }
 
-    int errorOffset = 0;
-    int result = ksjson_decode(crashReport, (int)strlen(crashReport), stringBuffer, stringBufferLength, &callbacks,
-                               &fixupContext, &errorOffset);
-    *fixupContext.outputPtr = '\0';
-    free(stringBuffer);
+    int result = fixupCrashReport(crashReport, crashReportLength, NULL, addJSONDataToBuffer, &outputContext);
     if (result != KSJSON_OK) {
         KSLOG_ERROR("Could not decode report: %s", ksjson_stringForError(result));
-        free(fixedReport);
+        free(outputContext.data);
         return NULL;
     }
-    return fixedReport;
+    outputContext.data[outputContext.length] = '\0';
+    return outputContext.data;
+}
+
+bool kscrf_fixupCrashReportStreaming(const char *crashReport, int length, KSReportDemangleFunction demangleFunction,
+                                     KSCrashReportFixupOutputFunc output, void *userData)
+{
+    if (crashReport == NULL || output == NULL) {
+        return false;
+    }
+
+    StreamingOutputContext *outputContext = malloc(sizeof(*outputContext));
+    if (outputContext == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return false;
+    }
+    outputContext->output = output;
+    outputContext->userData = userData;
+    outputContext->position = 0;
+    outputContext->isCancelled = false;
+
+    int result = fixupCrashReport(crashReport, length, demangleFunction, addJSONDataToStream, outputContext);
+    if (result == KSJSON_OK && !flushStreamingOutput(outputContext)) {
+        result = KSJSON_ERROR_CANNOT_ADD_DATA;
+    }
+    bool isCancelled = outputContext->isCancelled;
+    free(outputContext);
+
+    if (isCancelled) {
+        KSLOG_DEBUG("Report fixup was cancelled by the output callback");
+        return false;
+    }
+    if (result != KSJSON_OK) {
+        KSLOG_ERROR("Could not decode report: %s", ksjson_stringForError(result));
+        return false;
+    }
+    return true;
 }
@@ -27,6 +27,10 @@
 #ifndef HDR_KSCrashReportFixer_h
 #define HDR_KSCrashReportFixer_h
 
+#include <stdbool.h>
+
+#include "KSCrashCConfiguration.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -42,6 +46,30 @@ extern "C" {
  */
 char *kscrf_fixupCrashReport(const char *crashReport);
 
+/** Receives a chunk of fixed up report data.
+ *
+ * @param data The chunk of UTF-8 JSON data. Only valid for the duration of the call.
+ * @param length The length of the chunk.
+ * @param userData User-specified contextual data.
+ *
+ * @return true to continue, false to stop the fixup process.
+ */
+typedef bool (*KSCrashReportFixupOutputFunc)(const char *data, int length, void *userData);
+
+/** Fixes up a crash report, passing the output to a callback in chunks rather
+ * than building it in memory. There is no upper limit on the output size.
+ *
+ * @param crashReport A raw report loaded from disk (need not be NUL terminated).
+ * @param length The length of the raw report.
+ * @param demangleFunction Function used to demangle symbol names, or NULL to leave them as they are.
+ * @param output The function to pass output chunks to.
+ * @param userData User-specified data which gets passed to output.
+ *
+ * @return true if the whole report was fixed up and passed to the callback.
+ */
+bool kscrf_fixupCrashReportStreaming(const char *crashReport, int length, KSReportDemangleFunction demangleFunction,
+                                     KSCrashReportFixupOutputFunc output, void *userData);
+
 #ifdef __cplusplus
 }
 #endif
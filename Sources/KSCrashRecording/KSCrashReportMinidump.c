@@ -0,0 +1,750 @@
+//
+//  KSCrashReportMinidump.c
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "KSCrashReportMinidump.h"
+
+#include "KSArena.h"
+#include "KSCPU.h"
+#include "KSDynamicLinker.h"
+#include "KSFileUtils.h"
+#include "KSMachineContext.h"
+#include "KSMemory.h"
+#include "KSSystemCapabilities.h"
+#include "KSThread.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if KSCRASH_HOST_APPLE
+#include <mach/exception_types.h>
+#endif
+
+// #define KSLogger_LocalLevel TRACE
+#include "KSLogger.h"
+
+// ============================================================================
+#pragma mark - Format -
+// ============================================================================
+
+#define kMinidumpSignature 0x504d444d  // "MDMP"
+#define kMinidumpVersion 0xa793
+#define kFixedFileInfoSignature 0xfeef04bd
+#define kCodeViewSignature 0x53445352  // "RSDS"
+
+enum {
+    MinidumpStream_ThreadList = 3,
+    MinidumpStream_ModuleList = 4,
+    MinidumpStream_MemoryList = 5,
+    MinidumpStream_Exception = 6,
+    MinidumpStream_SystemInfo = 7,
+    MinidumpStream_BreakpadInfo = 0x47670001,
+};
+#define kStreamCount 6
+
+enum {
+    MinidumpPlatform_MacOS = 0x8101,
+    MinidumpPlatform_IOS = 0x8102,
+    MinidumpPlatform_Linux = 0x8201,
+};
+
+/** The dump thread ID and requesting thread ID are both valid. */
+#define kBreakpadInfoValidity 3
+
+/** How much of each thread's stack to save, starting at the stack pointer. */
+#define kMaxStackSize (64 * 1024)
+
+/** How much memory to save around an address in a register of the crashed thread. */
+#define kRegisterMemorySize 256
+
+/** Memory is copied to the file through a buffer this big. */
+#define kMemoryChunkSize 1024
+
+/** Values below this are more likely to be numbers than addresses. */
+#define kMinPointerValue 4096
+
+// Structures in a minidump are packed to 4 bytes.
+#pragma pack(push, 4)
+
+typedef struct {
+    uint32_t dataSize;
+    uint32_t rva;
+} MinidumpLocation;
+
+typedef struct {
+    uint64_t startOfMemoryRange;
+    MinidumpLocation memory;
+} MinidumpMemoryDescriptor;
+
+typedef struct {
+    uint32_t signature;
+    uint32_t version;
+    uint32_t streamCount;
+    uint32_t streamDirectoryRva;
+    uint32_t checksum;
+    uint32_t timeDateStamp;
+    uint64_t flags;
+} MinidumpHeader;
+
+typedef struct {
+    uint32_t streamType;
+    MinidumpLocation location;
+} MinidumpDirectory;
+
+typedef struct {
+    uint32_t threadID;
+    uint32_t suspendCount;
+    uint32_t priorityClass;
+    uint32_t priority;
+    uint64_t teb;
+    MinidumpMemoryDescriptor stack;
+    MinidumpLocation threadContext;
+} MinidumpThread;
+
+typedef struct {
+    uint32_t signature;
+    uint32_t structVersion;
+    uint32_t fileVersionHigh;
+    uint32_t fileVersionLow;
+    uint32_t productVersionHigh;
+    uint32_t productVersionLow;
+    uint32_t fileFlagsMask;
+    uint32_t fileFlags;
+    uint32_t fileOS;
+    uint32_t fileType;
+    uint32_t fileSubtype;
+    uint32_t fileDateHigh;
+    uint32_t fileDateLow;
+} MinidumpFixedFileInfo;
+
+typedef struct {
+    uint64_t baseOfImage;
+    uint32_t sizeOfImage;
+    uint32_t checksum;
+    uint32_t timeDateStamp;
+    uint32_t moduleNameRva;
+    MinidumpFixedFileInfo versionInfo;
+    MinidumpLocation cvRecord;
+    MinidumpLocation miscRecord;
+    uint64_t reserved0;
+    uint64_t reserved1;
+} MinidumpModule;
+
+typedef struct {
+    uint32_t threadID;
+    uint32_t alignment;
+    uint32_t exceptionCode;
+    uint32_t exceptionFlags;
+    uint64_t exceptionRecord;
+    uint64_t exceptionAddress;
+    uint32_t numberParameters;
+    uint32_t unusedAlignment;
+    uint64_t exceptionInformation[15];
+    MinidumpLocation threadContext;
+} MinidumpException;
+
+typedef struct {
+    uint16_t processorArchitecture;
+    uint16_t processorLevel;
+    uint16_t processorRevision;
+    uint8_t numberOfProcessors;
+    uint8_t productType;
+    uint32_t majorVersion;
+    uint32_t minorVersion;
+    uint32_t buildNumber;
+    uint32_t platformID;
+    uint32_t csdVersionRva;
+    uint16_t suiteMask;
+    uint16_t reserved;
+    uint8_t cpuInformation[24];
+} MinidumpSystemInfo;
+
+typedef struct {
+    uint32_t validity;
+    uint32_t dumpThreadID;
+    uint32_t requestingThreadID;
+} MinidumpBreakpadInfo;
+
+/** Followed by the NUL terminated file name of the image. */
+typedef struct {
+    uint32_t signature;
+    uint8_t guid[16];
+    uint32_t age;
+} MinidumpCodeViewRecord;
+
+#pragma pack(pop)
+
+_Static_assert(sizeof(MinidumpHeader) == 32, "Minidump header size");
+_Static_assert(sizeof(MinidumpThread) == 48, "Minidump thread size");
+_Static_assert(sizeof(MinidumpModule) == 108, "Minidump module size");
+_Static_assert(sizeof(MinidumpException) == 168, "Minidump exception size");
+_Static_assert(sizeof(MinidumpSystemInfo) == 56, "Minidump system info size");
+
+// ============================================================================
+#pragma mark - Thread Context -
+// ============================================================================
+
+/** Where a register named by kscpu_registerName() goes in a minidump thread context. */
+typedef struct {
+    const char *name;
+    uint16_t offset;
+    uint8_t size;
+    bool isCodeAddress;
+} ContextRegister;
+
+#if defined(__x86_64__)
+
+#define kProcessorArchitecture 9  // AMD64
+#define kContextSize 1232
+#define kContextFlagsOffset 48
+#define kContextFlags 0x00100007  // AMD64 | control | integer | segments
+
+static const ContextRegister g_contextRegisters[] = {
+    { "cs", 56, 2, false },   { "fs", 62, 2, false },   { "gs", 64, 2, false },   { "rflags", 68, 4, false },
+    { "rax", 120, 8, false }, { "rcx", 128, 8, false }, { "rdx", 136, 8, false }, { "rbx", 144, 8, false },
+    { "rsp", 152, 8, false }, { "rbp", 160, 8, false }, { "rsi", 168, 8, false }, { "rdi", 176, 8, false },
+    { "r8", 184, 8, false },  { "r9", 192, 8, false },  { "r10", 200, 8, false }, { "r11", 208, 8, false },
+    { "r12", 216, 8, false }, { "r13", 224, 8, false }, { "r14", 232, 8, false }, { "r15", 240, 8, false },
+    { "rip", 248, 8, true },
+};
+
+#elif defined(__arm64__)
+
+#define kProcessorArchitecture 12  // ARM64
+#define kContextSize 912
+#define kContextFlagsOffset 0
+#define kContextFlags 0x00400003  // ARM64 | control | integer
+
+static const ContextRegister g_contextRegisters[] = {
+    { "cpsr", 4, 4, false }, { "x0", 8, 8, false },   { "x1", 16, 8, false },  { "x2", 24, 8, false },
+    { "x3", 32, 8, false },  { "x4", 40, 8, false },  { "x5", 48, 8, false },  { "x6", 56, 8, false },
+    { "x7", 64, 8, false },  { "x8", 72, 8, false },  { "x9", 80, 8, false },  { "x10", 88, 8, false },
+    { "x11", 96, 8, false }, { "x12", 104, 8, false }, { "x13", 112, 8, false }, { "x14", 120, 8, false },
+    { "x15", 128, 8, false }, { "x16", 136, 8, false }, { "x17", 144, 8, false }, { "x18", 152, 8, false },
+    { "x19", 160, 8, false }, { "x20", 168, 8, false }, { "x21", 176, 8, false }, { "x22", 184, 8, false },
+    { "x23", 192, 8, false }, { "x24", 200, 8, false }, { "x25", 208, 8, false }, { "x26", 216, 8, false },
+    { "x27", 224, 8, false }, { "x28", 232, 8, false }, { "fp", 240, 8, false },  { "lr", 248, 8, true },
+    { "sp", 256, 8, false }, { "pc", 264, 8, true },
+};
+
+#else
+
+#define kProcessorArchitecture 0xffff  // Unknown
+#define kContextSize 0
+
+#endif
+
+/** Fill out a minidump thread context from a machine context.
+ *
+ * @param machineContext The machine context to read registers from.
+ *
+ * @param context The thread context to fill out (kContextSize bytes).
+ */
+static void fillThreadContext(const struct KSMachineContext *const machineContext, uint8_t *context)
+{
+#if kContextSize > 0
+    memset(context, 0, kContextSize);
+    uint32_t flags = kContextFlags;
+    memcpy(context + kContextFlagsOffset, &flags, sizeof(flags));
+
+    const int registerCount = kscpu_numRegisters();
+    const int contextRegisterCount = (int)(sizeof(g_contextRegisters) / sizeof(*g_contextRegisters));
+    for (int i = 0; i < registerCount; i++) {
+        const char *name = kscpu_registerName(i);
+        for (int j = 0; name != NULL && j < contextRegisterCount; j++) {
+            const ContextRegister *contextRegister = &g_contextRegisters[j];
+            if (strcmp(name, contextRegister->name) == 0) {
+                uint64_t value = kscpu_registerValue(machineContext, i);
+                if (contextRegister->isCodeAddress) {
+                    value = kscpu_normaliseInstructionPointer((uintptr_t)value);
+                }
+                // All supported CPUs are little endian, so the low bytes come first.
+                memcpy(context + contextRegister->offset, &value, contextRegister->size);
+                break;
+            }
+        }
+    }
+#else
+    (void)machineContext;
+    (void)context;
+#endif
+}
+
+// ============================================================================
+#pragma mark - Writer -
+// ============================================================================
+
+typedef struct {
+    int fd;
+
+    /** Where the next appended data goes. */
+    uint32_t offset;
+
+    bool hasFailed;
+} MinidumpWriter;
+
+/** The memory that the memory list stream describes. */
+typedef struct {
+    MinidumpMemoryDescriptor *descriptors;
+    int count;
+    int capacity;
+} MemoryList;
+
+static bool writeAt(MinidumpWriter *writer, uint32_t rva, const void *data, uint32_t length)
+{
+    if (writer->hasFailed) {
+        return false;
+    }
+    if (lseek(writer->fd, (off_t)rva, SEEK_SET) < 0 || !ksfu_writeBytesToFD(writer->fd, data, (int)length)) {
+        KSLOG_ERROR("Could not write %u bytes at offset %u: %s", length, rva, strerror(errno));
+        writer->hasFailed = true;
+        return false;
+    }
+    return true;
+}
+
+/** Reserve space at the end of the file, to be written later. */
+static uint32_t reserve(MinidumpWriter *writer, uint32_t length)
+{
+    uint32_t rva = writer->offset;
+    writer->offset += (length + 7) & ~7u;
+    return rva;
+}
+
+static MinidumpLocation append(MinidumpWriter *writer, const void *data, uint32_t length)
+{
+    MinidumpLocation location = { .dataSize = length, .rva = reserve(writer, length) };
+    writeAt(writer, location.rva, data, length);
+    return location;
+}
+
+/** Decode one code point from a UTF-8 string. Malformed sequences decode as U+FFFD. */
+static uint32_t decodeUTF8(const uint8_t **cursor)
+{
+    const uint8_t *ptr = *cursor;
+    uint32_t codePoint = *ptr++;
+    int extraByteCount = 0;
+    if (codePoint < 0x80) {
+    } else if (codePoint >= 0xc0 && codePoint < 0xe0) {
+        codePoint &= 0x1f;
+        extraByteCount = 1;
+    } else if (codePoint >= 0xe0 && codePoint < 0xf0) {
+        codePoint &= 0x0f;
+        extraByteCount = 2;
+    } else if (codePoint >= 0xf0 && codePoint < 0xf8) {
+        codePoint &= 0x07;
+        extraByteCount = 3;
+    } else {
+        codePoint = 0xfffd;
+    }
+    for (; extraByteCount > 0; extraByteCount--) {
+        // This also stops at the terminator.
+        if ((*ptr & 0xc0) != 0x80) {
+            codePoint = 0xfffd;
+            break;
+        }
+        codePoint = (codePoint << 6) | (*ptr++ & 0x3f);
+    }
+    *cursor = ptr;
+    return codePoint > 0x10ffff ? 0xfffd : codePoint;
+}
+
+static int encodeUTF16(uint32_t codePoint, uint16_t *units)
+{
+    if (codePoint < 0x10000) {
+        units[0] = (uint16_t)codePoint;
+        return 1;
+    }
+    codePoint -= 0x10000;
+    units[0] = (uint16_t)(0xd800 | (codePoint >> 10));
+    units[1] = (uint16_t)(0xdc00 | (codePoint & 0x3ff));
+    return 2;
+}
+
+/** Append a string as a minidump string: its length in bytes, then UTF-16 with a terminator.
+ *
+ * @return The RVA of the string.
+ */
+static uint32_t appendString(MinidumpWriter *writer, const char *string)
+{
+    uint16_t units[128];
+    uint32_t byteCount = 0;
+    for (const uint8_t *ptr = (const uint8_t *)string; *ptr != 0;) {
+        byteCount += (uint32_t)encodeUTF16(decodeUTF8(&ptr), units) * sizeof(*units);
+    }
+
+    uint32_t rva = reserve(writer, (uint32_t)sizeof(byteCount) + byteCount + (uint32_t)sizeof(*units));
+    writeAt(writer, rva, &byteCount, sizeof(byteCount));
+    uint32_t offset = rva + (uint32_t)sizeof(byteCount);
+    uint32_t unitCount = 0;
+    for (const uint8_t *ptr = (const uint8_t *)string; *ptr != 0;) {
+        unitCount += (uint32_t)encodeUTF16(decodeUTF8(&ptr), units + unitCount);
+        if (unitCount >= sizeof(units) / sizeof(*units) - 2) {
+            writeAt(writer, offset, units, unitCount * (uint32_t)sizeof(*units));
+            offset += unitCount * (uint32_t)sizeof(*units);
+            unitCount = 0;
+        }
+    }
+    units[unitCount++] = 0;
+    writeAt(writer, offset, units, unitCount * (uint32_t)sizeof(*units));
+    return rva;
+}
+
+/** Append as much of a memory range as can be read, stopping at the first unreadable byte. */
+static MinidumpMemoryDescriptor appendMemory(MinidumpWriter *writer, uintptr_t address, uint32_t maxLength)
+{
+    MinidumpMemoryDescriptor descriptor = { .startOfMemoryRange = address, .memory = { 0, writer->offset } };
+    uint8_t buffer[kMemoryChunkSize];
+    while (descriptor.memory.dataSize < maxLength) {
+        uint32_t length = maxLength - descriptor.memory.dataSize;
+        if (length > sizeof(buffer)) {
+            length = sizeof(buffer);
+        }
+        int copied =
+            ksmem_copyMaxPossible((const void *)(address + descriptor.memory.dataSize), buffer, (int)length);
+        if (copied <= 0 ||
+            !writeAt(writer, descriptor.memory.rva + descriptor.memory.dataSize, buffer, (uint32_t)copied)) {
+            break;
+        }
+        descriptor.memory.dataSize += (uint32_t)copied;
+        if ((uint32_t)copied < length) {
+            break;
+        }
+    }
+    reserve(writer, descriptor.memory.dataSize);
+    return descriptor;
+}
+
+static bool isInMemoryList(const MemoryList *memoryList, uint64_t start, uint64_t end)
+{
+    for (int i = 0; i < memoryList->count; i++) {
+        const MinidumpMemoryDescriptor *descriptor = &memoryList->descriptors[i];
+        uint64_t descriptorEnd = descriptor->startOfMemoryRange + descriptor->memory.dataSize;
+        if (start < descriptorEnd && descriptor->startOfMemoryRange < end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void addToMemoryList(MemoryList *memoryList, MinidumpMemoryDescriptor descriptor)
+{
+    if (descriptor.memory.dataSize > 0 && memoryList->count < memoryList->capacity) {
+        memoryList->descriptors[memoryList->count++] = descriptor;
+    }
+}
+
+// ============================================================================
+#pragma mark - Streams -
+// ============================================================================
+
+/** Save the memory around the addresses in the crashed thread's registers,
+ * including the code around its instruction pointer.
+ */
+static void appendRegisterMemory(MinidumpWriter *writer, const struct KSMachineContext *const machineContext,
+                                 MemoryList *memoryList)
+{
+    const int registerCount = kscpu_numRegisters();
+    for (int i = 0; i < registerCount && memoryList->count < memoryList->capacity; i++) {
+        uintptr_t address = kscpu_normaliseInstructionPointer((uintptr_t)kscpu_registerValue(machineContext, i));
+        if (address < kMinPointerValue) {
+            continue;
+        }
+        uintptr_t start = address - kRegisterMemorySize / 2;
+        if (isInMemoryList(memoryList, start, start + kRegisterMemorySize)) {
+            continue;
+        }
+        MinidumpMemoryDescriptor descriptor = appendMemory(writer, start, kRegisterMemorySize);
+        if (descriptor.memory.dataSize == 0) {
+            // The address may be at the start of a readable region.
+            descriptor = appendMemory(writer, address, kRegisterMemorySize / 2);
+        }
+        addToMemoryList(memoryList, descriptor);
+    }
+}
+
+static MinidumpDirectory writeThreadList(MinidumpWriter *writer, const KSCrash_MonitorContext *const crash,
+                                         MemoryList *memoryList, MinidumpLocation *crashedThreadContext)
+{
+    const struct KSMachineContext *const context = crash->offendingMachineContext;
+    KSThread offendingThread = ksmc_getThreadFromContext(context);
+    // Without a thread list (the environment wasn't suspended), only the offending thread is written.
+    uint32_t threadCount = (uint32_t)ksmc_getThreadCount(context);
+    bool hasThreadList = threadCount > 0;
+    if (!hasThreadList) {
+        threadCount = 1;
+    }
+    KSMC_NEW_CONTEXT(machineContext);
+    uint8_t threadContext[kContextSize > 0 ? kContextSize : 1];
+
+    uint32_t listSize = (uint32_t)sizeof(threadCount) + threadCount * (uint32_t)sizeof(MinidumpThread);
+    uint32_t rva = reserve(writer, listSize);
+    writeAt(writer, rva, &threadCount, sizeof(threadCount));
+    for (uint32_t i = 0; i < threadCount; i++) {
+        KSThread thread = hasThreadList ? ksmc_getThreadAtIndex(context, (int)i) : offendingThread;
+        const struct KSMachineContext *threadMachineContext = context;
+        if (thread != offendingThread) {
+            threadMachineContext = ksmc_getContextForThread(thread, machineContext, false) ? machineContext : NULL;
+        }
+
+        MinidumpThread entry = { .threadID = (uint32_t)thread };
+        if (threadMachineContext != NULL) {
+            if (kContextSize > 0) {
+                fillThreadContext(threadMachineContext, threadContext);
+                entry.threadContext = append(writer, threadContext, kContextSize);
+            }
+            entry.stack = appendMemory(writer, kscpu_stackPointer(threadMachineContext), kMaxStackSize);
+            addToMemoryList(memoryList, entry.stack);
+        }
+        if (thread == offendingThread) {
+            *crashedThreadContext = entry.threadContext;
+        }
+        writeAt(writer, rva + (uint32_t)sizeof(threadCount) + i * (uint32_t)sizeof(entry), &entry, sizeof(entry));
+    }
+
+    // Stacks go first, so that memory around registers that point into a stack isn't saved twice.
+    appendRegisterMemory(writer, context, memoryList);
+
+    return (MinidumpDirectory) {
+        .streamType = MinidumpStream_ThreadList,
+        .location = { .dataSize = listSize, .rva = rva },
+    };
+}
+
+/** The GUID is the image UUID, with its first three fields read as big endian,
+ * the same way Breakpad's Mac dumper does it. Symbol servers then see the UUID
+ * as the debug ID.
+ */
+static MinidumpLocation appendCodeViewRecord(MinidumpWriter *writer, const KSBinaryImage *const image)
+{
+    MinidumpLocation location = { 0 };
+    if (image->uuid == NULL) {
+        return location;
+    }
+    MinidumpCodeViewRecord record = { .signature = kCodeViewSignature };
+    const uint8_t *uuid = image->uuid;
+    uint32_t data1 = (uint32_t)uuid[0] << 24 | (uint32_t)uuid[1] << 16 | (uint32_t)uuid[2] << 8 | uuid[3];
+    uint16_t data2 = (uint16_t)(uuid[4] << 8 | uuid[5]);
+    uint16_t data3 = (uint16_t)(uuid[6] << 8 | uuid[7]);
+    memcpy(record.guid, &data1, sizeof(data1));
+    memcpy(record.guid + 4, &data2, sizeof(data2));
+    memcpy(record.guid + 6, &data3, sizeof(data3));
+    memcpy(record.guid + 8, uuid + 8, 8);
+
+    const char *fileName = image->name != NULL ? ksfu_lastPathEntry(image->name) : "";
+    uint32_t fileNameLength = (uint32_t)strlen(fileName) + 1;
+    location.dataSize = (uint32_t)sizeof(record) + fileNameLength;
+    location.rva = reserve(writer, location.dataSize);
+    writeAt(writer, location.rva, &record, sizeof(record));
+    writeAt(writer, location.rva + (uint32_t)sizeof(record), fileName, fileNameLength);
+    return location;
+}
+
+static MinidumpDirectory writeModuleList(MinidumpWriter *writer)
+{
+    uint32_t imageCount = (uint32_t)ksdl_imageCount();
+    uint32_t rva = reserve(writer, (uint32_t)sizeof(imageCount) + imageCount * (uint32_t)sizeof(MinidumpModule));
+    uint32_t moduleCount = 0;
+    for (uint32_t i = 0; i < imageCount; i++) {
+        KSBinaryImage image = { 0 };
+        if (!ksdl_getBinaryImage((int)i, &image)) {
+            continue;
+        }
+        uint32_t fileVersionHigh = (uint32_t)(image.majorVersion << 16 | (image.minorVersion & 0xffff));
+        uint32_t fileVersionLow = (uint32_t)(image.revisionVersion << 16);
+        MinidumpModule module = {
+            .baseOfImage = image.address,
+            .sizeOfImage = (uint32_t)image.size,
+            .moduleNameRva = appendString(writer, image.name != NULL ? image.name : ""),
+            .versionInfo = {
+                .signature = kFixedFileInfoSignature,
+                .structVersion = 0x00010000,
+                .fileVersionHigh = fileVersionHigh,
+                .fileVersionLow = fileVersionLow,
+                .productVersionHigh = fileVersionHigh,
+                .productVersionLow = fileVersionLow,
+            },
+            .cvRecord = appendCodeViewRecord(writer, &image),
+        };
+        writeAt(writer, rva + (uint32_t)sizeof(moduleCount) + moduleCount * (uint32_t)sizeof(module), &module,
+                sizeof(module));
+        moduleCount++;
+    }
+    writeAt(writer, rva, &moduleCount, sizeof(moduleCount));
+
+    return (MinidumpDirectory) {
+        .streamType = MinidumpStream_ModuleList,
+        .location = { .dataSize = (uint32_t)sizeof(moduleCount) + moduleCount * (uint32_t)sizeof(MinidumpModule),
+                      .rva = rva },
+    };
+}
+
+static MinidumpDirectory writeMemoryList(MinidumpWriter *writer, const MemoryList *memoryList)
+{
+    uint32_t count = (uint32_t)memoryList->count;
+    uint32_t listSize = (uint32_t)sizeof(count) + count * (uint32_t)sizeof(*memoryList->descriptors);
+    uint32_t rva = reserve(writer, listSize);
+    writeAt(writer, rva, &count, sizeof(count));
+    if (count > 0) {
+        writeAt(writer, rva + (uint32_t)sizeof(count), memoryList->descriptors,
+                count * (uint32_t)sizeof(*memoryList->descriptors));
+    }
+    return (MinidumpDirectory) {
+        .streamType = MinidumpStream_MemoryList,
+        .location = { .dataSize = listSize, .rva = rva },
+    };
+}
+
+static MinidumpDirectory writeException(MinidumpWriter *writer, const KSCrash_MonitorContext *const crash,
+                                        MinidumpLocation crashedThreadContext)
+{
+    MinidumpException exception = {
+        .threadID = (uint32_t)ksmc_getThreadFromContext(crash->offendingMachineContext),
+        .exceptionAddress = crash->faultAddress,
+        .threadContext = crashedThreadContext,
+    };
+#if KSCRASH_HOST_APPLE
+    // Minidump processors read the code as a Mach exception type.
+    if (crash->mach.type != 0) {
+        exception.exceptionCode = (uint32_t)crash->mach.type;
+        exception.exceptionFlags = (uint32_t)crash->mach.code;
+    } else {
+        exception.exceptionCode = EXC_SOFTWARE;
+        exception.exceptionFlags = EXC_SOFT_SIGNAL;
+        exception.numberParameters = 1;
+        exception.exceptionInformation[0] = (uint64_t)crash->signal.signum;
+    }
+#else
+    exception.exceptionCode = (uint32_t)crash->signal.signum;
+    exception.exceptionFlags = (uint32_t)crash->signal.sigcode;
+#endif
+    return (MinidumpDirectory) {
+        .streamType = MinidumpStream_Exception,
+        .location = append(writer, &exception, sizeof(exception)),
+    };
+}
+
+/** Parse the next number from a version string like "17.4.1", and skip the dot after it. */
+static uint32_t parseVersionComponent(const char **version)
+{
+    uint32_t value = 0;
+    const char *ptr = *version;
+    for (; *ptr >= '0' && *ptr <= '9'; ptr++) {
+        value = value * 10 + (uint32_t)(*ptr - '0');
+    }
+    if (*ptr == '.') {
+        ptr++;
+    }
+    *version = ptr;
+    return value;
+}
+
+static MinidumpDirectory writeSystemInfo(MinidumpWriter *writer, const KSCrash_MonitorContext *const crash)
+{
+    long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+    MinidumpSystemInfo systemInfo = {
+        .processorArchitecture = kProcessorArchitecture,
+        .numberOfProcessors = (uint8_t)(processorCount > 0 && processorCount < 256 ? processorCount : 0),
+#if KSCRASH_HOST_MAC
+        .platformID = MinidumpPlatform_MacOS,
+#elif KSCRASH_HOST_APPLE
+        .platformID = MinidumpPlatform_IOS,
+#else
+        .platformID = MinidumpPlatform_Linux,
+#endif
+    };
+    const char *version = crash->System.systemVersion != NULL ? crash->System.systemVersion : "";
+    systemInfo.majorVersion = parseVersionComponent(&version);
+    systemInfo.minorVersion = parseVersionComponent(&version);
+    systemInfo.buildNumber = parseVersionComponent(&version);
+    systemInfo.csdVersionRva = appendString(writer, crash->System.osVersion != NULL ? crash->System.osVersion : "");
+
+    return (MinidumpDirectory) {
+        .streamType = MinidumpStream_SystemInfo,
+        .location = append(writer, &systemInfo, sizeof(systemInfo)),
+    };
+}
+
+static MinidumpDirectory writeBreakpadInfo(MinidumpWriter *writer, const KSCrash_MonitorContext *const crash)
+{
+    MinidumpBreakpadInfo info = {
+        .validity = kBreakpadInfoValidity,
+        .dumpThreadID = (uint32_t)ksthread_self(),
+        .requestingThreadID = (uint32_t)ksmc_getThreadFromContext(crash->offendingMachineContext),
+    };
+    return (MinidumpDirectory) {
+        .streamType = MinidumpStream_BreakpadInfo,
+        .location = append(writer, &info, sizeof(info)),
+    };
+}
+
+// ============================================================================
+#pragma mark - API -
+// ============================================================================
+
+bool kscrashreport_writeMinidump(const KSCrash_MonitorContext *const monitorContext, const char *const path)
+{
+    KSLOG_INFO("Writing minidump to %s", path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        KSLOG_ERROR("Could not open minidump file %s: %s", path, strerror(errno));
+        return false;
+    }
+    KSArenaScope arenaScope;
+    ksarena_beginScope(&arenaScope, monitorContext->handlingCrash);
+
+    MinidumpWriter writer = { .fd = fd };
+    reserve(&writer, sizeof(MinidumpHeader));
+    MinidumpDirectory directory[kStreamCount];
+    uint32_t directoryRva = reserve(&writer, sizeof(directory));
+
+    MemoryList memoryList = { 0 };
+    int capacity = ksmc_getThreadCount(monitorContext->offendingMachineContext) + kscpu_numRegisters() + 1;
+    memoryList.descriptors = ksarena_alloc((size_t)capacity * sizeof(*memoryList.descriptors));
+    memoryList.capacity = memoryList.descriptors != NULL ? capacity : 0;
+
+    MinidumpLocation crashedThreadContext = { 0 };
+    directory[0] = writeThreadList(&writer, monitorContext, &memoryList, &crashedThreadContext);
+    directory[1] = writeMemoryList(&writer, &memoryList);
+    directory[2] = writeModuleList(&writer);
+    directory[3] = writeException(&writer, monitorContext, crashedThreadContext);
+    directory[4] = writeSystemInfo(&writer, monitorContext);
+    directory[5] = writeBreakpadInfo(&writer, monitorContext);
+
+    // The header goes in last, so that a dump that was cut short isn't mistaken for a valid one.
+    writeAt(&writer, directoryRva, directory, sizeof(directory));
+    MinidumpHeader header = {
+        .signature = kMinidumpSignature,
+        .version = kMinidumpVersion,
+        .streamCount = kStreamCount,
+        .streamDirectoryRva = directoryRva,
+        .timeDateStamp = (uint32_t)time(NULL),
+    };
+    writeAt(&writer, 0, &header, sizeof(header));
+
+    close(fd);
+    ksarena_endScope(&arenaScope);
+    return !writer.hasFailed;
+}
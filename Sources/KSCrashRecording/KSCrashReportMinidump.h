@@ -0,0 +1,63 @@
+//
+//  KSCrashReportMinidump.h
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+/* Writes a crash as a minidump, so that it can be processed by minidump
+ * tooling (Breakpad, Crashpad, LLDB) alongside the JSON report.
+ */
+
+#ifndef HDR_KSCrashReportMinidump_h
+#define HDR_KSCrashReportMinidump_h
+
+#include <stdbool.h>
+
+#include "KSCrashMonitorContext.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Write a minidump of the crash to a file.
+ *
+ * The dump holds the thread list with each thread's registers and stack,
+ * the loaded images, the exception, the system info, and the memory around
+ * the crashed thread's instruction pointer and the addresses in its registers.
+ * It is written directly from the crash handler, without calling malloc.
+ *
+ * Thread contexts are only written on x86_64 and arm64. On other CPUs the
+ * threads are listed without contexts.
+ *
+ * @param monitorContext Contextual information about the crash and environment.
+ *                       The caller must fill this out before passing it in.
+ *
+ * @param path The file to write to.
+ *
+ * @return true if the minidump was written.
+ */
+bool kscrashreport_writeMinidump(const KSCrash_MonitorContext *const monitorContext, const char *const path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HDR_KSCrashReportMinidump_h
@@ -32,6 +32,7 @@
 #import "KSCrashReportFields.h"
 #import "KSCrashReportFilter.h"
 #import "KSCrashReportStoreC.h"
+#import "KSDate.h"
 #import "KSJSONCodecObjC.h"
 #import "KSNSErrorHelper.h"
 
@@ -135,11 +136,18 @@
                 }];
 }
 
+static bool appendReportData(const char *data, int length, void *userData)
+{
+    NSMutableData *reportData = (__bridge NSMutableData *)userData;
+    [reportData appendBytes:data length:(NSUInteger)length];
+    return true;
+}
+
 - (NSData *)loadCrashReportJSONWithID:(int64_t)reportID
 {
-    char *report = kscrs_readReport(reportID, &_cConfig);
-    if (report != NULL) {
-        return [NSData dataWithBytesNoCopy:report length:strlen(report) freeWhenDone:YES];
+    NSMutableData *reportData = [NSMutableData data];
+    if (kscrs_readReportStreaming(reportID, appendReportData, (__bridge void *)reportData, &_cConfig)) {
+        return reportData;
     }
     return nil;
 }
@@ -162,7 +170,11 @@
     if (jsonData == nil) {
         return nil;
     }
+    return [self reportWithJSONData:jsonData reportID:reportID];
+}
 
+- (KSCrashReportDictionary *)reportWithJSONData:(NSData *)jsonData reportID:(int64_t)reportID
+{
     NSError *error = nil;
     NSMutableDictionary *crashReport =
         [KSJSONCodec decode:jsonData
@@ -177,21 +189,60 @@
         return nil;
     }
 
+    NSArray *occurrences = [self occurrencesForReportID:reportID];
+    if (occurrences.count > 0) {
+        crashReport[KSCrashField_Occurrences] = occurrences;
+    }
+
     return [KSCrashReportDictionary reportWithValue:crashReport];
 }
 
+- (NSArray<NSDictionary *> *)occurrencesForReportID:(int64_t)reportID
+{
+    int count = kscrs_getOccurrenceCount(reportID, &_cConfig);
+    if (count <= 0) {
+        return nil;
+    }
+    KSCrashReportOccurrence occurrencesC[count];
+    count = kscrs_getOccurrences(reportID, occurrencesC, count, &_cConfig);
+    NSMutableArray *occurrences = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    for (int i = 0; i < count; i++) {
+        char timestamp[28];
+        ksdate_utcStringFromMicroseconds(occurrencesC[i].timestamp, timestamp);
+        [occurrences addObject:@{
+            KSCrashField_ID : @(occurrencesC[i].reportID),
+            KSCrashField_Timestamp : [NSString stringWithUTF8String:timestamp],
+        }];
+    }
+    return [occurrences copy];
+}
+
 - (NSArray<KSCrashReportDictionary *> *)allReports
 {
     int reportCount = kscrs_getReportCount(&_cConfig);
+    if (reportCount <= 0) {
+        return @[];
+    }
     int64_t reportIDs[reportCount];
     reportCount = kscrs_getReportIDs(reportIDs, reportCount, &_cConfig);
+    char **rawReports = calloc((size_t)reportCount, sizeof(*rawReports));
+    if (rawReports == NULL) {
+        return @[];
+    }
+    kscrs_readReports(reportIDs, reportCount, rawReports, &_cConfig);
+
     NSMutableArray<KSCrashReportDictionary *> *reports = [NSMutableArray arrayWithCapacity:(NSUInteger)reportCount];
     for (int i = 0; i < reportCount; i++) {
-        KSCrashReportDictionary *report = [self reportForID:reportIDs[i]];
+        if (rawReports[i] == NULL) {
+            continue;
+        }
+        NSData *jsonData = [NSData dataWithBytesNoCopy:rawReports[i] length:strlen(rawReports[i]) freeWhenDone:YES];
+        KSCrashReportDictionary *report = [self reportWithJSONData:jsonData reportID:reportIDs[i]];
         if (report != nil) {
             [reports addObject:report];
         }
     }
+    free(rawReports);
 
     return reports;
 }
@@ -44,6 +44,10 @@ extern "C" {
 int64_t kscrs_getNextCrashReport(char *crashReportPathBuffer,
                                  const KSCrashReportStoreCConfiguration *const configuration);
 
+/** Block until all store maintenance scheduled by kscrs_initialize() has completed.
+ */
+void kscrs_waitForMaintenance(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,21 +30,54 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "KSCrashReportFields.h"
 #include "KSCrashReportFixer.h"
 #include "KSCrashReportStoreC+Private.h"
 #include "KSFileUtils.h"
+#include "KSJSONCodec.h"
 #include "KSLogger.h"
+#include "KSSystemCapabilities.h"
+
+#if KSCRASH_HOST_LINUX
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
 
 // Have to use max 32-bit atomics because of MIPS.
 static _Atomic(uint32_t) g_nextUniqueIDLow;
 static int64_t g_nextUniqueIDHigh;
 static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/** Upper bound on the number of threads used by kscrs_readReports(). */
+#define KSCRS_MAX_BATCH_READ_THREADS 8
+
+/** How much of a report to read when looking for its fingerprint. */
+#define KSCRS_REPORT_HEAD_LENGTH 4096
+
+#define KSCRS_FINGERPRINT_LENGTH 16
+
+/** How many file operations store maintenance performs before letting other store users in. */
+#define KSCRS_MAINTENANCE_WORK_BUDGET 16
+
+/** How many reports kscrs_readReports() hands to batched file I/O at once. */
+#define KSCRS_BATCH_IO_REPORTS 64
+
+/** Upper bound on reports waiting for a group commit. Each one holds an open file descriptor. */
+#define KSCRS_MAX_PENDING_REPORTS 256
+
+/** Nice value for the maintenance thread where there are no QoS classes (roughly QOS_CLASS_UTILITY). */
+#define KSCRS_MAINTENANCE_NICENESS 10
+
 static int compareInt64(const void *a, const void *b)
 {
     int64_t diff = *(int64_t *)a - *(int64_t *)b;
@@ -56,6 +89,22 @@ static int compareInt64(const void *a, const void *b)
     return 0;
 }
 
+/** Count one unit of maintenance work. Once the budget is spent, release the store lock
+ * briefly so that adds, reads and deletes are not held up behind a long maintenance pass.
+ *
+ * Must be called with g_mutex held. A NULL workDone means the caller is not maintenance.
+ */
+static void spendMaintenanceBudget(int *workDone)
+{
+    if (workDone == NULL || ++*workDone < KSCRS_MAINTENANCE_WORK_BUDGET) {
+        return;
+    }
+    *workDone = 0;
+    pthread_mutex_unlock(&g_mutex);
+    sched_yield();
+    pthread_mutex_lock(&g_mutex);
+}
+
 static inline int64_t getNextUniqueID(void) { return g_nextUniqueIDHigh + g_nextUniqueIDLow++; }
 
 static void getCrashReportPathByID(int64_t id, char *pathBuffer, const KSCrashReportStoreCConfiguration *const config)
@@ -63,16 +112,44 @@ static void getCrashReportPathByID(int64_t id, char *pathBuffer, const KSCrashRe
     snprintf(pathBuffer, KSCRS_MAX_PATH_LENGTH, "%s/%s-report-%016llx.json", config->reportsPath, config->appName, id);
 }
 
-static int64_t getReportIDFromFilename(const char *filename, const KSCrashReportStoreCConfiguration *const config)
+static void getOccurrencesPathByID(int64_t id, char *pathBuffer, const KSCrashReportStoreCConfiguration *const config)
+{
+    snprintf(pathBuffer, KSCRS_MAX_PATH_LENGTH, "%s/%s-occurrences-%016llx.bin", config->reportsPath, config->appName,
+             id);
+}
+
+/** A minidump written next to the report, if minidumps are enabled. */
+static void getMinidumpPathByID(int64_t id, char *pathBuffer, const KSCrashReportStoreCConfiguration *const config)
+{
+    snprintf(pathBuffer, KSCRS_MAX_PATH_LENGTH, "%s/%s-report-%016llx.dmp", config->reportsPath, config->appName, id);
+}
+
+/** Reports that are not yet durable live here until they are renamed to their report path. */
+static void getPendingPathByID(int64_t id, char *pathBuffer, const KSCrashReportStoreCConfiguration *const config)
+{
+    snprintf(pathBuffer, KSCRS_MAX_PATH_LENGTH, "%s/%s-pending-%016llx.json", config->reportsPath, config->appName, id);
+}
+
+static int64_t getIDFromFilename(const char *filename, const char *kind,
+                                 const KSCrashReportStoreCConfiguration *const config)
 {
     char scanFormat[100];
-    sprintf(scanFormat, "%s-report-%%" PRIx64 ".json", config->appName);
+    snprintf(scanFormat, sizeof(scanFormat), "%s-%s-%%" PRIx64 ".json%%n", config->appName, kind);
 
+    // The whole name has to match, so that files next to a report (like its minidump) aren't taken for it.
     int64_t reportID = 0;
-    sscanf(filename, scanFormat, &reportID);
+    int matchedLength = 0;
+    if (sscanf(filename, scanFormat, &reportID, &matchedLength) < 1 || filename[matchedLength] != '\0') {
+        return 0;
+    }
     return reportID;
 }
 
+static int64_t getReportIDFromFilename(const char *filename, const KSCrashReportStoreCConfiguration *const config)
+{
+    return getIDFromFilename(filename, "report", config);
+}
+
 static int getReportCount(const KSCrashReportStoreCConfiguration *const config)
 {
     int count = 0;
@@ -112,7 +189,7 @@ static int getReportIDs(int64_t *reportIDs, int count, const KSCrashReportStoreC
         }
     }
 
-    qsort(reportIDs, (unsigned)count, sizeof(reportIDs[0]), compareInt64);
+    qsort(reportIDs, (unsigned)index, sizeof(reportIDs[0]), compareInt64);
 
 done:
     if (dir != NULL) {
@@ -126,23 +203,926 @@ static void deleteReportWithID(int64_t reportID, const KSCrashReportStoreCConfig
     char path[KSCRS_MAX_PATH_LENGTH];
     getCrashReportPathByID(reportID, path, config);
     ksfu_removeFile(path, true);
+    getOccurrencesPathByID(reportID, path, config);
+    ksfu_removeFile(path, false);
+    getMinidumpPathByID(reportID, path, config);
+    ksfu_removeFile(path, false);
+}
+
+// ============================================================================
+#pragma mark - Fingerprint deduplication -
+// ============================================================================
+
+typedef struct {
+    int depth;
+    bool isInReportInfo;
+    bool isReportInfoDone;
+    char fingerprint[KSCRS_FINGERPRINT_LENGTH + 1];
+    int64_t timestamp;
+} ReportHeadContext;
+
+static int head_onBeginContainer(const char *const name, void *const userData)
+{
+    ReportHeadContext *context = (ReportHeadContext *)userData;
+    context->depth++;
+    if (context->depth == 2 && name != NULL && strcmp(name, KSCrashField_Report) == 0) {
+        context->isInReportInfo = true;
+    }
+    return KSJSON_OK;
+}
+
+static int head_onEndContainer(void *const userData)
+{
+    ReportHeadContext *context = (ReportHeadContext *)userData;
+    if (context->isInReportInfo && context->depth == 2) {
+        // Everything we need comes before this point.
+        context->isReportInfoDone = true;
+        return KSJSON_ERROR_INVALID_DATA;
+    }
+    context->depth--;
+    return KSJSON_OK;
+}
+
+static int head_onIntegerElement(const char *const name, const int64_t value, void *const userData)
+{
+    ReportHeadContext *context = (ReportHeadContext *)userData;
+    if (context->isInReportInfo && context->depth == 2 && strcmp(name, KSCrashField_Timestamp) == 0) {
+        context->timestamp = value;
+    }
+    return KSJSON_OK;
+}
+
+static int head_onStringElement(const char *const name, const char *const value, void *const userData)
+{
+    ReportHeadContext *context = (ReportHeadContext *)userData;
+    if (context->isInReportInfo && context->depth == 2 && strcmp(name, KSCrashField_Fingerprint) == 0) {
+        strncpy(context->fingerprint, value, KSCRS_FINGERPRINT_LENGTH);
+        context->fingerprint[KSCRS_FINGERPRINT_LENGTH] = '\0';
+    }
+    return KSJSON_OK;
+}
+
+static int head_onNullElement(__unused const char *const name, __unused void *const userData) { return KSJSON_OK; }
+
+static int head_onBooleanElement(__unused const char *const name, __unused const bool value,
+                                 __unused void *const userData)
+{
+    return KSJSON_OK;
+}
+
+static int head_onFloatingPointElement(__unused const char *const name, __unused const double value,
+                                       __unused void *const userData)
+{
+    return KSJSON_OK;
 }
 
-static void pruneReports(const KSCrashReportStoreCConfiguration *const config)
+static int head_onUnsignedIntegerElement(__unused const char *const name, __unused const uint64_t value,
+                                         __unused void *const userData)
 {
-    if (config->maxReportCount <= 0) {
+    return KSJSON_OK;
+}
+
+static int head_onEndData(__unused void *const userData) { return KSJSON_OK; }
+
+/** Read the fingerprint and timestamp from the report info section at the start of a report.
+ *
+ * @return true if the report has a fingerprint.
+ */
+static bool readReportFingerprint(int64_t reportID, ReportHeadContext *context,
+                                  const KSCrashReportStoreCConfiguration *const config)
+{
+    char path[KSCRS_MAX_PATH_LENGTH];
+    getCrashReportPathByID(reportID, path, config);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        KSLOG_ERROR("Could not open file %s: %s", path, strerror(errno));
+        return false;
+    }
+    char head[KSCRS_REPORT_HEAD_LENGTH];
+    int headLength = (int)read(fd, head, sizeof(head));
+    close(fd);
+    if (headLength <= 0) {
+        return false;
+    }
+
+    KSJSONDecodeCallbacks callbacks = {
+        .onBeginArray = head_onBeginContainer,
+        .onBeginObject = head_onBeginContainer,
+        .onBooleanElement = head_onBooleanElement,
+        .onEndContainer = head_onEndContainer,
+        .onEndData = head_onEndData,
+        .onFloatingPointElement = head_onFloatingPointElement,
+        .onIntegerElement = head_onIntegerElement,
+        .onUnsignedIntegerElement = head_onUnsignedIntegerElement,
+        .onNullElement = head_onNullElement,
+        .onStringElement = head_onStringElement,
+    };
+    memset(context, 0, sizeof(*context));
+    char stringBuffer[1000];
+    int errorOffset = 0;
+    ksjson_decode(head, headLength, stringBuffer, sizeof(stringBuffer), &callbacks, context, &errorOffset);
+    return context->isReportInfoDone && context->fingerprint[0] != '\0';
+}
+
+static bool reportExists(int64_t reportID, const KSCrashReportStoreCConfiguration *const config)
+{
+    char path[KSCRS_MAX_PATH_LENGTH];
+    getCrashReportPathByID(reportID, path, config);
+    return access(path, F_OK) == 0;
+}
+
+static void addOccurrence(int64_t exemplarID, const KSCrashReportOccurrence *occurrence,
+                          const KSCrashReportStoreCConfiguration *const config)
+{
+    char path[KSCRS_MAX_PATH_LENGTH];
+    getOccurrencesPathByID(exemplarID, path, config);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        KSLOG_ERROR("Could not open file %s: %s", path, strerror(errno));
+        return;
+    }
+    ksfu_writeBytesToFD(fd, (const char *)occurrence, (int)sizeof(*occurrence));
+    close(fd);
+}
+
+typedef struct {
+    char fingerprint[KSCRS_FINGERPRINT_LENGTH + 1];
+    int64_t exemplarID;
+    int reportCount;
+} FingerprintEntry;
+
+static void dedupReports(const KSCrashReportStoreCConfiguration *const config, int *workDone)
+{
+    if (config->maxReportsPerFingerprint <= 0) {
         return;
     }
     int reportCount = getReportCount(config);
-    if (reportCount > config->maxReportCount) {
-        int64_t reportIDs[reportCount];
-        reportCount = getReportIDs(reportIDs, reportCount, config);
+    if (reportCount <= 1) {
+        return;
+    }
+    int64_t *reportIDs = malloc(sizeof(*reportIDs) * (unsigned)reportCount);
+    FingerprintEntry *entries = malloc(sizeof(*entries) * (unsigned)reportCount);
+    if (reportIDs == NULL || entries == NULL) {
+        KSLOG_ERROR("Out of memory");
+        goto done;
+    }
+    reportCount = getReportIDs(reportIDs, reportCount, config);
 
-        for (int i = 0; i < reportCount - config->maxReportCount; i++) {
+    // Oldest reports come first, so they become the exemplars.
+    int entryCount = 0;
+    for (int i = 0; i < reportCount; i++) {
+        spendMaintenanceBudget(workDone);
+        ReportHeadContext head;
+        if (!readReportFingerprint(reportIDs[i], &head, config)) {
+            continue;
+        }
+        FingerprintEntry *entry = NULL;
+        for (int j = 0; j < entryCount; j++) {
+            if (strcmp(entries[j].fingerprint, head.fingerprint) == 0) {
+                entry = &entries[j];
+                break;
+            }
+        }
+        if (entry != NULL && !reportExists(entry->exemplarID, config)) {
+            // The exemplar was deleted while the store was unlocked. This report takes over.
+            entry->exemplarID = reportIDs[i];
+            entry->reportCount = 1;
+        } else if (entry == NULL) {
+            entry = &entries[entryCount++];
+            memcpy(entry->fingerprint, head.fingerprint, sizeof(entry->fingerprint));
+            entry->exemplarID = reportIDs[i];
+            entry->reportCount = 1;
+        } else if (entry->reportCount < config->maxReportsPerFingerprint) {
+            entry->reportCount++;
+        } else {
+            KSCrashReportOccurrence occurrence = { .reportID = reportIDs[i], .timestamp = head.timestamp };
+            addOccurrence(entry->exemplarID, &occurrence, config);
             deleteReportWithID(reportIDs[i], config);
         }
     }
+
+done:
+    free(reportIDs);
+    free(entries);
 }
+
+static int getOccurrences(int64_t reportID, KSCrashReportOccurrence *occurrences, int count,
+                          const KSCrashReportStoreCConfiguration *const config)
+{
+    char path[KSCRS_MAX_PATH_LENGTH];
+    getOccurrencesPathByID(reportID, path, config);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    int result = 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        result = (int)(st.st_size / (off_t)sizeof(KSCrashReportOccurrence));
+        if (occurrences != NULL) {
+            if (result > count) {
+                result = count;
+            }
+            if (result > 0 && !ksfu_readBytesFromFD(fd, (char *)occurrences, result * (int)sizeof(*occurrences))) {
+                result = 0;
+            }
+        }
+    }
+    close(fd);
+    return result;
+}
+
+// ============================================================================
+#pragma mark - Store index -
+// ============================================================================
+
+/** A report known to the store. Report IDs increase with creation time. */
+typedef struct {
+    int64_t reportID;
+    int64_t size;
+    time_t creationTime;
+    bool isDeleted;
+} IndexEntry;
+
+/** Running totals for one store, so that retention limits can be enforced
+ * on every add without scanning the reports directory.
+ */
+typedef struct StoreIndex {
+    struct StoreIndex *next;
+    /** Owned copy of the store configuration, used by background maintenance. */
+    KSCrashReportStoreCConfiguration config;
+    /** False until maintenance has rebuilt the index from disk. */
+    bool isReady;
+    bool needsMaintenance;
+    /** Sorted by report ID. Entries before `first` have been evicted. */
+    IndexEntry *entries;
+    int first;
+    int end;
+    int capacity;
+    int liveCount;
+    int64_t totalSize;
+} StoreIndex;
+
+static StoreIndex *g_storeIndexes;
+
+static StoreIndex *findStoreIndex(const KSCrashReportStoreCConfiguration *const config)
+{
+    for (StoreIndex *index = g_storeIndexes; index != NULL; index = index->next) {
+        if (strcmp(index->config.reportsPath, config->reportsPath) == 0 &&
+            strcmp(index->config.appName, config->appName) == 0) {
+            return index;
+        }
+    }
+    return NULL;
+}
+
+static StoreIndex *getStoreIndex(const KSCrashReportStoreCConfiguration *const config)
+{
+    StoreIndex *index = findStoreIndex(config);
+    if (index != NULL) {
+        return index;
+    }
+
+    index = calloc(1, sizeof(*index));
+    if (index == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return NULL;
+    }
+    index->config = *config;
+    index->config.reportsPath = strdup(config->reportsPath);
+    index->config.appName = strdup(config->appName);
+    if (index->config.reportsPath == NULL || index->config.appName == NULL) {
+        KSLOG_ERROR("Out of memory");
+        KSCrashReportStoreCConfiguration_Release(&index->config);
+        free(index);
+        return NULL;
+    }
+    index->next = g_storeIndexes;
+    g_storeIndexes = index;
+    return index;
+}
+
+static void resetStoreIndex(StoreIndex *index)
+{
+    index->first = 0;
+    index->end = 0;
+    index->liveCount = 0;
+    index->totalSize = 0;
+}
+
+static bool appendToStoreIndex(StoreIndex *index, int64_t reportID, int64_t size, time_t creationTime)
+{
+    if (index->end == index->capacity) {
+        if (index->first >= index->capacity / 2 && index->first > 0) {
+            // Mostly evicted entries: slide the live ones down instead of growing.
+            int length = index->end - index->first;
+            memmove(index->entries, index->entries + index->first, sizeof(*index->entries) * (unsigned)length);
+            index->first = 0;
+            index->end = length;
+        } else {
+            int newCapacity = index->capacity > 0 ? index->capacity * 2 : 16;
+            IndexEntry *newEntries = realloc(index->entries, sizeof(*newEntries) * (unsigned)newCapacity);
+            if (newEntries == NULL) {
+                KSLOG_ERROR("Out of memory");
+                return false;
+            }
+            index->entries = newEntries;
+            index->capacity = newCapacity;
+        }
+    }
+
+    index->entries[index->end++] = (IndexEntry) {
+        .reportID = reportID,
+        .size = size,
+        .creationTime = creationTime,
+        .isDeleted = false,
+    };
+    index->liveCount++;
+    index->totalSize += size;
+    return true;
+}
+
+static void removeFromStoreIndex(StoreIndex *index, int64_t reportID)
+{
+    int low = index->first;
+    int high = index->end - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        IndexEntry *entry = &index->entries[mid];
+        if (entry->reportID < reportID) {
+            low = mid + 1;
+        } else if (entry->reportID > reportID) {
+            high = mid - 1;
+        } else {
+            if (!entry->isDeleted) {
+                entry->isDeleted = true;
+                index->liveCount--;
+                index->totalSize -= entry->size;
+            }
+            break;
+        }
+    }
+
+    while (index->first < index->end && index->entries[index->first].isDeleted) {
+        index->first++;
+    }
+}
+
+static int compareIndexEntries(const void *a, const void *b)
+{
+    return compareInt64(&((const IndexEntry *)a)->reportID, &((const IndexEntry *)b)->reportID);
+}
+
+/** Rebuild the index from what is on disk. This is the only full scan of the reports directory.
+ * It runs without yielding the store lock, so that no add or delete can slip between
+ * the scan and the index becoming ready.
+ */
+static void buildStoreIndex(StoreIndex *index)
+{
+    const KSCrashReportStoreCConfiguration *const config = &index->config;
+    resetStoreIndex(index);
+
+    DIR *dir = opendir(config->reportsPath);
+    if (dir == NULL) {
+        KSLOG_ERROR("Could not open directory %s", config->reportsPath);
+        return;
+    }
+    int dirFD = dirfd(dir);
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        int64_t reportID = getReportIDFromFilename(ent->d_name, config);
+        if (reportID <= 0) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirFD, ent->d_name, &st, 0) != 0) {
+            KSLOG_ERROR("Could not stat %s: %s", ent->d_name, strerror(errno));
+            continue;
+        }
+        if (!appendToStoreIndex(index, reportID, (int64_t)st.st_size, st.st_mtime)) {
+            break;
+        }
+    }
+    closedir(dir);
+
+    qsort(index->entries, (unsigned)index->end, sizeof(*index->entries), compareIndexEntries);
+}
+
+/** Reclaim the space held by evicted entries. */
+static void compactStoreIndex(StoreIndex *index)
+{
+    int length = index->end - index->first;
+    if (index->first > 0) {
+        memmove(index->entries, index->entries + index->first, sizeof(*index->entries) * (unsigned)length);
+        index->first = 0;
+        index->end = length;
+    }
+    if (length < index->capacity / 4 && index->capacity > 16) {
+        int newCapacity = length > 8 ? length * 2 : 16;
+        IndexEntry *newEntries = realloc(index->entries, sizeof(*newEntries) * (unsigned)newCapacity);
+        if (newEntries != NULL) {
+            index->entries = newEntries;
+            index->capacity = newCapacity;
+        }
+    }
+}
+
+static int compareOccurrences(const void *a, const void *b)
+{
+    return compareInt64(&((const KSCrashReportOccurrence *)a)->reportID,
+                        &((const KSCrashReportOccurrence *)b)->reportID);
+}
+
+/** Before a report that has occurrence records is deleted, hand the records over to the
+ * oldest remaining report with the same fingerprint, which deduplication treats as the
+ * exemplar from then on. The deleted report becomes one of its occurrences.
+ */
+static void handOverOccurrences(const StoreIndex *index, int64_t reportID,
+                                const KSCrashReportStoreCConfiguration *const config)
+{
+    char path[KSCRS_MAX_PATH_LENGTH];
+    getOccurrencesPathByID(reportID, path, config);
+    ReportHeadContext head;
+    if (access(path, F_OK) != 0 || !readReportFingerprint(reportID, &head, config)) {
+        return;
+    }
+    int64_t successorID = 0;
+    for (int i = index->first; i < index->end && successorID == 0; i++) {
+        const IndexEntry *entry = &index->entries[i];
+        ReportHeadContext successorHead;
+        if (!entry->isDeleted && entry->reportID != reportID &&
+            readReportFingerprint(entry->reportID, &successorHead, config) &&
+            strcmp(successorHead.fingerprint, head.fingerprint) == 0) {
+            successorID = entry->reportID;
+        }
+    }
+    if (successorID == 0) {
+        return;
+    }
+
+    int count = 1 + getOccurrences(reportID, NULL, 0, config) + getOccurrences(successorID, NULL, 0, config);
+    KSCrashReportOccurrence *occurrences = malloc(sizeof(*occurrences) * (unsigned)count);
+    if (occurrences == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return;
+    }
+    occurrences[0] = (KSCrashReportOccurrence) { .reportID = reportID, .timestamp = head.timestamp };
+    int ownCount = getOccurrences(reportID, occurrences + 1, count - 1, config);
+    count = 1 + ownCount + getOccurrences(successorID, occurrences + 1 + ownCount, count - 1 - ownCount, config);
+    qsort(occurrences, (unsigned)count, sizeof(*occurrences), compareOccurrences);
+
+    // Rewrite the deleted report's records, then move them into place in one step.
+    char successorPath[KSCRS_MAX_PATH_LENGTH];
+    getOccurrencesPathByID(successorID, successorPath, config);
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    if (fd < 0) {
+        KSLOG_ERROR("Could not open file %s: %s", path, strerror(errno));
+    } else {
+        bool isWritten = ksfu_writeBytesToFD(fd, (const char *)occurrences, count * (int)sizeof(*occurrences));
+        close(fd);
+        if (isWritten && rename(path, successorPath) != 0) {
+            KSLOG_ERROR("Could not rename %s to %s: %s", path, successorPath, strerror(errno));
+        }
+    }
+    free(occurrences);
+}
+
+/** Delete the oldest reports until the store is within its count, size and age limits.
+ * The newest report is always kept. Occurrence records move to a remaining report
+ * with the same fingerprint.
+ */
+static void enforceRetention(StoreIndex *index, const KSCrashReportStoreCConfiguration *const config, int *workDone)
+{
+    time_t now = time(NULL);
+    while (index->liveCount > 1) {
+        spendMaintenanceBudget(workDone);
+        if (!index->isReady || index->liveCount <= 1) {
+            break;
+        }
+        const IndexEntry *oldest = &index->entries[index->first];
+        bool isOverCount = config->maxReportCount > 0 && index->liveCount > config->maxReportCount;
+        bool isOverSize = config->maxReportsTotalSize > 0 && index->totalSize > config->maxReportsTotalSize;
+        bool isTooOld = config->maxReportAge > 0 && difftime(now, oldest->creationTime) > config->maxReportAge;
+        if (!isOverCount && !isOverSize && !isTooOld) {
+            break;
+        }
+        int64_t reportID = oldest->reportID;
+        handOverOccurrences(index, reportID, config);
+        removeFromStoreIndex(index, reportID);
+        deleteReportWithID(reportID, config);
+    }
+}
+
+/** Add a newly written report to the index, if the index is in use. Must be called with g_mutex held. */
+static void indexNewReport(StoreIndex *index, int64_t reportID, int64_t size,
+                           const KSCrashReportStoreCConfiguration *const config)
+{
+    if (index != NULL && index->isReady && appendToStoreIndex(index, reportID, size, time(NULL))) {
+        enforceRetention(index, config, NULL);
+    }
+}
+
+// ============================================================================
+#pragma mark - Group commit -
+// ============================================================================
+
+/** A report written to its pending path, waiting to be synced and renamed into place. */
+typedef struct {
+    int64_t reportID;
+    int64_t size;
+    int fd;
+    struct timespec addedTime;
+    /** The store the report belongs to. Owns the paths used to commit the report. */
+    StoreIndex *index;
+} PendingReport;
+
+/** Oldest first. The first g_committingCount entries belong to the commit in flight,
+ * and are only touched by the commit thread until it is done with them.
+ */
+static PendingReport g_pendingReports[KSCRS_MAX_PENDING_REPORTS];
+static int g_pendingCount;
+static int g_committingCount;
+/** Counts every report ever made pending, and every one committed, so that readers
+ * only wait for the reports that were added before them.
+ */
+static uint64_t g_pendingSequence;
+static uint64_t g_committedSequence;
+static bool g_isCommitRequested;
+static bool g_isCommitThreadStarted;
+/** Wakes the commit thread. */
+static pthread_cond_t g_commitCondition = PTHREAD_COND_INITIALIZER;
+/** Wakes threads waiting for a commit to finish. */
+static pthread_cond_t g_commitDoneCondition = PTHREAD_COND_INITIALIZER;
+
+static void syncFile(int fd)
+{
+#if KSCRASH_HOST_APPLE
+    // fsync() leaves the data in the drive's cache on Apple platforms.
+    if (fcntl(fd, F_FULLFSYNC) == 0) {
+        return;
+    }
+#endif
+    if (fsync(fd) != 0) {
+        KSLOG_ERROR("fsync: %s", strerror(errno));
+    }
+}
+
+/** Make renames into the directory durable. */
+static void syncDirectory(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        KSLOG_ERROR("Could not open directory %s: %s", path, strerror(errno));
+        return;
+    }
+    syncFile(fd);
+    close(fd);
+}
+
+/** Write a report to its pending path. Returns the open file descriptor, or -1 on failure. */
+static int writePendingReport(int64_t reportID, const char *report, int reportLength,
+                              const KSCrashReportStoreCConfiguration *const config)
+{
+    char path[KSCRS_MAX_PATH_LENGTH];
+    getPendingPathByID(reportID, path, config);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        KSLOG_ERROR("Could not open file %s: %s", path, strerror(errno));
+        return -1;
+    }
+    if (!ksfu_writeBytesToFD(fd, report, reportLength)) {
+        KSLOG_ERROR("Could not write to file %s", path);
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+/** Move a pending report into the store. */
+static bool promotePendingReport(int64_t reportID, const KSCrashReportStoreCConfiguration *const config)
+{
+    char pendingPath[KSCRS_MAX_PATH_LENGTH];
+    char reportPath[KSCRS_MAX_PATH_LENGTH];
+    getPendingPathByID(reportID, pendingPath, config);
+    getCrashReportPathByID(reportID, reportPath, config);
+    if (rename(pendingPath, reportPath) != 0) {
+        // ENOENT means the pending file was already moved or deleted.
+        if (errno != ENOENT) {
+            KSLOG_ERROR("Could not rename %s to %s: %s", pendingPath, reportPath, strerror(errno));
+        }
+        return false;
+    }
+    return true;
+}
+
+/** Write, sync and rename a report before returning. Must be called with g_mutex held. */
+static void addReportSynchronously(StoreIndex *index, int64_t reportID, const char *report, int reportLength,
+                                   const KSCrashReportStoreCConfiguration *const config)
+{
+    int fd = writePendingReport(reportID, report, reportLength, config);
+    if (fd < 0) {
+        return;
+    }
+    syncFile(fd);
+    close(fd);
+    if (promotePendingReport(reportID, config)) {
+        syncDirectory(config->reportsPath);
+        indexNewReport(index, reportID, reportLength, config);
+    }
+}
+
+static void addInterval(struct timespec *time, double interval)
+{
+    int64_t nanoseconds = time->tv_nsec + (int64_t)(interval * 1000000000.0);
+    time->tv_sec += (time_t)(nanoseconds / 1000000000);
+    time->tv_nsec = (long)(nanoseconds % 1000000000);
+}
+
+static bool isBefore(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/** pthread_cond_timedwait() deadlines are on the realtime clock. */
+static void getCurrentTime(struct timespec *time)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    time->tv_sec = now.tv_sec;
+    time->tv_nsec = (long)now.tv_usec * 1000;
+}
+
+/** Sync, close and rename the first `count` pending reports.
+ * Must be called with g_mutex held, and releases it while syncing.
+ */
+static void commitPendingReports(int count)
+{
+    g_committingCount = count;
+    g_isCommitRequested = false;
+
+    pthread_mutex_unlock(&g_mutex);
+    for (int i = 0; i < count; i++) {
+        syncFile(g_pendingReports[i].fd);
+    }
+    pthread_mutex_lock(&g_mutex);
+
+    // A batch usually belongs to a single store, so its directory only needs syncing once.
+    // Store indexes are never freed, so they can be used after the lock is released.
+    StoreIndex *changedIndexes[KSCRS_MAX_PENDING_REPORTS];
+    int changedCount = 0;
+    for (int i = 0; i < count; i++) {
+        PendingReport *pending = &g_pendingReports[i];
+        close(pending->fd);
+        if (!promotePendingReport(pending->reportID, &pending->index->config)) {
+            continue;
+        }
+        indexNewReport(pending->index, pending->reportID, pending->size, &pending->index->config);
+        bool isKnown = false;
+        for (int j = 0; j < changedCount && !isKnown; j++) {
+            isKnown = changedIndexes[j] == pending->index;
+        }
+        if (!isKnown) {
+            changedIndexes[changedCount++] = pending->index;
+        }
+    }
+
+    memmove(g_pendingReports, g_pendingReports + count, sizeof(*g_pendingReports) * (unsigned)(g_pendingCount - count));
+    g_pendingCount -= count;
+    g_committingCount = 0;
+    g_committedSequence += (uint64_t)count;
+    pthread_cond_broadcast(&g_commitDoneCondition);
+
+    pthread_mutex_unlock(&g_mutex);
+    for (int i = 0; i < changedCount; i++) {
+        syncDirectory(changedIndexes[i]->config.reportsPath);
+    }
+    pthread_mutex_lock(&g_mutex);
+}
+
+static void *commitThread(__unused void *userData)
+{
+    pthread_mutex_lock(&g_mutex);
+    for (;;) {
+        if (g_pendingCount == 0) {
+            pthread_cond_wait(&g_commitCondition, &g_mutex);
+            continue;
+        }
+        const PendingReport *oldest = &g_pendingReports[0];
+        const KSCrashReportStoreCConfiguration *config = &oldest->index->config;
+        if (!g_isCommitRequested && g_pendingCount < config->groupCommitMaxReports) {
+            struct timespec deadline = oldest->addedTime;
+            addInterval(&deadline, config->groupCommitInterval);
+            struct timespec now;
+            getCurrentTime(&now);
+            if (isBefore(&now, &deadline)) {
+                pthread_cond_timedwait(&g_commitCondition, &g_mutex, &deadline);
+                continue;
+            }
+        }
+        commitPendingReports(g_pendingCount);
+    }
+    return NULL;
+}
+
+static bool startCommitThread(void)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int error = pthread_create(&thread, &attr, commitThread, NULL);
+    pthread_attr_destroy(&attr);
+    if (error != 0) {
+        KSLOG_ERROR("pthread_create: %s", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+/** Write a report to its pending path and leave it to the commit thread.
+ * Must be called with g_mutex held.
+ */
+static void addReportForGroupCommit(StoreIndex *index, int64_t reportID, const char *report, int reportLength)
+{
+    const KSCrashReportStoreCConfiguration *config = &index->config;
+    if (!g_isCommitThreadStarted) {
+        g_isCommitThreadStarted = startCommitThread();
+    }
+    if (!g_isCommitThreadStarted) {
+        addReportSynchronously(index, reportID, report, reportLength, config);
+        return;
+    }
+
+    // Don't let writers run arbitrarily far ahead of the disk.
+    while (g_pendingCount == KSCRS_MAX_PENDING_REPORTS) {
+        g_isCommitRequested = true;
+        pthread_cond_signal(&g_commitCondition);
+        pthread_cond_wait(&g_commitDoneCondition, &g_mutex);
+    }
+
+    int fd = writePendingReport(reportID, report, reportLength, config);
+    if (fd < 0) {
+        return;
+    }
+    PendingReport *pending = &g_pendingReports[g_pendingCount++];
+    pending->reportID = reportID;
+    pending->size = reportLength;
+    pending->fd = fd;
+    pending->index = index;
+    getCurrentTime(&pending->addedTime);
+    g_pendingSequence++;
+    if (g_pendingCount == 1 || g_pendingCount - g_committingCount >= config->groupCommitMaxReports) {
+        pthread_cond_signal(&g_commitCondition);
+    }
+}
+
+/** Commit every report added so far, so that readers see them.
+ * Must be called with g_mutex held.
+ */
+static void waitForPendingReports(void)
+{
+    uint64_t target = g_pendingSequence;
+    while (g_committedSequence < target) {
+        g_isCommitRequested = true;
+        pthread_cond_signal(&g_commitCondition);
+        pthread_cond_wait(&g_commitDoneCondition, &g_mutex);
+    }
+}
+
+static bool isPendingReport(int64_t reportID, const StoreIndex *index)
+{
+    for (int i = 0; i < g_pendingCount; i++) {
+        if (g_pendingReports[i].reportID == reportID && g_pendingReports[i].index == index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Delete pending reports left behind by an earlier process.
+ * The process may have gone away in the middle of writing one, and nothing
+ * marks which of them are complete, so none of them can go into the store.
+ */
+static void deleteOrphanedPendingReports(StoreIndex *index, int *workDone)
+{
+    DIR *dir = opendir(index->config.reportsPath);
+    if (dir == NULL) {
+        KSLOG_ERROR("Could not open directory %s", index->config.reportsPath);
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        int64_t reportID = getIDFromFilename(ent->d_name, "pending", &index->config);
+        if (reportID > 0 && !isPendingReport(reportID, index)) {
+            char path[KSCRS_MAX_PATH_LENGTH];
+            getPendingPathByID(reportID, path, &index->config);
+            // ENOENT means a concurrent commit got there first.
+            if (unlink(path) != 0 && errno != ENOENT) {
+                KSLOG_ERROR("Could not delete %s: %s", path, strerror(errno));
+            }
+            spendMaintenanceBudget(workDone);
+        }
+    }
+    closedir(dir);
+}
+
+// ============================================================================
+#pragma mark - Maintenance -
+// ============================================================================
+
+static pthread_cond_t g_maintenanceCondition = PTHREAD_COND_INITIALIZER;
+static bool g_isMaintenanceThreadStarted;
+static bool g_isMaintenanceRunning;
+
+static void runMaintenance(StoreIndex *index)
+{
+    int workDone = 0;
+    deleteOrphanedPendingReports(index, &workDone);
+    dedupReports(&index->config, &workDone);
+    buildStoreIndex(index);
+    index->isReady = true;
+    enforceRetention(index, &index->config, &workDone);
+    compactStoreIndex(index);
+}
+
+static StoreIndex *getIndexNeedingMaintenance(void)
+{
+    for (StoreIndex *index = g_storeIndexes; index != NULL; index = index->next) {
+        if (index->needsMaintenance) {
+            return index;
+        }
+    }
+    return NULL;
+}
+
+static void *maintenanceThread(__unused void *userData)
+{
+#if KSCRASH_HOST_LINUX
+    // Linux has no QoS classes, and setpriority() on a thread ID only affects that thread.
+    // SCHED_IDLE would be lower still, but the thread holds g_mutex while it works.
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), KSCRS_MAINTENANCE_NICENESS) != 0) {
+        KSLOG_ERROR("setpriority: %s", strerror(errno));
+    }
+#endif
+    pthread_mutex_lock(&g_mutex);
+    for (;;) {
+        StoreIndex *index = getIndexNeedingMaintenance();
+        if (index == NULL) {
+            g_isMaintenanceRunning = false;
+            pthread_cond_broadcast(&g_maintenanceCondition);
+            pthread_cond_wait(&g_maintenanceCondition, &g_mutex);
+            continue;
+        }
+        g_isMaintenanceRunning = true;
+        index->needsMaintenance = false;
+        runMaintenance(index);
+    }
+    return NULL;
+}
+
+static bool startMaintenanceThread(void)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+#if KSCRASH_HOST_APPLE
+    pthread_attr_set_qos_class_np(&attr, QOS_CLASS_UTILITY, 0);
+#endif
+    pthread_t thread;
+    int error = pthread_create(&thread, &attr, maintenanceThread, NULL);
+    pthread_attr_destroy(&attr);
+    if (error != 0) {
+        KSLOG_ERROR("pthread_create: %s", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+/** Must be called with g_mutex held. */
+static void scheduleMaintenance(StoreIndex *index, const KSCrashReportStoreCConfiguration *const config)
+{
+    // Keep the owned paths; pick up any new limits.
+    const char *reportsPath = index->config.reportsPath;
+    const char *appName = index->config.appName;
+    index->config = *config;
+    index->config.reportsPath = reportsPath;
+    index->config.appName = appName;
+
+    index->isReady = false;
+    index->needsMaintenance = true;
+
+    if (!g_isMaintenanceThreadStarted) {
+        g_isMaintenanceThreadStarted = startMaintenanceThread();
+    }
+    if (g_isMaintenanceThreadStarted) {
+        pthread_cond_broadcast(&g_maintenanceCondition);
+    } else {
+        index->needsMaintenance = false;
+        runMaintenance(index);
+    }
+}
+
 // clang-format off
 static void initializeIDs(void)
 {
@@ -172,7 +1152,10 @@ KSCrashInstallErrorCode kscrs_initialize(const KSCrashReportStoreCConfiguration
         KSLOG_ERROR("Could not create path: %s", configuration->reportsPath);
         result = KSCrashInstallErrorCouldNotCreatePath;
     } else {
-        pruneReports(configuration);
+        StoreIndex *index = getStoreIndex(configuration);
+        if (index != NULL) {
+            scheduleMaintenance(index, configuration);
+        }
         initializeIDs();
     }
     pthread_mutex_unlock(&g_mutex);
@@ -192,6 +1175,7 @@ int64_t kscrs_getNextCrashReport(char *crashReportPathBuffer,
 int kscrs_getReportCount(const KSCrashReportStoreCConfiguration *const configuration)
 {
     pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
     int count = getReportCount(configuration);
     pthread_mutex_unlock(&g_mutex);
     return count;
@@ -200,34 +1184,100 @@ int kscrs_getReportCount(const KSCrashReportStoreCConfiguration *const configura
 int kscrs_getReportIDs(int64_t *reportIDs, int count, const KSCrashReportStoreCConfiguration *const configuration)
 {
     pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
     count = getReportIDs(reportIDs, count, configuration);
     pthread_mutex_unlock(&g_mutex);
     return count;
 }
 
-static char *readReportAtPath(const char *path)
+static bool readReportAtPathStreaming(const char *path, KSReportDemangleFunction demangleFunction,
+                                      KSCrashReportReadCallback callback, void *userData)
 {
-    char *rawReport;
-    ksfu_readEntireFile(path, &rawReport, NULL, 2000000);
+    int rawReportLength = 0;
+    const char *rawReport = ksfu_mmapReadOnly(path, &rawReportLength);
     if (rawReport == NULL) {
-        KSLOG_ERROR("Failed to load report at path: %s", path);
-        return NULL;
+        KSLOG_ERROR("Failed to map report at path: %s", path);
+        return false;
     }
 
-    char *result = kscrf_fixupCrashReport(rawReport);
-    free(rawReport);
-    if (result == NULL) {
+    bool isSuccessful =
+        kscrf_fixupCrashReportStreaming(rawReport, rawReportLength, demangleFunction, callback, userData);
+    munmap((void *)rawReport, (size_t)rawReportLength);
+    if (!isSuccessful) {
         KSLOG_ERROR("Failed to fixup report at path: %s", path);
+    }
+    return isSuccessful;
+}
+
+typedef struct {
+    char *data;
+    int length;
+    int capacity;
+} ReportBuffer;
+
+static bool appendToReportBuffer(const char *data, int length, void *userData)
+{
+    ReportBuffer *buffer = (ReportBuffer *)userData;
+    if (buffer->length + length + 1 > buffer->capacity) {
+        int newCapacity = buffer->capacity;
+        while (buffer->length + length + 1 > newCapacity) {
+            newCapacity *= 2;
+        }
+        char *newData = realloc(buffer->data, (unsigned)newCapacity);
+        if (newData == NULL) {
+            KSLOG_ERROR("Out of memory");
+            return false;
+        }
+        buffer->data = newData;
+        buffer->capacity = newCapacity;
+    }
+    memcpy(buffer->data + buffer->length, data, (unsigned)length);
+    buffer->length += length;
+    return true;
+}
+
+static char *readReportAtPath(const char *path, KSReportDemangleFunction demangleFunction)
+{
+    ReportBuffer buffer = { .data = NULL, .length = 0, .capacity = 4096 };
+    buffer.data = malloc((unsigned)buffer.capacity);
+    if (buffer.data == NULL) {
+        KSLOG_ERROR("Out of memory");
         return NULL;
     }
 
-    return result;
+    if (!readReportAtPathStreaming(path, demangleFunction, appendToReportBuffer, &buffer)) {
+        free(buffer.data);
+        return NULL;
+    }
+
+    buffer.data[buffer.length] = '\0';
+    return buffer.data;
+}
+
+/** Fix up a raw report that has already been read into memory. */
+static char *readReportFromData(const char *rawReport, int rawReportLength, KSReportDemangleFunction demangleFunction)
+{
+    ReportBuffer buffer = { .data = NULL, .length = 0, .capacity = 4096 };
+    buffer.data = malloc((unsigned)buffer.capacity);
+    if (buffer.data == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return NULL;
+    }
+
+    if (!kscrf_fixupCrashReportStreaming(rawReport, rawReportLength, demangleFunction, appendToReportBuffer,
+                                         &buffer)) {
+        free(buffer.data);
+        return NULL;
+    }
+
+    buffer.data[buffer.length] = '\0';
+    return buffer.data;
 }
 
 char *kscrs_readReportAtPath(const char *path)
 {
     pthread_mutex_lock(&g_mutex);
-    char *result = readReportAtPath(path);
+    char *result = readReportAtPath(path, NULL);
     pthread_mutex_unlock(&g_mutex);
     return result;
 }
@@ -235,22 +1285,199 @@ char *kscrs_readReportAtPath(const char *path)
 char *kscrs_readReport(int64_t reportID, const KSCrashReportStoreCConfiguration *const configuration)
 {
     pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
     char path[KSCRS_MAX_PATH_LENGTH];
     getCrashReportPathByID(reportID, path, configuration);
-    char *result = readReportAtPath(path);
+    char *result = readReportAtPath(path, configuration->demangleFunction);
     pthread_mutex_unlock(&g_mutex);
     return result;
 }
 
+bool kscrs_readReportStreaming(int64_t reportID, KSCrashReportReadCallback callback, void *userData,
+                               const KSCrashReportStoreCConfiguration *const configuration)
+{
+    if (callback == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
+    char path[KSCRS_MAX_PATH_LENGTH];
+    getCrashReportPathByID(reportID, path, configuration);
+    bool result = readReportAtPathStreaming(path, configuration->demangleFunction, callback, userData);
+    pthread_mutex_unlock(&g_mutex);
+    return result;
+}
+
+typedef struct {
+    const int64_t *reportIDs;
+    char **reports;
+    int count;
+    _Atomic(int) nextIndex;
+    const KSCrashReportStoreCConfiguration *configuration;
+    /** Raw reports already read by batched I/O. If NULL, each worker reads its own reports. */
+    char **rawReports;
+    int *rawReportLengths;
+} BatchReadContext;
+
+static void *batchReadWorker(void *userData)
+{
+    BatchReadContext *context = (BatchReadContext *)userData;
+    KSReportDemangleFunction demangleFunction = context->configuration->demangleFunction;
+    char path[KSCRS_MAX_PATH_LENGTH];
+    for (;;) {
+        int index = context->nextIndex++;
+        if (index >= context->count) {
+            break;
+        }
+        if (context->rawReports != NULL) {
+            if (context->rawReports[index] != NULL) {
+                context->reports[index] = readReportFromData(context->rawReports[index],
+                                                             context->rawReportLengths[index], demangleFunction);
+            }
+            continue;
+        }
+        // Reports are small, and mapping them costs more than copying them,
+        // especially with several threads unmapping at once.
+        getCrashReportPathByID(context->reportIDs[index], path, context->configuration);
+        char *rawReport = NULL;
+        int rawReportLength = 0;
+        if (ksfu_readEntireFile(path, &rawReport, &rawReportLength, 0)) {
+            context->reports[index] = readReportFromData(rawReport, rawReportLength, demangleFunction);
+            free(rawReport);
+        }
+    }
+    return NULL;
+}
+
+static int getBatchReadThreadCount(int reportCount)
+{
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    int threadCount = cpuCount > 0 ? (int)cpuCount : 1;
+    if (threadCount > KSCRS_MAX_BATCH_READ_THREADS) {
+        threadCount = KSCRS_MAX_BATCH_READ_THREADS;
+    }
+    if (threadCount > reportCount) {
+        threadCount = reportCount;
+    }
+    return threadCount;
+}
+
+/** Run the batch read workers over the whole context. The calling thread is one of them. */
+static void runBatchReadWorkers(BatchReadContext *context)
+{
+    int threadCount = getBatchReadThreadCount(context->count);
+    pthread_t threads[KSCRS_MAX_BATCH_READ_THREADS];
+    int startedCount = 0;
+    for (int i = 1; i < threadCount; i++) {
+        int error = pthread_create(&threads[startedCount], NULL, batchReadWorker, context);
+        if (error != 0) {
+            KSLOG_ERROR("pthread_create: %s", strerror(error));
+            break;
+        }
+        startedCount++;
+    }
+    batchReadWorker(context);
+    for (int i = 0; i < startedCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/** Read reports a chunk at a time, with one batch of file system calls per chunk.
+ * The workers are then only left with fixing up the reports.
+ *
+ * @return false if the chunk buffers could not be allocated.
+ */
+static bool readReportsWithBatchIO(const int64_t *reportIDs, int count, char **reports,
+                                   const KSCrashReportStoreCConfiguration *const configuration)
+{
+    char(*paths)[KSCRS_MAX_PATH_LENGTH] = malloc(sizeof(*paths) * KSCRS_BATCH_IO_REPORTS);
+    if (paths == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return false;
+    }
+    const char *pathPointers[KSCRS_BATCH_IO_REPORTS];
+    char *rawReports[KSCRS_BATCH_IO_REPORTS];
+    int rawReportLengths[KSCRS_BATCH_IO_REPORTS];
+
+    for (int i = 0; i < count; i += KSCRS_BATCH_IO_REPORTS) {
+        int batchCount = count - i < KSCRS_BATCH_IO_REPORTS ? count - i : KSCRS_BATCH_IO_REPORTS;
+        for (int j = 0; j < batchCount; j++) {
+            getCrashReportPathByID(reportIDs[i + j], paths[j], configuration);
+            pathPointers[j] = paths[j];
+        }
+        ksfu_readEntireFiles(pathPointers, batchCount, rawReports, rawReportLengths);
+
+        BatchReadContext context = {
+            .reportIDs = reportIDs + i,
+            .reports = reports + i,
+            .count = batchCount,
+            .nextIndex = 0,
+            .configuration = configuration,
+            .rawReports = rawReports,
+            .rawReportLengths = rawReportLengths,
+        };
+        runBatchReadWorkers(&context);
+        for (int j = 0; j < batchCount; j++) {
+            free(rawReports[j]);
+        }
+    }
+    free(paths);
+    return true;
+}
+
+int kscrs_readReports(const int64_t *reportIDs, int count, char **reports,
+                      const KSCrashReportStoreCConfiguration *const configuration)
+{
+    if (reportIDs == NULL || reports == NULL || count <= 0) {
+        return 0;
+    }
+    memset(reports, 0, sizeof(*reports) * (unsigned)count);
+
+    pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
+    if (!ksfu_isBatchIOAvailable() || !readReportsWithBatchIO(reportIDs, count, reports, configuration)) {
+        BatchReadContext context = {
+            .reportIDs = reportIDs,
+            .reports = reports,
+            .count = count,
+            .nextIndex = 0,
+            .configuration = configuration,
+            .rawReports = NULL,
+            .rawReportLengths = NULL,
+        };
+        runBatchReadWorkers(&context);
+    }
+    pthread_mutex_unlock(&g_mutex);
+
+    int readCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (reports[i] != NULL) {
+            readCount++;
+        }
+    }
+    return readCount;
+}
+
 int64_t kscrs_addUserReport(const char *report, int reportLength,
                             const KSCrashReportStoreCConfiguration *const configuration)
 {
     pthread_mutex_lock(&g_mutex);
     int64_t currentID = getNextUniqueID();
+    StoreIndex *index = findStoreIndex(configuration);
     char crashReportPath[KSCRS_MAX_PATH_LENGTH];
+    int fd = -1;
+
+    if (configuration->durability == KSCrashReportDurabilityGroupCommit && index != NULL) {
+        addReportForGroupCommit(index, currentID, report, reportLength);
+        goto done;
+    } else if (configuration->durability != KSCrashReportDurabilityNone) {
+        addReportSynchronously(index, currentID, report, reportLength, configuration);
+        goto done;
+    }
+
     getCrashReportPathByID(currentID, crashReportPath, configuration);
 
-    int fd = open(crashReportPath, O_WRONLY | O_CREAT, 0644);
+    fd = open(crashReportPath, O_WRONLY | O_CREAT, 0644);
     if (fd < 0) {
         KSLOG_ERROR("Could not open file %s: %s", crashReportPath, strerror(errno));
         goto done;
@@ -265,6 +1492,8 @@ int64_t kscrs_addUserReport(const char *report, int reportLength,
                     bytesWritten);
     }
 
+    indexNewReport(index, currentID, bytesWritten, configuration);
+
 done:
     if (fd >= 0) {
         close(fd);
@@ -274,16 +1503,70 @@ done:
     return currentID;
 }
 
+int kscrs_getOccurrenceCount(int64_t reportID, const KSCrashReportStoreCConfiguration *const configuration)
+{
+    pthread_mutex_lock(&g_mutex);
+    int count = getOccurrences(reportID, NULL, 0, configuration);
+    pthread_mutex_unlock(&g_mutex);
+    return count;
+}
+
+int kscrs_getOccurrences(int64_t reportID, KSCrashReportOccurrence *occurrences, int count,
+                         const KSCrashReportStoreCConfiguration *const configuration)
+{
+    pthread_mutex_lock(&g_mutex);
+    count = getOccurrences(reportID, occurrences, count, configuration);
+    pthread_mutex_unlock(&g_mutex);
+    return count;
+}
+
 void kscrs_deleteAllReports(const KSCrashReportStoreCConfiguration *const configuration)
 {
     pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
     ksfu_deleteContentsOfPath(configuration->reportsPath);
+    StoreIndex *index = findStoreIndex(configuration);
+    if (index != NULL) {
+        resetStoreIndex(index);
+    }
     pthread_mutex_unlock(&g_mutex);
 }
 
 void kscrs_deleteReportWithID(int64_t reportID, const KSCrashReportStoreCConfiguration *const configuration)
 {
     pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
     deleteReportWithID(reportID, configuration);
+    StoreIndex *index = findStoreIndex(configuration);
+    if (index != NULL && index->isReady) {
+        removeFromStoreIndex(index, reportID);
+    }
+    pthread_mutex_unlock(&g_mutex);
+}
+
+void kscrs_deleteReportsWithIDs(const int64_t *reportIDs, int count,
+                                const KSCrashReportStoreCConfiguration *const configuration)
+{
+    if (reportIDs == NULL || count <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&g_mutex);
+    waitForPendingReports();
+    StoreIndex *index = findStoreIndex(configuration);
+    for (int i = 0; i < count; i++) {
+        deleteReportWithID(reportIDs[i], configuration);
+        if (index != NULL && index->isReady) {
+            removeFromStoreIndex(index, reportIDs[i]);
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+}
+
+void kscrs_waitForMaintenance(void)
+{
+    pthread_mutex_lock(&g_mutex);
+    while (g_isMaintenanceRunning || getIndexNeedingMaintenance() != NULL) {
+        pthread_cond_wait(&g_maintenanceCondition, &g_mutex);
+    }
     pthread_mutex_unlock(&g_mutex);
 }
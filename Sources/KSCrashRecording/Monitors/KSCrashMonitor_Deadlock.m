@@ -30,7 +30,7 @@
 #import "KSCrashMonitorContext.h"
 #import "KSCrashMonitorContextHelper.h"
 #import "KSID.h"
-#import "KSStackCursor_MachineContext.h"
+#import "KSStackCursor_Unwind.h"
 #import "KSThread.h"
 
 // #define KSLogger_LocalLevel TRACE
@@ -110,7 +110,7 @@ static NSTimeInterval g_watchdogInterval = 0;
     //指明 主线程
     ksmc_getContextForThread(g_mainQueueThread, machineContext, false);
     KSStackCursor stackCursor;
-    kssc_initWithMachineContext(&stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
+    kssc_initWithUnwindTables(&stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
     char eventID[37];
     ksid_generate(eventID);
 
@@ -32,7 +32,7 @@
 #include "KSCrashMonitorHelper.h"
 #include "KSCrashMonitor_Signal.h"
 #include "KSID.h"
-#include "KSStackCursor_MachineContext.h"
+#include "KSStackCursor_Unwind.h"
 #include "KSSystemCapabilities.h"
 #include "KSThread.h"
 
@@ -314,7 +314,7 @@ static void *handleExceptions(void *const userData)
         crashContext->offendingMachineContext = machineContext;
         kssc_initCursor(&g_stackCursor, NULL, NULL);
         if (ksmc_getContextForThread(exceptionMessage.thread.name, machineContext, true)) {
-            kssc_initWithMachineContext(&g_stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
+            kssc_initWithUnwindTables(&g_stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
             KSLOG_TRACE("Fault address %p, instruction address %p", kscpu_faultAddress(machineContext),
                         kscpu_instructionAddress(machineContext));
             if (exceptionMessage.exception == EXC_BAD_ACCESS) {
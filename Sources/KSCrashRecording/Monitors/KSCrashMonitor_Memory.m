@@ -38,8 +38,8 @@
 #import "KSFileUtils.h"
 #import "KSID.h"
 #import "KSStackCursor.h"
-#import "KSStackCursor_MachineContext.h"
 #import "KSStackCursor_SelfThread.h"
+#import "KSStackCursor_Unwind.h"
 #import "KSSystemCapabilities.h"
 
 #import <Foundation/Foundation.h>
@@ -510,7 +510,7 @@ static void ksmemory_write_possible_oom(void)
     KSMC_NEW_CONTEXT(machineContext);
     ksmc_getContextForThread(ksthread_self(), machineContext, false);
     KSStackCursor stackCursor;
-    kssc_initWithMachineContext(&stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
+    kssc_initWithUnwindTables(&stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
 
     char eventID[37] = { 0 };
     ksid_generate(eventID);
@@ -0,0 +1,582 @@
+//
+//  KSCrashMonitor_Profiler.c
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// For the register names in ucontext_t.
+#define _GNU_SOURCE
+#endif
+
+#include "KSCrashMonitor_Profiler.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "KSCrashMonitorContext.h"
+#include "KSSystemCapabilities.h"
+
+#if KSCRASH_HOST_APPLE
+#include "KSMachineContext.h"
+#include "KSStackCursor_Unwind.h"
+#include "KSThread.h"
+#elif KSCRASH_HOST_LINUX
+#include <dirent.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+
+#include "KSMemory.h"
+#endif
+
+// #define KSLogger_LocalLevel TRACE
+#include "KSLogger.h"
+
+/** The most threads sampled in one pass. */
+#define KSPROFILER_MaxThreads 256
+
+/** How long a thread on Linux has to answer the sample signal, in microseconds. */
+#define KSPROFILER_SignalTimeout 10000
+
+typedef struct {
+    int count;
+    uintptr_t addresses[KSPROFILER_MaxDepth];
+} StackCapture;
+
+// ============================================================================
+#pragma mark - Globals -
+// ============================================================================
+
+static volatile bool g_isEnabled = false;
+
+/** Bumped whenever the monitor is enabled or disabled, so that a sampler thread
+ * from an earlier enable knows to stop.
+ */
+static _Atomic int g_samplerGeneration;
+
+static int64_t g_sampleInterval = 10000;
+static int64_t g_windowDuration = 1000000;
+
+static KSProfileWindow *g_windows;
+static volatile int g_currentWindow;
+static pthread_mutex_t g_windowMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Stacks captured in one pass, added to the window once the threads are running again. */
+static StackCapture *g_captures;
+
+/** Held by the sampler thread for each pass. */
+static pthread_mutex_t g_samplerMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// ============================================================================
+#pragma mark - Utility -
+// ============================================================================
+
+static int64_t getMicroseconds(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + (int64_t)ts.tv_nsec / 1000;
+}
+
+static int64_t getMonotonicMicroseconds(void) { return getMicroseconds(CLOCK_MONOTONIC); }
+
+/** Clear the next window in the ring and make it current. Call with g_windowMutex held. */
+static KSProfileWindow *startNextWindow(int64_t now)
+{
+    int index = (g_currentWindow + 1) % KSPROFILER_WindowCount;
+    KSProfileWindow *window = &g_windows[index];
+    // A crash report may read the window at any time, so it's marked invalid while it changes.
+    window->isValid = false;
+    atomic_thread_fence(memory_order_seq_cst);
+    window->startTime = now;
+    window->endTime = now;
+    window->sampleCount = 0;
+    window->droppedSampleCount = 0;
+    window->samplingTime = 0;
+    window->nodeCount = 1;
+    memset(&window->nodes[0], 0, sizeof(window->nodes[0]));
+    atomic_thread_fence(memory_order_seq_cst);
+    window->isValid = true;
+    g_currentWindow = index;
+    return window;
+}
+
+static KSProfileWindow *getCurrentWindow(int64_t now)
+{
+    KSProfileWindow *window = &g_windows[g_currentWindow];
+    if (!window->isValid || now - window->startTime >= g_windowDuration) {
+        window = startNextWindow(now);
+    }
+    return window;
+}
+
+/** Find or add the child of a node with the given address.
+ *
+ * @return The child's index, or 0 if the window is full.
+ */
+static uint32_t getChild(KSProfileWindow *window, uint32_t parentIndex, uintptr_t address)
+{
+    KSProfileNode *parent = &window->nodes[parentIndex];
+    for (uint32_t index = parent->firstChild; index != 0; index = window->nodes[index].nextSibling) {
+        if (window->nodes[index].address == address) {
+            return index;
+        }
+    }
+    if (window->nodeCount >= KSPROFILER_MaxNodes) {
+        return 0;
+    }
+    uint32_t index = window->nodeCount++;
+    KSProfileNode *node = &window->nodes[index];
+    node->address = address;
+    node->firstChild = 0;
+    node->sampleCount = 0;
+    node->nextSibling = parent->firstChild;
+    // The node has to be complete before a crash report can reach it.
+    atomic_store_explicit((_Atomic uint32_t *)&parent->firstChild, index, memory_order_release);
+    return index;
+}
+
+static void addSamplingTime(int64_t samplingTime)
+{
+    pthread_mutex_lock(&g_windowMutex);
+    getCurrentWindow(getMonotonicMicroseconds())->samplingTime += samplingTime;
+    pthread_mutex_unlock(&g_windowMutex);
+}
+
+// ============================================================================
+#pragma mark - Sampling -
+// ============================================================================
+
+#if KSCRASH_HOST_APPLE
+
+/** Capture the stacks of all other threads. */
+static int captureAllThreads(void)
+{
+#if KSCRASH_HAS_THREADS_API
+    thread_act_array_t threads = NULL;
+    mach_msg_type_number_t numThreads = 0;
+    ksmc_suspendEnvironment(&threads, &numThreads);
+    if (threads == NULL) {
+        return 0;
+    }
+
+    KSThread thisThread = ksthread_self();
+    KSMC_NEW_CONTEXT(machineContext);
+    int captureCount = 0;
+    for (mach_msg_type_number_t i = 0; i < numThreads && captureCount < KSPROFILER_MaxThreads; i++) {
+        if ((KSThread)threads[i] == thisThread) {
+            continue;
+        }
+        ksmc_getContextForThread((KSThread)threads[i], machineContext, false);
+        KSStackCursor stackCursor;
+        kssc_initWithUnwindTables(&stackCursor, KSPROFILER_MaxDepth, machineContext);
+        StackCapture *capture = &g_captures[captureCount];
+        capture->count = 0;
+        while (capture->count < KSPROFILER_MaxDepth && stackCursor.advanceCursor(&stackCursor)) {
+            capture->addresses[capture->count++] = stackCursor.stackEntry.address;
+        }
+        if (capture->count > 0) {
+            captureCount++;
+        }
+    }
+
+    ksmc_resumeEnvironment(threads, numThreads);
+    return captureCount;
+#else
+    return 0;
+#endif
+}
+
+static bool installSampling(void) { return true; }
+
+static void uninstallSampling(void) {}
+
+#elif KSCRASH_HOST_LINUX
+
+/** The phase of a signal capture, kept in the low bits of the capture state
+ * along with a sequence number. Each sample signal carries the sequence number
+ * of its capture, so that a handler that runs late can't write into a later
+ * capture.
+ */
+enum {
+    CapturePhaseAbandoned = 0,
+    CapturePhaseRequested = 1,
+    CapturePhaseCapturing = 2,
+    CapturePhaseDone = 3,
+    CapturePhaseMask = 3,
+};
+
+static _Atomic uint32_t g_captureState;
+static StackCapture g_signalCapture;
+static struct sigaction g_previousSignalHandler;
+
+/** Walk the interrupted stack by frame pointer. Async-safe. */
+static int walkSignalStack(const ucontext_t *userContext, uintptr_t *addresses, int maxCount)
+{
+#if defined(__x86_64__)
+    uintptr_t instructionAddress = (uintptr_t)userContext->uc_mcontext.gregs[REG_RIP];
+    uintptr_t framePointer = (uintptr_t)userContext->uc_mcontext.gregs[REG_RBP];
+    uintptr_t linkRegister = 0;
+#elif defined(__aarch64__)
+    uintptr_t instructionAddress = (uintptr_t)userContext->uc_mcontext.pc;
+    uintptr_t framePointer = (uintptr_t)userContext->uc_mcontext.regs[29];
+    uintptr_t linkRegister = (uintptr_t)userContext->uc_mcontext.regs[30];
+#else
+    (void)userContext;
+    uintptr_t instructionAddress = 0;
+    uintptr_t framePointer = 0;
+    uintptr_t linkRegister = 0;
+#endif
+    int count = 0;
+    if (instructionAddress == 0) {
+        return 0;
+    }
+    addresses[count++] = instructionAddress;
+    if (linkRegister != 0 && count < maxCount) {
+        addresses[count++] = linkRegister;
+    }
+    while (framePointer != 0 && count < maxCount) {
+        uintptr_t frame[2];
+        if (!ksmem_copySafely((const void *)framePointer, frame, sizeof(frame)) || frame[1] == 0) {
+            break;
+        }
+        addresses[count++] = frame[1];
+        if (frame[0] <= framePointer) {
+            break;
+        }
+        framePointer = frame[0];
+    }
+    return count;
+}
+
+/** Pass a SIGPROF that the profiler didn't send on to whoever had it before. */
+static void forwardSignal(int signum, siginfo_t *signalInfo, void *userContext)
+{
+    if (g_previousSignalHandler.sa_flags & SA_SIGINFO) {
+        if (g_previousSignalHandler.sa_sigaction != NULL) {
+            g_previousSignalHandler.sa_sigaction(signum, signalInfo, userContext);
+        }
+    } else if (g_previousSignalHandler.sa_handler != SIG_DFL && g_previousSignalHandler.sa_handler != SIG_IGN) {
+        g_previousSignalHandler.sa_handler(signum);
+    }
+    // The default action would terminate the process, which a stray SIGPROF
+    // shouldn't do just because the profiler is running. It's ignored instead.
+}
+
+static void handleSampleSignal(int signum, siginfo_t *signalInfo, void *userContext)
+{
+    if (signalInfo->si_code != SI_QUEUE) {
+        // Not one of ours (e.g. an ITIMER_PROF timer).
+        forwardSignal(signum, signalInfo, userContext);
+        return;
+    }
+    int savedErrno = errno;
+    uint32_t sequence = (uint32_t)signalInfo->si_value.sival_int;
+    uint32_t state = (sequence << 2) | CapturePhaseRequested;
+    if (atomic_compare_exchange_strong(&g_captureState, &state, (sequence << 2) | CapturePhaseCapturing)) {
+        g_signalCapture.count = walkSignalStack(userContext, g_signalCapture.addresses, KSPROFILER_MaxDepth);
+        atomic_store(&g_captureState, (sequence << 2) | CapturePhaseDone);
+    }
+    errno = savedErrno;
+}
+
+/** Send the sample signal to a thread, with the capture's sequence number as its value. */
+static bool sendSampleSignal(pid_t processID, pid_t threadID, uint32_t sequence)
+{
+    siginfo_t signalInfo;
+    memset(&signalInfo, 0, sizeof(signalInfo));
+    signalInfo.si_signo = SIGPROF;
+    signalInfo.si_code = SI_QUEUE;
+    signalInfo.si_pid = processID;
+    signalInfo.si_uid = getuid();
+    signalInfo.si_value.sival_int = (int)sequence;
+    return syscall(SYS_rt_tgsigqueueinfo, processID, threadID, SIGPROF, &signalInfo) == 0;
+}
+
+/** Have a thread capture its own stack in the signal handler, and wait for it. */
+static bool captureThread(pid_t processID, pid_t threadID, uint32_t sequence, StackCapture *capture)
+{
+    uint32_t requested = (sequence << 2) | CapturePhaseRequested;
+    atomic_store(&g_captureState, requested);
+    if (!sendSampleSignal(processID, threadID, sequence)) {
+        return false;
+    }
+    int64_t deadline = getMonotonicMicroseconds() + KSPROFILER_SignalTimeout;
+    for (;;) {
+        uint32_t state = atomic_load(&g_captureState);
+        if ((state & CapturePhaseMask) == CapturePhaseDone) {
+            *capture = g_signalCapture;
+            return capture->count > 0;
+        }
+        if ((state & CapturePhaseMask) == CapturePhaseRequested && getMonotonicMicroseconds() > deadline &&
+            atomic_compare_exchange_strong(&g_captureState, &state, (sequence << 2) | CapturePhaseAbandoned)) {
+            // The thread never ran the handler. If it does later, it will see the capture was abandoned.
+            return false;
+        }
+        sched_yield();
+    }
+}
+
+/** Capture the stacks of all other threads. */
+static int captureAllThreads(void)
+{
+    DIR *taskDir = opendir("/proc/self/task");
+    if (taskDir == NULL) {
+        return 0;
+    }
+    static uint32_t sequence;
+    pid_t processID = getpid();
+    pid_t thisThread = (pid_t)syscall(SYS_gettid);
+    int captureCount = 0;
+    struct dirent *entry;
+    while (captureCount < KSPROFILER_MaxThreads && (entry = readdir(taskDir)) != NULL) {
+        pid_t threadID = (pid_t)atoi(entry->d_name);
+        if (threadID <= 0 || threadID == thisThread) {
+            continue;
+        }
+        if (captureThread(processID, threadID, ++sequence, &g_captures[captureCount])) {
+            captureCount++;
+        }
+    }
+    closedir(taskDir);
+    return captureCount;
+}
+
+static bool installSampling(void)
+{
+    // Prime the memory reader outside of a signal handler.
+    uintptr_t primer = 0;
+    uintptr_t primerCopy;
+    ksmem_copySafely(&primer, &primerCopy, sizeof(primer));
+
+    struct sigaction action = { 0 };
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    action.sa_sigaction = handleSampleSignal;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &g_previousSignalHandler) != 0) {
+        KSLOG_ERROR("sigaction (SIGPROF): %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static void uninstallSampling(void)
+{
+    // A sample signal may still be on its way, and the default action for SIGPROF is to terminate.
+    struct sigaction action = g_previousSignalHandler;
+    if (!(action.sa_flags & SA_SIGINFO) && action.sa_handler == SIG_DFL) {
+        action.sa_handler = SIG_IGN;
+    }
+    sigaction(SIGPROF, &action, NULL);
+}
+
+#else
+
+static int captureAllThreads(void) { return 0; }
+
+static bool installSampling(void) { return false; }
+
+static void uninstallSampling(void) {}
+
+#endif
+
+static void *samplerThread(void *userData)
+{
+    int generation = (int)(intptr_t)userData;
+    for (;;) {
+        // A sampler from an earlier enable may still be finishing its pass.
+        pthread_mutex_lock(&g_samplerMutex);
+        if (atomic_load(&g_samplerGeneration) != generation) {
+            pthread_mutex_unlock(&g_samplerMutex);
+            break;
+        }
+        // Sampling cost is the sampler's CPU time. Waiting for other threads to be
+        // scheduled costs nothing, and shouldn't slow sampling down.
+        int64_t startTime = getMicroseconds(CLOCK_THREAD_CPUTIME_ID);
+        int captureCount = captureAllThreads();
+        for (int i = 0; i < captureCount; i++) {
+            kscm_profiler_addSample(g_captures[i].addresses, g_captures[i].count);
+        }
+        int64_t samplingTime = getMicroseconds(CLOCK_THREAD_CPUTIME_ID) - startTime;
+        addSamplingTime(samplingTime);
+        pthread_mutex_unlock(&g_samplerMutex);
+
+        // Back off when sampling is slow, so that it stays under the overhead limit.
+        int64_t sleepTime = g_sampleInterval - samplingTime;
+        int64_t minSleepTime = (int64_t)((double)samplingTime * (1.0 / KSPROFILER_MaxOverhead - 1.0));
+        if (sleepTime < minSleepTime) {
+            sleepTime = minSleepTime;
+        }
+        if (sleepTime > 0) {
+            usleep((useconds_t)sleepTime);
+        }
+    }
+    return NULL;
+}
+
+// ============================================================================
+#pragma mark - API -
+// ============================================================================
+
+static bool install(void)
+{
+    if (g_windows == NULL) {
+        g_windows = calloc(KSPROFILER_WindowCount, sizeof(*g_windows));
+        g_captures = calloc(KSPROFILER_MaxThreads, sizeof(*g_captures));
+        if (g_windows == NULL || g_captures == NULL) {
+            KSLOG_ERROR("Could not allocate %zu bytes for profiling",
+                        KSPROFILER_WindowCount * sizeof(*g_windows) + KSPROFILER_MaxThreads * sizeof(*g_captures));
+            free(g_windows);
+            free(g_captures);
+            g_windows = NULL;
+            g_captures = NULL;
+            return false;
+        }
+    }
+    if (!installSampling()) {
+        return false;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int generation = atomic_load(&g_samplerGeneration);
+    int error = pthread_create(&thread, &attr, samplerThread, (void *)(intptr_t)generation);
+    pthread_attr_destroy(&attr);
+    if (error != 0) {
+        KSLOG_ERROR("pthread_create: %s", strerror(error));
+        uninstallSampling();
+        return false;
+    }
+    return true;
+}
+
+static const char *monitorId(void) { return "Profiler"; }
+
+static void setEnabled(bool isEnabled)
+{
+    if (isEnabled != g_isEnabled) {
+        atomic_fetch_add(&g_samplerGeneration, 1);
+        g_isEnabled = isEnabled;
+        if (isEnabled) {
+            if (!install()) {
+                g_isEnabled = false;
+            }
+        } else {
+            uninstallSampling();
+        }
+    }
+}
+
+static bool isEnabled(void) { return g_isEnabled; }
+
+static void addContextualInfoToEvent(KSCrash_MonitorContext *eventContext)
+{
+    if (g_isEnabled) {
+        eventContext->Profile.window = kscm_profiler_getRecentWindow();
+    }
+}
+
+KSCrashMonitorAPI *kscm_profiler_getAPI(void)
+{
+    static KSCrashMonitorAPI api = {
+        .monitorId = monitorId,
+        .setEnabled = setEnabled,
+        .isEnabled = isEnabled,
+        .addContextualInfoToEvent = addContextualInfoToEvent,
+    };
+    return &api;
+}
+
+void kscm_setProfilerSampleInterval(double value)
+{
+    if (value > 0) {
+        g_sampleInterval = (int64_t)(value * 1000000);
+    }
+}
+
+void kscm_setProfilerWindowDuration(double value)
+{
+    if (value > 0) {
+        g_windowDuration = (int64_t)(value * 1000000);
+    }
+}
+
+bool kscm_profiler_addSample(const uintptr_t *addresses, int count)
+{
+    if (!g_isEnabled || g_windows == NULL || count <= 0) {
+        return false;
+    }
+    if (count > KSPROFILER_MaxDepth) {
+        count = KSPROFILER_MaxDepth;
+    }
+
+    pthread_mutex_lock(&g_windowMutex);
+    int64_t now = getMonotonicMicroseconds();
+    KSProfileWindow *window = getCurrentWindow(now);
+    window->endTime = now;
+
+    // The stack is innermost first, and the tree is outermost first.
+    uint32_t path[KSPROFILER_MaxDepth];
+    uint32_t nodeIndex = 0;
+    int depth = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        nodeIndex = getChild(window, nodeIndex, addresses[i]);
+        if (nodeIndex == 0) {
+            break;
+        }
+        path[depth++] = nodeIndex;
+    }
+    bool isAdded = nodeIndex != 0;
+    if (isAdded) {
+        window->sampleCount++;
+        window->nodes[0].sampleCount++;
+        for (int i = 0; i < depth; i++) {
+            window->nodes[path[i]].sampleCount++;
+        }
+    } else {
+        window->droppedSampleCount++;
+    }
+    pthread_mutex_unlock(&g_windowMutex);
+    return isAdded;
+}
+
+const KSProfileWindow *kscm_profiler_getRecentWindow(void)
+{
+    if (g_windows == NULL) {
+        return NULL;
+    }
+    int current = g_currentWindow;
+    for (int i = 0; i < KSPROFILER_WindowCount; i++) {
+        const KSProfileWindow *window = &g_windows[(current - i + KSPROFILER_WindowCount) % KSPROFILER_WindowCount];
+        if (window->isValid && window->sampleCount > 0) {
+            return window;
+        }
+    }
+    return NULL;
+}
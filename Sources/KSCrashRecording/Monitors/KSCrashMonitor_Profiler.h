@@ -0,0 +1,145 @@
+//
+//  KSCrashMonitor_Profiler.h
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+/* Samples the stacks of all threads at a regular interval, so that a report
+ * can show what the process was doing in the moments before it crashed or hung.
+ *
+ * Samples are merged into a call tree (a trie of return addresses, outermost
+ * frame first). The trees live in a ring of time windows that are allocated
+ * when the monitor is enabled, so sampling never allocates memory. Reports
+ * include the most recent window.
+ *
+ * On Apple platforms, the sampler thread suspends the other threads and walks
+ * their machine contexts. On Linux, each thread is sent SIGPROF and walks its
+ * own frame pointers in the signal handler. Like any SIGPROF profiler, this
+ * interrupts sleeps and other calls that don't restart after a signal (EINTR).
+ *
+ * The time spent sampling is recorded in each window, and the sampler backs off
+ * to keep it under KSPROFILER_MaxOverhead of one CPU.
+ */
+
+#ifndef HDR_KSCrashMonitor_Profiler_h
+#define HDR_KSCrashMonitor_Profiler_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "KSCrashMonitor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The most frames recorded per sample. */
+#define KSPROFILER_MaxDepth 64
+
+/** The most call tree nodes in a window. Samples that need more are dropped. */
+#define KSPROFILER_MaxNodes 4096
+
+/** The number of windows in the ring. */
+#define KSPROFILER_WindowCount 4
+
+/** The fraction of one CPU that sampling may use. */
+#define KSPROFILER_MaxOverhead 0.05
+
+/** A call tree node. Node 0 is the root, and has no address. */
+typedef struct {
+    /** The return (or, for the innermost frame, instruction) address. */
+    uintptr_t address;
+
+    /** The index of the first child (0 = none). */
+    uint32_t firstChild;
+
+    /** The index of the next node with the same parent (0 = none). */
+    uint32_t nextSibling;
+
+    /** The number of samples that passed through this node. */
+    uint32_t sampleCount;
+} KSProfileNode;
+
+/** The samples taken during one slice of time. */
+typedef struct {
+    /** False while the window is being cleared for reuse. */
+    volatile bool isValid;
+
+    /** When the window began, in monotonic microseconds. */
+    int64_t startTime;
+
+    /** When the last sample was added, in monotonic microseconds. */
+    int64_t endTime;
+
+    /** The number of samples taken, counting one per thread. */
+    uint32_t sampleCount;
+
+    /** The number of samples that didn't fit in the call tree. */
+    uint32_t droppedSampleCount;
+
+    /** The CPU time the sampler spent taking the samples, in microseconds. */
+    int64_t samplingTime;
+
+    /** The number of nodes in use, including the root. */
+    uint32_t nodeCount;
+    KSProfileNode nodes[KSPROFILER_MaxNodes];
+} KSProfileWindow;
+
+/** Set the interval between samples.
+ * Default is 10 milliseconds.
+ *
+ * @param value The number of seconds between samples.
+ */
+void kscm_setProfilerSampleInterval(double value);
+
+/** Set how long each window covers.
+ * Default is 1 second.
+ *
+ * @param value The number of seconds that each window covers.
+ */
+void kscm_setProfilerWindowDuration(double value);
+
+/** Add a sample to the current window. The sampler calls this for each
+ * thread, but it can also be called directly.
+ *
+ * @param addresses The stack, innermost frame first.
+ *
+ * @param count The number of addresses.
+ *
+ * @return true if the sample was added, false if the monitor isn't enabled or the window is full.
+ */
+bool kscm_profiler_addSample(const uintptr_t *addresses, int count);
+
+/** Get the most recent window that has samples. Async-safe.
+ *
+ * @return The window, or NULL if there are no samples.
+ */
+const KSProfileWindow *kscm_profiler_getRecentWindow(void);
+
+/** Access the Monitor API.
+ */
+KSCrashMonitorAPI *kscm_profiler_getAPI(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HDR_KSCrashMonitor_Profiler_h
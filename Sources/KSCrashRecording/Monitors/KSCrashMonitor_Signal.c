@@ -26,6 +26,7 @@
 
 #include "KSCrashMonitor_Signal.h"
 
+#include "KSArena.h"
 #include "KSCrashMonitorContext.h"
 #include "KSCrashMonitorContextHelper.h"
 #include "KSCrashMonitorHelper.h"
@@ -34,7 +35,7 @@
 #include "KSID.h"
 #include "KSMachineContext.h"
 #include "KSSignalInfo.h"
-#include "KSStackCursor_MachineContext.h"
+#include "KSStackCursor_Unwind.h"
 #include "KSSystemCapabilities.h"
 
 // #define KSLogger_LocalLevel TRACE
@@ -59,6 +60,9 @@ static KSCrash_MonitorContext g_monitorContext;
 static KSStackCursor g_stackCursor;
 
 #if KSCRASH_HAS_SIGNAL_STACK
+/** The size of our signal stack. Report writing runs on it, so it is larger than the system minimum. */
+#define KSSIGNAL_StackSize (SIGSTKSZ > 65536 ? SIGSTKSZ : 65536)
+
 /** Our custom signal stack. The signal handler will use this as its stack. */
 static stack_t g_signalStack = { 0 };
 #endif
@@ -103,7 +107,7 @@ static void handleSignal(int sigNum, siginfo_t *signalInfo, void *userContext)
         KSLOG_DEBUG("Filling out context.");
         KSMC_NEW_CONTEXT(machineContext);
         ksmc_getContextForSignal(userContext, machineContext);
-        kssc_initWithMachineContext(&g_stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
+        kssc_initWithUnwindTables(&g_stackCursor, KSSC_MAX_STACK_DEPTH, machineContext);
 
         KSCrash_MonitorContext *crashContext = &g_monitorContext;
         memset(crashContext, 0, sizeof(*crashContext));
@@ -140,8 +144,12 @@ static bool installSignalHandler(void)
 
     if (g_signalStack.ss_size == 0) {
         KSLOG_DEBUG("Allocating signal stack area.");
-        g_signalStack.ss_size = SIGSTKSZ;
-        g_signalStack.ss_sp = malloc(g_signalStack.ss_size);
+        // Prefer the crash arena, where the stack sits on top of a guard page.
+        g_signalStack.ss_size = KSSIGNAL_StackSize;
+        g_signalStack.ss_sp = ksarena_allocPermanent(g_signalStack.ss_size);
+        if (g_signalStack.ss_sp == NULL) {
+            g_signalStack.ss_sp = malloc(g_signalStack.ss_size);
+        }
     }
 
     KSLOG_DEBUG("Setting signal stack area.");
@@ -205,9 +213,6 @@ static void uninstallSignalHandler(void)
         sigaction(fatalSignals[i], &g_previousSignalHandlers[i], NULL);
     }
 
-#if KSCRASH_HAS_SIGNAL_STACK
-    g_signalStack = (stack_t) { 0 };
-#endif
     KSLOG_DEBUG("Signal handlers uninstalled.");
 }
 
@@ -41,6 +41,34 @@
 extern "C" {
 #endif
 
+/** Time spent in each phase of kscrash_install(), in microseconds.
+ */
+typedef struct {
+    /** Applying the configuration. */
+    int64_t configuration;
+
+    /** Initializing the report store (maintenance runs later, in the background). */
+    int64_t reportStore;
+
+    /** Creating the data directory and initializing the memory monitor's storage. */
+    int64_t memory;
+
+    /** Loading and updating the persisted crash state. */
+    int64_t crashState;
+
+    /** Printing the previous console log, if enabled, and opening the new one. */
+    int64_t consoleLog;
+
+    /** Starting the cached data thread. */
+    int64_t cachedData;
+
+    /** Installing and activating the crash monitors. */
+    int64_t monitors;
+
+    /** The whole of kscrash_install(). */
+    int64_t total;
+} KSCrashInstallTimings;
+
 /**
  * Install the crash reporter. This function initializes and configures the crash
  * reporter for the specified application, allowing it to monitor and record crashes.
@@ -85,6 +113,11 @@ extern "C" {
 KSCrashInstallErrorCode kscrash_install(const char *appName, const char *const installPath,
                                         KSCrashCConfiguration *configuration);
 
+/** Get how long each phase of kscrash_install() took.
+ * Phases that were not reached (because installation failed or has not happened) are 0.
+ */
+KSCrashInstallTimings kscrash_getInstallTimings(void);
+
 /** Set the user-supplied data in JSON format.
  *
  * @param userInfoJSON Pre-baked JSON containing user-supplied information.
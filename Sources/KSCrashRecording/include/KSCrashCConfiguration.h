@@ -43,6 +43,39 @@ extern "C" {
  */
 typedef void (*KSReportWrittenCallback)(int64_t reportID);
 
+/** Function type for demangling a symbol name.
+ *
+ * @param mangledSymbol The possibly mangled symbol.
+ *
+ * @return The demangled symbol, or NULL if it could not be demangled.
+ *         The caller is responsible for calling free() on the returned value.
+ */
+typedef char *(*KSReportDemangleFunction)(const char *mangledSymbol);
+
+// clang-format off
+/** How reports added with `kscrs_addUserReport` are made durable. */
+#ifdef __OBJC__
+typedef NS_ENUM(NSUInteger, KSCrashReportDurability)
+#else
+enum
+#endif
+{
+    /** Reports are written in place and never synced. The OS writes them to disk eventually. */
+    KSCrashReportDurabilityNone = 0,
+
+    /** Reports are written to temporary files, then a commit thread syncs them in batches
+     * and renames them into place. A report is either complete or not in the store.
+     * Reports that weren't committed when the process ended are discarded. */
+    KSCrashReportDurabilityGroupCommit,
+
+    /** Like group commit, but every report is synced and renamed before `kscrs_addUserReport` returns. */
+    KSCrashReportDurabilitySync,
+} NS_SWIFT_NAME(CrashReportDurability);
+#ifndef __OBJC__
+typedef int KSCrashReportDurability;
+#endif
+// clang-format on
+
 /** Configuration for managing crash reports through the report store API.
  */
 typedef struct {
@@ -70,6 +103,65 @@ typedef struct {
      * **Default**: 5
      */
     int maxReportCount;
+
+    /** The maximum number of full crash reports to retain per crash fingerprint.
+     *
+     * Crash reports carry a fingerprint built from the crash type, the top frames of the
+     * crashed thread and the app version. When this is greater than 0, only the first
+     * reports of each fingerprint are kept in full. Later occurrences are reduced to
+     * compact occurrence records (timestamp and report ID) attached to the oldest report
+     * with the same fingerprint. 0 disables deduplication.
+     *
+     * **Default**: 0
+     */
+    int maxReportsPerFingerprint;
+
+    /** The maximum total size in bytes of all crash reports retained on disk.
+     *
+     * Enforced every time a report is added. When exceeded, the oldest reports are
+     * removed until the total fits again. The newest report is always kept.
+     * 0 disables this limit.
+     *
+     * **Default**: 0
+     */
+    int64_t maxReportsTotalSize;
+
+    /** The maximum age in seconds of a crash report retained on disk.
+     *
+     * Enforced every time a report is added. Older reports are removed.
+     * The newest report is always kept. 0 disables this limit.
+     *
+     * **Default**: 0
+     */
+    double maxReportAge;
+
+    /** Function used to demangle symbol names while reports are read.
+     *
+     * Demangling then happens in the same pass that fixes up the raw report,
+     * instead of in a filter after the report has been parsed.
+     * NULL disables it.
+     *
+     * **Default**: NULL
+     */
+    KSReportDemangleFunction demangleFunction;
+
+    /** How reports added with `kscrs_addUserReport` are made durable.
+     *
+     * **Default**: KSCrashReportDurabilityNone
+     */
+    KSCrashReportDurability durability;
+
+    /** With group commit, the longest a report waits before its batch is synced, in seconds.
+     *
+     * **Default**: 0.05
+     */
+    double groupCommitInterval;
+
+    /** With group commit, the number of waiting reports that triggers a sync right away.
+     *
+     * **Default**: 32
+     */
+    int groupCommitMaxReports;
 } KSCrashReportStoreCConfiguration;
 
 static inline KSCrashReportStoreCConfiguration KSCrashReportStoreCConfiguration_Default(void)
@@ -78,6 +170,13 @@ static inline KSCrashReportStoreCConfiguration KSCrashReportStoreCConfiguration_
         .appName = NULL,
         .reportsPath = NULL,
         .maxReportCount = 5,
+        .maxReportsPerFingerprint = 0,
+        .maxReportsTotalSize = 0,
+        .maxReportAge = 0,
+        .demangleFunction = NULL,
+        .durability = KSCrashReportDurabilityNone,
+        .groupCommitInterval = 0.05,
+        .groupCommitMaxReports = 32,
     };
 }
 
@@ -88,6 +187,13 @@ static inline KSCrashReportStoreCConfiguration KSCrashReportStoreCConfiguration_
         .appName = configuration->appName ? strdup(configuration->appName) : NULL,
         .reportsPath = configuration->reportsPath ? strdup(configuration->reportsPath) : NULL,
         .maxReportCount = configuration->maxReportCount,
+        .maxReportsPerFingerprint = configuration->maxReportsPerFingerprint,
+        .maxReportsTotalSize = configuration->maxReportsTotalSize,
+        .maxReportAge = configuration->maxReportAge,
+        .demangleFunction = configuration->demangleFunction,
+        .durability = configuration->durability,
+        .groupCommitInterval = configuration->groupCommitInterval,
+        .groupCommitMaxReports = configuration->groupCommitMaxReports,
     };
 }
 
@@ -190,6 +296,33 @@ typedef struct {
      */
     bool addConsoleLogToReport;
 
+    /** The maximum number of console log lines to add to the crash report.
+     *
+     * Only the last lines of the log are added, so that reports from long running
+     * processes don't have to encode the whole log. 0 means no limit.
+     *
+     * **Default**: 0
+     */
+    int maxConsoleLogLines;
+
+    /** The maximum number of console log bytes to add to the crash report.
+     *
+     * Only the end of the log is added, starting at a line boundary. 0 means no limit.
+     *
+     * **Default**: 0
+     */
+    int maxConsoleLogBytes;
+
+    /** If greater than 0, keep the console log in a memory mapped ring buffer of this many bytes.
+     *
+     * Log calls then only copy into memory instead of writing to the log file, and
+     * the last part of the log still survives a crash. The size is rounded up to a
+     * whole number of pages. Log messages are not echoed to stdout in this mode.
+     *
+     * **Default**: 0
+     */
+    int consoleLogBufferSize;
+
     /** If true, print the previous log to the console on startup.
      *
      * This option is for debugging purposes and will print the previous log to the
@@ -220,6 +353,56 @@ typedef struct {
      * **Default**: false
      */
     bool enableSigTermMonitoring;
+
+    /** If true, crash stack traces are walked using the unwind info in each
+     * loaded image (compact unwind and DWARF CFI) instead of frame pointers alone.
+     *
+     * This finds frames that frame pointer walking skips, such as functions built
+     * without frame pointers and functions that crashed before setting up their frame.
+     * The unwind info is parsed into lookup tables on a background thread at install
+     * time, which costs some memory for every loaded image.
+     *
+     * **Default**: false
+     */
+    bool enableUnwindTables;
+
+    /** If the profiler monitor (KSCrashMonitorTypeProfiler) is enabled, the stacks of
+     * all threads are sampled this often, in seconds. Sampling backs off on its own when
+     * a pass takes long enough that it would use more than 5% of one core.
+     *
+     * **Default**: 0.01
+     */
+    double profilerSampleInterval;
+
+    /** The profiler monitor keeps its samples in windows of this length, in seconds.
+     * Crash reports include the most recent window.
+     *
+     * **Default**: 1.0
+     */
+    double profilerWindowDuration;
+
+    /** If true, threads with the same backtrace as an earlier thread refer to it.
+     *
+     * Each thread's raw return addresses are hashed before its backtrace is written.
+     * When an earlier thread had the same addresses, the thread gets a `same_backtrace_as`
+     * field with that thread's index instead of a `backtrace`. This shrinks reports and
+     * speeds up writing them for processes with large pools of idle threads. The crashed
+     * thread's backtrace is always written in full.
+     *
+     * **Default**: false
+     */
+    bool collapseIdenticalBacktraces;
+
+    /** If true, a minidump is written next to each crash report.
+     *
+     * The minidump has the same name as the report, with a `.dmp` extension. It holds
+     * each thread's registers and stack, the loaded images, and the memory around the
+     * crashed thread's registers, so that minidump tooling can process the crash.
+     * Deleting a report from the report store also deletes its minidump.
+     *
+     * **Default**: false
+     */
+    bool writeMinidump;
 } KSCrashCConfiguration;
 
 static inline KSCrashCConfiguration KSCrashCConfiguration_Default(void)
@@ -235,9 +418,17 @@ static inline KSCrashCConfiguration KSCrashCConfiguration_Default(void)
         .crashNotifyCallback = NULL,
         .reportWrittenCallback = NULL,
         .addConsoleLogToReport = false,
+        .maxConsoleLogLines = 0,
+        .maxConsoleLogBytes = 0,
+        .consoleLogBufferSize = 0,
         .printPreviousLogOnStartup = false,
         .enableSwapCxaThrow = true,
         .enableSigTermMonitoring = false,
+        .enableUnwindTables = false,
+        .profilerSampleInterval = 0.01,
+        .profilerWindowDuration = 1.0,
+        .collapseIdenticalBacktraces = false,
+        .writeMinidump = false,
     };
 }
 
@@ -25,6 +25,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "KSCrashCConfiguration.h"
 #import "KSCrashMonitorType.h"
 #import "KSCrashReportStore.h"
 #import "KSCrashReportWriter.h"
@@ -144,6 +145,36 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property(nonatomic, assign) BOOL addConsoleLogToReport; // 是否将控制台日志添加到报告
 
+/**
+ * The maximum number of console log lines to add to the crash report.
+ *
+ * Only the last lines of the log are added, so that reports from long running
+ * processes don't have to encode the whole log. 0 means no limit.
+ *
+ * **Default**: 0
+ */
+@property(nonatomic, assign) NSInteger maxConsoleLogLines;
+
+/**
+ * The maximum number of console log bytes to add to the crash report.
+ *
+ * Only the end of the log is added, starting at a line boundary. 0 means no limit.
+ *
+ * **Default**: 0
+ */
+@property(nonatomic, assign) NSInteger maxConsoleLogBytes;
+
+/**
+ * If greater than 0, keep the console log in a memory mapped ring buffer of this many bytes.
+ *
+ * Log calls then only copy into memory instead of writing to the log file, and
+ * the last part of the log still survives a crash. The size is rounded up to a
+ * whole number of pages. Log messages are not echoed to stdout in this mode.
+ *
+ * **Default**: 0
+ */
+@property(nonatomic, assign) NSInteger consoleLogBufferSize;
+
 /**
  * If true, print the previous log to the console on startup.
  *
@@ -178,6 +209,61 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property(nonatomic, assign) BOOL enableSigTermMonitoring; // 是否监控 SIGTERM 信号
 
+/**
+ * If true, crash stack traces are walked using the unwind info in each
+ * loaded image (compact unwind and DWARF CFI) instead of frame pointers alone.
+ *
+ * This finds frames that frame pointer walking skips, such as functions built
+ * without frame pointers and functions that crashed before setting up their frame.
+ * The unwind info is parsed into lookup tables on a background thread at install
+ * time, which costs some memory for every loaded image.
+ *
+ * **Default**: false
+ */
+@property(nonatomic, assign) BOOL enableUnwindTables;
+
+/**
+ * If the profiler monitor (KSCrashMonitorTypeProfiler) is enabled, the stacks of
+ * all threads are sampled this often, in seconds. Sampling backs off on its own when
+ * a pass takes long enough that it would use more than 5% of one core.
+ *
+ * **Default**: 0.01
+ */
+@property(nonatomic, assign) double profilerSampleInterval;
+
+/**
+ * The profiler monitor keeps its samples in windows of this length, in seconds.
+ * Crash reports include the most recent window.
+ *
+ * **Default**: 1.0
+ */
+@property(nonatomic, assign) double profilerWindowDuration;
+
+/**
+ * If true, threads with the same backtrace as an earlier thread refer to it.
+ *
+ * Each thread's raw return addresses are hashed before its backtrace is written.
+ * When an earlier thread had the same addresses, the thread gets a `same_backtrace_as`
+ * field with that thread's index instead of a `backtrace`. This shrinks reports and
+ * speeds up writing them for processes with large pools of idle threads. The crashed
+ * thread's backtrace is always written in full.
+ *
+ * **Default**: false
+ */
+@property(nonatomic, assign) BOOL collapseIdenticalBacktraces;
+
+/**
+ * If true, a minidump is written next to each crash report.
+ *
+ * The minidump has the same name as the report, with a `.dmp` extension. It holds
+ * each thread's registers and stack, the loaded images, and the memory around the
+ * crashed thread's registers, so that minidump tooling can process the crash.
+ * Deleting a report from the report store also deletes its minidump.
+ *
+ * **Default**: false
+ */
+@property(nonatomic, assign) BOOL writeMinidump;
+
 @end
 
 
@@ -207,6 +293,69 @@ NS_SWIFT_NAME(CrashReportStoreConfiguration)
  */
 @property(nonatomic, assign) NSInteger maxReportCount;
 
+/** The maximum number of full crash reports to keep per crash fingerprint.
+ *
+ * When greater than 0, repeated occurrences of the same crash (same crash type, top
+ * frames of the crashed thread and app version) beyond this number are not kept in full.
+ * They are reduced to occurrence records that get attached to the first report
+ * of that crash under the `occurrences` key. 0 disables deduplication.
+ *
+ * **Default**: 0
+ */
+@property(nonatomic, assign) NSInteger maxReportsPerFingerprint;
+
+/** The maximum total size in bytes of all crash reports kept on disk.
+ *
+ * Checked every time a report is added. When exceeded, the oldest reports
+ * will be deleted until the total fits again. 0 disables this limit.
+ *
+ * **Default**: 0
+ */
+@property(nonatomic, assign) long long maxReportsTotalSize;
+
+/** The maximum age of a crash report kept on disk.
+ *
+ * Checked every time a report is added. Older reports will be deleted.
+ * 0 disables this limit.
+ *
+ * **Default**: 0
+ */
+@property(nonatomic, assign) NSTimeInterval maxReportAge;
+
+/** Function used to demangle symbol names while reports are read from the store.
+ *
+ * `ksdm_demangleSymbol` from the DemangleFilter module handles C++ and Swift symbols.
+ * When set, reports come out of the store already demangled and
+ * `KSCrashReportFilterDemangle` is not needed. `NULL` disables it.
+ *
+ * **Default**: `NULL`
+ */
+@property(nonatomic, assign, nullable) KSReportDemangleFunction demangleFunction;
+
+/** How reports added with `-[KSCrash reportUserException:...]` and similar are made durable.
+ *
+ * - `KSCrashReportDurabilityNone` writes reports in place without syncing them.
+ * - `KSCrashReportDurabilityGroupCommit` syncs reports in batches on a background thread,
+ *   and only moves them into the store once they are on disk. Reports still waiting when
+ *   the process ends are discarded.
+ * - `KSCrashReportDurabilitySync` syncs every report before returning.
+ *
+ * **Default**: `KSCrashReportDurabilityNone`
+ */
+@property(nonatomic, assign) KSCrashReportDurability durability;
+
+/** With group commit, the longest a report waits before its batch is synced.
+ *
+ * **Default**: 0.05
+ */
+@property(nonatomic, assign) NSTimeInterval groupCommitInterval;
+
+/** With group commit, the number of waiting reports that triggers a sync right away.
+ *
+ * **Default**: 32
+ */
+@property(nonatomic, assign) NSInteger groupCommitMaxReports;
+
 /** What to do after sending reports via `-[KSCrashReportStore sendAllReportsWithCompletion:]`.
  *
  * - Use `KSCrashReportCleanupPolicyNever` if you manually manage the reports.
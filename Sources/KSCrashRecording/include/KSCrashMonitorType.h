@@ -87,6 +87,9 @@ enum
     /** Monitor memory to detect OOMs at startup. */
     KSCrashMonitorTypeMemoryTermination  = 1 << 9,
 
+    /** Periodically sample the stacks of all threads, and add the most recent samples to reports. */
+    KSCrashMonitorTypeProfiler           = 1 << 10,
+
     /** Enable all monitoring options. */
     KSCrashMonitorTypeAll = (
                              KSCrashMonitorTypeMachException |
@@ -98,7 +101,8 @@ enum
                              KSCrashMonitorTypeSystem |
                              KSCrashMonitorTypeApplicationState |
                              KSCrashMonitorTypeZombie |
-                             KSCrashMonitorTypeMemoryTermination
+                             KSCrashMonitorTypeMemoryTermination |
+                             KSCrashMonitorTypeProfiler
                              ),
 
     /** Fatal monitors track exceptions that lead to error termination of the process.. */
@@ -111,7 +115,7 @@ enum
                                ),
 
     /** Enable experimental monitoring options. */
-    KSCrashMonitorTypeExperimental = KSCrashMonitorTypeMainThreadDeadlock,
+    KSCrashMonitorTypeExperimental = (KSCrashMonitorTypeMainThreadDeadlock | KSCrashMonitorTypeProfiler),
 
     /** Monitor options unsafe for use with a debugger. */
     KSCrashMonitorTypeDebuggerUnsafe = KSCrashMonitorTypeMachException,
@@ -134,6 +134,7 @@ KSCRF_DEFINE_CONSTANT(KSCrashField, CurrentThread, currentThread, "current_threa
 KSCRF_DEFINE_CONSTANT(KSCrashField, DispatchQueue, dispatchQueue, "dispatch_queue")
 KSCRF_DEFINE_CONSTANT(KSCrashField, NotableAddresses, notableAddresses, "notable_addresses")
 KSCRF_DEFINE_CONSTANT(KSCrashField, Registers, registers, "registers")
+KSCRF_DEFINE_CONSTANT(KSCrashField, SameBacktraceAs, sameBacktraceAs, "same_backtrace_as")
 KSCRF_DEFINE_CONSTANT(KSCrashField, Skipped, skipped, "skipped")
 KSCRF_DEFINE_CONSTANT(KSCrashField, Stack, stack, "stack")
 
@@ -187,12 +188,25 @@ KSCRF_DEFINE_CONSTANT(KSCrashField, LaunchesSinceCrash, launchesSinceCrash, "lau
 KSCRF_DEFINE_CONSTANT(KSCrashField, SessionsSinceCrash, sessionsSinceCrash, "sessions_since_last_crash")
 KSCRF_DEFINE_CONSTANT(KSCrashField, SessionsSinceLaunch, sessionsSinceLaunch, "sessions_since_launch")
 
+#pragma mark - Profile -
+
+KSCRF_DEFINE_CONSTANT(KSCrashField, Age, age, "age")
+KSCRF_DEFINE_CONSTANT(KSCrashField, DroppedSamples, droppedSamples, "dropped_samples")
+KSCRF_DEFINE_CONSTANT(KSCrashField, Duration, duration, "duration")
+KSCRF_DEFINE_CONSTANT(KSCrashField, Nodes, nodes, "nodes")
+KSCRF_DEFINE_CONSTANT(KSCrashField, Profile, profile, "profile")
+KSCRF_DEFINE_CONSTANT(KSCrashField, SampleCount, sampleCount, "sample_count")
+KSCRF_DEFINE_CONSTANT(KSCrashField, SamplingTime, samplingTime, "sampling_time")
+
 #pragma mark - Report -
 
 KSCRF_DEFINE_CONSTANT(KSCrashField, Crash, crash, "crash")
 KSCRF_DEFINE_CONSTANT(KSCrashField, Debug, debug, "debug")
+KSCRF_DEFINE_CONSTANT(KSCrashField, CrashedThreadFingerprint, crashedThreadFingerprint, "crashed_thread_fingerprint")
 KSCRF_DEFINE_CONSTANT(KSCrashField, Diagnosis, diagnosis, "diagnosis")
+KSCRF_DEFINE_CONSTANT(KSCrashField, Fingerprint, fingerprint, "fingerprint")
 KSCRF_DEFINE_CONSTANT(KSCrashField, ID, id, "id")
+KSCRF_DEFINE_CONSTANT(KSCrashField, Occurrences, occurrences, "occurrences")
 KSCRF_DEFINE_CONSTANT(KSCrashField, ProcessName, processName, "process_name")
 KSCRF_DEFINE_CONSTANT(KSCrashField, Report, report, "report")
 KSCRF_DEFINE_CONSTANT(KSCrashField, Timestamp, timestamp, "timestamp")
@@ -27,6 +27,7 @@
 #ifndef HDR_KSCrashReportStoreC_h
 #define HDR_KSCrashReportStoreC_h
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "KSCrashCConfiguration.h"
@@ -42,7 +43,20 @@ extern "C" {
  */
 #define KSCRS_DEFAULT_REPORTS_FOLDER "Reports"
 
+/** A compact record of a crash that was folded into an earlier report with the same fingerprint.
+ */
+typedef struct {
+    /** The ID the folded report had in the store. */
+    int64_t reportID;
+
+    /** When the folded report was written, in microseconds since the epoch. */
+    int64_t timestamp;
+} KSCrashReportOccurrence;
+
 /** Initialize the report store.
+ *
+ * Only the reports directory is created here. Deduplication, index rebuilding and
+ * pruning run afterwards on a low priority maintenance thread.
  *
  * @param configuration The store configuretion (e.g. reports path, app name etc).
  */
@@ -88,7 +102,53 @@ char *kscrs_readReport(int64_t reportID, const KSCrashReportStoreCConfiguration
  */
 char *kscrs_readReportAtPath(const char *path);
 
+/** Read several reports at once.
+ * Fixups are spread over a small pool of worker threads. Where the platform allows it,
+ * the reads are batched into a few system calls, otherwise the workers do them too.
+ *
+ * @warning MEMORY MANAGEMENT WARNING: User is responsible for calling free() on each non-NULL entry of reports.
+ *
+ * @param reportIDs The IDs of the reports to read.
+ * @param count The number of report IDs.
+ * @param reports An array of `count` entries that receives the NULL terminated reports in the same
+ *                order as reportIDs. Entries for reports that could not be read are set to NULL.
+ * @param configuration The store configuretion (e.g. reports path, app name etc).
+ *
+ * @return The number of reports that were successfully read.
+ */
+int kscrs_readReports(const int64_t *reportIDs, int count, char **reports,
+                      const KSCrashReportStoreCConfiguration *const configuration);
+
+/** Receives a chunk of report data during a streaming read.
+ *
+ * @param data The chunk of UTF-8 JSON data. Only valid for the duration of the call.
+ * @param length The length of the chunk.
+ * @param userData The user data that was passed to the read function.
+ *
+ * @return true to continue reading, false to stop.
+ */
+typedef bool (*KSCrashReportReadCallback)(const char *data, int length, void *userData);
+
+/** Read a report, passing its fixed up contents to a callback in chunks.
+ * The report file is memory mapped rather than loaded, so there is no upper
+ * limit on the report size and no full in-memory copy of the output.
+ *
+ * @note The callback is invoked with the store lock held and must not call other `kscrs_` functions.
+ *
+ * @param reportID The report's ID.
+ * @param callback The function to pass output chunks to.
+ * @param userData User-specified data which gets passed to the callback.
+ * @param configuration The store configuretion (e.g. reports path, app name etc).
+ *
+ * @return true if the whole report was read and passed to the callback.
+ */
+bool kscrs_readReportStreaming(int64_t reportID, KSCrashReportReadCallback callback, void *userData,
+                               const KSCrashReportStoreCConfiguration *const configuration);
+
 /** Add a custom report to the store.
+ *
+ * With group commit durability the report may not be on disk yet when this returns,
+ * but reading, counting or deleting reports through this API always sees it.
  *
  * @param report The report's contents (must be JSON encoded).
  * @param reportLength The length of the report in bytes.
@@ -99,6 +159,28 @@ char *kscrs_readReportAtPath(const char *path);
 int64_t kscrs_addUserReport(const char *report, int reportLength,
                             const KSCrashReportStoreCConfiguration *const configuration);
 
+/** Get the number of occurrence records attached to a report.
+ * Occurrence records are only created when `maxReportsPerFingerprint` is set.
+ *
+ * @param reportID The report's ID.
+ * @param configuration The store configuretion (e.g. reports path, app name etc).
+ *
+ * @return The number of occurrence records.
+ */
+int kscrs_getOccurrenceCount(int64_t reportID, const KSCrashReportStoreCConfiguration *const configuration);
+
+/** Get the occurrence records attached to a report, oldest first.
+ *
+ * @param reportID The report's ID.
+ * @param occurrences An array big enough to hold all occurrence records.
+ * @param count How many records the array can hold.
+ * @param configuration The store configuretion (e.g. reports path, app name etc).
+ *
+ * @return The number of occurrence records that were placed in the array.
+ */
+int kscrs_getOccurrences(int64_t reportID, KSCrashReportOccurrence *occurrences, int count,
+                         const KSCrashReportStoreCConfiguration *const configuration);
+
 /** Delete all reports on disk.
  *
  * @param configuration The store configuretion (e.g. reports path, app name etc).
@@ -112,6 +194,15 @@ void kscrs_deleteAllReports(const KSCrashReportStoreCConfiguration *const config
  */
 void kscrs_deleteReportWithID(int64_t reportID, const KSCrashReportStoreCConfiguration *const configuration);
 
+/** Delete several reports, taking the store lock once.
+ *
+ * @param reportIDs The IDs of the reports to delete.
+ * @param count The number of report IDs.
+ * @param configuration The store configuretion (e.g. reports path, app name etc).
+ */
+void kscrs_deleteReportsWithIDs(const int64_t *reportIDs, int count,
+                                const KSCrashReportStoreCConfiguration *const configuration);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,186 @@
+//
+//  KSArena.c
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "KSArena.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// #define KSLogger_LocalLevel TRACE
+#include "KSLogger.h"
+
+#define KSARENA_Alignment 16
+
+// ============================================================================
+#pragma mark - Globals -
+// ============================================================================
+
+static uint8_t *g_base;
+static uint32_t g_capacity;
+
+/** Bytes used by permanent allocations in the low half, and by scratch
+ * allocations in the high half. Keeping both in one word lets allocations
+ * from either end check against each other without a lock.
+ */
+static _Atomic uint64_t g_usage;
+
+static pthread_mutex_t g_scopeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_installMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// ============================================================================
+#pragma mark - Utility -
+// ============================================================================
+
+static inline uint32_t permanentUsage(uint64_t usage) { return (uint32_t)usage; }
+
+static inline uint32_t scratchUsage(uint64_t usage) { return (uint32_t)(usage >> 32); }
+
+static inline uint64_t makeUsage(uint32_t permanent, uint32_t scratch) { return ((uint64_t)scratch << 32) | permanent; }
+
+static inline size_t alignedSize(size_t size)
+{
+    return (size + KSARENA_Alignment - 1) & ~(size_t)(KSARENA_Alignment - 1);
+}
+
+// ============================================================================
+#pragma mark - API -
+// ============================================================================
+
+bool ksarena_install(size_t size)
+{
+    bool isInstalled = false;
+    pthread_mutex_lock(&g_installMutex);
+    if (g_base != NULL) {
+        isInstalled = true;
+        goto done;
+    }
+
+    size_t pageSize = (size_t)getpagesize();
+    size = (size + pageSize - 1) & ~(pageSize - 1);
+    if (size == 0 || size > UINT32_MAX - pageSize) {
+        KSLOG_ERROR("Invalid arena size %zu", size);
+        goto done;
+    }
+
+    // Reserve everything as inaccessible, then open up the space between the guard pages.
+    uint8_t *mapping = mmap(NULL, size + pageSize * 2, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (mapping == MAP_FAILED) {
+        KSLOG_ERROR("Could not map %zu bytes for the arena: %s", size, strerror(errno));
+        goto done;
+    }
+    if (mprotect(mapping + pageSize, size, PROT_READ | PROT_WRITE) != 0) {
+        KSLOG_ERROR("Could not make the arena writable: %s", strerror(errno));
+        munmap(mapping, size + pageSize * 2);
+        goto done;
+    }
+
+    g_capacity = (uint32_t)size;
+    atomic_store(&g_usage, 0);
+    g_base = mapping + pageSize;
+    isInstalled = true;
+    KSLOG_DEBUG("Installed a %zu byte arena at %p", size, g_base);
+
+done:
+    pthread_mutex_unlock(&g_installMutex);
+    return isInstalled;
+}
+
+void *ksarena_allocPermanent(size_t size)
+{
+    if (g_base == NULL) {
+        return NULL;
+    }
+    size = alignedSize(size);
+    uint64_t usage = atomic_load(&g_usage);
+    uint64_t newUsage;
+    do {
+        uint32_t permanent = permanentUsage(usage);
+        if (size > g_capacity - permanent - scratchUsage(usage)) {
+            KSLOG_ERROR("Arena is too full to allocate %zu permanent bytes", size);
+            return NULL;
+        }
+        newUsage = makeUsage(permanent + (uint32_t)size, scratchUsage(usage));
+    } while (!atomic_compare_exchange_weak(&g_usage, &usage, newUsage));
+    return g_base + permanentUsage(usage);
+}
+
+void ksarena_beginScope(KSArenaScope *scope, bool isHandlingCrash)
+{
+    if (isHandlingCrash) {
+        scope->isLocked = pthread_mutex_trylock(&g_scopeMutex) == 0;
+    } else {
+        scope->isLocked = pthread_mutex_lock(&g_scopeMutex) == 0;
+    }
+    scope->mark = ksarena_getMark();
+}
+
+void ksarena_endScope(KSArenaScope *scope)
+{
+    ksarena_releaseToMark(scope->mark);
+    if (scope->isLocked) {
+        pthread_mutex_unlock(&g_scopeMutex);
+        scope->isLocked = false;
+    }
+}
+
+void *ksarena_alloc(size_t size)
+{
+    if (g_base == NULL) {
+        return NULL;
+    }
+    size = alignedSize(size);
+    uint64_t usage = atomic_load(&g_usage);
+    uint64_t newUsage;
+    do {
+        uint32_t scratch = scratchUsage(usage);
+        if (size > g_capacity - permanentUsage(usage) - scratch) {
+            KSLOG_ERROR("Arena is too full to allocate %zu bytes", size);
+            return NULL;
+        }
+        newUsage = makeUsage(permanentUsage(usage), scratch + (uint32_t)size);
+    } while (!atomic_compare_exchange_weak(&g_usage, &usage, newUsage));
+    return g_base + g_capacity - scratchUsage(newUsage);
+}
+
+uint32_t ksarena_getMark(void) { return scratchUsage(atomic_load(&g_usage)); }
+
+void ksarena_releaseToMark(uint32_t mark)
+{
+    uint64_t usage = atomic_load(&g_usage);
+    while (!atomic_compare_exchange_weak(&g_usage, &usage, makeUsage(permanentUsage(usage), mark))) {
+    }
+}
+
+size_t ksarena_bytesAvailable(void)
+{
+    if (g_base == NULL) {
+        return 0;
+    }
+    uint64_t usage = atomic_load(&g_usage);
+    return g_capacity - permanentUsage(usage) - scratchUsage(usage);
+}
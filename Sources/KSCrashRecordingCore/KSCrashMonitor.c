@@ -270,6 +270,8 @@ void kscm_removeMonitor(const KSCrashMonitorAPI *api)
 bool kscm_notifyFatalExceptionCaptured(bool isAsyncSafeEnvironment)
 {
     g_requiresAsyncSafety |= isAsyncSafeEnvironment;  // Don't let it be unset.
+    // Get queued log entries into the console log before the report includes it.
+    kslog_drainForCrash();
     if (g_handlingFatalException) {
         g_crashedDuringExceptionHandling = true;
     }
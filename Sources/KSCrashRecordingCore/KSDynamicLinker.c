@@ -178,21 +178,29 @@ const uint8_t *ksdl_imageUUID(const char *const imageName, bool exactMatch)
     if (imageName != NULL) {
         const uint32_t iImg = ksdl_imageNamed(imageName, exactMatch);
         if (iImg != UINT32_MAX) {
-            const struct mach_header *header = _dyld_get_image_header(iImg);
-            if (header != NULL) {
-                uintptr_t cmdPtr = firstCmdAfterHeader(header);
-                if (cmdPtr != 0) {
-                    for (uint32_t iCmd = 0; iCmd < header->ncmds; iCmd++) {
-                        const struct load_command *loadCmd = (struct load_command *)cmdPtr;
-                        if (loadCmd->cmd == LC_UUID) {
-                            struct uuid_command *uuidCmd = (struct uuid_command *)cmdPtr;
-                            return uuidCmd->uuid;
-                        }
-                        cmdPtr += loadCmd->cmdsize;
-                    }
-                }
-            }
+            return ksdl_imageUUIDForHeader(_dyld_get_image_header(iImg));
+        }
+    }
+    return NULL;
+}
+
+const uint8_t *ksdl_imageUUIDForHeader(const void *const header_ptr)
+{
+    const struct mach_header *header = (const struct mach_header *)header_ptr;
+    if (header == NULL) {
+        return NULL;
+    }
+    uintptr_t cmdPtr = firstCmdAfterHeader(header);
+    if (cmdPtr == 0) {
+        return NULL;
+    }
+    for (uint32_t iCmd = 0; iCmd < header->ncmds; iCmd++) {
+        const struct load_command *loadCmd = (struct load_command *)cmdPtr;
+        if (loadCmd->cmd == LC_UUID) {
+            struct uuid_command *uuidCmd = (struct uuid_command *)cmdPtr;
+            return uuidCmd->uuid;
         }
+        cmdPtr += loadCmd->cmdsize;
     }
     return NULL;
 }
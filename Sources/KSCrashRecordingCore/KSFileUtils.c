@@ -30,14 +30,24 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "KSLogger.h"
+#include "KSSystemCapabilities.h"
+
+#if KSCRASH_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/syscall.h>
+#endif
 
 /** Buffer size to use in the "writeFmt" functions.
  * If the formatted output length would exceed this value, it is truncated.
@@ -46,6 +56,330 @@
 #define KSFU_WriteFmtBufferSize 1024
 #endif
 
+/** Writes to a buffered writer that are at least 1/N of its buffer size are not
+ * copied into the buffer. They get written along with the buffered data in one
+ * writev() call instead.
+ */
+#ifndef KSFU_GatherThresholdDivisor
+#define KSFU_GatherThresholdDivisor 4
+#endif
+
+// ============================================================================
+#pragma mark - Batch I/O -
+// ============================================================================
+
+#if KSCRASH_HAS_IO_URING
+
+/** Operations queued per io_uring submission. */
+#ifndef KSFU_BatchIODepth
+#define KSFU_BatchIODepth 64
+#endif
+
+/** Below this many files, setting up a ring costs more system calls than it saves. */
+#ifndef KSFU_BatchIOMinCount
+#define KSFU_BatchIOMinCount 4
+#endif
+
+/** The most bytes of one file read through the ring. Anything past this is read with pread(). */
+#ifndef KSFU_BatchIOMaxReadLength
+#define KSFU_BatchIOMaxReadLength (256 * 1024)
+#endif
+
+/** A minimal io_uring, driven with raw system calls.
+ * Every submission waits for all of its completions, so no request outlives a batch.
+ */
+typedef struct {
+    int fd;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned queuedCount;
+} KSIORing;
+
+/** Everything the kernel reads or writes for one batch, apart from the file contents.
+ * If the ring fails with operations still in flight, it's leaked rather than freed.
+ */
+typedef struct {
+    int fds[KSFU_BatchIODepth / 2];
+    struct statx stats[KSFU_BatchIODepth / 2];
+    char paths[];
+} KSIORingBatch;
+
+/** 1 if io_uring works in this process, -1 if it doesn't, 0 if not known yet. */
+static _Atomic(int) g_ioRingSupport;
+
+static void closeIORing(KSIORing *ring)
+{
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != NULL) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static void *mapIORing(int fd, size_t size, off_t offset)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (ptr == MAP_FAILED) {
+        KSLOG_ERROR("Could not map io_uring: %s", strerror(errno));
+        return NULL;
+    }
+    return ptr;
+}
+
+static bool openIORing(KSIORing *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    if (g_ioRingSupport < 0) {
+        return false;
+    }
+
+    struct io_uring_params params = { 0 };
+    ring->fd = (int)syscall(__NR_io_uring_setup, KSFU_BatchIODepth, &params);
+    if (ring->fd < 0) {
+        // Kernels without io_uring, and sandboxes that forbid it, won't change their minds.
+        if (errno == ENOSYS || errno == EPERM || errno == EACCES) {
+            g_ioRingSupport = -1;
+        } else {
+            KSLOG_ERROR("Could not set up io_uring: %s", strerror(errno));
+        }
+        return false;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqRing = mapIORing(ring->fd, ring->sqRingSize, IORING_OFF_SQ_RING);
+    ring->cqRing = mapIORing(ring->fd, ring->cqRingSize, IORING_OFF_CQ_RING);
+    ring->sqes = mapIORing(ring->fd, ring->sqesSize, IORING_OFF_SQES);
+    if (ring->sqRing == NULL || ring->cqRing == NULL || ring->sqes == NULL) {
+        closeIORing(ring);
+        return false;
+    }
+
+    char *sq = ring->sqRing;
+    char *cq = ring->cqRing;
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    g_ioRingSupport = 1;
+    return true;
+}
+
+/** Queue an operation. Its result ends up at results[userData] after submitIORing(). */
+static struct io_uring_sqe *queueIORing(KSIORing *ring, uint8_t opcode, int fd, uint64_t userData)
+{
+    unsigned tail = *ring->sqTail + ring->queuedCount;
+    unsigned slot = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    ring->sqArray[slot] = slot;
+    ring->queuedCount++;
+    return sqe;
+}
+
+/** Submit everything queued and wait for all of it to complete.
+ * Results go to results[userData], for user data below resultCount.
+ * Results with no completion are -ECANCELED.
+ *
+ * @return false if the ring failed before everything completed. Operations may
+ *         still be in flight then, so their memory must not be reused.
+ */
+static bool submitIORing(KSIORing *ring, int *results, int resultCount)
+{
+    unsigned expectedCount = ring->queuedCount;
+    for (int i = 0; i < resultCount; i++) {
+        results[i] = -ECANCELED;
+    }
+    __atomic_store_n(ring->sqTail, *ring->sqTail + ring->queuedCount, __ATOMIC_RELEASE);
+
+    unsigned toSubmit = ring->queuedCount;
+    unsigned completedCount = 0;
+    ring->queuedCount = 0;
+    while (completedCount < expectedCount) {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, toSubmit, expectedCount - completedCount,
+                                 IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            KSLOG_ERROR("io_uring_enter: %s", strerror(errno));
+            return false;
+        }
+        toSubmit -= (unsigned)submitted;
+
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+            if (cqe->user_data < (uint64_t)resultCount) {
+                results[cqe->user_data] = cqe->res;
+            }
+            completedCount++;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+/** Read the rest of a file that the ring read part of.
+ * Ring reads are positional, so the file offset hasn't moved past what they read.
+ */
+static bool readRemainingBytes(int fd, char *bytes, int offset, int length)
+{
+    while (offset < length) {
+        ssize_t bytesRead = pread(fd, bytes + offset, (size_t)(length - offset), offset);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            KSLOG_ERROR("Could not read fd %d at %d: %s", fd, offset, bytesRead == 0 ? "EOF" : strerror(errno));
+            return false;
+        }
+        offset += (int)bytesRead;
+    }
+    return true;
+}
+
+/** Abandon the reads of a batch the ring failed in the middle of.
+ * The kernel may still write to the buffers, or close the files, so they are all leaked,
+ * along with the batch itself.
+ */
+static void abandonBatch(int count, char **data, int *lengths)
+{
+    KSLOG_ERROR("Abandoning %d reads in flight on a failed io_uring", count);
+    for (int i = 0; i < count; i++) {
+        data[i] = NULL;
+        lengths[i] = 0;
+    }
+}
+
+/** Read up to KSFU_BatchIODepth / 2 entire files through the ring: open and statx them all,
+ * then read them all, then close them all.
+ * Files the ring couldn't read are left NULL.
+ *
+ * @return false if the ring failed, and can't be used any more.
+ */
+static bool readBatchWithIORing(KSIORing *ring, const char *const *paths, int count, char **data, int *lengths)
+{
+    size_t pathsSize = 0;
+    for (int i = 0; i < count; i++) {
+        pathsSize += strlen(paths[i]) + 1;
+    }
+    // The kernel may read the paths after the call that submitted them, so it gets its own copies.
+    KSIORingBatch *batch = malloc(sizeof(*batch) + pathsSize);
+    if (batch == NULL) {
+        KSLOG_ERROR("Out of memory");
+        return true;
+    }
+    int results[KSFU_BatchIODepth];
+    int *fds = batch->fds;
+    struct statx *stats = batch->stats;
+
+    char *path = batch->paths;
+    for (int i = 0; i < count; i++) {
+        size_t pathLength = strlen(paths[i]) + 1;
+        memcpy(path, paths[i], pathLength);
+        struct io_uring_sqe *sqe = queueIORing(ring, IORING_OP_OPENAT, AT_FDCWD, (uint64_t)i * 2);
+        sqe->addr = (uint64_t)(uintptr_t)path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe = queueIORing(ring, IORING_OP_STATX, AT_FDCWD, (uint64_t)i * 2 + 1);
+        sqe->addr = (uint64_t)(uintptr_t)path;
+        sqe->len = STATX_SIZE;
+        sqe->off = (uint64_t)(uintptr_t)&stats[i];
+        path += pathLength;
+    }
+    if (!submitIORing(ring, results, count * 2)) {
+        abandonBatch(count, data, lengths);
+        return false;
+    }
+
+    int readCount = 0;
+    for (int i = 0; i < count; i++) {
+        fds[i] = results[i * 2];
+        if (fds[i] < 0 || results[i * 2 + 1] < 0 || stats[i].stx_size >= INT_MAX) {
+            continue;
+        }
+        data[i] = malloc((size_t)stats[i].stx_size + 1);
+        if (data[i] == NULL) {
+            KSLOG_ERROR("Out of memory");
+            continue;
+        }
+        lengths[i] = (int)stats[i].stx_size;
+        struct io_uring_sqe *sqe = queueIORing(ring, IORING_OP_READ, fds[i], (uint64_t)i);
+        sqe->addr = (uint64_t)(uintptr_t)data[i];
+        sqe->len = (uint32_t)(lengths[i] < KSFU_BatchIOMaxReadLength ? lengths[i] : KSFU_BatchIOMaxReadLength);
+        sqe->off = 0;
+        readCount++;
+    }
+    if (readCount > 0 && !submitIORing(ring, results, count)) {
+        abandonBatch(count, data, lengths);
+        return false;
+    }
+
+    int closeCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (data[i] != NULL) {
+            int bytesRead = results[i];
+            // Finish short reads the ordinary way.
+            if (bytesRead < 0 || !readRemainingBytes(fds[i], data[i], bytesRead, lengths[i])) {
+                free(data[i]);
+                data[i] = NULL;
+                lengths[i] = 0;
+            } else {
+                data[i][lengths[i]] = '\0';
+            }
+        }
+        if (fds[i] >= 0) {
+            queueIORing(ring, IORING_OP_CLOSE, fds[i], (uint64_t)i);
+            closeCount++;
+        }
+    }
+    if (closeCount > 0) {
+        if (!submitIORing(ring, results, count)) {
+            // The files have been read, but the closes may still be in flight.
+            KSLOG_ERROR("Leaking %d files whose close was in flight on a failed io_uring", closeCount);
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            if (fds[i] >= 0 && results[i] < 0) {
+                close(fds[i]);
+            }
+        }
+    }
+    free(batch);
+    return true;
+}
+
+#endif
+
 // ============================================================================
 #pragma mark - Utility -
 // ============================================================================
@@ -67,75 +401,92 @@ static bool canDeletePath(const char *path)
     return true;
 }
 
-static int dirContentsCount(const char *path)
+static bool deleteDirectoryContents(int dirFD);
+
+/** Delete one entry of the directory open at `dirFD`.
+ * Symbolic links are deleted, not followed.
+ *
+ * @return true if the entry and everything in it was deleted, or was already gone.
+ */
+static bool deleteDirectoryEntry(int dirFD, const struct dirent *entry)
 {
-    int count = 0;
-    DIR *dir = opendir(path);
-    if (dir == NULL) {
-        KSLOG_ERROR("Error reading directory %s: %s", path, strerror(errno));
-        return 0;
+    const char *name = entry->d_name;
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+        struct stat statStruct = { 0 };
+        if (fstatat(dirFD, name, &statStruct, AT_SYMLINK_NOFOLLOW) != 0) {
+            KSLOG_ERROR("Could not stat %s: %s", name, strerror(errno));
+            return false;
+        }
+        if (S_ISDIR(statStruct.st_mode)) {
+            type = DT_DIR;
+        } else if (S_ISREG(statStruct.st_mode)) {
+            type = DT_REG;
+        } else if (S_ISLNK(statStruct.st_mode)) {
+            type = DT_LNK;
+        }
     }
 
-    struct dirent *ent;
-    while ((ent = readdir(dir))) {
-        count++;
+    int flags = 0;
+    switch (type) {
+        case DT_DIR: {
+            int fd = openat(dirFD, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (fd < 0) {
+                KSLOG_ERROR("Could not open directory %s: %s", name, strerror(errno));
+                return false;
+            }
+            if (!deleteDirectoryContents(fd)) {
+                return false;
+            }
+            flags = AT_REMOVEDIR;
+            break;
+        }
+        case DT_REG:
+        case DT_LNK:
+            break;
+        default:
+            KSLOG_ERROR("Could not delete %s: Not a regular file.", name);
+            return false;
     }
 
-    closedir(dir);
-    return count;
+    if (unlinkat(dirFD, name, flags) != 0 && errno != ENOENT) {
+        KSLOG_ERROR("Could not delete %s: %s", name, strerror(errno));
+        return false;
+    }
+    return true;
 }
 
-static void dirContents(const char *path, char ***entries, int *count)
+/** Delete everything inside the directory open at `dirFD`.
+ * The directory is read in a single streaming pass, working relative to
+ * directory file descriptors so nothing is allocated per entry.
+ *
+ * @param dirFD The directory. It is closed before returning.
+ *
+ * @return true if everything in the directory was deleted.
+ */
+static bool deleteDirectoryContents(int dirFD)
 {
-    DIR *dir = NULL;
-    char **entryList = NULL;
-    int entryCount = dirContentsCount(path);
-    if (entryCount <= 0) {
-        goto done;
-    }
-    dir = opendir(path);
+    DIR *dir = fdopendir(dirFD);
     if (dir == NULL) {
-        KSLOG_ERROR("Error reading directory %s: %s", path, strerror(errno));
-        goto done;
+        KSLOG_ERROR("Error reading directory: %s", strerror(errno));
+        close(dirFD);
+        return false;
     }
 
-    entryList = calloc((unsigned)entryCount, sizeof(char *));
-    struct dirent *ent;
-    int index = 0;
-    while ((ent = readdir(dir))) {
-        if (index >= entryCount) {
-            KSLOG_ERROR("Contents of %s have been mutated", path);
-            goto done;
+    // Keep going after a failure, so that as much as possible gets deleted.
+    bool success = true;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (canDeletePath(entry->d_name) && !deleteDirectoryEntry(dirfd(dir), entry)) {
+            success = false;
         }
-        entryList[index] = strdup(ent->d_name);
-        index++;
     }
 
-done:
-    if (dir != NULL) {
-        closedir(dir);
-    }
-    if (entryList == NULL) {
-        entryCount = 0;
-    }
-    *entries = entryList;
-    *count = entryCount;
-}
-
-static void freeDirListing(char **entries, int count)
-{
-    if (entries != NULL) {
-        for (int i = 0; i < count; i++) {
-            char *ptr = entries[i];
-            if (ptr != NULL) {
-                free(ptr);
-            }
-        }
-        free(entries);
-    }
+    closedir(dir);
+    return success;
 }
 
-static bool deletePathContents(const char *path, bool deleteTopLevelPathAlso)
+static bool deletePathContents(const char *path)
 {
     struct stat statStruct = { 0 };
     if (stat(path, &statStruct) != 0) {
@@ -143,29 +494,12 @@ static bool deletePathContents(const char *path, bool deleteTopLevelPathAlso)
         return false;
     }
     if (S_ISDIR(statStruct.st_mode)) {
-        char **entries = NULL;
-        int entryCount = 0;
-        dirContents(path, &entries, &entryCount);
-
-        int bufferLength = KSFU_MAX_PATH_LENGTH;
-        char *pathBuffer = malloc((unsigned)bufferLength);
-        snprintf(pathBuffer, bufferLength, "%s/", path);
-        char *pathPtr = pathBuffer + strlen(pathBuffer);
-        int pathRemainingLength = bufferLength - (int)(pathPtr - pathBuffer);
-
-        for (int i = 0; i < entryCount; i++) {
-            char *entry = entries[i];
-            if (entry != NULL && canDeletePath(entry)) {
-                strncpy(pathPtr, entry, pathRemainingLength);
-                deletePathContents(pathBuffer, true);
-            }
-        }
-
-        free(pathBuffer);
-        freeDirListing(entries, entryCount);
-        if (deleteTopLevelPathAlso) {
-            ksfu_removeFile(path, false);
+        int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            KSLOG_ERROR("Error reading directory %s: %s", path, strerror(errno));
+            return false;
         }
+        return deleteDirectoryContents(fd);
     } else if (S_ISREG(statStruct.st_mode)) {
         ksfu_removeFile(path, false);
     } else {
@@ -387,7 +721,7 @@ bool ksfu_deleteContentsOfPath(const char *path)
         return false;
     }
 
-    return deletePathContents(path, false);
+    return deletePathContents(path);
 }
 
 bool ksfu_openBufferedWriter(KSBufferedWriter *writer, const char *const path, char *writeBuffer, int writeBufferLength)
@@ -412,16 +746,56 @@ void ksfu_closeBufferedWriter(KSBufferedWriter *writer)
     }
 }
 
+/** Write all of `iov` to `fd`, picking up where a partial write left off. Modifies `iov`. */
+static bool writeVectorToFD(const int fd, struct iovec *iov, int iovCount)
+{
+    while (iovCount > 0) {
+        ssize_t bytesWritten = writev(fd, iov, iovCount);
+        if (bytesWritten == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            KSLOG_ERROR("Could not write to fd %d: %s", fd, strerror(errno));
+            return false;
+        }
+        while (iovCount > 0 && (size_t)bytesWritten >= iov->iov_len) {
+            bytesWritten -= (ssize_t)iov->iov_len;
+            iov++;
+            iovCount--;
+        }
+        if (iovCount > 0) {
+            iov->iov_base = (char *)iov->iov_base + bytesWritten;
+            iov->iov_len -= (size_t)bytesWritten;
+        }
+    }
+    return true;
+}
+
 bool ksfu_writeBufferedWriter(KSBufferedWriter *writer, const char *restrict const data, const int length)
 {
+    if (length <= 0) {
+        return true;
+    }
+    if (length > writer->bufferLength - writer->position &&
+        length >= writer->bufferLength / KSFU_GatherThresholdDivisor) {
+        // Gather the buffered data and the payload into a single write rather than copying the payload.
+        struct iovec iov[2];
+        int iovCount = 0;
+        if (writer->position > 0) {
+            iov[iovCount++] = (struct iovec) { .iov_base = writer->buffer, .iov_len = (size_t)writer->position };
+        }
+        iov[iovCount++] = (struct iovec) { .iov_base = (void *)data, .iov_len = (size_t)length };
+        if (!writeVectorToFD(writer->fd, iov, iovCount)) {
+            return false;
+        }
+        writer->position = 0;
+        return true;
+    }
     if (length > writer->bufferLength - writer->position) {
         if (!ksfu_flushBufferedWriter(writer)) {
             return false;
         }
     }
-    if (length > writer->bufferLength) {
-        return ksfu_writeBytesToFD(writer->fd, data, length);
-    }
     memcpy(writer->buffer + writer->position, data, length);
     writer->position += length;
     return true;
@@ -443,7 +817,8 @@ static inline bool isReadBufferEmpty(KSBufferedReader *reader) { return reader->
 static bool fillReadBuffer(KSBufferedReader *reader)
 {
     if (reader->dataStartPos > 0) {
-        memmove(reader->buffer, reader->buffer + reader->dataStartPos, reader->dataStartPos);
+        memmove(reader->buffer, reader->buffer + reader->dataStartPos,
+                (size_t)(reader->dataEndPos - reader->dataStartPos));
         reader->dataEndPos -= reader->dataStartPos;
         reader->dataStartPos = 0;
         reader->buffer[reader->dataEndPos] = '\0';
@@ -500,7 +875,8 @@ bool ksfu_readBufferedReaderUntilChar(KSBufferedReader *reader, int ch, char *ds
         int bytesInReader = reader->dataEndPos - reader->dataStartPos;
         int bytesToCopy = bytesInReader <= bytesRemaining ? bytesInReader : bytesRemaining;
         char *pSrc = reader->buffer + reader->dataStartPos;
-        char *pChar = strchr(pSrc, ch);
+        // memchr is vectorized by libc, and unlike strchr doesn't stop at NUL bytes in the data.
+        char *pChar = memchr(pSrc, ch, (size_t)bytesInReader);
         bool isFound = pChar != NULL;
         if (isFound) {
             int bytesToChar = (int)(pChar - pSrc) + 1;
@@ -554,6 +930,35 @@ void ksfu_closeBufferedReader(KSBufferedReader *reader)
     }
 }
 
+int ksfu_tailOffset(const char *const text, const int length, const int maxLines, const int maxBytes)
+{
+    int start = 0;
+    if (maxBytes > 0 && length > maxBytes) {
+        start = length - maxBytes;
+        // Start at the next whole line, unless the tail is all one line.
+        if (text[start - 1] != '\n') {
+            const char *newline = memchr(text + start, '\n', (size_t)(length - start));
+            if (newline != NULL && newline + 1 < text + length) {
+                start = (int)(newline - text) + 1;
+            }
+        }
+    }
+    if (maxLines > 0) {
+        int end = length;
+        // A trailing newline ends the last line rather than starting a new one.
+        if (end > start && text[end - 1] == '\n') {
+            end--;
+        }
+        int lineCount = 0;
+        for (int pos = end; pos > start; pos--) {
+            if (text[pos - 1] == '\n' && ++lineCount == maxLines) {
+                return pos;
+            }
+        }
+    }
+    return start;
+}
+
 void *ksfu_mmap(const char *path, int size)
 {
     int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
@@ -588,3 +993,80 @@ void *ksfu_mmap(const char *path, int size)
     close(fd);
     return ptr;
 }
+
+int ksfu_readEntireFiles(const char *const *paths, int count, char **data, int *lengths)
+{
+    for (int i = 0; i < count; i++) {
+        data[i] = NULL;
+        lengths[i] = 0;
+    }
+
+#if KSCRASH_HAS_IO_URING
+    KSIORing ring;
+    if (count >= KSFU_BatchIOMinCount && openIORing(&ring)) {
+        for (int i = 0; i < count; i += KSFU_BatchIODepth / 2) {
+            int batchCount = count - i < KSFU_BatchIODepth / 2 ? count - i : KSFU_BatchIODepth / 2;
+            if (!readBatchWithIORing(&ring, paths + i, batchCount, data + i, lengths + i)) {
+                g_ioRingSupport = -1;
+                break;
+            }
+        }
+        closeIORing(&ring);
+    }
+#endif
+
+    int readCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (data[i] == NULL && !ksfu_readEntireFile(paths[i], &data[i], &lengths[i], 0)) {
+            continue;
+        }
+        readCount++;
+    }
+    return readCount;
+}
+
+bool ksfu_isBatchIOAvailable(void)
+{
+#if KSCRASH_HAS_IO_URING
+    if (g_ioRingSupport == 0) {
+        KSIORing ring;
+        openIORing(&ring);
+        closeIORing(&ring);
+    }
+    return g_ioRingSupport > 0;
+#else
+    return false;
+#endif
+}
+
+const char *ksfu_mmapReadOnly(const char *path, int *size)
+{
+    *size = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        KSLOG_ERROR("Could not open file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        KSLOG_ERROR("Could not stat %s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size <= 0 || st.st_size > INT_MAX) {
+        KSLOG_ERROR("Could not mmap file %s: Unsupported file size %lld", path, (long long)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    void *ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        KSLOG_ERROR("Could not mmap file %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    *size = (int)st.st_size;
+    return ptr;
+}
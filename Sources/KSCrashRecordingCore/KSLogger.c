@@ -34,9 +34,17 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 // Compiler hints for "if" statements
@@ -96,8 +104,80 @@ static inline void writeFmtToLog(const char *fmt, ...)
 /** The file descriptor where log entries get written. */
 static int g_fd = -1;
 
+// Log buffer: a file of fixed size, mapped into memory, that log text is
+// appended to in a ring. The text area is mapped twice in a row so that both
+// appends and reads are contiguous even when they straddle the wrap point.
+
+#define KSLOGGER_LogBufferMagic 0x6b736c62
+
+/** Header at the start of a log buffer file. The text area follows at the next page boundary. */
+typedef struct {
+    uint32_t magic;
+    uint32_t capacity;
+    /** Total bytes ever appended. The next byte goes at cursor % capacity. */
+    _Atomic(uint64_t) cursor;
+} LogBufferHeader;
+
+static LogBufferHeader *g_logBufferHeader;
+static char *g_logBufferData;
+static _Atomic(bool) g_isLogBufferActive;
+
+/** Find the log text in a buffer, skipping the partial line at the start once it has wrapped.
+ *
+ * @return The offset of the oldest complete line in `data`.
+ */
+static uint32_t findLogBufferText(const char *data, uint64_t cursor, uint32_t capacity, int *length)
+{
+    if (cursor <= capacity) {
+        *length = (int)cursor;
+        return 0;
+    }
+    uint32_t start = (uint32_t)(cursor % capacity);
+    const char *text = data + start;
+    const char *newline = memchr(text, '\n', capacity);
+    uint32_t skip = newline == NULL ? 0 : (uint32_t)(newline - text) + 1;
+    *length = (int)(capacity - skip);
+    return start + skip;
+}
+
+static bool mapLogBuffer(int fd, uint32_t capacity, LogBufferHeader **header, char **data)
+{
+    size_t pageSize = (size_t)getpagesize();
+    size_t fileSize = pageSize + capacity;
+    size_t mappingSize = fileSize + capacity;
+    uint8_t *base = mmap(NULL, mappingSize, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    unlikely_if(base == MAP_FAILED) { return false; }
+    unlikely_if(mmap(base, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+                mmap(base + fileSize, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+                     (off_t)pageSize) == MAP_FAILED)
+    {
+        munmap(base, mappingSize);
+        return false;
+    }
+    *header = (LogBufferHeader *)base;
+    *data = (char *)base + pageSize;
+    return true;
+}
+
+/** Append to the log buffer. Concurrent appends reserve separate ranges, so this never makes a syscall. */
+static void appendToLogBuffer(const char *str, size_t length)
+{
+    uint32_t capacity = g_logBufferHeader->capacity;
+    if (length > capacity) {
+        str += length - capacity;
+        length = capacity;
+    }
+    uint64_t cursor = atomic_fetch_add_explicit(&g_logBufferHeader->cursor, length, memory_order_relaxed);
+    memcpy(g_logBufferData + cursor % capacity, str, length);
+}
+
 static void writeToLog(const char *const str)
 {
+    likely_if(atomic_load_explicit(&g_isLogBufferActive, memory_order_acquire))
+    {
+        appendToLogBuffer(str, strlen(str));
+        return;
+    }
     if (g_fd >= 0) {
         int bytesToWrite = (int)strlen(str);
         const char *pos = str;
@@ -135,9 +215,667 @@ static inline void setLogFD(int fd)
     g_fd = fd;
 }
 
+// Async logging: log calls capture their arguments into a lock-free ring and a
+// formatter thread formats and writes them in batches.
+
+/** Number of entries the async log ring can hold. Must be a power of 2. */
+#ifndef KSLOGGER_AsyncRingCapacity
+#define KSLOGGER_AsyncRingCapacity 1024
+#endif
+
+/** Bytes available in each async log entry for its captured arguments. */
+#define KSLOGGER_AsyncArgsSize 200
+
+/** Size of the buffer the formatter thread collects lines in before writing them. */
+#define KSLOGGER_AsyncBatchSize (KSLOGGER_CBufferSize * 16)
+
+/** Longest conversion specification (e.g. "%-08.3lld") that can be deferred. */
+#define KSLOGGER_MaxSpecLength 32
+
+/** How long the formatter thread sleeps when there is nothing to wake it (ms). */
+#define KSLOGGER_AsyncIdleTimeout 1000
+
+/** How many times a flush yields to a producer that has claimed an entry but not yet filled it. */
+#define KSLOGGER_MaxDrainYields 1000
+
+typedef enum {
+    LengthModifierNone,
+    LengthModifierChar,
+    LengthModifierShort,
+    LengthModifierLong,
+    LengthModifierLongLong,
+    LengthModifierIntMax,
+    LengthModifierSize,
+    LengthModifierPtrDiff,
+    LengthModifierLongDouble,
+} LengthModifier;
+
+/** A single printf conversion specification. */
+typedef struct {
+    const char *start;
+    int length;
+    bool hasStarWidth;
+    bool hasStarPrecision;
+    bool hasPrecision;
+    int precision;
+    LengthModifier lengthModifier;
+    char conversion;
+} FormatSpec;
+
+/** A log call whose formatting has been deferred to the formatter thread.
+ *
+ * The level, file, function and format are string literals, so only their
+ * pointers are kept. Arguments are copied into `args` in the order they appear
+ * in the format; strings are copied in full since they may not outlive the call.
+ */
+typedef struct {
+    _Atomic(uint64_t) sequence;
+    /** NULL for basic entries, which have no context prefix. */
+    const char *level;
+    const char *file;
+    const char *function;
+    const char *fmt;
+    int line;
+    uint8_t args[KSLOGGER_AsyncArgsSize];
+} LogRecord;
+
+/** Bounded MPSC queue: producers claim a slot by advancing g_enqueuePosition and
+ * publish it by setting its sequence to position + 1. The consumer releases it
+ * for reuse by setting the sequence to position + capacity.
+ */
+static LogRecord g_logRing[KSLOGGER_AsyncRingCapacity];
+static _Atomic(uint64_t) g_enqueuePosition;
+static _Atomic(uint64_t) g_dequeuePosition;
+
+static _Atomic(bool) g_isAsyncLoggingEnabled;
+static _Atomic(bool) g_isFormatterStarted;
+static _Atomic(bool) g_isFormatterWaiting;
+static int g_wakePipe[2] = { -1, -1 };
+
+/** Serializes draining between the formatter thread and synchronous flushes. */
+static pthread_mutex_t g_drainMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char g_batch[KSLOGGER_AsyncBatchSize];
+
+/** kslog_drainForCrash() may run alongside a drain that holds g_drainMutex, so it formats into its own buffer. */
+static char g_crashBatch[KSLOGGER_AsyncBatchSize];
+
+/** Parse the conversion specification that `fmt` (which points at '%') starts.
+ *
+ * @return true if the specification can be deferred.
+ */
+static bool parseFormatSpec(const char *fmt, FormatSpec *spec)
+{
+    const char *pos = fmt + 1;
+    *spec = (FormatSpec) { .start = fmt };
+    while (*pos != '\0' && strchr("-+ #0'", *pos) != NULL) {
+        pos++;
+    }
+    if (*pos == '*') {
+        spec->hasStarWidth = true;
+        pos++;
+    } else {
+        while (*pos >= '0' && *pos <= '9') {
+            pos++;
+        }
+    }
+    if (*pos == '.') {
+        spec->hasPrecision = true;
+        pos++;
+        if (*pos == '*') {
+            spec->hasStarPrecision = true;
+            pos++;
+        } else {
+            while (*pos >= '0' && *pos <= '9') {
+                spec->precision = spec->precision * 10 + (*pos++ - '0');
+            }
+        }
+    }
+    switch (*pos) {
+        case 'h':
+            pos++;
+            spec->lengthModifier = LengthModifierShort;
+            if (*pos == 'h') {
+                pos++;
+                spec->lengthModifier = LengthModifierChar;
+            }
+            break;
+        case 'l':
+            pos++;
+            spec->lengthModifier = LengthModifierLong;
+            if (*pos == 'l') {
+                pos++;
+                spec->lengthModifier = LengthModifierLongLong;
+            }
+            break;
+        case 'q':
+            pos++;
+            spec->lengthModifier = LengthModifierLongLong;
+            break;
+        case 'j':
+            pos++;
+            spec->lengthModifier = LengthModifierIntMax;
+            break;
+        case 'z':
+            pos++;
+            spec->lengthModifier = LengthModifierSize;
+            break;
+        case 't':
+            pos++;
+            spec->lengthModifier = LengthModifierPtrDiff;
+            break;
+        case 'L':
+            pos++;
+            spec->lengthModifier = LengthModifierLongDouble;
+            break;
+        default:
+            break;
+    }
+    spec->conversion = *pos;
+    spec->length = (int)(pos - fmt) + 1;
+    if (spec->length >= KSLOGGER_MaxSpecLength) {
+        return false;
+    }
+    switch (spec->conversion) {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'p':
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        case '%':
+            return true;
+        case 'c':
+        case 's':
+            // Wide characters and strings would need converting on the calling thread anyway.
+            return spec->lengthModifier == LengthModifierNone;
+        default:
+            return false;
+    }
+}
+
+static inline bool isFloatConversion(char conversion) { return strchr("fFeEgGaA", conversion) != NULL; }
+
+static inline bool isSignedConversion(char conversion) { return conversion == 'd' || conversion == 'i'; }
+
+static inline bool appendArg(uint8_t *args, int *length, const void *value, int size)
+{
+    if (*length + size > KSLOGGER_AsyncArgsSize) {
+        return false;
+    }
+    memcpy(args + *length, value, (size_t)size);
+    *length += size;
+    return true;
+}
+
+static inline const uint8_t *nextArg(const uint8_t *args, void *value, int size)
+{
+    memcpy(value, args, (size_t)size);
+    return args + size;
+}
+
+static int64_t takeSignedArg(LengthModifier lengthModifier, va_list *args)
+{
+    switch (lengthModifier) {
+        case LengthModifierLong:
+            return va_arg(*args, long);
+        case LengthModifierLongLong:
+            return va_arg(*args, long long);
+        case LengthModifierIntMax:
+            return va_arg(*args, intmax_t);
+        case LengthModifierSize:
+            return (int64_t)va_arg(*args, size_t);
+        case LengthModifierPtrDiff:
+            return va_arg(*args, ptrdiff_t);
+        default:
+            return va_arg(*args, int);
+    }
+}
+
+static uint64_t takeUnsignedArg(LengthModifier lengthModifier, va_list *args)
+{
+    switch (lengthModifier) {
+        case LengthModifierLong:
+            return va_arg(*args, unsigned long);
+        case LengthModifierLongLong:
+            return va_arg(*args, unsigned long long);
+        case LengthModifierIntMax:
+            return va_arg(*args, uintmax_t);
+        case LengthModifierSize:
+            return va_arg(*args, size_t);
+        case LengthModifierPtrDiff:
+            return (uint64_t)va_arg(*args, ptrdiff_t);
+        default:
+            return va_arg(*args, unsigned int);
+    }
+}
+
+/** Copy the arguments `fmt` refers to into `args`.
+ *
+ * @return The number of bytes used, or -1 if the arguments can't be deferred.
+ */
+static int captureArgs(const char *fmt, va_list *args, uint8_t *captured)
+{
+    int length = 0;
+    for (const char *pos = strchr(fmt, '%'); pos != NULL; pos = strchr(pos, '%')) {
+        FormatSpec spec;
+        if (!parseFormatSpec(pos, &spec)) {
+            return -1;
+        }
+        pos += spec.length;
+        if (spec.hasStarWidth) {
+            int width = va_arg(*args, int);
+            if (!appendArg(captured, &length, &width, sizeof(width))) {
+                return -1;
+            }
+        }
+        if (spec.hasStarPrecision) {
+            spec.precision = va_arg(*args, int);
+            if (!appendArg(captured, &length, &spec.precision, sizeof(spec.precision))) {
+                return -1;
+            }
+        }
+
+        bool fits = true;
+        if (spec.conversion == '%') {
+            continue;
+        } else if (spec.conversion == 's') {
+            const char *string = va_arg(*args, const char *);
+            if (string == NULL) {
+                string = "(null)";
+            }
+            size_t stringLength = spec.hasPrecision && spec.precision >= 0 ? strnlen(string, (size_t)spec.precision)
+                                                                           : strlen(string);
+            if (stringLength >= KSLOGGER_AsyncArgsSize) {
+                return -1;
+            }
+            fits = appendArg(captured, &length, string, (int)stringLength) &&
+                   appendArg(captured, &length, "", 1);
+        } else if (spec.conversion == 'p') {
+            void *pointer = va_arg(*args, void *);
+            fits = appendArg(captured, &length, &pointer, sizeof(pointer));
+        } else if (isFloatConversion(spec.conversion)) {
+            if (spec.lengthModifier == LengthModifierLongDouble) {
+                long double value = va_arg(*args, long double);
+                fits = appendArg(captured, &length, &value, sizeof(value));
+            } else {
+                double value = va_arg(*args, double);
+                fits = appendArg(captured, &length, &value, sizeof(value));
+            }
+        } else if (isSignedConversion(spec.conversion) || spec.conversion == 'c') {
+            int64_t value = takeSignedArg(spec.lengthModifier, args);
+            fits = appendArg(captured, &length, &value, sizeof(value));
+        } else {
+            uint64_t value = takeUnsignedArg(spec.lengthModifier, args);
+            fits = appendArg(captured, &length, &value, sizeof(value));
+        }
+        if (!fits) {
+            return -1;
+        }
+    }
+    return length;
+}
+
+/** Format a single captured argument with its conversion specification. */
+static int formatArg(char *buffer, size_t bufferSize, const char *spec, const FormatSpec *parsed, const uint8_t **args)
+{
+    if (parsed->conversion == 's') {
+        const char *string = (const char *)*args;
+        *args += strlen(string) + 1;
+        return snprintf(buffer, bufferSize, spec, string);
+    }
+    if (parsed->conversion == 'p') {
+        void *pointer;
+        *args = nextArg(*args, &pointer, sizeof(pointer));
+        return snprintf(buffer, bufferSize, spec, pointer);
+    }
+    if (isFloatConversion(parsed->conversion)) {
+        if (parsed->lengthModifier == LengthModifierLongDouble) {
+            long double value;
+            *args = nextArg(*args, &value, sizeof(value));
+            return snprintf(buffer, bufferSize, spec, value);
+        }
+        double value;
+        *args = nextArg(*args, &value, sizeof(value));
+        return snprintf(buffer, bufferSize, spec, value);
+    }
+
+    uint64_t value;
+    *args = nextArg(*args, &value, sizeof(value));
+    switch (parsed->lengthModifier) {
+        case LengthModifierLong:
+            return snprintf(buffer, bufferSize, spec, (unsigned long)value);
+        case LengthModifierLongLong:
+            return snprintf(buffer, bufferSize, spec, (unsigned long long)value);
+        case LengthModifierIntMax:
+            return snprintf(buffer, bufferSize, spec, (uintmax_t)value);
+        case LengthModifierSize:
+        case LengthModifierPtrDiff:
+            return snprintf(buffer, bufferSize, spec, (size_t)value);
+        default:
+            return snprintf(buffer, bufferSize, spec, (unsigned int)value);
+    }
+}
+
+/** Format a deferred entry's message the same way vsnprintf would have.
+ *
+ * @return The length of the formatted message.
+ */
+static int formatRecordMessage(const LogRecord *record, char *buffer, int bufferSize)
+{
+    if (record->fmt == NULL) {
+        return snprintf(buffer, (size_t)bufferSize, "(null)");
+    }
+    const uint8_t *args = record->args;
+    int length = 0;
+    for (const char *pos = record->fmt; *pos != '\0' && length < bufferSize - 1;) {
+        const char *nextSpec = strchr(pos, '%');
+        int literalLength = nextSpec == NULL ? (int)strlen(pos) : (int)(nextSpec - pos);
+        if (literalLength > bufferSize - 1 - length) {
+            literalLength = bufferSize - 1 - length;
+        }
+        memcpy(buffer + length, pos, (size_t)literalLength);
+        length += literalLength;
+        if (nextSpec == NULL) {
+            break;
+        }
+
+        FormatSpec parsed;
+        parseFormatSpec(nextSpec, &parsed);
+        pos = nextSpec + parsed.length;
+        if (parsed.conversion == '%') {
+            buffer[length++] = '%';
+            continue;
+        }
+
+        // Substitute captured '*' values so that the spec takes a single argument.
+        char spec[KSLOGGER_MaxSpecLength * 2];
+        int specLength = 0;
+        for (int i = 0; i < parsed.length; i++) {
+            if (parsed.start[i] == '*') {
+                int value;
+                args = nextArg(args, &value, sizeof(value));
+                if (value < 0 && spec[specLength - 1] == '.') {
+                    // A negative precision is taken as if it were omitted.
+                    specLength--;
+                    continue;
+                }
+                specLength += snprintf(spec + specLength, sizeof(spec) - (size_t)specLength, "%d", value);
+            } else {
+                spec[specLength++] = parsed.start[i];
+            }
+        }
+        spec[specLength] = '\0';
+
+        int written = formatArg(buffer + length, (size_t)(bufferSize - length), spec, &parsed, &args);
+        if (written > 0) {
+            length += written;
+        }
+    }
+    if (length > bufferSize - 1) {
+        length = bufferSize - 1;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+/** Format a deferred entry as a complete log line, matching the synchronous output. */
+static int formatRecord(const LogRecord *record, char *buffer)
+{
+    int length = 0;
+    if (record->level != NULL) {
+        length = snprintf(buffer, KSLOGGER_CBufferSize, "%s: %s (%u): %s: ", record->level,
+                          lastPathEntry(record->file), record->line, record->function);
+        if (length > KSLOGGER_CBufferSize - 1) {
+            length = KSLOGGER_CBufferSize - 1;
+        }
+    }
+    length += formatRecordMessage(record, buffer + length, KSLOGGER_CBufferSize);
+    buffer[length++] = '\n';
+    return length;
+}
+
+static void writeBatch(char *batch, int length)
+{
+    batch[length] = '\0';
+    writeToLog(batch);
+}
+
+/** Format and write every published entry.
+ *
+ * Entries are only released back to producers once they have been written,
+ * so a crash drain that interrupts the formatter thread doesn't lose lines.
+ *
+ * @param target Keep going until this position, briefly waiting for entries
+ *               that have been claimed but not yet published.
+ *
+ * @param batch Buffer of KSLOGGER_AsyncBatchSize bytes to format into.
+ */
+static void drainRing(uint64_t target, char *batch)
+{
+    uint64_t position = atomic_load_explicit(&g_dequeuePosition, memory_order_relaxed);
+    int yields = 0;
+    for (;;) {
+        uint64_t first = position;
+        int batchLength = 0;
+        while (batchLength < KSLOGGER_AsyncBatchSize - KSLOGGER_CBufferSize * 2 - 1) {
+            LogRecord *record = &g_logRing[position & (KSLOGGER_AsyncRingCapacity - 1)];
+            if (atomic_load_explicit(&record->sequence, memory_order_acquire) != position + 1) {
+                break;
+            }
+            batchLength += formatRecord(record, batch + batchLength);
+            position++;
+        }
+        if (position == first) {
+            if (position >= target || yields++ >= KSLOGGER_MaxDrainYields) {
+                return;
+            }
+            sched_yield();
+            continue;
+        }
+        writeBatch(batch, batchLength);
+        for (uint64_t released = first; released < position; released++) {
+            LogRecord *record = &g_logRing[released & (KSLOGGER_AsyncRingCapacity - 1)];
+            atomic_store_explicit(&record->sequence, released + KSLOGGER_AsyncRingCapacity, memory_order_release);
+        }
+        atomic_store_explicit(&g_dequeuePosition, position, memory_order_release);
+    }
+}
+
+/** Queue a log call for the formatter thread.
+ *
+ * Lock-free and async-safe.
+ *
+ * @return false if the entry couldn't be queued and must be written synchronously.
+ */
+static bool queueLogRecord(const char *level, const char *file, int line, const char *function, const char *fmt,
+                           va_list args)
+{
+    uint8_t captured[KSLOGGER_AsyncArgsSize];
+    int capturedLength = 0;
+    if (fmt != NULL) {
+        va_list argsCopy;
+        va_copy(argsCopy, args);
+        capturedLength = captureArgs(fmt, &argsCopy, captured);
+        va_end(argsCopy);
+        if (capturedLength < 0) {
+            return false;
+        }
+    }
+
+    LogRecord *record;
+    uint64_t position = atomic_load_explicit(&g_enqueuePosition, memory_order_relaxed);
+    for (;;) {
+        record = &g_logRing[position & (KSLOGGER_AsyncRingCapacity - 1)];
+        uint64_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        int64_t difference = (int64_t)(sequence - position);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&g_enqueuePosition, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // Full.
+            return false;
+        } else {
+            position = atomic_load_explicit(&g_enqueuePosition, memory_order_relaxed);
+        }
+    }
+
+    record->level = level;
+    record->file = file;
+    record->line = line;
+    record->function = function;
+    record->fmt = fmt;
+    memcpy(record->args, captured, (size_t)capturedLength);
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+
+    if (atomic_load(&g_isFormatterWaiting)) {
+        char wake = 0;
+        write(g_wakePipe[1], &wake, 1);
+    }
+    return true;
+}
+
+static void *formatterThread(__unused void *userData)
+{
+    struct pollfd wakeFD = { .fd = g_wakePipe[0], .events = POLLIN };
+    for (;;) {
+        pthread_mutex_lock(&g_drainMutex);
+        drainRing(0, g_batch);
+        pthread_mutex_unlock(&g_drainMutex);
+
+        atomic_store(&g_isFormatterWaiting, true);
+        // Re-check after announcing that we're waiting, so that an entry queued in between isn't missed.
+        uint64_t position = atomic_load(&g_dequeuePosition);
+        LogRecord *record = &g_logRing[position & (KSLOGGER_AsyncRingCapacity - 1)];
+        if (atomic_load(&record->sequence) != position + 1) {
+            poll(&wakeFD, 1, KSLOGGER_AsyncIdleTimeout);
+        }
+        atomic_store(&g_isFormatterWaiting, false);
+        char wakeBytes[64];
+        while (read(g_wakePipe[0], wakeBytes, sizeof(wakeBytes)) > 0) {
+        }
+    }
+    return NULL;
+}
+
+static bool startFormatterThread(void)
+{
+    if (pipe(g_wakePipe) != 0) {
+        writeFmtToLog("KSLogger: Could not create pipe: %s\n", strerror(errno));
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_wakePipe[i], F_SETFL, fcntl(g_wakePipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(g_wakePipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    for (uint64_t i = 0; i < KSLOGGER_AsyncRingCapacity; i++) {
+        atomic_store_explicit(&g_logRing[i].sequence, i, memory_order_relaxed);
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int error = pthread_create(&thread, &attr, formatterThread, NULL);
+    pthread_attr_destroy(&attr);
+    if (error != 0) {
+        writeFmtToLog("KSLogger: Could not start formatter thread: %s\n", strerror(error));
+        close(g_wakePipe[0]);
+        close(g_wakePipe[1]);
+        g_wakePipe[0] = g_wakePipe[1] = -1;
+        return false;
+    }
+    return true;
+}
+
+static inline bool isAsyncLoggingEnabled(void)
+{
+    return atomic_load_explicit(&g_isAsyncLoggingEnabled, memory_order_relaxed);
+}
+
+/** Write out everything queued so far and keep the formatter thread from writing
+ * until endSynchronousEntry(), so that a synchronous entry lands intact and in order.
+ *
+ * This never blocks: it does nothing unless async logging is on (kslog_drainForCrash()
+ * turns it off, since the suspended formatter thread may be holding the lock), and if
+ * the formatter thread keeps the lock for too long, the entry is written without it.
+ *
+ * @return true if endSynchronousEntry() needs to release the formatter.
+ */
+static bool beginSynchronousEntry(void)
+{
+    likely_if(!isAsyncLoggingEnabled())
+    {
+        return false;
+    }
+    for (int yields = 0; pthread_mutex_trylock(&g_drainMutex) != 0; yields++) {
+        if (yields >= KSLOGGER_MaxDrainYields) {
+            return false;
+        }
+        sched_yield();
+    }
+    drainRing(atomic_load(&g_enqueuePosition), g_batch);
+    return true;
+}
+
+static inline void endSynchronousEntry(bool isFormatterHeld)
+{
+    if (isFormatterHeld) {
+        pthread_mutex_unlock(&g_drainMutex);
+    }
+}
+
+bool kslog_setAsyncLogging(bool enabled)
+{
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&mutex);
+    if (enabled && !g_isFormatterStarted) {
+        g_isFormatterStarted = startFormatterThread();
+    }
+    bool isEnabled = enabled && g_isFormatterStarted;
+    bool wasEnabled = atomic_exchange(&g_isAsyncLoggingEnabled, isEnabled);
+    pthread_mutex_unlock(&mutex);
+
+    if (wasEnabled && !isEnabled) {
+        // Synchronous entries stop coordinating with the formatter from here on,
+        // so write out everything it hasn't got to yet.
+        pthread_mutex_lock(&g_drainMutex);
+        drainRing(atomic_load(&g_enqueuePosition), g_batch);
+        pthread_mutex_unlock(&g_drainMutex);
+    }
+    return isEnabled == enabled;
+}
+
+void kslog_drainForCrash(void)
+{
+    atomic_store(&g_isAsyncLoggingEnabled, false);
+    if (!g_isFormatterStarted) {
+        return;
+    }
+    // The formatter thread may have been suspended while holding the lock, or (where
+    // threads aren't suspended) still be draining. Entries it was part way through get
+    // written again rather than risk losing them.
+    bool isLocked = pthread_mutex_trylock(&g_drainMutex) == 0;
+    drainRing(0, g_crashBatch);
+    if (isLocked) {
+        pthread_mutex_unlock(&g_drainMutex);
+    }
+}
+
 bool kslog_setLogFilename(const char *filename, bool overwrite)
 {
-    static int fd = -1;
+    int fd = -1;
     if (filename != NULL) {
         int openMask = O_WRONLY | O_CREAT;
         if (overwrite) {
@@ -154,12 +892,121 @@ bool kslog_setLogFilename(const char *filename, bool overwrite)
         }
     }
 
+    // Queued entries belong to the old file.
+    bool isFormatterHeld = beginSynchronousEntry();
+    atomic_store(&g_isLogBufferActive, false);
     setLogFD(fd);
+    endSynchronousEntry(isFormatterHeld);
     return true;
 }
 
+bool kslog_setLogBuffer(const char *filename, int size, bool overwrite)
+{
+    if (filename == NULL) {
+        atomic_store(&g_isLogBufferActive, false);
+        return true;
+    }
+    int pageSize = getpagesize();
+    uint32_t capacity = (uint32_t)((size > 0 ? size + pageSize - 1 : pageSize) / pageSize * pageSize);
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    unlikely_if(fd < 0)
+    {
+        writeFmtToLog("KSLogger: Could not open %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    LogBufferHeader *header = NULL;
+    char *data = NULL;
+    bool isMapped = ftruncate(fd, (off_t)(pageSize + (int)capacity)) == 0 && mapLogBuffer(fd, capacity, &header, &data);
+    int error = errno;
+    close(fd);
+    unlikely_if(!isMapped)
+    {
+        writeFmtToLog("KSLogger: Could not map %s: %s\n", filename, strerror(error));
+        return false;
+    }
+    if (overwrite || header->magic != KSLOGGER_LogBufferMagic || header->capacity != capacity) {
+        header->magic = KSLOGGER_LogBufferMagic;
+        header->capacity = capacity;
+        atomic_store(&header->cursor, 0);
+    }
+
+    // A previous buffer stays mapped, since log calls on other threads may still be using it.
+    bool isFormatterHeld = beginSynchronousEntry();
+    g_logBufferHeader = header;
+    g_logBufferData = data;
+    atomic_store_explicit(&g_isLogBufferActive, true, memory_order_release);
+    setLogFD(-1);
+    endSynchronousEntry(isFormatterHeld);
+    if (filename != g_logFilename) {
+        strncpy(g_logFilename, filename, sizeof(g_logFilename));
+    }
+    return true;
+}
+
+const char *kslog_getLogBuffer(int *length)
+{
+    if (!atomic_load_explicit(&g_isLogBufferActive, memory_order_acquire)) {
+        return NULL;
+    }
+    uint64_t cursor = atomic_load_explicit(&g_logBufferHeader->cursor, memory_order_relaxed);
+    return g_logBufferData + findLogBufferText(g_logBufferData, cursor, g_logBufferHeader->capacity, length);
+}
+
+char *kslog_readLogBufferFile(const char *filename, int *length)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    char *text = NULL;
+    LogBufferHeader header;
+    if (read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) && header.magic == KSLOGGER_LogBufferMagic) {
+        // Read the text area twice over so that the wrapped text is contiguous.
+        char *data = malloc((size_t)header.capacity * 2 + 1);
+        if (data != NULL && pread(fd, data, header.capacity, getpagesize()) == (ssize_t)header.capacity) {
+            memcpy(data + header.capacity, data, header.capacity);
+            uint32_t start = findLogBufferText(data, atomic_load(&header.cursor), header.capacity, length);
+            memmove(data, data + start, (size_t)*length);
+            data[*length] = '\0';
+            text = data;
+        } else {
+            free(data);
+        }
+    }
+    close(fd);
+    return text;
+}
+
 #else  // if KSLogger_CBufferSize <= 0
 
+static inline bool queueLogRecord(__unused const char *level, __unused const char *file, __unused int line,
+                                  __unused const char *function, __unused const char *fmt, __unused va_list args)
+{
+    return false;
+}
+
+static inline bool isAsyncLoggingEnabled(void) { return false; }
+
+static inline bool beginSynchronousEntry(void) { return false; }
+
+static inline void endSynchronousEntry(__unused bool isFormatterHeld)
+{
+    // Nothing to do.
+}
+
+bool kslog_setAsyncLogging(bool enabled) { return !enabled; }
+
+bool kslog_setLogBuffer(const char *filename, __unused int size, __unused bool overwrite) { return filename == NULL; }
+
+const char *kslog_getLogBuffer(__unused int *length) { return NULL; }
+
+char *kslog_readLogBufferFile(__unused const char *filename, __unused int *length) { return NULL; }
+
+void kslog_drainForCrash(void)
+{
+    // Nothing to do.
+}
+
 static FILE *g_file = NULL;
 
 static inline void setLogFD(FILE *file)
@@ -217,7 +1064,16 @@ bool kslog_setLogFilename(const char *filename, bool overwrite)
 
 #endif
 
-bool kslog_clearLogFile(void) { return kslog_setLogFilename(g_logFilename, true); }
+bool kslog_clearLogFile(void)
+{
+#if KSLOGGER_CBufferSize > 0
+    if (atomic_load(&g_isLogBufferActive)) {
+        atomic_store(&g_logBufferHeader->cursor, 0);
+        return true;
+    }
+#endif
+    return kslog_setLogFilename(g_logFilename, true);
+}
 
 // ===========================================================================
 #pragma mark - C -
@@ -227,22 +1083,32 @@ void i_kslog_logCBasic(const char *const fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    writeFmtArgsToLog(fmt, args);
+    likely_if(!isAsyncLoggingEnabled() || !queueLogRecord(NULL, NULL, 0, NULL, fmt, args))
+    {
+        bool isFormatterHeld = beginSynchronousEntry();
+        writeFmtArgsToLog(fmt, args);
+        writeToLog("\n");
+        flushLog();
+        endSynchronousEntry(isFormatterHeld);
+    }
     va_end(args);
-    writeToLog("\n");
-    flushLog();
 }
 
 void i_kslog_logC(const char *const level, const char *const file, const int line, const char *const function,
                   const char *const fmt, ...)
 {
-    writeFmtToLog("%s: %s (%u): %s: ", level, lastPathEntry(file), line, function);
     va_list args;
     va_start(args, fmt);
-    writeFmtArgsToLog(fmt, args);
+    likely_if(!isAsyncLoggingEnabled() || !queueLogRecord(level, file, line, function, fmt, args))
+    {
+        bool isFormatterHeld = beginSynchronousEntry();
+        writeFmtToLog("%s: %s (%u): %s: ", level, lastPathEntry(file), line, function);
+        writeFmtArgsToLog(fmt, args);
+        writeToLog("\n");
+        flushLog();
+        endSynchronousEntry(isFormatterHeld);
+    }
     va_end(args);
-    writeToLog("\n");
-    flushLog();
 }
 
 // ===========================================================================
@@ -255,7 +1121,9 @@ void i_kslog_logC(const char *const level, const char *const file, const int lin
 void i_kslog_logObjCBasic(CFStringRef fmt, ...)
 {
     if (fmt == NULL) {
+        bool isFormatterHeld = beginSynchronousEntry();
         writeToLog("(null)");
+        endSynchronousEntry(isFormatterHeld);
         return;
     }
 
@@ -266,12 +1134,14 @@ void i_kslog_logObjCBasic(CFStringRef fmt, ...)
 
     int bufferLength = (int)CFStringGetLength(entry) * 4 + 1;
     char *stringBuffer = malloc((unsigned)bufferLength);
+    bool isFormatterHeld = beginSynchronousEntry();
     if (CFStringGetCString(entry, stringBuffer, (CFIndex)bufferLength, kCFStringEncodingUTF8)) {
         writeToLog(stringBuffer);
     } else {
         writeToLog("Could not convert log string to UTF-8. No logging performed.");
     }
     writeToLog("\n");
+    endSynchronousEntry(isFormatterHeld);
 
     free(stringBuffer);
     CFRelease(entry);
@@ -24,13 +24,30 @@
 // THE SOFTWARE.
 //
 
+
 #include "KSMemory.h"
 
+#include "KSSystemCapabilities.h"
+
 // #define KSLogger_LocalLevel TRACE
+#if KSCRASH_HOST_APPLE
 #include <mach/mach.h>
+#elif KSCRASH_HOST_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#include <stdint.h>
+#include <string.h>
 
 #include "KSLogger.h"
 
+#if KSCRASH_HOST_APPLE
+
 static inline int copySafely(const void *restrict const src, void *restrict const dst, const int byteCount)
 {
     vm_size_t bytesCopied = 0;
@@ -80,17 +97,414 @@ static inline int copyMaxPossible(const void *restrict const src, void *restrict
     return bytesCopied;
 }
 
-static char g_memoryTestBuffer[10240];
+static int copyManySafely(KSMemoryRegion *const regions, const int count)
+{
+    int copiedCount = 0;
+    for (int i = 0; i < count; i++) {
+        regions[i].isCopied = copySafely(regions[i].src, regions[i].dst, regions[i].byteCount) == regions[i].byteCount;
+        if (regions[i].isCopied) {
+            copiedCount++;
+        }
+    }
+    return copiedCount;
+}
+
+#elif KSCRASH_HOST_LINUX
+
+/** Most iovecs to pass in one process_vm_readv call. Kept small since this runs on the crash handler's stack. */
+#define KSMEM_MaxIOVecs 64
+
+/** This process's ID, cached since getpid() is a syscall. Reset in fork children. */
+static pid_t g_pid;
+static pthread_once_t g_pidOnce = PTHREAD_ONCE_INIT;
+
+/** Set once process_vm_readv turns out to be unavailable (e.g. blocked by seccomp). */
+static volatile bool g_isProcessVMReadvUnavailable;
+
+/** /proc/self/mem, which is read instead when process_vm_readv is unavailable.
+ * -1 = not open yet, -2 = can't be opened. Reset in fork children, since it refers to the parent.
+ */
+static _Atomic(int) g_memFD = -1;
+
+static void resetForChild(void)
+{
+    g_pid = 0;
+    int memFD = atomic_exchange(&g_memFD, -1);
+    if (memFD >= 0) {
+        close(memFD);
+    }
+}
+
+static void registerForkReset(void) { pthread_atfork(NULL, NULL, resetForChild); }
+
+static int getMemFD(void)
+{
+    int memFD = atomic_load(&g_memFD);
+    if (memFD != -1) {
+        return memFD;
+    }
+    int newFD = open("/proc/self/mem", O_RDONLY | O_CLOEXEC);
+    if (newFD < 0) {
+        newFD = -2;
+    }
+    if (!atomic_compare_exchange_strong(&g_memFD, &memFD, newFD)) {
+        // Another thread got there first.
+        if (newFD >= 0) {
+            close(newFD);
+        }
+        return memFD;
+    }
+    return newFD;
+}
+
+/** process_vm_readv() done with pread() on /proc/self/mem, which also stops at the first unreadable page.
+ * Unlike process_vm_readv(), it can read mappings that are mapped without read permission.
+ */
+static ssize_t readSelfFromMem(const struct iovec *local, int localCount, const struct iovec *remote,
+                               int remoteCount)
+{
+    int memFD = getMemFD();
+    if (memFD < 0) {
+        errno = EFAULT;
+        return -1;
+    }
+    ssize_t bytesRead = 0;
+    int localIndex = 0;
+    size_t localOffset = 0;
+    for (int remoteIndex = 0; remoteIndex < remoteCount; remoteIndex++) {
+        size_t remoteOffset = 0;
+        while (remoteOffset < remote[remoteIndex].iov_len) {
+            while (localIndex < localCount && localOffset == local[localIndex].iov_len) {
+                localIndex++;
+                localOffset = 0;
+            }
+            if (localIndex == localCount) {
+                return bytesRead;
+            }
+            size_t length = remote[remoteIndex].iov_len - remoteOffset;
+            if (length > local[localIndex].iov_len - localOffset) {
+                length = local[localIndex].iov_len - localOffset;
+            }
+            uintptr_t address = (uintptr_t)remote[remoteIndex].iov_base + remoteOffset;
+            ssize_t result = pread(memFD, (uint8_t *)local[localIndex].iov_base + localOffset, length, (off_t)address);
+            if (result <= 0) {
+                if (bytesRead == 0) {
+                    errno = EFAULT;
+                    return -1;
+                }
+                return bytesRead;
+            }
+            bytesRead += result;
+            remoteOffset += (size_t)result;
+            localOffset += (size_t)result;
+            if ((size_t)result < length) {
+                return bytesRead;
+            }
+        }
+    }
+    return bytesRead;
+}
+
+/** Read from our own address space. The kernel validates the source, so bad addresses fail with EFAULT
+ * instead of faulting. Source regions are copied in order, stopping at the first unreadable page.
+ */
+static inline ssize_t readSelf(const struct iovec *local, int localCount, const struct iovec *remote, int remoteCount)
+{
+    if (g_pid == 0) {
+        pthread_once(&g_pidOnce, registerForkReset);
+        g_pid = getpid();
+    }
+    if (!g_isProcessVMReadvUnavailable) {
+        ssize_t result = syscall(SYS_process_vm_readv, g_pid, local, (unsigned long)localCount, remote,
+                                 (unsigned long)remoteCount, 0UL);
+        if (result >= 0 || (errno != ENOSYS && errno != EPERM)) {
+            return result;
+        }
+        g_isProcessVMReadvUnavailable = true;
+    }
+    return readSelfFromMem(local, localCount, remote, remoteCount);
+}
+
+static inline int copySafely(const void *restrict const src, void *restrict const dst, const int byteCount)
+{
+    struct iovec local = { .iov_base = dst, .iov_len = (size_t)byteCount };
+    struct iovec remote = { .iov_base = (void *)src, .iov_len = (size_t)byteCount };
+    return readSelf(&local, 1, &remote, 1) == byteCount ? byteCount : 0;
+}
+
+/** A partial read only ends at an iovec boundary, so the source is split at page boundaries
+ * and the readable prefix comes back from a single call.
+ */
+static int copyMaxPossible(const void *restrict const src, void *restrict const dst, const int byteCount)
+{
+    const uintptr_t pageSize = (uintptr_t)getpagesize();
+    struct iovec remote[KSMEM_MaxIOVecs];
+    int bytesCopied = 0;
+    while (bytesCopied < byteCount) {
+        int remoteCount = 0;
+        int batchLength = 0;
+        while (remoteCount < KSMEM_MaxIOVecs && bytesCopied + batchLength < byteCount) {
+            uintptr_t start = (uintptr_t)src + (uintptr_t)(bytesCopied + batchLength);
+            uintptr_t length = ((start | (pageSize - 1)) + 1) - start;
+            if (length > (uintptr_t)(byteCount - bytesCopied - batchLength)) {
+                length = (uintptr_t)(byteCount - bytesCopied - batchLength);
+            }
+            remote[remoteCount++] = (struct iovec) { .iov_base = (void *)start, .iov_len = length };
+            batchLength += (int)length;
+        }
+        struct iovec local = { .iov_base = (uint8_t *)dst + bytesCopied, .iov_len = (size_t)batchLength };
+        ssize_t result = readSelf(&local, 1, remote, remoteCount);
+        if (result <= 0) {
+            break;
+        }
+        bytesCopied += (int)result;
+        if (result < batchLength) {
+            break;
+        }
+    }
+    return bytesCopied;
+}
+
+static int copyManySafely(KSMemoryRegion *const regions, const int count)
+{
+    struct iovec local[KSMEM_MaxIOVecs];
+    struct iovec remote[KSMEM_MaxIOVecs];
+    int copiedCount = 0;
+    int first = 0;
+    while (first < count) {
+        int batchCount = count - first < KSMEM_MaxIOVecs ? count - first : KSMEM_MaxIOVecs;
+        for (int i = 0; i < batchCount; i++) {
+            KSMemoryRegion *region = &regions[first + i];
+            region->isCopied = false;
+            local[i] = (struct iovec) { .iov_base = region->dst, .iov_len = (size_t)region->byteCount };
+            remote[i] = (struct iovec) { .iov_base = (void *)region->src, .iov_len = (size_t)region->byteCount };
+        }
+        ssize_t result = readSelf(local, batchCount, remote, batchCount);
+        if (result < 0 && errno != EFAULT) {
+            break;
+        }
+
+        // Everything before the region that faulted was copied. Carry on after it.
+        size_t bytesRemaining = result > 0 ? (size_t)result : 0;
+        int i = 0;
+        while (i < batchCount && bytesRemaining >= (size_t)regions[first + i].byteCount) {
+            bytesRemaining -= (size_t)regions[first + i].byteCount;
+            regions[first + i].isCopied = true;
+            copiedCount++;
+            i++;
+        }
+        first += i < batchCount ? i + 1 : i;
+    }
+    for (int i = first; i < count; i++) {
+        regions[i].isCopied = false;
+    }
+    return copiedCount;
+}
+
+#endif
+
+// ============================================================================
+#pragma mark - Readable Region Snapshot -
+// ============================================================================
+
+/** Most readable regions a snapshot can hold. Adjacent regions are merged. */
+#define KSMEM_MaxSnapshotRegions 4096
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+} ReadableRegion;
+
+static ReadableRegion g_readableRegions[KSMEM_MaxSnapshotRegions];
+static int g_readableRegionCount;
+static volatile bool g_isSnapshotActive;
+
+/** Add a readable region. Regions must be added in ascending order. */
+static bool addReadableRegion(uintptr_t start, uintptr_t end)
+{
+    if (g_readableRegionCount > 0 && g_readableRegions[g_readableRegionCount - 1].end == start) {
+        g_readableRegions[g_readableRegionCount - 1].end = end;
+        return true;
+    }
+    if (g_readableRegionCount >= KSMEM_MaxSnapshotRegions) {
+        return false;
+    }
+    g_readableRegions[g_readableRegionCount++] = (ReadableRegion) { .start = start, .end = end };
+    return true;
+}
+
+#if KSCRASH_HOST_APPLE
+
+static bool readReadableRegions(void)
+{
+    vm_address_t address = 0;
+    natural_t depth = 0;
+    for (;;) {
+        vm_size_t size = 0;
+        vm_region_submap_info_data_64_t info;
+        mach_msg_type_number_t count = VM_REGION_SUBMAP_INFO_COUNT_64;
+        kern_return_t kr = vm_region_recurse_64(mach_task_self(), &address, &size, &depth,
+                                                (vm_region_recurse_info_t)&info, &count);
+        if (kr != KERN_SUCCESS) {
+            // KERN_INVALID_ADDRESS: there are no regions past this address.
+            return kr == KERN_INVALID_ADDRESS;
+        }
+        if (info.is_submap) {
+            depth++;
+            continue;
+        }
+        if ((info.protection & VM_PROT_READ) != 0 && !addReadableRegion(address, address + size)) {
+            return false;
+        }
+        address += size;
+    }
+}
+
+#elif KSCRASH_HOST_LINUX
+
+static bool parseMapsLine(const char *line)
+{
+    // Lines look like: 7f0000000000-7f0000021000 rw-p 00000000 00:00 0 [heap]
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    const char *pos = line;
+    for (; *pos != '-'; pos++) {
+        int digit = *pos >= 'a' ? *pos - 'a' + 10 : *pos - '0';
+        start = (start << 4) | (uintptr_t)digit;
+    }
+    for (pos++; *pos != ' '; pos++) {
+        int digit = *pos >= 'a' ? *pos - 'a' + 10 : *pos - '0';
+        end = (end << 4) | (uintptr_t)digit;
+    }
+    if (pos[1] != 'r') {
+        return true;
+    }
+    return addReadableRegion(start, end);
+}
+
+/** Parse /proc/self/maps, which is sorted by address, without allocating. */
+static bool readReadableRegions(void)
+{
+    int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char buffer[4096];
+    int length = 0;
+    bool isSkippingLine = false;
+    bool isSuccessful = true;
+    for (;;) {
+        ssize_t bytesRead = read(fd, buffer + length, sizeof(buffer) - 1 - (size_t)length);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            break;
+        }
+        length += (int)bytesRead;
+        buffer[length] = '\0';
+        char *line = buffer;
+        if (isSkippingLine) {
+            char *newline = memchr(buffer, '\n', (size_t)length);
+            if (newline == NULL) {
+                length = 0;
+                continue;
+            }
+            line = newline + 1;
+            isSkippingLine = false;
+        }
+        for (char *newline; (newline = memchr(line, '\n', (size_t)(buffer + length - line))) != NULL;
+             line = newline + 1) {
+            *newline = '\0';
+            if (!parseMapsLine(line)) {
+                isSuccessful = false;
+                break;
+            }
+        }
+        if (!isSuccessful) {
+            break;
+        }
+        length = (int)(buffer + length - line);
+        if (length == (int)sizeof(buffer) - 1) {
+            // The line doesn't fit (a very long path). The address range and permissions are at the start
+            // of it, so parse what there is and skip the rest.
+            if (!parseMapsLine(buffer)) {
+                isSuccessful = false;
+                break;
+            }
+            isSkippingLine = true;
+            length = 0;
+            continue;
+        }
+        memmove(buffer, line, (size_t)length);
+    }
+    close(fd);
+    return isSuccessful;
+}
+
+#else
+
+static bool readReadableRegions(void) { return false; }
+
+#endif
+
+bool ksmem_snapshotReadableRegions(void)
+{
+    g_isSnapshotActive = false;
+    g_readableRegionCount = 0;
+    if (!readReadableRegions()) {
+        KSLOG_DEBUG("Could not snapshot readable regions. Falling back to trial copies.");
+        g_readableRegionCount = 0;
+        return false;
+    }
+    g_isSnapshotActive = true;
+    return true;
+}
+
+void ksmem_clearReadableRegionSnapshot(void) { g_isSnapshotActive = false; }
+
+/** Find the snapshotted region containing an address, using binary search. */
+static const ReadableRegion *findReadableRegion(uintptr_t address)
+{
+    int low = 0;
+    int high = g_readableRegionCount - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        const ReadableRegion *region = &g_readableRegions[mid];
+        if (address < region->start) {
+            high = mid - 1;
+        } else if (address >= region->end) {
+            low = mid + 1;
+        } else {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+// ============================================================================
+#pragma mark - API -
+// ============================================================================
+
+/** Trial copies go through a buffer on the stack, so that concurrent callers don't share one. */
+#define KSMEM_TestBufferSize 1024
+
 static inline bool isMemoryReadable(const void *const memory, const int byteCount)
 {
-    const int testBufferSize = sizeof(g_memoryTestBuffer);
-    int bytesRemaining = byteCount;
+    if (g_isSnapshotActive && byteCount > 0) {
+        const ReadableRegion *region = findReadableRegion((uintptr_t)memory);
+        return region != NULL && (uintptr_t)byteCount <= region->end - (uintptr_t)memory;
+    }
 
+    uint8_t testBuffer[KSMEM_TestBufferSize];
+    const uint8_t *currentPosition = memory;
+    int bytesRemaining = byteCount;
     while (bytesRemaining > 0) {
-        int bytesToCopy = bytesRemaining > testBufferSize ? testBufferSize : bytesRemaining;
-        if (copySafely(memory, g_memoryTestBuffer, bytesToCopy) != bytesToCopy) {
+        int bytesToCopy = bytesRemaining > KSMEM_TestBufferSize ? KSMEM_TestBufferSize : bytesRemaining;
+        if (copySafely(currentPosition, testBuffer, bytesToCopy) != bytesToCopy) {
             break;
         }
+        currentPosition += bytesToCopy;
         bytesRemaining -= bytesToCopy;
     }
     return bytesRemaining == 0;
@@ -98,18 +512,27 @@ static inline bool isMemoryReadable(const void *const memory, const int byteCoun
 
 int ksmem_maxReadableBytes(const void *const memory, const int tryByteCount)
 {
-    const int testBufferSize = sizeof(g_memoryTestBuffer);
+    if (g_isSnapshotActive && tryByteCount > 0) {
+        const ReadableRegion *region = findReadableRegion((uintptr_t)memory);
+        if (region == NULL) {
+            return 0;
+        }
+        uintptr_t readableBytes = region->end - (uintptr_t)memory;
+        return readableBytes < (uintptr_t)tryByteCount ? (int)readableBytes : tryByteCount;
+    }
+
+    uint8_t testBuffer[KSMEM_TestBufferSize];
     const uint8_t *currentPosition = memory;
     int bytesRemaining = tryByteCount;
-
-    while (bytesRemaining > testBufferSize) {
-        if (!isMemoryReadable(currentPosition, testBufferSize)) {
+    while (bytesRemaining > KSMEM_TestBufferSize) {
+        if (copySafely(currentPosition, testBuffer, KSMEM_TestBufferSize) != KSMEM_TestBufferSize) {
             break;
         }
-        currentPosition += testBufferSize;
-        bytesRemaining -= testBufferSize;
+        currentPosition += KSMEM_TestBufferSize;
+        bytesRemaining -= KSMEM_TestBufferSize;
     }
-    bytesRemaining -= copyMaxPossible(currentPosition, g_memoryTestBuffer, testBufferSize);
+    int bytesToCopy = bytesRemaining > KSMEM_TestBufferSize ? KSMEM_TestBufferSize : bytesRemaining;
+    bytesRemaining -= copyMaxPossible(currentPosition, testBuffer, bytesToCopy);
     return tryByteCount - bytesRemaining;
 }
 
@@ -127,3 +550,5 @@ bool ksmem_copySafely(const void *restrict const src, void *restrict const dst,
 {
     return copySafely(src, dst, byteCount);
 }
+
+int ksmem_copyManySafely(KSMemoryRegion *const regions, const int count) { return copyManySafely(regions, count); }
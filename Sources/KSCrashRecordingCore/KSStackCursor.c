@@ -25,12 +25,17 @@
 #include "KSStackCursor.h"
 
 #include <stdlib.h>
+#include <string.h>
 
+#include "KSMemory.h"
 #include "KSSymbolicator.h"
 
 // #define KSLogger_LocalLevel TRACE
 #include "KSLogger.h"
 
+/** Blocks never cross a multiple of this, so they never span two pages. */
+#define kStackBlockBoundary 4096
+
 static bool g_advanceCursor(__unused KSStackCursor *cursor)
 {
     KSLOG_WARN(
@@ -62,3 +67,26 @@ void kssc_initCursor(KSStackCursor *cursor, void (*resetCursor)(KSStackCursor *)
     //调用游标的重置函数以初始化状态。这一步完成后，cursor 将处于有效状态，准备进行堆栈遍历。
     cursor->resetCursor(cursor);
 }
+
+void kssc_resetStackBlock(KSStackBlock *block) { block->length = 0; }
+
+bool kssc_readStackMemory(KSStackBlock *block, uintptr_t address, void *destination, int byteCount)
+{
+    uintptr_t offset = address - block->address;
+    if (address < block->address || offset + (uintptr_t)byteCount > block->length) {
+        // Stacks grow down, so the rest of the frames are above this address.
+        uintptr_t length = kStackBlockBoundary - (address & (kStackBlockBoundary - 1));
+        if (length > sizeof(block->bytes)) {
+            length = sizeof(block->bytes);
+        }
+        if (length < (uintptr_t)byteCount || !ksmem_copySafely((const void *)address, block->bytes, (int)length)) {
+            block->length = 0;
+            return ksmem_copySafely((const void *)address, destination, byteCount);
+        }
+        block->address = address;
+        block->length = length;
+        offset = 0;
+    }
+    memcpy(destination, block->bytes + offset, (size_t)byteCount);
+    return true;
+}
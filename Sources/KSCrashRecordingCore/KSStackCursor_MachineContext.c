@@ -91,7 +91,9 @@ typedef struct {
     uintptr_t instructionAddress;
     uintptr_t linkRegister;
     bool isPastFramePointer;
+    KSStackBlock stackBlock;
 } MachineContextCursor;
+_Static_assert(sizeof(MachineContextCursor) <= sizeof(((KSStackCursor *)0)->context), "MachineContextCursor must fit in a cursor context");
 
 static bool advanceCursor(KSStackCursor *cursor)
 {
@@ -126,7 +128,8 @@ static bool advanceCursor(KSStackCursor *cursor)
         context->isPastFramePointer = true;
     }
 
-    if (!ksmem_copySafely(context->currentFrame.previous, &context->currentFrame, sizeof(context->currentFrame))) {
+    if (!kssc_readStackMemory(&context->stackBlock, (uintptr_t)context->currentFrame.previous, &context->currentFrame,
+                              sizeof(context->currentFrame))) {
         return false;
     }
     if (context->currentFrame.previous == 0 || context->currentFrame.return_address == 0) {
@@ -150,6 +153,7 @@ static void resetCursor(KSStackCursor *cursor)
     context->instructionAddress = 0;
     context->linkRegister = 0;
     context->isPastFramePointer = 0;
+    kssc_resetStackBlock(&context->stackBlock);
 }
 
 void kssc_initWithMachineContext(KSStackCursor *cursor, int maxStackDepth,
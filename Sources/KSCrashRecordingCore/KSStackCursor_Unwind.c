@@ -0,0 +1,193 @@
+//
+//  KSStackCursor_Unwind.c
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "KSStackCursor_Unwind.h"
+
+#include "KSCPU.h"
+#include "KSStackCursor_MachineContext.h"
+#include "KSUnwindTable.h"
+
+// #define KSLogger_LocalLevel TRACE
+#include "KSLogger.h"
+
+typedef struct {
+    const struct KSMachineContext *machineContext;
+    int maxStackDepth;
+
+    /** The registers of the frame the cursor is on. */
+    uintptr_t instructionAddress;
+    uintptr_t stackPointer;
+    uintptr_t framePointer;
+    uintptr_t linkRegister;
+
+    /** The top frame is the only one whose instruction address isn't a return address,
+     * and the only one where the link register still holds its return address.
+     */
+    bool isTopFrame;
+
+    /** The top frame had no unwind rule, so the link register was given as the
+     * next address, and the walk continues from the frame pointer.
+     */
+    bool isLinkRegisterGiven;
+
+    KSStackBlock stackBlock;
+} UnwindCursor;
+_Static_assert(sizeof(UnwindCursor) <= sizeof(((KSStackCursor *)0)->context), "UnwindCursor must fit in a cursor context");
+
+static inline bool readStackWord(UnwindCursor *context, uintptr_t address, uintptr_t *value)
+{
+    return kssc_readStackMemory(&context->stackBlock, address, value, sizeof(*value));
+}
+
+/** Step to the caller using the frame record that the frame pointer points to. */
+static bool stepWithFramePointer(UnwindCursor *context, uintptr_t *returnAddress)
+{
+    uintptr_t framePointer = context->framePointer;
+    if (framePointer == 0 || framePointer < context->stackPointer ||
+        (framePointer & (sizeof(uintptr_t) - 1)) != 0) {
+        return false;
+    }
+    uintptr_t previousFramePointer;
+    if (!readStackWord(context, framePointer, &previousFramePointer) ||
+        !readStackWord(context, framePointer + sizeof(uintptr_t), returnAddress)) {
+        return false;
+    }
+    context->stackPointer = framePointer + sizeof(uintptr_t) * 2;
+    context->framePointer = previousFramePointer;
+    return true;
+}
+
+/** Step to the caller using an unwind rule. */
+static bool stepWithRule(UnwindCursor *context, const KSUnwindRule *rule, uintptr_t *returnAddress)
+{
+    uintptr_t base = rule->cfaRegister == KSUnwindRegister_FramePointer ? context->framePointer : context->stackPointer;
+    if (base == 0) {
+        return false;
+    }
+    uintptr_t cfa = base + (uintptr_t)(intptr_t)rule->cfaOffset;
+    if (rule->returnAddressOffset != 0) {
+        if (!readStackWord(context, cfa + (uintptr_t)(intptr_t)rule->returnAddressOffset, returnAddress)) {
+            return false;
+        }
+    } else if (context->isTopFrame && context->linkRegister != 0) {
+        *returnAddress = context->linkRegister;
+    } else {
+        return false;
+    }
+
+    uintptr_t framePointer = context->framePointer;
+    if (rule->framePointerOffset != 0 &&
+        !readStackWord(context, cfa + (uintptr_t)(intptr_t)rule->framePointerOffset, &framePointer)) {
+        return false;
+    }
+    // Only a frame that hasn't touched the stack yet can leave the stack pointer where it is.
+    if (cfa < context->stackPointer || (cfa == context->stackPointer && rule->returnAddressOffset != 0)) {
+        return false;
+    }
+    context->stackPointer = cfa;
+    context->framePointer = framePointer;
+    return true;
+}
+
+static bool advanceCursor(KSStackCursor *cursor)
+{
+    UnwindCursor *context = (UnwindCursor *)cursor->context;
+    uintptr_t nextAddress = 0;
+
+    if (cursor->state.currentDepth >= context->maxStackDepth) {
+        cursor->state.hasGivenUp = true;
+        return false;
+    }
+
+    if (cursor->state.currentDepth == 0) {
+        context->instructionAddress = kscpu_instructionAddress(context->machineContext);
+        context->stackPointer = kscpu_stackPointer(context->machineContext);
+        context->framePointer = kscpu_framePointer(context->machineContext);
+        context->linkRegister = kscpu_linkRegister(context->machineContext);
+        context->isTopFrame = true;
+        nextAddress = context->instructionAddress;
+        goto successfulExit;
+    }
+
+    if (context->isLinkRegisterGiven) {
+        context->isLinkRegisterGiven = false;
+        if (!stepWithFramePointer(context, &nextAddress)) {
+            return false;
+        }
+    } else {
+        // A return address points after the call, which may be past the end of the function.
+        uintptr_t lookupAddress = kscpu_normaliseInstructionPointer(context->instructionAddress);
+        if (!context->isTopFrame) {
+            lookupAddress--;
+        }
+        KSUnwindRule rule;
+        if (ksunwind_findRule(lookupAddress, &rule)) {
+            if (!stepWithRule(context, &rule, &nextAddress)) {
+                return false;
+            }
+        } else if (context->isTopFrame && context->linkRegister != 0) {
+            // Same as the machine context cursor: the link register, then the frame pointer chain.
+            context->isLinkRegisterGiven = true;
+            nextAddress = context->linkRegister;
+        } else if (!stepWithFramePointer(context, &nextAddress)) {
+            return false;
+        }
+    }
+
+    if (nextAddress == 0) {
+        return false;
+    }
+    context->instructionAddress = nextAddress;
+    context->isTopFrame = false;
+
+successfulExit:
+    cursor->stackEntry.address = kscpu_normaliseInstructionPointer(nextAddress);
+    cursor->state.currentDepth++;
+    return true;
+}
+
+static void resetCursor(KSStackCursor *cursor)
+{
+    kssc_resetCursor(cursor);
+    UnwindCursor *context = (UnwindCursor *)cursor->context;
+    context->instructionAddress = 0;
+    context->stackPointer = 0;
+    context->framePointer = 0;
+    context->linkRegister = 0;
+    context->isTopFrame = true;
+    context->isLinkRegisterGiven = false;
+    kssc_resetStackBlock(&context->stackBlock);
+}
+
+void kssc_initWithUnwindTables(KSStackCursor *cursor, int maxStackDepth, const struct KSMachineContext *machineContext)
+{
+    if (!ksunwind_isEnabled()) {
+        kssc_initWithMachineContext(cursor, maxStackDepth, machineContext);
+        return;
+    }
+    kssc_initCursor(cursor, resetCursor, advanceCursor);
+    UnwindCursor *context = (UnwindCursor *)cursor->context;
+    context->machineContext = machineContext;
+    context->maxStackDepth = maxStackDepth;
+}
@@ -0,0 +1,1393 @@
+//
+//  KSUnwindTable.c
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// For dl_iterate_phdr().
+#define _GNU_SOURCE
+#endif
+
+#include "KSUnwindTable.h"
+
+#include "KSSystemCapabilities.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if KSCRASH_HOST_APPLE
+#include <mach-o/compact_unwind_encoding.h>
+#include <mach-o/dyld.h>
+#include <mach-o/getsect.h>
+#include <mach-o/loader.h>
+
+#include "KSMach-O.h"
+#elif KSCRASH_HOST_LINUX
+#include <link.h>
+#endif
+
+// #define KSLogger_LocalLevel TRACE
+#include "KSLogger.h"
+
+// DWARF register numbers of the registers the unwinder tracks.
+#if (defined(__arm64__) || defined(__aarch64__)) && defined(__LP64__)
+#define KSUNWIND_IsSupported 1
+#define KSUNWIND_DwarfFP 29
+#define KSUNWIND_DwarfLR 30
+#define KSUNWIND_DwarfSP 31
+#elif defined(__x86_64__)
+#define KSUNWIND_IsSupported 1
+#define KSUNWIND_DwarfFP 6
+#define KSUNWIND_DwarfSP 7
+#else
+#define KSUNWIND_IsSupported 0
+#endif
+
+#define KSUNWIND_MaxImages 4096
+#define KSUNWIND_MaxRememberedStates 8
+
+/** How many times removing an image yields to lookups still reading it, before giving up
+ * and leaking its table. Lookups only stay that long if their thread is suspended.
+ */
+#define KSUNWIND_MaxGraceYields 1000
+
+// DWARF pointer encodings (DW_EH_PE_*).
+#define DW_EH_PE_omit 0xff
+#define DW_EH_PE_absptr 0x00
+#define DW_EH_PE_uleb128 0x01
+#define DW_EH_PE_udata2 0x02
+#define DW_EH_PE_udata4 0x03
+#define DW_EH_PE_udata8 0x04
+#define DW_EH_PE_sleb128 0x09
+#define DW_EH_PE_sdata2 0x0a
+#define DW_EH_PE_sdata4 0x0b
+#define DW_EH_PE_sdata8 0x0c
+#define DW_EH_PE_pcrel 0x10
+#define DW_EH_PE_datarel 0x30
+#define DW_EH_PE_indirect 0x80
+
+// DWARF call frame instructions (DW_CFA_*).
+#define DW_CFA_advance_loc 0x40
+#define DW_CFA_offset 0x80
+#define DW_CFA_restore 0xc0
+#define DW_CFA_nop 0x00
+#define DW_CFA_set_loc 0x01
+#define DW_CFA_advance_loc1 0x02
+#define DW_CFA_advance_loc2 0x03
+#define DW_CFA_advance_loc4 0x04
+#define DW_CFA_offset_extended 0x05
+#define DW_CFA_restore_extended 0x06
+#define DW_CFA_undefined 0x07
+#define DW_CFA_same_value 0x08
+#define DW_CFA_register 0x09
+#define DW_CFA_remember_state 0x0a
+#define DW_CFA_restore_state 0x0b
+#define DW_CFA_def_cfa 0x0c
+#define DW_CFA_def_cfa_register 0x0d
+#define DW_CFA_def_cfa_offset 0x0e
+#define DW_CFA_def_cfa_expression 0x0f
+#define DW_CFA_expression 0x10
+#define DW_CFA_offset_extended_sf 0x11
+#define DW_CFA_def_cfa_sf 0x12
+#define DW_CFA_def_cfa_offset_sf 0x13
+#define DW_CFA_val_offset 0x14
+#define DW_CFA_val_offset_sf 0x15
+#define DW_CFA_val_expression 0x16
+#define DW_CFA_AARCH64_negate_ra_state 0x2d
+#define DW_CFA_GNU_args_size 0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+/** One row of an image's unwind table. It applies from its offset up to the next row's offset. */
+typedef struct {
+    /** Offset of the first instruction covered, from the start of the image's text. */
+    uint32_t offset;
+
+    int32_t cfaOffset;
+
+    /** A KSUnwindRegister, or 0 if there is no rule here. */
+    uint8_t cfaRegister;
+
+    /** Where the return address and frame pointer are saved, in words from the CFA. 0 = not saved. */
+    int8_t returnAddressSlot;
+    int8_t framePointerSlot;
+} UnwindRow;
+
+typedef struct {
+    uintptr_t textStart;
+    uintptr_t textEnd;
+    uintptr_t imageBase;
+    const uint8_t *unwindInfo;
+    uintptr_t unwindInfoSize;
+    UnwindRow *rows;
+    uint32_t rowCount;
+    /** Set once the image is unloaded. Lookups skip it, and its slot can be reused. */
+    bool isRetired;
+    /** Odd while the slot is being written. Lookups that see it change discard what they read. */
+    _Atomic(uint32_t) sequence;
+} UnwindImage;
+
+typedef struct {
+    const uint8_t *position;
+    const uint8_t *end;
+    bool isValid;
+} DwarfReader;
+
+typedef struct {
+    uint64_t codeAlignment;
+    int64_t dataAlignment;
+    uint64_t returnAddressRegister;
+    uint8_t pointerEncoding;
+    bool hasAugmentationData;
+    const uint8_t *instructions;
+    const uint8_t *instructionsEnd;
+} CommonInfo;
+
+typedef enum {
+    RegisterRuleSame = 0,
+    RegisterRuleOffset,
+    RegisterRuleUnsupported,
+} RegisterRuleKind;
+
+typedef struct {
+    RegisterRuleKind kind;
+    int64_t offset;
+} RegisterRule;
+
+typedef struct {
+    uint64_t cfaRegister;
+    int64_t cfaOffset;
+    bool isCFAUnsupported;
+    RegisterRule returnAddress;
+    RegisterRule framePointer;
+} CFAState;
+
+typedef struct {
+    UnwindRow *rows;
+    uint32_t count;
+    uint32_t capacity;
+    uintptr_t textStart;
+} RowBuilder;
+
+// ============================================================================
+#pragma mark - Globals -
+// ============================================================================
+
+static UnwindImage g_images[KSUNWIND_MaxImages];
+static _Atomic int g_imageCount;
+static pthread_mutex_t g_addImageMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Lookups in progress, counted against the epoch they started in. Removing an image
+ * moves to the next epoch, then waits for the lookups of the one before to finish.
+ */
+static _Atomic(uint32_t) g_lookupEpoch;
+static _Atomic(int) g_lookupCounts[2];
+static pthread_mutex_t g_removeImageMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool g_isEnabled = false;
+
+#if KSCRASH_HOST_APPLE
+/** Images that dyld has loaded, waiting for the builder thread to parse their unwind info. */
+typedef struct PendingImage {
+    const struct mach_header *header;
+    intptr_t slide;
+    struct PendingImage *next;
+} PendingImage;
+
+static PendingImage *g_pendingImagesHead;
+static PendingImage *g_pendingImagesTail;
+/** The image that the builder thread is parsing right now. */
+static const struct mach_header *g_buildingImage;
+static pthread_mutex_t g_pendingImagesMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_pendingImagesCondition = PTHREAD_COND_INITIALIZER;
+#endif
+
+// ============================================================================
+#pragma mark - DWARF Reading -
+// ============================================================================
+
+static inline bool canRead(DwarfReader *reader, uintptr_t byteCount)
+{
+    if (!reader->isValid || (uintptr_t)(reader->end - reader->position) < byteCount) {
+        reader->isValid = false;
+        return false;
+    }
+    return true;
+}
+
+static uint64_t readUnsigned(DwarfReader *reader, uintptr_t byteCount)
+{
+    if (!canRead(reader, byteCount)) {
+        return 0;
+    }
+    uint64_t value = 0;
+    switch (byteCount) {
+        case 1:
+            value = *reader->position;
+            break;
+        case 2: {
+            uint16_t value16;
+            memcpy(&value16, reader->position, sizeof(value16));
+            value = value16;
+            break;
+        }
+        case 4: {
+            uint32_t value32;
+            memcpy(&value32, reader->position, sizeof(value32));
+            value = value32;
+            break;
+        }
+        default:
+            memcpy(&value, reader->position, sizeof(value));
+            break;
+    }
+    reader->position += byteCount;
+    return value;
+}
+
+static uint64_t readULEB128(DwarfReader *reader)
+{
+    uint64_t value = 0;
+    unsigned shift = 0;
+    while (canRead(reader, 1)) {
+        uint8_t byte = *reader->position++;
+        if (shift < 64) {
+            value |= (uint64_t)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    return value;
+}
+
+static int64_t readSLEB128(DwarfReader *reader)
+{
+    uint64_t value = 0;
+    unsigned shift = 0;
+    uint8_t byte = 0;
+    while (canRead(reader, 1)) {
+        byte = *reader->position++;
+        if (shift < 64) {
+            value |= (uint64_t)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    if (shift < 64 && (byte & 0x40) != 0) {
+        value |= ~(uint64_t)0 << shift;
+    }
+    return (int64_t)value;
+}
+
+/** Read a pointer in one of the DW_EH_PE_* encodings.
+ *
+ * @param dataBase The base for DW_EH_PE_datarel pointers (0 = not allowed).
+ */
+static uintptr_t readEncodedPointer(DwarfReader *reader, uint8_t encoding, uintptr_t dataBase)
+{
+    if (encoding == DW_EH_PE_omit) {
+        return 0;
+    }
+    uintptr_t fieldAddress = (uintptr_t)reader->position;
+    uintptr_t value = 0;
+    switch (encoding & 0x0f) {
+        case DW_EH_PE_absptr:
+            value = (uintptr_t)readUnsigned(reader, sizeof(uintptr_t));
+            break;
+        case DW_EH_PE_uleb128:
+            value = (uintptr_t)readULEB128(reader);
+            break;
+        case DW_EH_PE_udata2:
+            value = (uintptr_t)readUnsigned(reader, 2);
+            break;
+        case DW_EH_PE_udata4:
+            value = (uintptr_t)readUnsigned(reader, 4);
+            break;
+        case DW_EH_PE_udata8:
+            value = (uintptr_t)readUnsigned(reader, 8);
+            break;
+        case DW_EH_PE_sleb128:
+            value = (uintptr_t)readSLEB128(reader);
+            break;
+        case DW_EH_PE_sdata2:
+            value = (uintptr_t)(int16_t)readUnsigned(reader, 2);
+            break;
+        case DW_EH_PE_sdata4:
+            value = (uintptr_t)(int32_t)readUnsigned(reader, 4);
+            break;
+        case DW_EH_PE_sdata8:
+            value = (uintptr_t)(int64_t)readUnsigned(reader, 8);
+            break;
+        default:
+            reader->isValid = false;
+            return 0;
+    }
+    switch (encoding & 0x70) {
+        case 0:
+            break;
+        case DW_EH_PE_pcrel:
+            value += fieldAddress;
+            break;
+        case DW_EH_PE_datarel:
+            if (dataBase == 0) {
+                reader->isValid = false;
+                return 0;
+            }
+            value += dataBase;
+            break;
+        default:
+            reader->isValid = false;
+            return 0;
+    }
+    // Indirect pointers are only used for personality routines, which aren't needed for unwinding.
+    return value;
+}
+
+/** Read the length of a CIE or FDE and set `entryEnd` to the end of it.
+ *
+ * @return false at the end of the section or on a bad entry.
+ */
+static bool readEntryLength(DwarfReader *reader, const uint8_t **entryEnd)
+{
+    uint64_t length = readUnsigned(reader, 4);
+    if (length == 0xffffffff) {
+        length = readUnsigned(reader, 8);
+    }
+    if (!reader->isValid || length == 0 || length > (uint64_t)(reader->end - reader->position)) {
+        return false;
+    }
+    *entryEnd = reader->position + length;
+    return true;
+}
+
+static bool parseCommonInfo(const uint8_t *cie, const uint8_t *sectionEnd, CommonInfo *info)
+{
+    DwarfReader reader = { .position = cie, .end = sectionEnd, .isValid = true };
+    const uint8_t *cieEnd;
+    if (!readEntryLength(&reader, &cieEnd)) {
+        return false;
+    }
+    reader.end = cieEnd;
+    if (readUnsigned(&reader, 4) != 0) {
+        return false;
+    }
+    uint8_t version = (uint8_t)readUnsigned(&reader, 1);
+    const char *augmentation = (const char *)reader.position;
+    size_t augmentationLength = strnlen(augmentation, (size_t)(reader.end - reader.position));
+    if (!canRead(&reader, augmentationLength + 1)) {
+        return false;
+    }
+    reader.position += augmentationLength + 1;
+    if (strstr(augmentation, "eh") != NULL) {
+        readUnsigned(&reader, sizeof(uintptr_t));
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->pointerEncoding = DW_EH_PE_absptr;
+    info->codeAlignment = readULEB128(&reader);
+    info->dataAlignment = readSLEB128(&reader);
+    info->returnAddressRegister = version == 1 ? readUnsigned(&reader, 1) : readULEB128(&reader);
+
+    if (augmentation[0] == 'z') {
+        info->hasAugmentationData = true;
+        uint64_t augmentationDataLength = readULEB128(&reader);
+        if (!canRead(&reader, augmentationDataLength)) {
+            return false;
+        }
+        const uint8_t *augmentationDataEnd = reader.position + augmentationDataLength;
+        for (const char *ch = augmentation + 1; *ch != '\0' && reader.isValid; ch++) {
+            switch (*ch) {
+                case 'L':
+                    readUnsigned(&reader, 1);
+                    break;
+                case 'R':
+                    info->pointerEncoding = (uint8_t)readUnsigned(&reader, 1);
+                    break;
+                case 'P': {
+                    uint8_t personalityEncoding = (uint8_t)readUnsigned(&reader, 1);
+                    readEncodedPointer(&reader, personalityEncoding & 0x7f, 0);
+                    break;
+                }
+                default:
+                    // 'S', 'B' and friends carry no data. Skip anything else we don't know.
+                    break;
+            }
+        }
+        reader.position = augmentationDataEnd;
+    }
+    info->instructions = reader.position;
+    info->instructionsEnd = cieEnd;
+    return reader.isValid;
+}
+
+// ============================================================================
+#pragma mark - CFA Programs -
+// ============================================================================
+
+static void setRegisterRule(CFAState *state, const CommonInfo *cie, uint64_t reg, RegisterRuleKind kind, int64_t offset)
+{
+    RegisterRule rule = { .kind = kind, .offset = offset };
+    if (reg == cie->returnAddressRegister) {
+        state->returnAddress = rule;
+    }
+    if (reg == KSUNWIND_DwarfFP) {
+        state->framePointer = rule;
+    }
+}
+
+static void restoreRegisterRule(CFAState *state, const CFAState *initialState, const CommonInfo *cie, uint64_t reg)
+{
+    if (reg == cie->returnAddressRegister) {
+        state->returnAddress = initialState->returnAddress;
+    }
+    if (reg == KSUNWIND_DwarfFP) {
+        state->framePointer = initialState->framePointer;
+    }
+}
+
+static void addRow(RowBuilder *builder, uintptr_t location, const UnwindRow *row)
+{
+    if (location < builder->textStart || location - builder->textStart > UINT32_MAX) {
+        return;
+    }
+    uint32_t offset = (uint32_t)(location - builder->textStart);
+    if (builder->count > 0 && builder->rows[builder->count - 1].offset == offset) {
+        builder->rows[builder->count - 1] = *row;
+        builder->rows[builder->count - 1].offset = offset;
+        return;
+    }
+    if (builder->count == builder->capacity) {
+        uint32_t newCapacity = builder->capacity == 0 ? 256 : builder->capacity * 2;
+        UnwindRow *newRows = realloc(builder->rows, sizeof(*newRows) * newCapacity);
+        if (newRows == NULL) {
+            return;
+        }
+        builder->rows = newRows;
+        builder->capacity = newCapacity;
+    }
+    builder->rows[builder->count] = *row;
+    builder->rows[builder->count].offset = offset;
+    builder->count++;
+}
+
+static bool slotForRule(const RegisterRule *rule, int8_t *slot)
+{
+    if (rule->kind == RegisterRuleSame) {
+        *slot = 0;
+        return true;
+    }
+    if (rule->kind != RegisterRuleOffset || rule->offset % (int64_t)sizeof(uintptr_t) != 0) {
+        return false;
+    }
+    int64_t words = rule->offset / (int64_t)sizeof(uintptr_t);
+    if (words == 0 || words < INT8_MIN || words > INT8_MAX) {
+        return false;
+    }
+    *slot = (int8_t)words;
+    return true;
+}
+
+static void addStateRow(RowBuilder *builder, uintptr_t location, const CFAState *state)
+{
+    UnwindRow row = { 0 };
+    if (!state->isCFAUnsupported && state->cfaOffset >= INT32_MIN && state->cfaOffset <= INT32_MAX &&
+        (state->cfaRegister == KSUNWIND_DwarfSP || state->cfaRegister == KSUNWIND_DwarfFP) &&
+        slotForRule(&state->returnAddress, &row.returnAddressSlot) &&
+        slotForRule(&state->framePointer, &row.framePointerSlot)) {
+        row.cfaRegister = state->cfaRegister == KSUNWIND_DwarfSP ? KSUnwindRegister_StackPointer
+                                                                 : KSUnwindRegister_FramePointer;
+        row.cfaOffset = (int32_t)state->cfaOffset;
+    }
+#ifndef KSUNWIND_DwarfLR
+    // Without a link register, the return address has to be on the stack.
+    if (row.returnAddressSlot == 0) {
+        row.cfaRegister = 0;
+    }
+#endif
+    if (row.cfaRegister == 0) {
+        row = (UnwindRow) { 0 };
+    }
+    addRow(builder, location, &row);
+}
+
+/** Run a CFA program, adding a row whenever the location advances.
+ *
+ * @param builder Where to add rows, or NULL to only update the state (for CIE programs).
+ */
+static void runCFAProgram(const uint8_t *instructions, const uint8_t *instructionsEnd, const CommonInfo *cie,
+                          CFAState *state, const CFAState *initialState, uintptr_t *location, RowBuilder *builder)
+{
+    DwarfReader reader = { .position = instructions, .end = instructionsEnd, .isValid = true };
+    CFAState rememberedStates[KSUNWIND_MaxRememberedStates];
+    int rememberedCount = 0;
+
+    while (reader.isValid && reader.position < reader.end) {
+        uint8_t opcode = (uint8_t)readUnsigned(&reader, 1);
+        uint8_t operand = opcode & 0x3f;
+        uintptr_t advance = 0;
+
+        switch (opcode & 0xc0) {
+            case DW_CFA_advance_loc:
+                advance = operand * cie->codeAlignment;
+                break;
+            case DW_CFA_offset:
+                setRegisterRule(state, cie, operand, RegisterRuleOffset,
+                                (int64_t)readULEB128(&reader) * cie->dataAlignment);
+                continue;
+            case DW_CFA_restore:
+                restoreRegisterRule(state, initialState, cie, operand);
+                continue;
+            default:
+                break;
+        }
+
+        if (advance == 0) {
+            switch (opcode) {
+                case DW_CFA_nop:
+                case DW_CFA_AARCH64_negate_ra_state:
+                    break;
+                case DW_CFA_set_loc: {
+                    uintptr_t newLocation = readEncodedPointer(&reader, cie->pointerEncoding, 0);
+                    if (builder != NULL && newLocation > *location) {
+                        addStateRow(builder, *location, state);
+                    }
+                    *location = newLocation;
+                    break;
+                }
+                case DW_CFA_advance_loc1:
+                    advance = readUnsigned(&reader, 1) * cie->codeAlignment;
+                    break;
+                case DW_CFA_advance_loc2:
+                    advance = readUnsigned(&reader, 2) * cie->codeAlignment;
+                    break;
+                case DW_CFA_advance_loc4:
+                    advance = readUnsigned(&reader, 4) * cie->codeAlignment;
+                    break;
+                case DW_CFA_offset_extended: {
+                    uint64_t reg = readULEB128(&reader);
+                    setRegisterRule(state, cie, reg, RegisterRuleOffset,
+                                    (int64_t)readULEB128(&reader) * cie->dataAlignment);
+                    break;
+                }
+                case DW_CFA_offset_extended_sf: {
+                    uint64_t reg = readULEB128(&reader);
+                    setRegisterRule(state, cie, reg, RegisterRuleOffset, readSLEB128(&reader) * cie->dataAlignment);
+                    break;
+                }
+                case DW_CFA_GNU_negative_offset_extended: {
+                    uint64_t reg = readULEB128(&reader);
+                    setRegisterRule(state, cie, reg, RegisterRuleOffset,
+                                    -(int64_t)readULEB128(&reader) * cie->dataAlignment);
+                    break;
+                }
+                case DW_CFA_restore_extended:
+                    restoreRegisterRule(state, initialState, cie, readULEB128(&reader));
+                    break;
+                case DW_CFA_same_value:
+                    setRegisterRule(state, cie, readULEB128(&reader), RegisterRuleSame, 0);
+                    break;
+                case DW_CFA_undefined:
+                    setRegisterRule(state, cie, readULEB128(&reader), RegisterRuleUnsupported, 0);
+                    break;
+                case DW_CFA_register: {
+                    uint64_t reg = readULEB128(&reader);
+                    readULEB128(&reader);
+                    setRegisterRule(state, cie, reg, RegisterRuleUnsupported, 0);
+                    break;
+                }
+                case DW_CFA_val_offset:
+                case DW_CFA_val_offset_sf: {
+                    uint64_t reg = readULEB128(&reader);
+                    readULEB128(&reader);
+                    setRegisterRule(state, cie, reg, RegisterRuleUnsupported, 0);
+                    break;
+                }
+                case DW_CFA_expression:
+                case DW_CFA_val_expression: {
+                    uint64_t reg = readULEB128(&reader);
+                    uint64_t length = readULEB128(&reader);
+                    if (canRead(&reader, length)) {
+                        reader.position += length;
+                    }
+                    setRegisterRule(state, cie, reg, RegisterRuleUnsupported, 0);
+                    break;
+                }
+                case DW_CFA_remember_state:
+                    if (rememberedCount < KSUNWIND_MaxRememberedStates) {
+                        rememberedStates[rememberedCount] = *state;
+                    }
+                    rememberedCount++;
+                    break;
+                case DW_CFA_restore_state:
+                    if (rememberedCount > 0) {
+                        rememberedCount--;
+                        if (rememberedCount < KSUNWIND_MaxRememberedStates) {
+                            *state = rememberedStates[rememberedCount];
+                        } else {
+                            state->isCFAUnsupported = true;
+                        }
+                    }
+                    break;
+                case DW_CFA_def_cfa:
+                    state->cfaRegister = readULEB128(&reader);
+                    state->cfaOffset = (int64_t)readULEB128(&reader);
+                    state->isCFAUnsupported = false;
+                    break;
+                case DW_CFA_def_cfa_sf:
+                    state->cfaRegister = readULEB128(&reader);
+                    state->cfaOffset = readSLEB128(&reader) * cie->dataAlignment;
+                    state->isCFAUnsupported = false;
+                    break;
+                case DW_CFA_def_cfa_register:
+                    state->cfaRegister = readULEB128(&reader);
+                    break;
+                case DW_CFA_def_cfa_offset:
+                    state->cfaOffset = (int64_t)readULEB128(&reader);
+                    break;
+                case DW_CFA_def_cfa_offset_sf:
+                    state->cfaOffset = readSLEB128(&reader) * cie->dataAlignment;
+                    break;
+                case DW_CFA_def_cfa_expression: {
+                    uint64_t length = readULEB128(&reader);
+                    if (canRead(&reader, length)) {
+                        reader.position += length;
+                    }
+                    state->isCFAUnsupported = true;
+                    break;
+                }
+                case DW_CFA_GNU_args_size:
+                    readULEB128(&reader);
+                    break;
+                default:
+                    // Unknown instruction, so we can't know how long it is.
+                    state->isCFAUnsupported = true;
+                    return;
+            }
+        }
+
+        if (advance != 0) {
+            if (builder != NULL) {
+                addStateRow(builder, *location, state);
+            }
+            *location += advance;
+        }
+    }
+}
+
+/** Parse an .eh_frame section into rows. CIEs are parsed again for each FDE
+ * unless the FDE uses the same CIE as the one before it, which is the usual case.
+ */
+static void parseEHFrame(const uint8_t *ehFrame, uintptr_t ehFrameSize, RowBuilder *builder, uintptr_t textEnd)
+{
+    const uint8_t *sectionEnd = ehFrame + ehFrameSize;
+    DwarfReader reader = { .position = ehFrame, .end = sectionEnd, .isValid = true };
+    const uint8_t *lastCIE = NULL;
+    CommonInfo cie;
+    CFAState initialState;
+
+    while (reader.position < sectionEnd) {
+        const uint8_t *entryEnd;
+        if (!readEntryLength(&reader, &entryEnd)) {
+            break;
+        }
+        const uint8_t *idField = reader.position;
+        uint32_t cieDistance = (uint32_t)readUnsigned(&reader, 4);
+        if (cieDistance == 0) {
+            // A CIE. It's parsed when an FDE refers to it.
+            reader.position = entryEnd;
+            continue;
+        }
+
+        const uint8_t *ciePosition = idField - cieDistance;
+        if (ciePosition < ehFrame || ciePosition >= sectionEnd) {
+            reader.position = entryEnd;
+            continue;
+        }
+        if (ciePosition != lastCIE) {
+            lastCIE = NULL;
+            if (!parseCommonInfo(ciePosition, sectionEnd, &cie)) {
+                reader.position = entryEnd;
+                continue;
+            }
+            memset(&initialState, 0, sizeof(initialState));
+            uintptr_t unusedLocation = 0;
+            runCFAProgram(cie.instructions, cie.instructionsEnd, &cie, &initialState, &initialState, &unusedLocation,
+                          NULL);
+            lastCIE = ciePosition;
+        }
+
+        DwarfReader fdeReader = { .position = reader.position, .end = entryEnd, .isValid = true };
+        uintptr_t pcStart = readEncodedPointer(&fdeReader, cie.pointerEncoding, 0);
+        uintptr_t pcRange = readEncodedPointer(&fdeReader, cie.pointerEncoding & 0x0f, 0);
+        if (cie.hasAugmentationData) {
+            uint64_t augmentationLength = readULEB128(&fdeReader);
+            if (canRead(&fdeReader, augmentationLength)) {
+                fdeReader.position += augmentationLength;
+            }
+        }
+        if (fdeReader.isValid && pcRange > 0 && pcStart >= builder->textStart && pcStart < textEnd) {
+            CFAState state = initialState;
+            uintptr_t location = pcStart;
+            runCFAProgram(fdeReader.position, entryEnd, &cie, &state, &initialState, &location, builder);
+            if (location < pcStart + pcRange) {
+                addStateRow(builder, location, &state);
+            }
+            UnwindRow endRow = { 0 };
+            addRow(builder, pcStart + pcRange, &endRow);
+        }
+        reader.position = entryEnd;
+    }
+}
+
+static int compareRows(const void *a, const void *b)
+{
+    const UnwindRow *rowA = a;
+    const UnwindRow *rowB = b;
+    if (rowA->offset != rowB->offset) {
+        return rowA->offset < rowB->offset ? -1 : 1;
+    }
+    // Where a function starts right where another ends, the start wins.
+    return (int)(rowA->cfaRegister != 0) - (int)(rowB->cfaRegister != 0);
+}
+
+static bool isSameRule(const UnwindRow *a, const UnwindRow *b)
+{
+    return a->cfaRegister == b->cfaRegister && a->cfaOffset == b->cfaOffset &&
+           a->returnAddressSlot == b->returnAddressSlot && a->framePointerSlot == b->framePointerSlot;
+}
+
+/** Sort the rows, then drop rows that are overridden at the same offset or that repeat the rule before them. */
+static void finishRows(RowBuilder *builder)
+{
+    if (builder->count == 0) {
+        return;
+    }
+    qsort(builder->rows, builder->count, sizeof(*builder->rows), compareRows);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < builder->count; i++) {
+        const UnwindRow *row = &builder->rows[i];
+        if (i + 1 < builder->count && builder->rows[i + 1].offset == row->offset) {
+            continue;
+        }
+        if (kept > 0 && isSameRule(&builder->rows[kept - 1], row)) {
+            continue;
+        }
+        builder->rows[kept++] = *row;
+    }
+    builder->count = kept;
+    UnwindRow *rows = realloc(builder->rows, sizeof(*rows) * kept);
+    if (rows != NULL) {
+        builder->rows = rows;
+    }
+}
+
+// ============================================================================
+#pragma mark - Lookup -
+// ============================================================================
+
+static void ruleFromRow(const UnwindRow *row, KSUnwindRule *rule)
+{
+    rule->cfaRegister = (KSUnwindRegister)row->cfaRegister;
+    rule->cfaOffset = row->cfaOffset;
+    rule->returnAddressOffset = row->returnAddressSlot * (int32_t)sizeof(uintptr_t);
+    rule->framePointerOffset = row->framePointerSlot * (int32_t)sizeof(uintptr_t);
+}
+
+static bool findTableRule(const UnwindImage *image, uintptr_t address, KSUnwindRule *rule)
+{
+    if (image->rowCount == 0) {
+        return false;
+    }
+    uint32_t offset = (uint32_t)(address - image->textStart);
+    uint32_t low = 0;
+    uint32_t high = image->rowCount;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (image->rows[mid].offset <= offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0 || image->rows[low - 1].cfaRegister == 0) {
+        return false;
+    }
+    ruleFromRow(&image->rows[low - 1], rule);
+    return true;
+}
+
+#if KSCRASH_HOST_APPLE && KSUNWIND_IsSupported
+
+/** Turn a compact unwind encoding into a rule. DWARF encodings (and anything
+ * that needs the function's instructions to decode) are left to the table.
+ */
+static bool ruleFromCompactEncoding(compact_unwind_encoding_t encoding, KSUnwindRule *rule)
+{
+#if defined(__arm64__)
+    switch (encoding & UNWIND_ARM64_MODE_MASK) {
+        case UNWIND_ARM64_MODE_FRAME:
+            *rule = (KSUnwindRule) { .cfaRegister = KSUnwindRegister_FramePointer,
+                                     .cfaOffset = 16,
+                                     .returnAddressOffset = -8,
+                                     .framePointerOffset = -16 };
+            return true;
+        case UNWIND_ARM64_MODE_FRAMELESS:
+            *rule = (KSUnwindRule) {
+                .cfaRegister = KSUnwindRegister_StackPointer,
+                .cfaOffset = (int32_t)(16 * ((encoding & UNWIND_ARM64_FRAMELESS_STACK_SIZE_MASK) >> 12)),
+            };
+            return true;
+        default:
+            return false;
+    }
+#else
+    switch (encoding & UNWIND_X86_64_MODE_MASK) {
+        case UNWIND_X86_64_MODE_RBP_FRAME:
+            *rule = (KSUnwindRule) { .cfaRegister = KSUnwindRegister_FramePointer,
+                                     .cfaOffset = 16,
+                                     .returnAddressOffset = -8,
+                                     .framePointerOffset = -16 };
+            return true;
+        case UNWIND_X86_64_MODE_STACK_IMMD:
+            // Registers saved by a frameless function aren't needed, since RBP isn't used as a frame pointer there.
+            *rule = (KSUnwindRule) {
+                .cfaRegister = KSUnwindRegister_StackPointer,
+                .cfaOffset = (int32_t)(8 * ((encoding & UNWIND_X86_64_FRAMELESS_STACK_SIZE) >> 16)),
+                .returnAddressOffset = -8,
+            };
+            return true;
+        default:
+            return false;
+    }
+#endif
+}
+
+/** Look up an address in an image's __unwind_info section. */
+static bool findCompactRule(const UnwindImage *image, uintptr_t address, KSUnwindRule *rule)
+{
+    const uint8_t *info = image->unwindInfo;
+    const uintptr_t infoSize = image->unwindInfoSize;
+    const struct unwind_info_section_header *header = (const struct unwind_info_section_header *)info;
+    if (infoSize < sizeof(*header) || header->version != UNWIND_SECTION_VERSION || header->indexCount < 2 ||
+        header->indexSectionOffset + header->indexCount * sizeof(struct unwind_info_section_header_index_entry) >
+            infoSize) {
+        return false;
+    }
+    uint32_t functionOffset = (uint32_t)(address - image->imageBase);
+
+    // The last index entry marks the end of the covered range.
+    const struct unwind_info_section_header_index_entry *index =
+        (const struct unwind_info_section_header_index_entry *)(info + header->indexSectionOffset);
+    uint32_t indexCount = header->indexCount - 1;
+    if (functionOffset < index[0].functionOffset || functionOffset >= index[indexCount].functionOffset) {
+        return false;
+    }
+    uint32_t low = 0;
+    uint32_t high = indexCount;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (index[mid].functionOffset <= functionOffset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    const struct unwind_info_section_header_index_entry *indexEntry = &index[low - 1];
+    uint32_t pageOffset = indexEntry->secondLevelPagesSectionOffset;
+    if (pageOffset == 0 || pageOffset + sizeof(uint32_t) > infoSize) {
+        return false;
+    }
+
+    const uint8_t *page = info + pageOffset;
+    compact_unwind_encoding_t encoding = 0;
+    if (*(const uint32_t *)page == UNWIND_SECOND_LEVEL_REGULAR) {
+        const struct unwind_info_regular_second_level_page_header *pageHeader =
+            (const struct unwind_info_regular_second_level_page_header *)page;
+        const struct unwind_info_regular_second_level_entry *entries =
+            (const struct unwind_info_regular_second_level_entry *)(page + pageHeader->entryPageOffset);
+        if (pageHeader->entryCount == 0 ||
+            pageOffset + pageHeader->entryPageOffset + pageHeader->entryCount * sizeof(*entries) > infoSize) {
+            return false;
+        }
+        low = 0;
+        high = pageHeader->entryCount;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            if (entries[mid].functionOffset <= functionOffset) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == 0) {
+            return false;
+        }
+        encoding = entries[low - 1].encoding;
+    } else if (*(const uint32_t *)page == UNWIND_SECOND_LEVEL_COMPRESSED) {
+        const struct unwind_info_compressed_second_level_page_header *pageHeader =
+            (const struct unwind_info_compressed_second_level_page_header *)page;
+        const uint32_t *entries = (const uint32_t *)(page + pageHeader->entryPageOffset);
+        if (pageHeader->entryCount == 0 ||
+            pageOffset + pageHeader->entryPageOffset + pageHeader->entryCount * sizeof(*entries) > infoSize) {
+            return false;
+        }
+        uint32_t pageFunctionOffset = functionOffset - indexEntry->functionOffset;
+        low = 0;
+        high = pageHeader->entryCount;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            if (UNWIND_INFO_COMPRESSED_ENTRY_FUNC_OFFSET(entries[mid]) <= pageFunctionOffset) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == 0) {
+            return false;
+        }
+        uint32_t encodingIndex = UNWIND_INFO_COMPRESSED_ENTRY_ENCODING_INDEX(entries[low - 1]);
+        if (encodingIndex < header->commonEncodingsArrayCount) {
+            const compact_unwind_encoding_t *commonEncodings =
+                (const compact_unwind_encoding_t *)(info + header->commonEncodingsArraySectionOffset);
+            if (header->commonEncodingsArraySectionOffset + (encodingIndex + 1) * sizeof(*commonEncodings) >
+                infoSize) {
+                return false;
+            }
+            encoding = commonEncodings[encodingIndex];
+        } else {
+            encodingIndex -= header->commonEncodingsArrayCount;
+            const compact_unwind_encoding_t *pageEncodings =
+                (const compact_unwind_encoding_t *)(page + pageHeader->encodingsPageOffset);
+            if (encodingIndex >= pageHeader->encodingsCount ||
+                pageOffset + pageHeader->encodingsPageOffset + (encodingIndex + 1) * sizeof(*pageEncodings) >
+                    infoSize) {
+                return false;
+            }
+            encoding = pageEncodings[encodingIndex];
+        }
+    } else {
+        return false;
+    }
+    return ruleFromCompactEncoding(encoding, rule);
+}
+
+#endif
+
+// ============================================================================
+#pragma mark - Image Slots -
+// ============================================================================
+
+/** Start changing a slot. Call with g_addImageMutex held. */
+static void beginWritingImage(UnwindImage *image)
+{
+    atomic_fetch_add_explicit(&image->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/** Publish a changed slot. Call with g_addImageMutex held. */
+static void endWritingImage(UnwindImage *image) { atomic_fetch_add_explicit(&image->sequence, 1, memory_order_release); }
+
+/** Copy a slot, without locking. Async-safe.
+ *
+ * @return false if the slot is retired, or was changed while it was being copied.
+ */
+static bool copyImage(const UnwindImage *image, UnwindImage *copy)
+{
+    uint32_t sequence = atomic_load_explicit(&image->sequence, memory_order_acquire);
+    if ((sequence & 1) != 0) {
+        return false;
+    }
+    copy->textStart = image->textStart;
+    copy->textEnd = image->textEnd;
+    copy->imageBase = image->imageBase;
+    copy->unwindInfo = image->unwindInfo;
+    copy->unwindInfoSize = image->unwindInfoSize;
+    copy->rows = image->rows;
+    copy->rowCount = image->rowCount;
+    copy->isRetired = image->isRetired;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&image->sequence, memory_order_relaxed) == sequence && !copy->isRetired;
+}
+
+/** Count a lookup in the current epoch. Async-safe.
+ *
+ * @return The counter to pass to endLookup().
+ */
+static _Atomic(int) *beginLookup(void)
+{
+    for (;;) {
+        uint32_t epoch = atomic_load(&g_lookupEpoch);
+        _Atomic(int) *count = &g_lookupCounts[epoch & 1];
+        atomic_fetch_add(count, 1);
+        // If an image was removed in between, this lookup might not have been waited for.
+        if (atomic_load(&g_lookupEpoch) == epoch) {
+            return count;
+        }
+        atomic_fetch_sub(count, 1);
+    }
+}
+
+static void endLookup(_Atomic(int) *count) { atomic_fetch_sub(count, 1); }
+
+/** Wait until every lookup that could have seen a slot before it was retired has finished.
+ * Call with g_removeImageMutex held.
+ *
+ * @return false if a lookup is still going, and the image's memory must be left alone.
+ */
+static bool waitForLookups(void)
+{
+    uint32_t epoch = atomic_fetch_add(&g_lookupEpoch, 1);
+    _Atomic(int) *count = &g_lookupCounts[epoch & 1];
+    for (int i = 0; atomic_load(count) > 0; i++) {
+        if (i >= KSUNWIND_MaxGraceYields) {
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+// ============================================================================
+#pragma mark - Image Discovery -
+// ============================================================================
+
+#if KSCRASH_HOST_APPLE
+
+static void addMachOImage(const struct mach_header *header, intptr_t slide)
+{
+    const segment_command_t *textSegment = ksmacho_getSegmentByNameFromHeader((const mach_header_t *)header, SEG_TEXT);
+    if (textSegment == NULL) {
+        return;
+    }
+    unsigned long ehFrameSize = 0;
+    unsigned long unwindInfoSize = 0;
+    const uint8_t *ehFrame = getsectiondata((const mach_header_t *)header, SEG_TEXT, "__eh_frame", &ehFrameSize);
+    const uint8_t *unwindInfo =
+        getsectiondata((const mach_header_t *)header, SEG_TEXT, "__unwind_info", &unwindInfoSize);
+    if (ehFrame == NULL && unwindInfo == NULL) {
+        return;
+    }
+    uintptr_t textStart = (uintptr_t)textSegment->vmaddr + (uintptr_t)slide;
+    ksunwind_addImage(textStart, textStart + (uintptr_t)textSegment->vmsize, (uintptr_t)header, ehFrame,
+                      ehFrameSize, unwindInfo, unwindInfoSize);
+}
+
+/** Called by dyld on the thread that loaded the image. Parsing is left to the builder thread. */
+static void queueMachOImage(const struct mach_header *header, intptr_t slide)
+{
+    PendingImage *pending = malloc(sizeof(*pending));
+    if (pending == NULL) {
+        addMachOImage(header, slide);
+        return;
+    }
+    *pending = (PendingImage) { .header = header, .slide = slide };
+    pthread_mutex_lock(&g_pendingImagesMutex);
+    if (g_pendingImagesTail == NULL) {
+        g_pendingImagesHead = pending;
+    } else {
+        g_pendingImagesTail->next = pending;
+    }
+    g_pendingImagesTail = pending;
+    pthread_cond_broadcast(&g_pendingImagesCondition);
+    pthread_mutex_unlock(&g_pendingImagesMutex);
+}
+
+/** Called by dyld before the image is unmapped. */
+static void removeMachOImage(const struct mach_header *header, __unused intptr_t slide)
+{
+    pthread_mutex_lock(&g_pendingImagesMutex);
+    PendingImage *previous = NULL;
+    for (PendingImage *pending = g_pendingImagesHead; pending != NULL;) {
+        PendingImage *next = pending->next;
+        if (pending->header == header) {
+            if (previous == NULL) {
+                g_pendingImagesHead = next;
+            } else {
+                previous->next = next;
+            }
+            if (g_pendingImagesTail == pending) {
+                g_pendingImagesTail = previous;
+            }
+            free(pending);
+        } else {
+            previous = pending;
+        }
+        pending = next;
+    }
+    // Don't let the image go away while its unwind info is being read.
+    while (g_buildingImage == header) {
+        pthread_cond_wait(&g_pendingImagesCondition, &g_pendingImagesMutex);
+    }
+    pthread_mutex_unlock(&g_pendingImagesMutex);
+    ksunwind_removeImage((uintptr_t)header);
+}
+
+#elif KSCRASH_HOST_LINUX
+
+static int addELFImage(struct dl_phdr_info *info, __unused size_t size, __unused void *data)
+{
+    uintptr_t base = (uintptr_t)info->dlpi_addr;
+    uintptr_t textStart = UINTPTR_MAX;
+    uintptr_t textEnd = 0;
+    const uint8_t *ehFrameHeader = NULL;
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X) != 0) {
+            uintptr_t start = base + phdr->p_vaddr;
+            textStart = start < textStart ? start : textStart;
+            textEnd = start + phdr->p_memsz > textEnd ? start + phdr->p_memsz : textEnd;
+        } else if (phdr->p_type == PT_GNU_EH_FRAME) {
+            ehFrameHeader = (const uint8_t *)(base + phdr->p_vaddr);
+        }
+    }
+    if (ehFrameHeader == NULL || textEnd == 0) {
+        return 0;
+    }
+
+    // .eh_frame_hdr points at .eh_frame, which runs to a zero terminator inside the same load segment.
+    DwarfReader reader = {
+        .position = ehFrameHeader,
+        .end = ehFrameHeader + 4 + sizeof(uintptr_t) * 2,
+        .isValid = true,
+    };
+    if (readUnsigned(&reader, 1) != 1) {
+        return 0;
+    }
+    uint8_t ehFramePointerEncoding = (uint8_t)readUnsigned(&reader, 1);
+    reader.position += 2;
+    const uint8_t *ehFrame =
+        (const uint8_t *)readEncodedPointer(&reader, ehFramePointerEncoding, (uintptr_t)ehFrameHeader);
+    if (!reader.isValid || ehFrame == NULL) {
+        return 0;
+    }
+    uintptr_t ehFrameEnd = 0;
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        uintptr_t start = base + phdr->p_vaddr;
+        if (phdr->p_type == PT_LOAD && (uintptr_t)ehFrame >= start && (uintptr_t)ehFrame < start + phdr->p_memsz) {
+            ehFrameEnd = start + phdr->p_memsz;
+        }
+    }
+    if (ehFrameEnd == 0) {
+        return 0;
+    }
+    ksunwind_addImage(textStart, textEnd, base, ehFrame, ehFrameEnd - (uintptr_t)ehFrame, NULL, 0);
+    return 0;
+}
+
+#endif
+
+static void *buildTablesThread(__unused void *userData)
+{
+#if KSCRASH_HOST_APPLE
+    // Called now for every image that is already loaded, and later for each new one.
+    _dyld_register_func_for_add_image(queueMachOImage);
+    _dyld_register_func_for_remove_image(removeMachOImage);
+    pthread_mutex_lock(&g_pendingImagesMutex);
+    for (;;) {
+        while (g_pendingImagesHead == NULL) {
+            KSLOG_DEBUG("Built unwind tables for %d images", atomic_load(&g_imageCount));
+            pthread_cond_wait(&g_pendingImagesCondition, &g_pendingImagesMutex);
+        }
+        PendingImage *pending = g_pendingImagesHead;
+        g_pendingImagesHead = pending->next;
+        if (g_pendingImagesHead == NULL) {
+            g_pendingImagesTail = NULL;
+        }
+        g_buildingImage = pending->header;
+        pthread_mutex_unlock(&g_pendingImagesMutex);
+
+        addMachOImage(pending->header, pending->slide);
+        free(pending);
+
+        pthread_mutex_lock(&g_pendingImagesMutex);
+        g_buildingImage = NULL;
+        pthread_cond_broadcast(&g_pendingImagesCondition);
+    }
+#elif KSCRASH_HOST_LINUX
+    dl_iterate_phdr(addELFImage, NULL);
+    KSLOG_DEBUG("Built unwind tables for %d images", atomic_load(&g_imageCount));
+#endif
+    return NULL;
+}
+
+// ============================================================================
+#pragma mark - API -
+// ============================================================================
+
+void ksunwind_initialize(void)
+{
+#if KSUNWIND_IsSupported
+    static bool isInitialized = false;
+    pthread_mutex_lock(&g_addImageMutex);
+    bool shouldStart = !isInitialized;
+    isInitialized = true;
+    pthread_mutex_unlock(&g_addImageMutex);
+    if (!shouldStart) {
+        return;
+    }
+
+    g_isEnabled = true;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int error = pthread_create(&thread, &attr, buildTablesThread, NULL);
+    pthread_attr_destroy(&attr);
+    if (error != 0) {
+        KSLOG_ERROR("pthread_create: %s", strerror(error));
+    }
+#endif
+}
+
+bool ksunwind_isEnabled(void) { return g_isEnabled; }
+
+bool ksunwind_addImage(uintptr_t textStart, uintptr_t textEnd, uintptr_t imageBase, const uint8_t *ehFrame,
+                       uintptr_t ehFrameSize, const uint8_t *unwindInfo, uintptr_t unwindInfoSize)
+{
+#if KSUNWIND_IsSupported
+    if (textEnd <= textStart || textEnd - textStart > UINT32_MAX) {
+        return false;
+    }
+    RowBuilder builder = { .textStart = textStart };
+    if (ehFrame != NULL && ehFrameSize > 0) {
+        parseEHFrame(ehFrame, ehFrameSize, &builder, textEnd);
+        finishRows(&builder);
+    }
+
+    bool isAdded = false;
+    pthread_mutex_lock(&g_addImageMutex);
+    int count = atomic_load(&g_imageCount);
+    int slot = 0;
+    while (slot < count && !g_images[slot].isRetired) {
+        slot++;
+    }
+    if (slot < KSUNWIND_MaxImages) {
+        // Crash time lookups don't lock, so they may be reading a retired slot while it's reused.
+        UnwindImage *image = &g_images[slot];
+        beginWritingImage(image);
+        image->textStart = textStart;
+        image->textEnd = textEnd;
+        image->imageBase = imageBase;
+        image->unwindInfo = unwindInfo;
+        image->unwindInfoSize = unwindInfo != NULL ? unwindInfoSize : 0;
+        image->rows = builder.rows;
+        image->rowCount = builder.count;
+        image->isRetired = false;
+        endWritingImage(image);
+        if (slot == count) {
+            atomic_store_explicit(&g_imageCount, count + 1, memory_order_release);
+        }
+        isAdded = true;
+    }
+    pthread_mutex_unlock(&g_addImageMutex);
+    if (!isAdded) {
+        KSLOG_ERROR("Too many images. Not adding unwind table for image at %p", (void *)imageBase);
+        free(builder.rows);
+    }
+    return isAdded;
+#else
+    (void)textStart;
+    (void)textEnd;
+    (void)imageBase;
+    (void)ehFrame;
+    (void)ehFrameSize;
+    (void)unwindInfo;
+    (void)unwindInfoSize;
+    return false;
+#endif
+}
+
+void ksunwind_removeImage(uintptr_t imageBase)
+{
+#if KSUNWIND_IsSupported
+    pthread_mutex_lock(&g_removeImageMutex);
+    for (;;) {
+        UnwindRow *rows = NULL;
+        bool isFound = false;
+        pthread_mutex_lock(&g_addImageMutex);
+        int count = atomic_load(&g_imageCount);
+        for (int i = 0; i < count && !isFound; i++) {
+            UnwindImage *image = &g_images[i];
+            if (image->imageBase == imageBase && !image->isRetired) {
+                beginWritingImage(image);
+                image->isRetired = true;
+                rows = image->rows;
+                image->rows = NULL;
+                image->rowCount = 0;
+                image->unwindInfo = NULL;
+                image->unwindInfoSize = 0;
+                endWritingImage(image);
+                isFound = true;
+            }
+        }
+        pthread_mutex_unlock(&g_addImageMutex);
+        if (!isFound) {
+            break;
+        }
+        // Lookups that started before the image was retired may still be reading its rows and unwind info.
+        if (waitForLookups()) {
+            free(rows);
+        } else {
+            KSLOG_ERROR("Unwind lookups are still running. Leaking the table of image at %p", (void *)imageBase);
+        }
+    }
+    pthread_mutex_unlock(&g_removeImageMutex);
+#else
+    (void)imageBase;
+#endif
+}
+
+bool ksunwind_findRule(uintptr_t address, KSUnwindRule *rule)
+{
+#if KSUNWIND_IsSupported
+    _Atomic(int) *lookupCount = beginLookup();
+    bool isFound = false;
+    int count = atomic_load_explicit(&g_imageCount, memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        UnwindImage image;
+        if (!copyImage(&g_images[i], &image) || address < image.textStart || address >= image.textEnd) {
+            continue;
+        }
+#if KSCRASH_HOST_APPLE
+        if (image.unwindInfo != NULL && findCompactRule(&image, address, rule)) {
+            isFound = true;
+            break;
+        }
+#endif
+        isFound = findTableRule(&image, address, rule);
+        break;
+    }
+    endLookup(lookupCount);
+    return isFound;
+#else
+    (void)address;
+    (void)rule;
+#endif
+    return false;
+}
@@ -0,0 +1,121 @@
+//
+//  KSArena.h
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+/* Preallocated memory for use while handling a crash.
+ *
+ * The arena is mapped once at install time, between two inaccessible guard
+ * pages. Permanent allocations (such as the signal stack) are taken from the
+ * bottom, and scratch allocations are bump-allocated from the top inside a
+ * scope, which gives them all back when it ends. Nothing here calls malloc
+ * once the arena is installed.
+ */
+
+#ifndef HDR_KSArena_h
+#define HDR_KSArena_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Bookkeeping for a scope of scratch allocations. */
+typedef struct {
+    /** Scratch usage when the scope began. */
+    uint32_t mark;
+
+    /** True if this scope holds the arena lock. */
+    bool isLocked;
+} KSArenaScope;
+
+/** Map the arena. Does nothing if it is already installed.
+ *
+ * @param size The number of usable bytes (rounded up to a whole page).
+ *
+ * @return true if the arena is installed.
+ */
+bool ksarena_install(size_t size);
+
+/** Allocate memory that is never given back. The first permanent allocation
+ * sits directly above the lower guard page.
+ *
+ * @param size The number of bytes to allocate.
+ *
+ * @return The memory, or NULL if the arena is not installed or is full.
+ */
+void *ksarena_allocPermanent(size_t size);
+
+/** Begin a scope of scratch allocations.
+ *
+ * Outside of a crash, scopes on different threads take turns. While handling
+ * a crash the other threads are suspended, so the scope never waits for them;
+ * it simply allocates above whatever they are holding.
+ *
+ * @param scope The scope to begin.
+ *
+ * @param isHandlingCrash True if the other threads are suspended.
+ */
+void ksarena_beginScope(KSArenaScope *scope, bool isHandlingCrash);
+
+/** End a scope, giving back every scratch allocation made since it began.
+ * Scopes must end in the reverse order that they began.
+ *
+ * @param scope The scope to end.
+ */
+void ksarena_endScope(KSArenaScope *scope);
+
+/** Allocate scratch memory, aligned to 16 bytes. Only call this inside a scope.
+ *
+ * @param size The number of bytes to allocate.
+ *
+ * @return The memory, or NULL if the arena is not installed or is full.
+ */
+void *ksarena_alloc(size_t size);
+
+/** Get a mark for ksarena_releaseToMark(), to give back short-lived scratch
+ * allocations without ending the scope they were made in.
+ *
+ * @return The current scratch usage.
+ */
+uint32_t ksarena_getMark(void);
+
+/** Give back every scratch allocation made since the mark was taken.
+ *
+ * @param mark A mark from ksarena_getMark().
+ */
+void ksarena_releaseToMark(uint32_t mark);
+
+/** Get the number of bytes that can still be allocated.
+ *
+ * @return The number of free bytes in the arena.
+ */
+size_t ksarena_bytesAvailable(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HDR_KSArena_h
@@ -249,6 +249,13 @@ typedef struct KSCrash_MonitorContext {
         const char *state;
     } AppMemory;
 
+    struct {
+        /** The most recent window of profiler samples (NULL = none).
+         * Note: Actual type is KSProfileWindow*
+         */
+        const void *window;
+    } Profile;
+
     /** Full path to the console log, if any. */
     const char *consoleLogPath;
 
@@ -99,6 +99,16 @@ uint32_t ksdl_imageNamed(const char *const imageName, bool exactMatch);
  */
 const uint8_t *ksdl_imageUUID(const char *const imageName, bool exactMatch);
 
+/** Get the UUID of a loaded binary image from its mach_header.
+ * Unlike ksdl_imageUUID(), this doesn't search the loaded images. Async-safe.
+ *
+ * @param header_ptr The pointer to mach_header of the image.
+ *
+ * @return A pointer to the binary (16 byte) UUID of the image, or NULL if it
+ *         has none.
+ */
+const uint8_t *ksdl_imageUUIDForHeader(const void *const header_ptr);
+
 /** async-safe version of dladdr.
  *
  * This method searches the dynamic loader for information about any image
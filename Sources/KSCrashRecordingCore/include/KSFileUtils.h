@@ -150,6 +150,7 @@ bool ksfu_makePath(const char *absolutePath);
 bool ksfu_removeFile(const char *path, bool mustExist);
 
 /** Delete the contents of a directory.
+ * Symbolic links inside the directory are deleted, not followed.
  *
  * @param path The path of the directory whose contents to delete.
  *
@@ -187,6 +188,8 @@ bool ksfu_openBufferedWriter(KSBufferedWriter *writer, const char *const path, c
 void ksfu_closeBufferedWriter(KSBufferedWriter *writer);
 
 /** Write to a buffered writer.
+ * Small writes are copied into the write buffer. Larger ones that don't fit are
+ * not copied, and get written together with the buffered data using writev().
  *
  * @param writer The writer to write to.
  *
@@ -276,6 +279,55 @@ bool ksfu_readBufferedReaderUntilChar(KSBufferedReader *reader, int ch, char *ds
  */
 void *ksfu_mmap(const char *path, int size);
 
+/** Find where the tail of some text starts, scanning backwards from the end.
+ *
+ * @param text The text.
+ *
+ * @param length The length of the text.
+ *
+ * @param maxLines The maximum number of lines in the tail, or 0 for no limit.
+ *
+ * @param maxBytes The maximum number of bytes in the tail, or 0 for no limit.
+ *                 The tail starts at a line boundary unless its last line alone is longer than this.
+ *
+ * @return The offset of the first byte of the tail.
+ */
+int ksfu_tailOffset(const char *const text, const int length, const int maxLines, const int maxBytes);
+
+/** Memory maps an existing file for reading.
+ * Unlike `ksfu_mmap`, the file is neither created nor truncated.
+ *
+ * @param path The path to the file.
+ *
+ * @param size Place to store the size of the mapped file.
+ *
+ * @return the mapped pointer if successful, NULL otherwise.
+ * The return value must be unmapped using `munmap` with the returned size
+ * when done with the returned pointer.
+ */
+const char *ksfu_mmapReadOnly(const char *path, int *size);
+
+/** Read several entire files.
+ * Where io_uring is available the system calls are batched, otherwise each
+ * file is read with `ksfu_readEntireFile`.
+ *
+ * @param paths The paths of the files to read.
+ *
+ * @param count The number of files.
+ *
+ * @param data Receives a malloc'd, NUL terminated buffer per file, or NULL if the file could not be read.
+ *
+ * @param lengths Receives the length of each file.
+ *
+ * @return The number of files read.
+ */
+int ksfu_readEntireFiles(const char *const *paths, int count, char **data, int *lengths);
+
+/** Check whether `ksfu_readEntireFiles` batches its system calls.
+ * When it doesn't, callers may be better off spreading the reads over threads.
+ */
+bool ksfu_isBatchIOAvailable(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -239,6 +239,62 @@ bool kslog_setLogFilename(const char *filename, bool overwrite);
 /** Clear the log file. */
 bool kslog_clearLogFile(void);
 
+/** Log to a fixed size ring buffer that is memory mapped from a file, instead of writing to a file.
+ *
+ * Log calls only copy their text into the mapping, so no syscalls are made and
+ * nothing is echoed to stdout. The kernel writes the pages back to the file, so
+ * the last `size` bytes of log survive the process dying.
+ *
+ * @param filename The file to map (NULL = stop using the buffer).
+ *
+ * @param size The size of the ring, rounded up to a whole number of pages.
+ *
+ * @param overwrite If true, discard what the file already holds.
+ */
+bool kslog_setLogBuffer(const char *filename, int size, bool overwrite);
+
+/** Get the text in the active log buffer, oldest line first.
+ *
+ * The text points into the mapping and is not NUL terminated.
+ *
+ * @param length Receives the length of the text.
+ *
+ * @return The text, or NULL if no log buffer is active.
+ */
+const char *kslog_getLogBuffer(int *length);
+
+/** Read the text from a log buffer file, oldest line first.
+ *
+ * @param filename The log buffer file.
+ *
+ * @param length Receives the length of the text.
+ *
+ * @return A NUL terminated copy of the text that the caller must free, or NULL on error.
+ */
+char *kslog_readLogBufferFile(const char *filename, int *length);
+
+/** Enable or disable async logging.
+ *
+ * When enabled, C log calls copy their format and arguments into a lock-free
+ * ring and return; a background thread formats and writes them in batches.
+ * Entries that can't be deferred (e.g. "%ls", or arguments that don't fit)
+ * are written synchronously after everything queued before them.
+ *
+ * Disabling writes out any queued entries before returning.
+ *
+ * @param enabled If true, defer formatting to the background thread.
+ *
+ * @return true if logging is now in the requested mode.
+ */
+bool kslog_setAsyncLogging(bool enabled);
+
+/** Synchronously write any queued async log entries and switch to synchronous logging.
+ *
+ * This doesn't wait on the formatter thread, so it is safe to call while handling
+ * a crash with other threads suspended.
+ */
+void kslog_drainForCrash(void);
+
 /** Tests if the logger would print at the specified level.
  *
  * @param LEVEL The level to test for. One of:
@@ -36,6 +36,35 @@
 extern "C" {
 #endif
 
+/** A region of memory to copy with ksmem_copyManySafely(). */
+typedef struct {
+    /** The source location to copy from. */
+    const void *src;
+
+    /** The location to copy to. */
+    void *dst;
+
+    /** The number of bytes to copy. */
+    int byteCount;
+
+    /** Set to true if the whole region was copied. */
+    bool isCopied;
+} KSMemoryRegion;
+
+/** Take a snapshot of which parts of the address space are readable.
+ *
+ * Until ksmem_clearReadableRegionSnapshot() is called, ksmem_isMemoryReadable()
+ * and ksmem_maxReadableBytes() look addresses up in the snapshot instead of
+ * trying to copy from them. Mappings that change after the snapshot is taken
+ * are not noticed, so only use it while other threads are suspended.
+ *
+ * @return true if the snapshot was taken.
+ */
+bool ksmem_snapshotReadableRegions(void);
+
+/** Go back to testing readability by copying. */
+void ksmem_clearReadableRegionSnapshot(void);
+
 /** Test if the specified memory is safe to read from.
  *
  * @param memory A pointer to the memory to test.
@@ -80,6 +109,18 @@ bool ksmem_copySafely(const void *restrict const src, void *restrict const dst,
  */
 int ksmem_copyMaxPossible(const void *restrict const src, void *restrict const dst, int byteCount);
 
+/** Copy several regions of memory safely. Regions that are not accessible
+ * are skipped rather than crashing. Where the platform allows, many regions
+ * are copied with a single call into the kernel.
+ *
+ * @param regions The regions to copy. Each region's isCopied is set.
+ *
+ * @param count The number of regions.
+ *
+ * @return The number of regions that were copied in full.
+ */
+int ksmem_copyManySafely(KSMemoryRegion *const regions, int count);
+
 #ifdef __cplusplus
 }
 #endif
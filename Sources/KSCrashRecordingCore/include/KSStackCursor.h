@@ -42,6 +42,22 @@ extern "C" {
 /** The max depth to search before giving up. */
 #define KSSC_MAX_STACK_DEPTH 500
 
+/** The size of a stack block. It takes whatever room a cursor context has left
+ * after the cursor's own fields.
+ */
+#define KSSC_STACK_BLOCK_SIZE ((KSSC_CONTEXT_SIZE - 16) * sizeof(void *))
+
+/** A cached block of stack memory, for cursors to keep in their context.
+ * Stack memory is read a block at a time, starting at the lowest address
+ * needed, so that a run of frames close together costs one read instead of
+ * one per frame.
+ */
+typedef struct {
+    uintptr_t address;
+    uintptr_t length;
+    uint8_t bytes[KSSC_STACK_BLOCK_SIZE];
+} KSStackBlock;
+
 typedef struct KSStackCursor {
     struct {
         /** Current address in the stack trace. */
@@ -99,6 +115,26 @@ void kssc_initCursor(KSStackCursor *cursor, void (*resetCursor)(KSStackCursor *)
  */
 void kssc_resetCursor(KSStackCursor *cursor);
 
+/** Empty a stack block, so that the next read refills it.
+ *
+ * @param block The block to empty.
+ */
+void kssc_resetStackBlock(KSStackBlock *block);
+
+/** Read stack memory, going through a cached block. Async-safe.
+ *
+ * @param block The block to read through.
+ *
+ * @param address The address to read from.
+ *
+ * @param destination Where to put the memory.
+ *
+ * @param byteCount The number of bytes to read.
+ *
+ * @return true if the memory was read.
+ */
+bool kssc_readStackMemory(KSStackBlock *block, uintptr_t address, void *destination, int byteCount);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,7 @@
 #define HDR_KSThread_h
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #ifdef __cplusplus
@@ -0,0 +1,134 @@
+//
+//  KSUnwindTable.h
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+/* Unwind rules for loaded images, from DWARF CFI (__eh_frame / .eh_frame) and
+ * Apple compact unwind info (__unwind_info).
+ *
+ * DWARF CFI is interpreted ahead of time into a sorted table of rows per image,
+ * so that looking up a rule at crash time is a binary search. Compact unwind
+ * info is already a sorted table and is searched in place.
+ */
+
+#ifndef HDR_KSUnwindTable_h
+#define HDR_KSUnwindTable_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The register that a canonical frame address (CFA) is computed from. */
+typedef enum {
+    KSUnwindRegister_StackPointer = 1,
+    KSUnwindRegister_FramePointer = 2,
+} KSUnwindRegister;
+
+/** How to recover the caller's registers at an instruction address.
+ * The caller's stack pointer is the CFA.
+ */
+typedef struct {
+    /** The CFA is this register plus cfaOffset. */
+    KSUnwindRegister cfaRegister;
+    int32_t cfaOffset;
+
+    /** The return address is stored at CFA + returnAddressOffset.
+     * 0 means that it is still in the link register.
+     */
+    int32_t returnAddressOffset;
+
+    /** The caller's frame pointer is stored at CFA + framePointerOffset.
+     * 0 means that the frame pointer is unchanged.
+     */
+    int32_t framePointerOffset;
+} KSUnwindRule;
+
+/** Start building unwind tables for all loaded images (and, on Apple platforms,
+ * for images loaded later). The tables are built on a background thread.
+ * On Apple platforms, the tables of unloaded images are removed.
+ * Does nothing on CPUs that the unwinder doesn't support.
+ *
+ * On Linux, only the images loaded when this is called get tables. Libraries
+ * opened later with dlopen() have none, so their frames fall back to the frame
+ * pointer. Libraries closed with dlclose() keep their tables, so a library that
+ * is later mapped at the same address may be unwound with the wrong rules,
+ * unless the caller removes the old table with ksunwind_removeImage().
+ */
+void ksunwind_initialize(void);
+
+/** Check if ksunwind_initialize() has been called on a supported CPU.
+ *
+ * @return true if unwind rules are being looked up.
+ */
+bool ksunwind_isEnabled(void);
+
+/** Build the unwind table for one image. This is called for each image by
+ * ksunwind_initialize(). Async-unsafe.
+ *
+ * @param textStart The start of the image's executable code.
+ *
+ * @param textEnd The end of the image's executable code.
+ *
+ * @param imageBase The address that compact unwind function offsets are relative to.
+ *
+ * @param ehFrame The image's DWARF CFI section (NULL = none).
+ *
+ * @param ehFrameSize The size of the DWARF CFI section.
+ *
+ * @param unwindInfo The image's compact unwind section (NULL = none).
+ *
+ * @param unwindInfoSize The size of the compact unwind section.
+ *
+ * @return true if the image was added.
+ */
+bool ksunwind_addImage(uintptr_t textStart, uintptr_t textEnd, uintptr_t imageBase, const uint8_t *ehFrame,
+                       uintptr_t ehFrameSize, const uint8_t *unwindInfo, uintptr_t unwindInfoSize);
+
+/** Remove the unwind table of an image that is being unloaded, so that crash
+ * time lookups no longer read its unwind info. Waits for lookups that may
+ * still be reading it before freeing it, so the image can be unmapped once
+ * this returns. Async-unsafe.
+ *
+ * @param imageBase The imageBase that the image was added with.
+ */
+void ksunwind_removeImage(uintptr_t imageBase);
+
+/** Find the unwind rule for an instruction address. Async-safe.
+ *
+ * @param address The instruction address. For return addresses, pass the
+ *                address minus 1, since a call can be the last instruction
+ *                of a function.
+ *
+ * @param rule Filled out with the rule.
+ *
+ * @return true if a rule was found.
+ */
+bool ksunwind_findRule(uintptr_t address, KSUnwindRule *rule);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HDR_KSUnwindTable_h
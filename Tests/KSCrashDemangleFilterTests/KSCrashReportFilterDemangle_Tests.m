@@ -84,6 +84,21 @@
                           @"Bar.doSomething(_:_:)");
 }
 
+#pragma mark - C function
+
+- (void)testDemangleSymbolFunction
+{
+    char *demangled = ksdm_demangleSymbol("_Z3foov");
+    XCTAssertEqual(strcmp(demangled, "foo()"), 0);
+    free(demangled);
+
+    demangled = ksdm_demangleSymbol("$s5HelloAAC8sayHelloyyF");
+    XCTAssertEqual(strcmp(demangled, "Hello.sayHello()"), 0);
+    free(demangled);
+
+    XCTAssertTrue(ksdm_demangleSymbol("Not_Mangled()") == NULL);
+}
+
 #pragma mark - Report
 
 - (void)testReportDemangle
@@ -0,0 +1,90 @@
+//
+//  KSArena_Tests.m
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "KSArena.h"
+
+@interface KSArena_Tests : XCTestCase
+@end
+
+@implementation KSArena_Tests
+
+- (void)setUp
+{
+    [super setUp];
+    XCTAssertTrue(ksarena_install(1024 * 1024), @"");
+}
+
+- (void)testScopeReleasesAllocations
+{
+    size_t available = ksarena_bytesAvailable();
+    KSArenaScope scope;
+    ksarena_beginScope(&scope, false);
+    uint8_t *first = ksarena_alloc(1);
+    uint8_t *second = ksarena_alloc(100);
+    XCTAssertTrue(first != NULL, @"");
+    XCTAssertTrue(second != NULL, @"");
+    XCTAssertEqual((uintptr_t)first % 16, 0, @"");
+    XCTAssertEqual((uintptr_t)second % 16, 0, @"");
+    XCTAssertTrue(second + 100 <= first, @"");
+    memset(second, 0xff, 100);
+    XCTAssertEqual(ksarena_bytesAvailable(), available - 16 - 112, @"");
+    ksarena_endScope(&scope);
+    XCTAssertEqual(ksarena_bytesAvailable(), available, @"");
+}
+
+- (void)testReleaseToMark
+{
+    KSArenaScope scope;
+    ksarena_beginScope(&scope, false);
+    ksarena_alloc(64);
+    size_t available = ksarena_bytesAvailable();
+    uint32_t mark = ksarena_getMark();
+    ksarena_alloc(1000);
+    ksarena_releaseToMark(mark);
+    XCTAssertEqual(ksarena_bytesAvailable(), available, @"");
+    ksarena_endScope(&scope);
+}
+
+- (void)testAllocTooLarge
+{
+    KSArenaScope scope;
+    ksarena_beginScope(&scope, false);
+    XCTAssertTrue(ksarena_alloc(ksarena_bytesAvailable() + 1) == NULL, @"");
+    XCTAssertTrue(ksarena_alloc(ksarena_bytesAvailable()) != NULL, @"");
+    XCTAssertEqual(ksarena_bytesAvailable(), 0, @"");
+    ksarena_endScope(&scope);
+}
+
+- (void)testPermanentAlloc
+{
+    size_t available = ksarena_bytesAvailable();
+    uint8_t *memory = ksarena_allocPermanent(10);
+    XCTAssertTrue(memory != NULL, @"");
+    memset(memory, 0xff, 10);
+    XCTAssertEqual(ksarena_bytesAvailable(), available - 16, @"");
+}
+
+@end
@@ -60,6 +60,20 @@
     XCTAssertTrue(uuidBytes != NULL, @"");
 }
 
+- (void)testImageUUIDForHeader
+{
+    const char *name = _dyld_get_image_name(4);
+    const uint8_t *uuidBytes = ksdl_imageUUIDForHeader(_dyld_get_image_header(4));
+    XCTAssertTrue(uuidBytes != NULL, @"");
+    XCTAssertTrue(uuidBytes == ksdl_imageUUID(name, true), @"");
+}
+
+- (void)testImageUUIDForNULLHeader
+{
+    const uint8_t *uuidBytes = ksdl_imageUUIDForHeader(NULL);
+    XCTAssertTrue(uuidBytes == NULL, @"");
+}
+
 - (void)testGetImageNameNULL
 {
     uint32_t imageIdx = ksdl_imageNamed(NULL, false);
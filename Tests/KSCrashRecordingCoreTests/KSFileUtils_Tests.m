@@ -26,6 +26,7 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #import "FileBasedTestCase.h"
 
 #import "KSFileUtils.h"
@@ -289,6 +290,22 @@
     ksfu_closeBufferedReader(&reader);
 }
 
+- (void)testTailOffset
+{
+    const char *text = "line 1\nline 2\nline 3\n";
+    int length = (int)strlen(text);
+    XCTAssertEqual(ksfu_tailOffset(text, length, 0, 0), 0);
+    XCTAssertEqual(ksfu_tailOffset(text, length, 1, 0), 14);
+    XCTAssertEqual(ksfu_tailOffset(text, length, 2, 0), 7);
+    XCTAssertEqual(ksfu_tailOffset(text, length, 10, 0), 0);
+    // Byte limits are rounded up to the next line.
+    XCTAssertEqual(ksfu_tailOffset(text, length, 0, 10), 14);
+    XCTAssertEqual(ksfu_tailOffset(text, length, 0, 14), 7);
+    XCTAssertEqual(ksfu_tailOffset(text, length, 2, 8), 14);
+    // Unless the last line alone is too long.
+    XCTAssertEqual(ksfu_tailOffset("a long line", 11, 0, 4), 7);
+}
+
 - (void)testWriteBuffered
 {
     int writeBufferSize = 5;
@@ -367,6 +384,82 @@
     XCTAssertEqualObjects(actual, expected, @"");
 }
 
+- (void)testDeleteContentsOfPath
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSString *root = [self.tempPath stringByAppendingPathComponent:@"delete"];
+    NSString *nested = [root stringByAppendingPathComponent:@"a/b/c"];
+    NSString *outside = [self.tempPath stringByAppendingPathComponent:@"outside"];
+    NSString *outsideFile = [outside stringByAppendingPathComponent:@"keep.txt"];
+    XCTAssertTrue([fileManager createDirectoryAtPath:nested withIntermediateDirectories:YES attributes:nil error:nil]);
+    XCTAssertTrue([fileManager createDirectoryAtPath:outside withIntermediateDirectories:YES attributes:nil error:nil]);
+    XCTAssertTrue([@"x" writeToFile:[nested stringByAppendingPathComponent:@"x.json"]
+                         atomically:NO
+                           encoding:NSUTF8StringEncoding
+                              error:nil]);
+    XCTAssertTrue([@"y" writeToFile:[root stringByAppendingPathComponent:@"y.json"]
+                         atomically:NO
+                           encoding:NSUTF8StringEncoding
+                              error:nil]);
+    XCTAssertTrue([@"k" writeToFile:outsideFile atomically:NO encoding:NSUTF8StringEncoding error:nil]);
+    XCTAssertTrue([fileManager createSymbolicLinkAtPath:[root stringByAppendingPathComponent:@"link"]
+                                    withDestinationPath:outside
+                                                  error:nil]);
+
+    XCTAssertTrue(ksfu_deleteContentsOfPath(root.UTF8String));
+
+    XCTAssertEqualObjects([fileManager contentsOfDirectoryAtPath:root error:nil], @[]);
+    // Symbolic links are deleted, not followed.
+    XCTAssertTrue([fileManager fileExistsAtPath:outsideFile]);
+}
+
+- (void)testDeleteContentsOfPathReportsFailure
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSString *root = [self.tempPath stringByAppendingPathComponent:@"delete"];
+    NSString *locked = [root stringByAppendingPathComponent:@"locked"];
+    XCTAssertTrue([fileManager createDirectoryAtPath:locked withIntermediateDirectories:YES attributes:nil error:nil]);
+    XCTAssertTrue([@"x" writeToFile:[locked stringByAppendingPathComponent:@"x.json"]
+                         atomically:NO
+                           encoding:NSUTF8StringEncoding
+                              error:nil]);
+    XCTAssertTrue([@"y" writeToFile:[root stringByAppendingPathComponent:@"y.json"]
+                         atomically:NO
+                           encoding:NSUTF8StringEncoding
+                              error:nil]);
+    chmod(locked.UTF8String, 0555);
+
+    XCTAssertFalse(ksfu_deleteContentsOfPath(root.UTF8String));
+
+    chmod(locked.UTF8String, 0755);
+    // Everything that could be deleted was.
+    XCTAssertEqualObjects([fileManager contentsOfDirectoryAtPath:root error:nil], @[ @"locked" ]);
+}
+
+- (void)testDeleteContentsOfPathPerformance
+{
+    NSString *root = [self.tempPath stringByAppendingPathComponent:@"delete"];
+    int fileCount = 100000;
+    [self measureMetrics:@[ XCTPerformanceMetric_WallClockTime ]
+        automaticallyStartMeasuring:NO
+                           forBlock:^{
+                               XCTAssertEqual(mkdir(root.UTF8String, 0755), 0);
+                               for (int i = 0; i < fileCount; i++) {
+                                   char path[PATH_MAX];
+                                   snprintf(path, sizeof(path), "%s/%d.json", root.UTF8String, i);
+                                   int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+                                   XCTAssertTrue(fd >= 0);
+                                   close(fd);
+                               }
+
+                               [self startMeasuring];
+                               XCTAssertTrue(ksfu_deleteContentsOfPath(root.UTF8String));
+                               [self stopMeasuring];
+
+                               XCTAssertEqual(rmdir(root.UTF8String), 0);
+                           }];
+}
+
 - (void)testWriteBytesToFD
 {
     NSError *error = nil;
@@ -486,6 +579,68 @@
     XCTAssertEqualObjects(actual, expected, @"");
 }
 
+- (void)testReadEntireFiles
+{
+    int fileCount = 100;
+    NSMutableArray *paths = [NSMutableArray array];
+    const char *cPaths[fileCount];
+    for (int i = 0; i < fileCount; i++) {
+        NSString *path = [self.tempPath stringByAppendingPathComponent:[NSString stringWithFormat:@"file%d.txt", i]];
+        // Leave a gap to check that missing files don't disturb the others.
+        if (i != 50) {
+            [[NSString stringWithFormat:@"contents %d", i] writeToFile:path
+                                                             atomically:YES
+                                                               encoding:NSUTF8StringEncoding
+                                                                  error:nil];
+        }
+        [paths addObject:path];
+        cPaths[i] = [path UTF8String];
+    }
+
+    char *data[fileCount];
+    int lengths[fileCount];
+    XCTAssertEqual(ksfu_readEntireFiles(cPaths, fileCount, data, lengths), fileCount - 1);
+    for (int i = 0; i < fileCount; i++) {
+        if (i == 50) {
+            XCTAssertTrue(data[i] == NULL);
+            continue;
+        }
+        NSString *expected = [NSString stringWithFormat:@"contents %d", i];
+        XCTAssertEqual(lengths[i], (int)expected.length);
+        XCTAssertEqualObjects([NSString stringWithUTF8String:data[i]], expected);
+        free(data[i]);
+    }
+}
+
+- (void)testReadEntireFilesLongerThanOneRead
+{
+    // Big enough that the batch read only gets part of it, and has to finish it separately.
+    int fileCount = 4;
+    int byteCount = 1024 * 1024 + 123;
+    NSMutableData *expected = [NSMutableData dataWithLength:(NSUInteger)byteCount];
+    uint8_t *bytes = expected.mutableBytes;
+    for (int i = 0; i < byteCount; i++) {
+        bytes[i] = (uint8_t)('a' + (i / 1000) % 26);
+    }
+    NSMutableArray *paths = [NSMutableArray array];
+    const char *cPaths[fileCount];
+    for (int i = 0; i < fileCount; i++) {
+        NSString *path = [self.tempPath stringByAppendingPathComponent:[NSString stringWithFormat:@"file%d.txt", i]];
+        [expected writeToFile:path atomically:YES];
+        [paths addObject:path];
+        cPaths[i] = [path UTF8String];
+    }
+
+    char *data[fileCount];
+    int lengths[fileCount];
+    XCTAssertEqual(ksfu_readEntireFiles(cPaths, fileCount, data, lengths), fileCount);
+    for (int i = 0; i < fileCount; i++) {
+        XCTAssertEqual(lengths[i], byteCount);
+        XCTAssertEqualObjects([NSData dataWithBytesNoCopy:data[i] length:(NSUInteger)lengths[i] freeWhenDone:YES],
+                              expected);
+    }
+}
+
 - (void)testWriteStringToFD
 {
     NSError *error = nil;
@@ -622,6 +777,29 @@
     XCTAssertEqualObjects(actualFileContents, expectedContents);
 }
 
+- (void)testWriteBuffered_GathersLargeWrites
+{
+    int writeBufferSize = 16;
+    char writeBuffer[writeBufferSize];
+    KSBufferedWriter writer;
+    NSString *path = [self generateTempFilePath];
+    XCTAssertTrue(ksfu_openBufferedWriter(&writer, path.UTF8String, writeBuffer, writeBufferSize));
+
+    XCTAssertTrue(ksfu_writeBufferedWriter(&writer, "0123456789", 10));
+    XCTAssertTrue(ksfu_writeBufferedWriter(&writer, "abc", 3));
+    // Doesn't fit, and is big enough to be written along with the buffer instead of being copied.
+    XCTAssertTrue(ksfu_writeBufferedWriter(&writer, "DEFGHIJK", 8));
+    XCTAssertEqual(writer.position, 0);
+    XCTAssertTrue(ksfu_writeBufferedWriter(&writer, "lmn", 3));
+    XCTAssertEqual(writer.position, 3);
+
+    ksfu_closeBufferedWriter(&writer);
+    NSError *error = nil;
+    NSString *actualFileContents = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(actualFileContents, @"0123456789abcDEFGHIJKlmn");
+}
+
 - (void)testWriteBuffered_FlushAndLargeWriteOrder
 {
     int writeBufferSize = 10;
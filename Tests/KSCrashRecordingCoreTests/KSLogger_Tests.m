@@ -29,6 +29,9 @@
 
 #import "KSLogger.h"
 
+// Only the Objective-C entry points are declared when compiling Objective-C.
+void i_kslog_logCBasic(const char *fmt, ...);
+
 @interface KSLogger_Tests : XCTestCase
 
 @property(nonatomic, readwrite, copy) NSString *tempDir;
@@ -113,4 +116,74 @@
     XCTAssertEqualObjects(result, expected, @"");
 }
 
+- (void)testAsyncLogging
+{
+    NSString *logFileName = [self.tempDir stringByAppendingPathComponent:@"log.txt"];
+    kslog_setLogFilename([logFileName UTF8String], true);
+    XCTAssertTrue(kslog_setAsyncLogging(true));
+    NSMutableArray *expected = [NSMutableArray array];
+    for (int i = 0; i < 2000; i++) {
+        i_kslog_logCBasic("entry %d %s %.2f %*x", i, "test", i / 4.0, 6, i);
+        [expected addObject:[NSString stringWithFormat:@"entry %d %s %.2f %*x", i, "test", i / 4.0, 6, i]];
+    }
+    XCTAssertTrue(kslog_setAsyncLogging(false));
+    kslog_setLogFilename(nil, true);
+
+    NSError *error = nil;
+    NSString *result = [NSString stringWithContentsOfFile:logFileName encoding:NSUTF8StringEncoding error:&error];
+    XCTAssertNil(error, @"");
+    NSArray *lines = [result componentsSeparatedByString:@"\x0a"];
+    lines = [lines subarrayWithRange:NSMakeRange(0, lines.count - 1)];
+    XCTAssertEqualObjects(lines, expected, @"");
+}
+
+- (void)testDrainForCrash
+{
+    NSString *logFileName = [self.tempDir stringByAppendingPathComponent:@"log.txt"];
+    kslog_setLogFilename([logFileName UTF8String], true);
+    XCTAssertTrue(kslog_setAsyncLogging(true));
+    i_kslog_logCBasic("before crash %s", "drained");
+    kslog_drainForCrash();
+    // Logging on the crash path afterwards is synchronous and doesn't wait on the formatter thread.
+    i_kslog_logCBasic("after crash %s", "drained");
+    kslog_setLogFilename(nil, true);
+
+    NSError *error = nil;
+    NSString *result = [NSString stringWithContentsOfFile:logFileName encoding:NSUTF8StringEncoding error:&error];
+    XCTAssertNil(error, @"");
+    XCTAssertEqualObjects(result, @"before crash drained\x0aafter crash drained\x0a", @"");
+}
+
+- (void)testLogBuffer
+{
+    NSString *bufferFileName = [self.tempDir stringByAppendingPathComponent:@"log.buf"];
+    XCTAssertTrue(kslog_setLogBuffer([bufferFileName UTF8String], 4096, true));
+    for (int i = 0; i < 1000; i++) {
+        i_kslog_logCBasic("entry %d", i);
+    }
+
+    // Only the newest complete lines are kept once the buffer wraps.
+    int length = 0;
+    const char *text = kslog_getLogBuffer(&length);
+    XCTAssertTrue(text != NULL);
+    NSString *result = [[NSString alloc] initWithBytes:text length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+    NSArray *lines = [result componentsSeparatedByString:@"\x0a"];
+    XCTAssertEqualObjects(lines.lastObject, @"");
+    XCTAssertEqualObjects(lines[lines.count - 2], @"entry 999");
+    XCTAssertTrue([lines.firstObject hasPrefix:@"entry "]);
+    XCTAssertLessThanOrEqual(length, 4096);
+
+    int fileLength = 0;
+    char *fileText = kslog_readLogBufferFile([bufferFileName UTF8String], &fileLength);
+    XCTAssertEqual(fileLength, length);
+    XCTAssertTrue(fileText != NULL && memcmp(fileText, text, (size_t)length) == 0);
+    free(fileText);
+
+    kslog_clearLogFile();
+    kslog_getLogBuffer(&length);
+    XCTAssertEqual(length, 0);
+    kslog_setLogBuffer(NULL, 0, false);
+    XCTAssertTrue(kslog_getLogBuffer(&length) == NULL);
+}
+
 @end
@@ -92,4 +92,38 @@
     XCTAssertTrue(copied == 0, @"");
 }
 
+- (void)testCopyManySafely
+{
+    char buff[3][100];
+    char buff2[100] = { 1, 2, 3, 4, 5 };
+    char buff3[100] = { 6, 7, 8, 9, 10 };
+    KSMemoryRegion regions[] = {
+        { .src = buff2, .dst = buff[0], .byteCount = sizeof(buff2) },
+        { .src = NULL, .dst = buff[1], .byteCount = sizeof(buff2) },
+        { .src = buff3, .dst = buff[2], .byteCount = sizeof(buff3) },
+    };
+
+    int copied = ksmem_copyManySafely(regions, 3);
+    XCTAssertEqual(copied, 2, @"");
+    XCTAssertTrue(regions[0].isCopied, @"");
+    XCTAssertFalse(regions[1].isCopied, @"");
+    XCTAssertTrue(regions[2].isCopied, @"");
+    XCTAssertEqual(memcmp(buff[0], buff2, sizeof(buff2)), 0, @"");
+    XCTAssertEqual(memcmp(buff[2], buff3, sizeof(buff3)), 0, @"");
+}
+
+- (void)testReadableRegionSnapshot
+{
+    char buff[100] = { 0 };
+    XCTAssertTrue(ksmem_snapshotReadableRegions(), @"");
+    XCTAssertTrue(ksmem_isMemoryReadable(buff, sizeof(buff)), @"");
+    XCTAssertFalse(ksmem_isMemoryReadable(NULL, 1), @"");
+    XCTAssertFalse(ksmem_isMemoryReadable((void *)-1, 1), @"");
+    XCTAssertEqual(ksmem_maxReadableBytes(buff, sizeof(buff)), (int)sizeof(buff), @"");
+    XCTAssertEqual(ksmem_maxReadableBytes(NULL, 100), 0, @"");
+    ksmem_clearReadableRegionSnapshot();
+    XCTAssertTrue(ksmem_isMemoryReadable(buff, sizeof(buff)), @"");
+    XCTAssertFalse(ksmem_isMemoryReadable(NULL, 1), @"");
+}
+
 @end
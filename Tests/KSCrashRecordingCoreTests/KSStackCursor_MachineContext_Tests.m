@@ -0,0 +1,154 @@
+//
+//  KSStackCursor_MachineContext_Tests.m
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "KSCPU.h"
+#import "KSMachineContext.h"
+#import "KSMemory.h"
+#import "KSStackCursor_MachineContext.h"
+#import "KSSystemCapabilities.h"
+#import "TestThread.h"
+
+#import <mach/mach.h>
+#import <pthread.h>
+#import <stdatomic.h>
+
+#if KSCRASH_HAS_THREADS_API
+
+#define kMaxFrames 200
+
+/** How deep the stack that the performance test walks is. */
+#define kDeepStackDepth 5000
+
+static atomic_bool g_isDeepStackReady;
+static atomic_bool g_shouldUnwindDeepStack;
+
+static int __attribute__((noinline)) recurseDeeply(int depth)
+{
+    if (depth == 0) {
+        atomic_store(&g_isDeepStackReady, true);
+        while (!atomic_load(&g_shouldUnwindDeepStack)) {
+            usleep(1000);
+        }
+        return 0;
+    }
+    // Reading this after the call keeps the compiler from turning the recursion into a loop.
+    volatile int level = depth;
+    int result = recurseDeeply(depth - 1);
+    return result + level;
+}
+
+static void *deepStackThread(__unused void *userData)
+{
+    recurseDeeply(kDeepStackDepth);
+    return NULL;
+}
+
+@interface KSStackCursor_MachineContext_Tests : XCTestCase
+@end
+
+@implementation KSStackCursor_MachineContext_Tests
+
+- (void)testWalkMatchesFrameChain
+{
+    TestThread *thread = [[TestThread alloc] init];
+    [thread start];
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertTrue(thread_suspend(thread.thread) == KERN_SUCCESS, @"");
+
+    KSMC_NEW_CONTEXT(machineContext);
+    ksmc_getContextForThread(thread.thread, machineContext, NO);
+
+    // Follow the frame pointers one read at a time for comparison.
+    uintptr_t expected[kMaxFrames];
+    int expectedCount = 0;
+    uintptr_t frame[2];
+    const void *framePointer = (const void *)kscpu_framePointer(machineContext);
+    while (expectedCount < kMaxFrames && ksmem_copySafely(framePointer, frame, sizeof(frame)) && frame[0] != 0 &&
+           frame[1] != 0) {
+        expected[expectedCount++] = kscpu_normaliseInstructionPointer(frame[1]);
+        framePointer = (const void *)frame[0];
+    }
+
+    uintptr_t actual[kMaxFrames];
+    int actualCount = 0;
+    KSStackCursor stackCursor;
+    kssc_initWithMachineContext(&stackCursor, kMaxFrames, machineContext);
+    while (actualCount < kMaxFrames && stackCursor.advanceCursor(&stackCursor)) {
+        actual[actualCount++] = stackCursor.stackEntry.address;
+    }
+
+    thread_resume(thread.thread);
+    [thread cancel];
+
+    // The cursor starts with the instruction address (and link register, if any) before the frame chain.
+    XCTAssertTrue(expectedCount > 0, @"");
+    XCTAssertTrue(actualCount >= expectedCount, @"");
+    int skipped = actualCount - expectedCount;
+    XCTAssertTrue(skipped <= 2, @"");
+    for (int i = 0; i < expectedCount; i++) {
+        XCTAssertEqual(actual[skipped + i], expected[i], @"Frame %d", i);
+    }
+}
+
+- (void)testWalkDeepStackPerformance
+{
+    atomic_store(&g_isDeepStackReady, false);
+    atomic_store(&g_shouldUnwindDeepStack, false);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 4 * 1024 * 1024);
+    pthread_t pthread;
+    XCTAssertEqual(pthread_create(&pthread, &attr, deepStackThread, NULL), 0);
+    pthread_attr_destroy(&attr);
+    while (!atomic_load(&g_isDeepStackReady)) {
+        usleep(1000);
+    }
+    thread_t thread = pthread_mach_thread_np(pthread);
+    XCTAssertTrue(thread_suspend(thread) == KERN_SUCCESS, @"");
+
+    KSMC_NEW_CONTEXT(machineContext);
+    ksmc_getContextForThread(thread, machineContext, NO);
+
+    __block int depth = 0;
+    [self measureBlock:^{
+        KSStackCursor stackCursor;
+        kssc_initWithMachineContext(&stackCursor, kDeepStackDepth * 2, machineContext);
+        depth = 0;
+        while (stackCursor.advanceCursor(&stackCursor)) {
+            depth++;
+        }
+    }];
+
+    thread_resume(thread);
+    atomic_store(&g_shouldUnwindDeepStack, true);
+    pthread_join(pthread, NULL);
+
+    XCTAssertTrue(depth > kDeepStackDepth, @"");
+}
+
+@end
+
+#endif
@@ -0,0 +1,184 @@
+//
+//  KSUnwindTable_Tests.m
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "KSUnwindTable.h"
+
+#if defined(__arm64__)
+#define kDwarfFP 29
+#define kDwarfSP 31
+#define kDwarfRA 30
+#else
+#define kDwarfFP 6
+#define kDwarfSP 7
+#define kDwarfRA 16
+#endif
+
+/** Stands in for an image's code, so that the test's unwind table doesn't cover any real code. */
+static uint8_t g_fakeText[0x200];
+
+@interface KSUnwindTable_Tests : XCTestCase
+@end
+
+@implementation KSUnwindTable_Tests
+
+/** Build an .eh_frame with one function at fakeText + 0x100 that is 0x40 bytes long.
+ * Its return address and frame pointer are saved on entry, and it switches to
+ * a frame pointer based CFA after 4 bytes.
+ */
+- (NSData *)ehFrameForFakeText
+{
+    NSMutableData *data = [NSMutableData data];
+    uint8_t cie[] = {
+        24 - 4, 0, 0, 0,        // length
+        0, 0, 0, 0,             // CIE id
+        1,                      // version
+        'z', 'R', 0,            // augmentation
+        1,                      // code alignment
+        0x78,                   // data alignment (-8)
+        kDwarfRA,               // return address register
+        1, 0x00,                // augmentation data: absolute pointers
+        0x0c, kDwarfSP, 16,     // DW_CFA_def_cfa sp, 16
+        0x80 | kDwarfRA, 1,     // DW_CFA_offset ra, cfa - 8
+        0x80 | kDwarfFP, 2,     // DW_CFA_offset fp, cfa - 16
+    };
+    [data appendBytes:cie length:sizeof(cie)];
+
+    uint8_t fdeHeader[] = {
+        32 - 4, 0, 0, 0,  // length
+        28, 0, 0, 0,      // distance back to the CIE
+    };
+    [data appendBytes:fdeHeader length:sizeof(fdeHeader)];
+    uintptr_t pcBegin = (uintptr_t)g_fakeText + 0x100;
+    uintptr_t pcRange = 0x40;
+    [data appendBytes:&pcBegin length:sizeof(pcBegin)];
+    [data appendBytes:&pcRange length:sizeof(pcRange)];
+    uint8_t fdeInstructions[] = {
+        0,                  // augmentation data length
+        0x40 | 4,           // DW_CFA_advance_loc 4
+        0x0d, kDwarfFP,     // DW_CFA_def_cfa_register fp
+        0, 0, 0, 0,         // padding
+    };
+    [data appendBytes:fdeInstructions length:sizeof(fdeInstructions)];
+
+    uint32_t terminator = 0;
+    [data appendBytes:&terminator length:sizeof(terminator)];
+    return data;
+}
+
+- (void)testRulesFromEHFrame
+{
+    NSData *ehFrame = [self ehFrameForFakeText];
+    uintptr_t textStart = (uintptr_t)g_fakeText;
+    XCTAssertTrue(ksunwind_addImage(textStart, textStart + sizeof(g_fakeText), textStart, ehFrame.bytes,
+                                    ehFrame.length, NULL, 0),
+                  @"");
+
+    KSUnwindRule rule;
+    XCTAssertTrue(ksunwind_findRule(textStart + 0x100, &rule), @"");
+    XCTAssertEqual(rule.cfaRegister, KSUnwindRegister_StackPointer, @"");
+    XCTAssertEqual(rule.cfaOffset, 16, @"");
+    XCTAssertEqual(rule.returnAddressOffset, -8, @"");
+    XCTAssertEqual(rule.framePointerOffset, -16, @"");
+
+    XCTAssertTrue(ksunwind_findRule(textStart + 0x13f, &rule), @"");
+    XCTAssertEqual(rule.cfaRegister, KSUnwindRegister_FramePointer, @"");
+    XCTAssertEqual(rule.cfaOffset, 16, @"");
+    XCTAssertEqual(rule.returnAddressOffset, -8, @"");
+    XCTAssertEqual(rule.framePointerOffset, -16, @"");
+
+    XCTAssertFalse(ksunwind_findRule(textStart + 0xff, &rule), @"");
+    XCTAssertFalse(ksunwind_findRule(textStart + 0x140, &rule), @"");
+}
+
+- (void)testRemovedImageHasNoRules
+{
+    NSData *ehFrame = [self ehFrameForFakeText];
+    uintptr_t textStart = (uintptr_t)g_fakeText;
+    XCTAssertTrue(ksunwind_addImage(textStart, textStart + sizeof(g_fakeText), textStart, ehFrame.bytes,
+                                    ehFrame.length, NULL, 0),
+                  @"");
+    KSUnwindRule rule;
+    XCTAssertTrue(ksunwind_findRule(textStart + 0x100, &rule), @"");
+
+    ksunwind_removeImage(textStart);
+    XCTAssertFalse(ksunwind_findRule(textStart + 0x100, &rule), @"");
+
+    // The retired slot can take the image again.
+    XCTAssertTrue(ksunwind_addImage(textStart, textStart + sizeof(g_fakeText), textStart, ehFrame.bytes,
+                                    ehFrame.length, NULL, 0),
+                  @"");
+    XCTAssertTrue(ksunwind_findRule(textStart + 0x100, &rule), @"");
+    ksunwind_removeImage(textStart);
+}
+
+- (void)testRemovingImageWhileLookingUpRules
+{
+    NSData *ehFrame = [self ehFrameForFakeText];
+    uintptr_t textStart = (uintptr_t)g_fakeText;
+    __block volatile bool isDone = false;
+    __block volatile bool isWrongRule = false;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        while (!isDone) {
+            KSUnwindRule rule;
+            if (ksunwind_findRule(textStart + 0x100, &rule) && rule.cfaOffset != 16) {
+                isWrongRule = true;
+            }
+        }
+    });
+    for (int i = 0; i < 2000; i++) {
+        ksunwind_addImage(textStart, textStart + sizeof(g_fakeText), textStart, ehFrame.bytes, ehFrame.length, NULL,
+                          0);
+        ksunwind_removeImage(textStart);
+    }
+    isDone = true;
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    XCTAssertFalse(isWrongRule, @"");
+    KSUnwindRule rule;
+    XCTAssertFalse(ksunwind_findRule(textStart + 0x100, &rule), @"");
+}
+
+- (void)testRulesForLoadedImages
+{
+    ksunwind_initialize();
+    XCTAssertTrue(ksunwind_isEnabled(), @"");
+
+    // The tables are built in the background.
+    KSUnwindRule rule;
+    bool isFound = false;
+    for (int i = 0; i < 500 && !isFound; i++) {
+        isFound = ksunwind_findRule((uintptr_t)ksunwind_findRule, &rule);
+        if (!isFound) {
+            usleep(10000);
+        }
+    }
+    XCTAssertTrue(isFound, @"");
+    XCTAssertTrue(rule.cfaRegister == KSUnwindRegister_StackPointer ||
+                      rule.cfaRegister == KSUnwindRegister_FramePointer,
+                  @"");
+}
+
+@end
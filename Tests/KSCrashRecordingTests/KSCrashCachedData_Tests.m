@@ -50,4 +50,41 @@
     ksccd_unfreeze();
 }
 
+- (void)testSharesNamesBetweenThreads
+{
+    NSString *expectedName = @"A shared thread name";
+    TestThread *thread1 = [TestThread new];
+    TestThread *thread2 = [TestThread new];
+    thread1.name = expectedName;
+    thread2.name = expectedName;
+    [thread1 start];
+    [thread2 start];
+    [NSThread sleepForTimeInterval:0.1];
+    ksccd_refresh();
+    ksccd_freeze();
+    const char *name1 = ksccd_getThreadName(thread1.thread);
+    const char *name2 = ksccd_getThreadName(thread2.thread);
+    XCTAssertTrue(name1 != NULL);
+    XCTAssertEqualObjects([NSString stringWithUTF8String:name1], expectedName);
+    XCTAssertTrue(name1 == name2);
+    ksccd_unfreeze();
+    [thread1 cancel];
+    [thread2 cancel];
+}
+
+- (void)testKeepsNamesOfUnchangedThreads
+{
+    TestThread *thread = [TestThread new];
+    thread.name = @"An unchanged thread";
+    [thread start];
+    [NSThread sleepForTimeInterval:0.1];
+    ksccd_refresh();
+    const char *name = ksccd_getThreadName(thread.thread);
+    XCTAssertTrue(name != NULL);
+
+    ksccd_refresh();
+    XCTAssertTrue(ksccd_getThreadName(thread.thread) == name);
+    [thread cancel];
+}
+
 @end
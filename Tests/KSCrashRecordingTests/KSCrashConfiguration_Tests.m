@@ -28,6 +28,8 @@
 #import "KSCrashConfiguration+Private.h"
 #import "KSCrashConfiguration.h"
 
+static char *demangleForTest(__unused const char *mangledSymbol) { return NULL; }
+
 @interface KSCrashConfigurationTests : XCTestCase
 @end
 
@@ -46,9 +48,24 @@
     XCTAssertNil(config.crashNotifyCallback);
     XCTAssertNil(config.reportWrittenCallback);
     XCTAssertFalse(config.addConsoleLogToReport);
+    XCTAssertEqual(config.maxConsoleLogLines, 0);
+    XCTAssertEqual(config.maxConsoleLogBytes, 0);
+    XCTAssertEqual(config.consoleLogBufferSize, 0);
     XCTAssertFalse(config.printPreviousLogOnStartup);
     XCTAssertEqual(config.reportStoreConfiguration.maxReportCount, 5);
+    XCTAssertEqual(config.reportStoreConfiguration.maxReportsPerFingerprint, 0);
+    XCTAssertEqual(config.reportStoreConfiguration.maxReportsTotalSize, 0);
+    XCTAssertEqual(config.reportStoreConfiguration.maxReportAge, 0.0);
+    XCTAssertTrue(config.reportStoreConfiguration.demangleFunction == NULL);
+    XCTAssertEqual(config.reportStoreConfiguration.durability, KSCrashReportDurabilityNone);
+    XCTAssertEqual(config.reportStoreConfiguration.groupCommitInterval, 0.05);
+    XCTAssertEqual(config.reportStoreConfiguration.groupCommitMaxReports, 32);
     XCTAssertTrue(config.enableSwapCxaThrow);
+    XCTAssertFalse(config.enableUnwindTables);
+    XCTAssertEqual(config.profilerSampleInterval, 0.01);
+    XCTAssertEqual(config.profilerWindowDuration, 1.0);
+    XCTAssertFalse(config.collapseIdenticalBacktraces);
+    XCTAssertFalse(config.writeMinidump);
 }
 
 - (void)testToCConfiguration
@@ -61,9 +78,24 @@
     config.enableMemoryIntrospection = YES;
     config.doNotIntrospectClasses = @[ @"ClassA", @"ClassB" ];
     config.addConsoleLogToReport = YES;
+    config.maxConsoleLogLines = 200;
+    config.maxConsoleLogBytes = 64 * 1024;
+    config.consoleLogBufferSize = 256 * 1024;
     config.printPreviousLogOnStartup = YES;
     config.reportStoreConfiguration.maxReportCount = 10;
+    config.reportStoreConfiguration.maxReportsPerFingerprint = 3;
+    config.reportStoreConfiguration.maxReportsTotalSize = 1024 * 1024;
+    config.reportStoreConfiguration.maxReportAge = 86400.0;
+    config.reportStoreConfiguration.demangleFunction = demangleForTest;
+    config.reportStoreConfiguration.durability = KSCrashReportDurabilityGroupCommit;
+    config.reportStoreConfiguration.groupCommitInterval = 0.2;
+    config.reportStoreConfiguration.groupCommitMaxReports = 8;
     config.enableSwapCxaThrow = NO;
+    config.enableUnwindTables = YES;
+    config.profilerSampleInterval = 0.05;
+    config.profilerWindowDuration = 2.0;
+    config.collapseIdenticalBacktraces = YES;
+    config.writeMinidump = YES;
 
     KSCrashCConfiguration cConfig = [config toCConfiguration];
 
@@ -77,9 +109,24 @@
     XCTAssertEqual(strcmp(cConfig.doNotIntrospectClasses.strings[0], "ClassA"), 0);
     XCTAssertEqual(strcmp(cConfig.doNotIntrospectClasses.strings[1], "ClassB"), 0);
     XCTAssertTrue(cConfig.addConsoleLogToReport);
+    XCTAssertEqual(cConfig.maxConsoleLogLines, 200);
+    XCTAssertEqual(cConfig.maxConsoleLogBytes, 64 * 1024);
+    XCTAssertEqual(cConfig.consoleLogBufferSize, 256 * 1024);
     XCTAssertTrue(cConfig.printPreviousLogOnStartup);
     XCTAssertEqual(cConfig.reportStoreConfiguration.maxReportCount, 10);
+    XCTAssertEqual(cConfig.reportStoreConfiguration.maxReportsPerFingerprint, 3);
+    XCTAssertEqual(cConfig.reportStoreConfiguration.maxReportsTotalSize, 1024 * 1024);
+    XCTAssertEqual(cConfig.reportStoreConfiguration.maxReportAge, 86400.0);
+    XCTAssertTrue(cConfig.reportStoreConfiguration.demangleFunction == demangleForTest);
+    XCTAssertEqual(cConfig.reportStoreConfiguration.durability, KSCrashReportDurabilityGroupCommit);
+    XCTAssertEqual(cConfig.reportStoreConfiguration.groupCommitInterval, 0.2);
+    XCTAssertEqual(cConfig.reportStoreConfiguration.groupCommitMaxReports, 8);
     XCTAssertFalse(cConfig.enableSwapCxaThrow);
+    XCTAssertTrue(cConfig.enableUnwindTables);
+    XCTAssertEqual(cConfig.profilerSampleInterval, 0.05);
+    XCTAssertEqual(cConfig.profilerWindowDuration, 2.0);
+    XCTAssertTrue(cConfig.collapseIdenticalBacktraces);
+    XCTAssertTrue(cConfig.writeMinidump);
 
     // Free memory allocated for C string array
     KSCrashCConfiguration_Release(&cConfig);
@@ -95,9 +142,24 @@
     config.enableMemoryIntrospection = YES;
     config.doNotIntrospectClasses = @[ @"ClassA", @"ClassB" ];
     config.addConsoleLogToReport = YES;
+    config.maxConsoleLogLines = 200;
+    config.maxConsoleLogBytes = 64 * 1024;
+    config.consoleLogBufferSize = 256 * 1024;
     config.printPreviousLogOnStartup = YES;
     config.reportStoreConfiguration.maxReportCount = 10;
+    config.reportStoreConfiguration.maxReportsPerFingerprint = 3;
+    config.reportStoreConfiguration.maxReportsTotalSize = 1024 * 1024;
+    config.reportStoreConfiguration.maxReportAge = 86400.0;
+    config.reportStoreConfiguration.demangleFunction = demangleForTest;
+    config.reportStoreConfiguration.durability = KSCrashReportDurabilityGroupCommit;
+    config.reportStoreConfiguration.groupCommitInterval = 0.2;
+    config.reportStoreConfiguration.groupCommitMaxReports = 8;
     config.enableSwapCxaThrow = NO;
+    config.enableUnwindTables = YES;
+    config.profilerSampleInterval = 0.05;
+    config.profilerWindowDuration = 2.0;
+    config.collapseIdenticalBacktraces = YES;
+    config.writeMinidump = YES;
 
     KSCrashConfiguration *copy = [config copy];
 
@@ -108,9 +170,24 @@
     XCTAssertTrue(copy.enableMemoryIntrospection);
     XCTAssertEqualObjects(copy.doNotIntrospectClasses, (@[ @"ClassA", @"ClassB" ]));
     XCTAssertTrue(copy.addConsoleLogToReport);
+    XCTAssertEqual(copy.maxConsoleLogLines, 200);
+    XCTAssertEqual(copy.maxConsoleLogBytes, 64 * 1024);
+    XCTAssertEqual(copy.consoleLogBufferSize, 256 * 1024);
     XCTAssertTrue(copy.printPreviousLogOnStartup);
     XCTAssertEqual(copy.reportStoreConfiguration.maxReportCount, 10);
+    XCTAssertEqual(copy.reportStoreConfiguration.maxReportsPerFingerprint, 3);
+    XCTAssertEqual(copy.reportStoreConfiguration.maxReportsTotalSize, 1024 * 1024);
+    XCTAssertEqual(copy.reportStoreConfiguration.maxReportAge, 86400.0);
+    XCTAssertTrue(copy.reportStoreConfiguration.demangleFunction == demangleForTest);
+    XCTAssertEqual(copy.reportStoreConfiguration.durability, KSCrashReportDurabilityGroupCommit);
+    XCTAssertEqual(copy.reportStoreConfiguration.groupCommitInterval, 0.2);
+    XCTAssertEqual(copy.reportStoreConfiguration.groupCommitMaxReports, 8);
     XCTAssertFalse(copy.enableSwapCxaThrow);
+    XCTAssertTrue(copy.enableUnwindTables);
+    XCTAssertEqual(copy.profilerSampleInterval, 0.05);
+    XCTAssertEqual(copy.profilerWindowDuration, 2.0);
+    XCTAssertTrue(copy.collapseIdenticalBacktraces);
+    XCTAssertTrue(copy.writeMinidump);
 }
 
 - (void)testEmptyDictionaryForJSONConversion
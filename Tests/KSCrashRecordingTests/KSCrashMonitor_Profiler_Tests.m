@@ -0,0 +1,129 @@
+//
+//  KSCrashMonitor_Profiler_Tests.m
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#import <XCTest/XCTest.h>
+
+#import "KSCrashMonitorContext.h"
+#import "KSCrashMonitor_Profiler.h"
+
+@interface KSCrashMonitor_Profiler_Tests : XCTestCase
+@end
+
+@implementation KSCrashMonitor_Profiler_Tests
+
+- (void)tearDown
+{
+    kscm_profiler_getAPI()->setEnabled(false);
+    [super tearDown];
+}
+
+/** Find the child of a node with the given address, or 0 if there is none. */
+static uint32_t findChild(const KSProfileWindow *window, uint32_t parentIndex, uintptr_t address)
+{
+    for (uint32_t index = window->nodes[parentIndex].firstChild; index != 0;
+         index = window->nodes[index].nextSibling) {
+        if (window->nodes[index].address == address) {
+            return index;
+        }
+    }
+    return 0;
+}
+
+- (void)testInstallAndRemove
+{
+    KSCrashMonitorAPI *api = kscm_profiler_getAPI();
+    api->setEnabled(true);
+    XCTAssertTrue(api->isEnabled());
+    [NSThread sleepForTimeInterval:0.1];
+    api->setEnabled(false);
+    XCTAssertFalse(api->isEnabled());
+}
+
+- (void)testAddSampleWhileDisabled
+{
+    uintptr_t addresses[] = { 0x3000, 0x2000, 0x1000 };
+    XCTAssertFalse(kscm_profiler_addSample(addresses, 3));
+}
+
+- (void)testAddSampleBuildsCallTree
+{
+    // A long interval keeps the sampler out of the window during the test.
+    kscm_setProfilerSampleInterval(60);
+    kscm_setProfilerWindowDuration(60);
+    kscm_profiler_getAPI()->setEnabled(true);
+
+    uintptr_t first[] = { 0x3000, 0x2000, 0x1000 };
+    uintptr_t second[] = { 0x3100, 0x2000, 0x1000 };
+    XCTAssertTrue(kscm_profiler_addSample(first, 3));
+    XCTAssertTrue(kscm_profiler_addSample(second, 3));
+    XCTAssertTrue(kscm_profiler_addSample(first, 3));
+
+    const KSProfileWindow *window = kscm_profiler_getRecentWindow();
+    XCTAssertTrue(window != NULL);
+    uint32_t outer = findChild(window, 0, 0x1000);
+    uint32_t middle = findChild(window, outer, 0x2000);
+    uint32_t innerFirst = findChild(window, middle, 0x3000);
+    uint32_t innerSecond = findChild(window, middle, 0x3100);
+    XCTAssertNotEqual(outer, 0);
+    XCTAssertNotEqual(middle, 0);
+    XCTAssertEqual(window->nodes[outer].sampleCount, 3);
+    XCTAssertEqual(window->nodes[middle].sampleCount, 3);
+    XCTAssertEqual(window->nodes[innerFirst].sampleCount, 2);
+    XCTAssertEqual(window->nodes[innerSecond].sampleCount, 1);
+
+    kscm_setProfilerSampleInterval(0.01);
+    kscm_setProfilerWindowDuration(1.0);
+}
+
+- (void)testSamplesBusyThread
+{
+    kscm_profiler_getAPI()->setEnabled(true);
+    __block volatile BOOL isDone = NO;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        while (!isDone) {
+        }
+    });
+    [NSThread sleepForTimeInterval:0.3];
+    isDone = YES;
+
+    const KSProfileWindow *window = kscm_profiler_getRecentWindow();
+    XCTAssertTrue(window != NULL);
+    XCTAssertGreaterThan(window->sampleCount, 0);
+    XCTAssertGreaterThan(window->nodeCount, 1);
+    XCTAssertLessThanOrEqual(window->nodeCount, KSPROFILER_MaxNodes);
+}
+
+- (void)testAddsWindowToEvent
+{
+    KSCrashMonitorAPI *api = kscm_profiler_getAPI();
+    api->setEnabled(true);
+    uintptr_t addresses[] = { 0x5000, 0x4000 };
+    kscm_profiler_addSample(addresses, 2);
+
+    KSCrash_MonitorContext context = { 0 };
+    api->addContextualInfoToEvent(&context);
+    XCTAssertTrue(context.Profile.window == kscm_profiler_getRecentWindow());
+    XCTAssertTrue(context.Profile.window != NULL);
+}
+
+@end
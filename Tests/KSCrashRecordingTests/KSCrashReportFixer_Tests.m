@@ -10,6 +10,23 @@
 #import "KSCrashReportFixer.h"
 #import "KSTestModuleConfig.h"
 
+static int g_demangleCallCount;
+
+static char *demangleForTest(const char *mangledSymbol)
+{
+    g_demangleCallCount++;
+    if (strcmp(mangledSymbol, "_Z3foov") == 0) {
+        return strdup("foo(\"quoted\")");
+    }
+    return NULL;
+}
+
+static bool appendToData(const char *data, int length, void *userData)
+{
+    [(__bridge NSMutableData *)userData appendBytes:data length:(NSUInteger)length];
+    return true;
+}
+
 @interface KSCrashReportFixer_Tests : XCTestCase
 
 @end
@@ -51,4 +68,68 @@
     XCTAssertEqualObjects(fixedObjects, processedObjects);
 }
 
+- (void)testKeepsUnchangedBytesVerbatim
+{
+    const char *raw = "{ \"report\" : {\"version\":\"3.3.0\", \"timestamp\":1700000000000000},\n"
+                      "  \"crash\": {\"a\\\"b\": [1.50, -2, null, true]} }";
+    const char *expected = "{ \"report\" : {\"version\":\"3.3.0\", \"timestamp\":\"2023-11-14T22:13:20.000000Z\"},\n"
+                           "  \"crash\": {\"a\\\"b\": [1.50, -2, null, true]} }";
+    char *fixed = kscrf_fixupCrashReport(raw);
+    XCTAssertTrue(fixed != NULL);
+    XCTAssertEqual(strcmp(fixed, expected), 0);
+    free(fixed);
+}
+
+- (void)testFixupCanGrowReport
+{
+    // The fixed up timestamp is much longer than the raw one.
+    const char *raw = "{\"report\":{\"version\":\"3.3.0\",\"timestamp\":0}}";
+    const char *expected = "{\"report\":{\"version\":\"3.3.0\",\"timestamp\":\"1970-01-01T00:00:00.000000Z\"}}";
+    char *fixed = kscrf_fixupCrashReport(raw);
+    XCTAssertTrue(fixed != NULL);
+    XCTAssertEqual(strcmp(fixed, expected), 0);
+    free(fixed);
+}
+
+- (void)testOnlyFixesMatchingPaths
+{
+    const char *raw = "{\"crash\":{\"report\":{\"timestamp\":1}},\"timestamp\":2,"
+                      "\"recrash_report\":{\"report\":{\"version\":\"3.2.0\",\"timestamp\":3}},"
+                      "\"report\":{\"times\":4,\"timestamp\":[5]}}";
+    const char *expected = "{\"crash\":{\"report\":{\"timestamp\":1}},\"timestamp\":2,"
+                           "\"recrash_report\":{\"report\":{\"version\":\"3.2.0\","
+                           "\"timestamp\":\"1970-01-01T00:00:03Z\"}},"
+                           "\"report\":{\"times\":4,\"timestamp\":[5]}}";
+    char *fixed = kscrf_fixupCrashReport(raw);
+    XCTAssertTrue(fixed != NULL);
+    XCTAssertEqual(strcmp(fixed, expected), 0);
+    free(fixed);
+}
+
+- (void)testDemanglesSymbolsWhileStreaming
+{
+    const char *raw = "{\"crash\":{\"threads\":[{\"backtrace\":{\"contents\":["
+                      "{\"symbol_name\":\"_Z3foov\"},{\"symbol_name\":\"main\"},{\"symbol_name\":\"_Z3foov\"}]}}],"
+                      "\"error\":{\"cpp_exception\":{\"name\":\"_Z3foov\"}},\"symbol_name\":\"_Z3foov\"}}";
+    const char *expected = "{\"crash\":{\"threads\":[{\"backtrace\":{\"contents\":["
+                           "{\"symbol_name\":\"foo(\\\"quoted\\\")\"},{\"symbol_name\":\"main\"},"
+                           "{\"symbol_name\":\"foo(\\\"quoted\\\")\"}]}}],"
+                           "\"error\":{\"cpp_exception\":{\"name\":\"foo(\\\"quoted\\\")\"}},"
+                           "\"symbol_name\":\"_Z3foov\"}}";
+    NSMutableData *fixedData = [NSMutableData data];
+    g_demangleCallCount = 0;
+    XCTAssertTrue(kscrf_fixupCrashReportStreaming(raw, (int)strlen(raw), demangleForTest, appendToData,
+                                                  (__bridge void *)fixedData));
+    NSString *fixed = [[NSString alloc] initWithData:fixedData encoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects(fixed, @(expected));
+    // Each distinct symbol is only demangled once per report.
+    XCTAssertEqual(g_demangleCallCount, 2);
+}
+
+- (void)testRejectsTruncatedReport
+{
+    XCTAssertTrue(kscrf_fixupCrashReport("{\"report\":{\"version\":\"3.3.0\",\"timestamp\":0") == NULL);
+    XCTAssertTrue(kscrf_fixupCrashReport("{\"report\":\"abc") == NULL);
+}
+
 @end
@@ -0,0 +1,135 @@
+//
+//  KSCrashReportMinidump_Tests.m
+//
+//  Copyright (c) 2012 Karl Stenerud. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall remain in place
+// in this source code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "FileBasedTestCase.h"
+
+#import "KSCPU.h"
+#import "KSCrashReportMinidump.h"
+#import "KSDynamicLinker.h"
+#import "KSMachineContext.h"
+#import "TestThread.h"
+
+#import <mach/mach.h>
+
+@interface KSCrashReportMinidump_Tests : FileBasedTestCase
+@end
+
+@implementation KSCrashReportMinidump_Tests
+
+static uint32_t readUInt32(NSData *data, NSUInteger offset)
+{
+    uint32_t value = 0;
+    [data getBytes:&value range:NSMakeRange(offset, sizeof(value))];
+    return value;
+}
+
+static uint64_t readUInt64(NSData *data, NSUInteger offset)
+{
+    uint64_t value = 0;
+    [data getBytes:&value range:NSMakeRange(offset, sizeof(value))];
+    return value;
+}
+
+/** Find a stream in the directory, and return its offset in the file (0 = not found). */
+static uint32_t findStream(NSData *data, uint32_t streamType)
+{
+    uint32_t streamCount = readUInt32(data, 8);
+    uint32_t directory = readUInt32(data, 12);
+    for (uint32_t i = 0; i < streamCount; i++) {
+        if (readUInt32(data, directory + i * 12) == streamType) {
+            return readUInt32(data, directory + i * 12 + 8);
+        }
+    }
+    return 0;
+}
+
+- (void)testWritesThreadModulesAndException
+{
+    TestThread *thread = [[TestThread alloc] init];
+    [thread start];
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertTrue(thread_suspend(thread.thread) == KERN_SUCCESS, @"");
+
+    KSMC_NEW_CONTEXT(machineContext);
+    ksmc_getContextForThread(thread.thread, machineContext, NO);
+    KSCrash_MonitorContext context = { 0 };
+    context.offendingMachineContext = machineContext;
+    context.faultAddress = 0x1234;
+    context.mach.type = EXC_BAD_ACCESS;
+    context.mach.code = KERN_INVALID_ADDRESS;
+    context.System.systemVersion = "17.4.1";
+    context.System.osVersion = "21E236";
+    uintptr_t stackPointer = kscpu_stackPointer(machineContext);
+
+    NSString *path = [self.tempPath stringByAppendingPathComponent:@"test.dmp"];
+    BOOL isWritten = kscrashreport_writeMinidump(&context, path.UTF8String);
+    thread_resume(thread.thread);
+    [thread cancel];
+    XCTAssertTrue(isWritten);
+
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    XCTAssertEqual(readUInt32(data, 0), 0x504d444du);
+    XCTAssertEqual(readUInt32(data, 4) & 0xffff, 0xa793u);
+
+    // Without a thread list in the context, only the offending thread is written.
+    uint32_t threadList = findStream(data, 3);
+    XCTAssertNotEqual(threadList, 0u);
+    XCTAssertEqual(readUInt32(data, threadList), 1u);
+    XCTAssertEqual(readUInt32(data, threadList + 4), (uint32_t)thread.thread);
+    XCTAssertEqual(readUInt64(data, threadList + 4 + 24), (uint64_t)stackPointer);
+    XCTAssertGreaterThan(readUInt32(data, threadList + 4 + 32), 0u);
+#if defined(__x86_64__)
+    XCTAssertEqual(readUInt32(data, threadList + 4 + 40), 1232u);
+#elif defined(__arm64__)
+    XCTAssertEqual(readUInt32(data, threadList + 4 + 40), 912u);
+#endif
+
+    uint32_t moduleList = findStream(data, 4);
+    XCTAssertNotEqual(moduleList, 0u);
+    XCTAssertGreaterThan(readUInt32(data, moduleList), 0u);
+    XCTAssertLessThanOrEqual(readUInt32(data, moduleList), (uint32_t)ksdl_imageCount());
+
+    uint32_t exception = findStream(data, 6);
+    XCTAssertNotEqual(exception, 0u);
+    XCTAssertEqual(readUInt32(data, exception), (uint32_t)thread.thread);
+    XCTAssertEqual(readUInt32(data, exception + 8), (uint32_t)EXC_BAD_ACCESS);
+    XCTAssertEqual(readUInt32(data, exception + 12), (uint32_t)KERN_INVALID_ADDRESS);
+    XCTAssertEqual(readUInt64(data, exception + 24), 0x1234ull);
+
+    uint32_t systemInfo = findStream(data, 7);
+    XCTAssertNotEqual(systemInfo, 0u);
+    XCTAssertEqual(readUInt32(data, systemInfo + 8), 17u);
+    XCTAssertEqual(readUInt32(data, systemInfo + 12), 4u);
+    XCTAssertEqual(readUInt32(data, systemInfo + 16), 1u);
+}
+
+- (void)testFailsForUnwritablePath
+{
+    KSMC_NEW_CONTEXT(machineContext);
+    KSCrash_MonitorContext context = { 0 };
+    context.offendingMachineContext = machineContext;
+    XCTAssertFalse(kscrashreport_writeMinidump(&context, "/nonexistent/directory/test.dmp"));
+}
+
+@end
@@ -32,6 +32,9 @@
 
 #define REPORT_PREFIX @"CrashReport-KSCrashTest"
 #define REPORT_CONTENTS(NUM) @"{\n    \"a\": \"" #NUM "\"\n}"
+#define FINGERPRINTED_REPORT_CONTENTS(FINGERPRINT, TIMESTAMP)                                             \
+    @"{\"report\":{\"version\":\"3.3.0\",\"timestamp\":" #TIMESTAMP ",\"fingerprint\":\"" FINGERPRINT "\"}," \
+     "\"crash\":{}}"
 
 @interface KSCrashReportStoreC_Tests : FileBasedTestCase
 
@@ -41,6 +44,13 @@
 
 @end
 
+static bool appendReportChunk(const char *data, int length, void *userData)
+{
+    NSMutableData *reportData = (__bridge NSMutableData *)userData;
+    [reportData appendBytes:data length:(NSUInteger)length];
+    return true;
+}
+
 @implementation KSCrashReportStoreC_Tests {
     KSCrashReportStoreCConfiguration _storeConfig;
 }
@@ -73,7 +83,13 @@
     _storeConfig.appName = self.appName.UTF8String;
     _storeConfig.reportsPath = self.reportStorePath.UTF8String;
     _storeConfig.maxReportCount = maxReportCount;
+    [self initializeReportStore];
+}
+
+- (void)initializeReportStore
+{
     kscrs_initialize(&_storeConfig);
+    kscrs_waitForMaintenance();
 }
 
 - (NSArray *)getReportIDs
@@ -116,6 +132,15 @@
     }
 }
 
+- (NSString *)streamReportID:(int64_t)reportID
+{
+    NSMutableData *reportData = [NSMutableData data];
+    if (!kscrs_readReportStreaming(reportID, appendReportChunk, (__bridge void *)reportData, &_storeConfig)) {
+        return nil;
+    }
+    return [[NSString alloc] initWithData:reportData encoding:NSUTF8StringEncoding];
+}
+
 - (void)expectHasReportCount:(int)reportCount
 {
     XCTAssertEqual(kscrs_getReportCount(&_storeConfig), reportCount);
@@ -204,6 +229,236 @@
     XCTAssertFalse([reportIDs containsObject:@(prunedReportID)]);
 }
 
+- (void)testPrunesReportsOverTotalSizeOnAdd
+{
+    [self prepareReportStoreWithPathEnd:@"testPrunesReportsOverTotalSizeOnAdd" maxReportCount:100];
+    NSString *contents = [@"" stringByPaddingToLength:300 withString:@"x" startingAtIndex:0];
+    _storeConfig.maxReportsTotalSize = 1000;
+    NSMutableArray *writtenIDs = [NSMutableArray new];
+    for (int i = 0; i < 10; i++) {
+        [writtenIDs addObject:@([self writeUserReportWithStringContents:contents])];
+    }
+    [self expectHasReportCount:3];
+    XCTAssertEqualObjects([self getReportIDs], [writtenIDs subarrayWithRange:NSMakeRange(7, 3)]);
+}
+
+- (void)testPrunesReportsOverMaxAge
+{
+    [self prepareReportStoreWithPathEnd:@"testPrunesReportsOverMaxAge" maxReportCount:100];
+    char oldReportPath[KSCRS_MAX_PATH_LENGTH];
+    kscrs_getNextCrashReport(oldReportPath, &_storeConfig);
+    NSString *oldPath = [NSString stringWithUTF8String:oldReportPath];
+    [[REPORT_CONTENTS(old) dataUsingEncoding:NSUTF8StringEncoding] writeToFile:oldPath atomically:YES];
+    NSDate *anHourAgo = [NSDate dateWithTimeIntervalSinceNow:-3600];
+    [[NSFileManager defaultManager] setAttributes:@{ NSFileModificationDate : anHourAgo }
+                                     ofItemAtPath:oldPath
+                                            error:nil];
+    int64_t newReportID = [self writeCrashReportWithStringContents:REPORT_CONTENTS(new)];
+
+    _storeConfig.maxReportAge = 60;
+    [self initializeReportStore];
+    XCTAssertEqualObjects([self getReportIDs], @[ @(newReportID) ]);
+}
+
+- (NSArray *)pendingReportFiles
+{
+    NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self.reportStorePath error:nil];
+    return [files filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF CONTAINS '-pending-'"]];
+}
+
+- (void)testGroupCommitReportsAreReadable
+{
+    _storeConfig.durability = KSCrashReportDurabilityGroupCommit;
+    _storeConfig.groupCommitInterval = 10;
+    _storeConfig.groupCommitMaxReports = 100;
+    [self prepareReportStoreWithPathEnd:@"testGroupCommitReportsAreReadable" maxReportCount:100];
+    NSMutableArray *reportIDs = [NSMutableArray new];
+    NSArray *reportContents = @[ REPORT_CONTENTS(1), REPORT_CONTENTS(2), REPORT_CONTENTS(3) ];
+    for (NSString *contents in reportContents) {
+        [reportIDs addObject:@([self writeUserReportWithStringContents:contents])];
+    }
+    [self expectHasReportCount:3];
+    XCTAssertEqualObjects([self pendingReportFiles], @[]);
+    [self expectReports:reportIDs areStrings:reportContents];
+}
+
+- (void)testSyncDurabilityWritesReportsInPlace
+{
+    _storeConfig.durability = KSCrashReportDurabilitySync;
+    [self prepareReportStoreWithPathEnd:@"testSyncDurabilityWritesReportsInPlace"];
+    int64_t reportID = [self writeUserReportWithStringContents:REPORT_CONTENTS(1)];
+    XCTAssertEqualObjects([self pendingReportFiles], @[]);
+    [self expectReports:@[ @(reportID) ] areStrings:@[ REPORT_CONTENTS(1) ]];
+}
+
+- (void)testDeletesOrphanedPendingReports
+{
+    [self prepareReportStoreWithPathEnd:@"testDeletesOrphanedPendingReports"];
+    NSString *pendingName = [NSString stringWithFormat:@"%@-pending-%016llx.json", self.appName, 0x1234LL];
+    NSString *pendingPath = [self.reportStorePath stringByAppendingPathComponent:pendingName];
+    // As left by a process that went away in the middle of writing it.
+    [[@"{\"a\":\"trunc" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:pendingPath atomically:YES];
+    [self initializeReportStore];
+    XCTAssertEqualObjects([self pendingReportFiles], @[]);
+    [self expectHasReportCount:0];
+}
+
+- (void)testStreamsOneUserReport
+{
+    [self prepareReportStoreWithPathEnd:@"testStreamsOneUserReport"];
+    int64_t reportID = [self writeUserReportWithStringContents:REPORT_CONTENTS(0)];
+    XCTAssertEqualObjects([self streamReportID:reportID], REPORT_CONTENTS(0));
+}
+
+- (void)testStreamsReportLargerThanReadLimit
+{
+    [self prepareReportStoreWithPathEnd:@"testStreamsReportLargerThanReadLimit"];
+    NSMutableArray *items = [NSMutableArray new];
+    for (int i = 0; i < 200000; i++) {
+        [items addObject:[NSString stringWithFormat:@"item-%08d", i]];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:@{ @"items" : items } options:0 error:nil];
+    XCTAssertGreaterThan(data.length, 2000000U);
+    int64_t reportID = kscrs_addUserReport(data.bytes, (int)data.length, &_storeConfig);
+
+    NSString *reportString = [self streamReportID:reportID];
+    XCTAssertNotNil(reportString);
+    id decoded = [NSJSONSerialization JSONObjectWithData:[reportString dataUsingEncoding:NSUTF8StringEncoding]
+                                                 options:0
+                                                   error:nil];
+    XCTAssertEqualObjects(decoded[@"items"], items);
+}
+
+- (void)testStreamingMissingReportFails
+{
+    [self prepareReportStoreWithPathEnd:@"testStreamingMissingReportFails"];
+    XCTAssertNil([self streamReportID:12345]);
+}
+
+- (void)testReadsMultipleReportsInOrder
+{
+    [self prepareReportStoreWithPathEnd:@"testReadsMultipleReportsInOrder"];
+    NSArray *reportContents = @[ REPORT_CONTENTS(1), REPORT_CONTENTS(2), REPORT_CONTENTS(3), REPORT_CONTENTS(4) ];
+    int64_t reportIDs[5];
+    reportIDs[0] = [self writeCrashReportWithStringContents:reportContents[0]];
+    reportIDs[1] = [self writeUserReportWithStringContents:reportContents[1]];
+    reportIDs[2] = 12345;
+    reportIDs[3] = [self writeUserReportWithStringContents:reportContents[2]];
+    reportIDs[4] = [self writeCrashReportWithStringContents:reportContents[3]];
+
+    char *reports[5];
+    XCTAssertEqual(kscrs_readReports(reportIDs, 5, reports, &_storeConfig), 4);
+    XCTAssertTrue(reports[2] == NULL);
+    int contentsIndex = 0;
+    for (int i = 0; i < 5; i++) {
+        if (reports[i] != NULL) {
+            XCTAssertEqualObjects([NSString stringWithUTF8String:reports[i]], reportContents[contentsIndex++]);
+            free(reports[i]);
+        }
+    }
+}
+
+- (void)testReadsReportsAcrossBatches
+{
+    [self prepareReportStoreWithPathEnd:@"testReadsReportsAcrossBatches" maxReportCount:200];
+    int reportCount = 150;
+    int64_t reportIDs[reportCount];
+    for (int i = 0; i < reportCount; i++) {
+        reportIDs[i] = [self writeUserReportWithStringContents:[NSString stringWithFormat:@"{\"n\":%d}", i]];
+    }
+
+    char *reports[reportCount];
+    XCTAssertEqual(kscrs_readReports(reportIDs, reportCount, reports, &_storeConfig), reportCount);
+    for (int i = 0; i < reportCount; i++) {
+        NSString *expected = [NSString stringWithFormat:@"{\"n\":%d}", i];
+        XCTAssertEqualObjects([NSString stringWithUTF8String:reports[i]], expected);
+        free(reports[i]);
+    }
+}
+
+- (void)testDeletesReportsWithIDs
+{
+    [self prepareReportStoreWithPathEnd:@"testDeletesReportsWithIDs"];
+    int64_t reportIDs[3];
+    reportIDs[0] = [self writeUserReportWithStringContents:REPORT_CONTENTS(1)];
+    int64_t keptReportID = [self writeUserReportWithStringContents:REPORT_CONTENTS(2)];
+    reportIDs[1] = [self writeCrashReportWithStringContents:REPORT_CONTENTS(3)];
+    reportIDs[2] = 12345;
+    kscrs_deleteReportsWithIDs(reportIDs, 3, &_storeConfig);
+    XCTAssertEqualObjects([self getReportIDs], @[ @(keptReportID) ]);
+}
+
+- (void)testDeletesMinidumpWithReport
+{
+    [self prepareReportStoreWithPathEnd:@"testDeletesMinidumpWithReport"];
+    int64_t reportID = [self writeCrashReportWithStringContents:REPORT_CONTENTS(1)];
+    NSString *minidumpPath = [self.reportStorePath
+        stringByAppendingPathComponent:[NSString stringWithFormat:@"%@-report-%016llx.dmp", self.appName, reportID]];
+    [[NSData dataWithBytes:"MDMP" length:4] writeToFile:minidumpPath atomically:YES];
+
+    // The minidump isn't taken for a report.
+    XCTAssertEqualObjects([self getReportIDs], @[ @(reportID) ]);
+
+    kscrs_deleteReportWithID(reportID, &_storeConfig);
+    [self expectHasReportCount:0];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:minidumpPath]);
+}
+
+- (void)testDedupsReportsWithSameFingerprint
+{
+    NSString *pathEnd = @"testDedupsReportsWithSameFingerprint";
+    [self prepareReportStoreWithPathEnd:pathEnd];
+    _storeConfig.maxReportsPerFingerprint = 2;
+    int64_t exemplarID = [self writeCrashReportWithStringContents:FINGERPRINTED_REPORT_CONTENTS("AAAA", 100)];
+    [self writeCrashReportWithStringContents:FINGERPRINTED_REPORT_CONTENTS("AAAA", 200)];
+    int64_t otherID = [self writeCrashReportWithStringContents:FINGERPRINTED_REPORT_CONTENTS("BBBB", 300)];
+    int64_t foldedID = [self writeCrashReportWithStringContents:FINGERPRINTED_REPORT_CONTENTS("AAAA", 400)];
+    NSString *foldedMinidumpPath = [self.reportStorePath
+        stringByAppendingPathComponent:[NSString stringWithFormat:@"%@-report-%016llx.dmp", self.appName, foldedID]];
+    [[NSData dataWithBytes:"MDMP" length:4] writeToFile:foldedMinidumpPath atomically:YES];
+    [self writeUserReportWithStringContents:REPORT_CONTENTS(0)];
+    [self expectHasReportCount:5];
+
+    // Calls kscrs_initialize() again, which dedups the reports.
+    [self initializeReportStore];
+    [self expectHasReportCount:4];
+    XCTAssertFalse([[self getReportIDs] containsObject:@(foldedID)]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:foldedMinidumpPath]);
+    XCTAssertEqual(kscrs_getOccurrenceCount(otherID, &_storeConfig), 0);
+    XCTAssertEqual(kscrs_getOccurrenceCount(exemplarID, &_storeConfig), 1);
+    KSCrashReportOccurrence occurrence = { 0 };
+    XCTAssertEqual(kscrs_getOccurrences(exemplarID, &occurrence, 1, &_storeConfig), 1);
+    XCTAssertEqual(occurrence.reportID, foldedID);
+    XCTAssertEqual(occurrence.timestamp, 400);
+
+    kscrs_deleteReportWithID(exemplarID, &_storeConfig);
+    XCTAssertEqual(kscrs_getOccurrenceCount(exemplarID, &_storeConfig), 0);
+}
+
+- (void)testKeepsOccurrencesWhenExemplarIsEvicted
+{
+    [self prepareReportStoreWithPathEnd:@"testKeepsOccurrencesWhenExemplarIsEvicted" maxReportCount:3];
+    _storeConfig.maxReportsPerFingerprint = 2;
+    int64_t exemplarID = [self writeCrashReportWithStringContents:FINGERPRINTED_REPORT_CONTENTS("AAAA", 100)];
+    int64_t successorID = [self writeCrashReportWithStringContents:FINGERPRINTED_REPORT_CONTENTS("AAAA", 200)];
+    int64_t foldedID = [self writeCrashReportWithStringContents:FINGERPRINTED_REPORT_CONTENTS("AAAA", 300)];
+    [self writeUserReportWithStringContents:REPORT_CONTENTS(0)];
+    [self writeUserReportWithStringContents:REPORT_CONTENTS(1)];
+
+    // Dedup folds the third report into the exemplar, and then the exemplar,
+    // being the oldest, is pushed out by the count limit.
+    [self initializeReportStore];
+    [self expectHasReportCount:3];
+    XCTAssertFalse([[self getReportIDs] containsObject:@(exemplarID)]);
+
+    KSCrashReportOccurrence occurrences[3] = { 0 };
+    XCTAssertEqual(kscrs_getOccurrences(successorID, occurrences, 3, &_storeConfig), 2);
+    XCTAssertEqual(occurrences[0].reportID, exemplarID);
+    XCTAssertEqual(occurrences[0].timestamp, 100);
+    XCTAssertEqual(occurrences[1].reportID, foldedID);
+    XCTAssertEqual(occurrences[1].timestamp, 300);
+}
+
 - (void)testStoresLoadsWithUnicodeAppName
 {
     self.appName = @"ЙогуртЙод";